@@ -7,12 +7,14 @@
 #include "ArchiveCache.h"
 #include "ChunkFile.h"
 #include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/PtrUtils.h"
 #include "../Utility/HeapUtils.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/IteratorUtils.h"
+#include "../Utility/SystemUtils.h"
 #include <algorithm>
 
 namespace Assets
@@ -66,6 +68,21 @@ namespace Assets
         };
     };
 
+        //  The directory log is a series of batches (one per flush). Each batch is a
+        //  DirectoryLogBatch header followed by _entryCount DirectoryChunk::Blocks.
+        //  The hash lets us reject a batch that was only partially written.
+    static const uint32 DirectoryLogMagic = 'ADLg';
+    class DirectoryLogBatch
+    {
+    public:
+        uint32 _magic;
+        unsigned _entryCount;
+        uint64 _entriesHash;
+    };
+
+        //  Don't bother compacting until at least this much space is wasted
+    static const unsigned CompactionMinimumWaste = 256 * 1024;
+
     ArchiveCache::PendingCommit::PendingCommit(PendingCommit&& moveFrom)
         : _id(moveFrom._id)
         , _pendingCommitPtr(moveFrom._pendingCommitPtr)
@@ -99,6 +116,26 @@ namespace Assets
         _data = std::move(data);
     }
 
+    void ArchiveCache::BlockView::reset()
+    {
+        _owner.reset();
+        _start = nullptr;
+        _size = 0;
+    }
+
+    ArchiveCache::BlockView::BlockView() : _start(nullptr), _size(0) {}
+    ArchiveCache::BlockView::BlockView(std::nullptr_t) : _start(nullptr), _size(0) {}
+
+    ArchiveCache::BlockView::BlockView(const BlockAndSize& block)
+    : _owner(block)
+    , _start(block ? AsPointer(block->cbegin()) : nullptr)
+    , _size(block ? block->size() : 0)
+    {}
+
+    ArchiveCache::BlockView::BlockView(std::shared_ptr<const void> owner, const uint8* start, size_t size)
+    : _owner(std::move(owner)), _start(start), _size(size)
+    {}
+
     void ArchiveCache::Commit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush)
     {
             // for for an existing pending commit, and replace it if it exists
@@ -117,9 +154,6 @@ namespace Assets
 
     static std::vector<DirectoryChunk::Block> LoadBlockList(const char filename[])
     {
-            // note --  we could potentially just keep the directory information in memory
-            //          but; currently we'll open the file and read it in again every time
-            //          Maybe we should use a memory mapped file for the directory...
         using namespace Serialization::ChunkFile;
         BasicFile directoryFile(filename, "rb");
         auto chunkTable = LoadChunkTable(directoryFile);
@@ -136,37 +170,147 @@ namespace Assets
         return std::move(blocks);
     }
 
-    auto ArchiveCache::OpenFromCache(uint64 id) -> BlockAndSize
+    auto ArchiveCache::GetDirectory() const -> const Directory&
+    {
+            // The directory is loaded from disk the first time it's required, and 
+            // then kept in memory. FlushToDisk() will keep it up-to-date after that.
+            // (so we're assuming no other process is writing to the same archive)
+        if (!_directoryLoaded) {
+            _directory.clear();
+            TRY {
+                auto blocks = LoadBlockList(_directoryFileName.c_str());
+                _directory.reserve(blocks.size());
+                for (const auto& b:blocks) {
+                    DirectoryEntry entry = { b._start, b._size };
+                    _directory.insert(std::make_pair(b._id, entry));
+                }
+            } CATCH (...) {
+                    // any exceptions indicate the archive is empty (or missing)
+            } CATCH_END
+
+                // replay the directory log on top of the base directory
+            _directoryLogSize = 0;
+            _directoryLogEntryCount = 0;
+            TRY {
+                BasicFile logFile(_directoryLogFileName.c_str(), "rb");
+                auto logFileSize = (unsigned)logFile.GetSize();
+                std::vector<DirectoryChunk::Block> entries;
+                for (;;) {
+                    DirectoryLogBatch batch;
+                    if (logFile.Read(&batch, 1, sizeof(batch)) != sizeof(batch)) break;
+                    if (batch._magic != DirectoryLogMagic) break;
+                    if (batch._entryCount > logFileSize / unsigned(sizeof(DirectoryChunk::Block))) break;
+
+                    auto entriesSize = batch._entryCount * unsigned(sizeof(DirectoryChunk::Block));
+                    if (_directoryLogSize + sizeof(batch) + entriesSize > logFileSize) break;
+                    entries.resize(batch._entryCount);
+                    if (logFile.Read(AsPointer(entries.begin()), 1, entriesSize) != entriesSize) break;
+                    if (Hash64(AsPointer(entries.cbegin()), AsPointer(entries.cend())) != batch._entriesHash) break;
+
+                    for (const auto& b:entries) {
+                        DirectoryEntry entry = { b._start, b._size };
+                        _directory[b._id] = entry;
+                    }
+                    _directoryLogSize += unsigned(sizeof(batch)) + entriesSize;
+                    _directoryLogEntryCount += batch._entryCount;
+                }
+            } CATCH (...) {
+                    // no log (which is normal after a compaction)
+            } CATCH_END
+
+            _archiveFileSize = unsigned(Utility::GetFileSize(_mainFileName.c_str()));
+            _directoryLoaded = true;
+        }
+        return _directory;
+    }
+
+    float ArchiveCache::CalculateFragmentation() const
+    {
+        const auto& directory = GetDirectory();
+        if (!_archiveFileSize) return 0.f;
+        uint64 usedSpace = 0;
+        for (const auto& d:directory) usedSpace += d.second._size;
+        return 1.f - std::min(1.f, float(usedSpace) / float(_archiveFileSize));
+    }
+
+    auto ArchiveCache::GetMappedArchive() -> const std::shared_ptr<MemoryMappedFile>&
+    {
+        if (!_mappedArchive) {
+                //  Note that we must allow other handles to write to the file. FlushToDisk
+                //  will write to the file while views into old mappings are still alive.
+                //  Compaction will also rename the file out of the way while views are alive.
+            auto mapping = std::make_shared<MemoryMappedFile>(
+                _mainFileName.c_str(), 0, MemoryMappedFile::Access::Read, 
+                BasicFile::ShareMode::Read | BasicFile::ShareMode::Write | BasicFile::ShareMode::Delete);
+            if (mapping->IsValid()) {
+                _mappedArchiveSize = mapping->GetSize();
+                _mappedArchive = std::move(mapping);
+            }
+        }
+        return _mappedArchive;
+    }
+
+    bool ArchiveCache::HasLiveViews()
+    {
+            //  Any BlockViews returned from OpenFromCache hold a reference on the mapping
+            //  they came from. So, if there are any references other than our own, some
+            //  client might still be reading from the mapped file.
+        _retiredMappings.erase(
+            std::remove_if(_retiredMappings.begin(), _retiredMappings.end(),
+                [](const std::weak_ptr<MemoryMappedFile>& m) { return m.expired(); }),
+            _retiredMappings.end());
+        return !_retiredMappings.empty() || (_mappedArchive && _mappedArchive.use_count() > 1);
+    }
+
+    void ArchiveCache::ReleaseRetiredArchives()
+    {
+            //  Delete old archive files (replaced by a compaction) once there are no
+            //  more BlockViews pointing into them
+        for (auto i=_retiredArchives.begin(); i!=_retiredArchives.end();) {
+            auto& m = i->_mappings;
+            m.erase(
+                std::remove_if(m.begin(), m.end(),
+                    [](const std::weak_ptr<MemoryMappedFile>& m) { return m.expired(); }),
+                m.end());
+            if (m.empty()) {
+                XlDeleteFile((const utf8*)i->_fileName.c_str());
+                i = _retiredArchives.erase(i);
+            } else {
+                ++i;
+            }
+        }
+    }
+
+    auto ArchiveCache::OpenFromCache(uint64 id) -> BlockView
     {
             // first, check our pending commits
-            // if it's not there, we have to lock and open the file
+            // if it's not there, we have to look in the archive file
             // note that we're keeping the pending block lock permanently locked
         ScopedLock(_pendingBlocksLock);
         auto i = std::lower_bound(_pendingBlocks.begin(), _pendingBlocks.end(), id, ComparePendingCommit());
         if (i!=_pendingBlocks.end() && i->_id == id) {
-            return i->_data;
+            return BlockView(i->_data);
         }
 
-            // lock and open the directory, and look for the given item
-            // note that a flush could be happening in a background 
-            // thread -- in that case, we need to stall waiting for the
-            // flush to complete.
-
-        {
-            auto blocks = LoadBlockList(_directoryFileName.c_str());
-                // we maintain the blocks array sorted by id to make this check faster...
-            auto bi = std::lower_bound(blocks.begin(), blocks.end(), id, DirectoryChunk::CompareBlock());
-            if (bi != blocks.end() && bi->_id == id) {
-                BasicFile dataFile(_mainFileName.c_str(), "rb");
-                dataFile.Seek(bi->_start, SEEK_SET);
-
-                auto result = std::make_shared<std::vector<uint8>>(bi->_size);
-                dataFile.Read(AsPointer(result->begin()), 1, bi->_size);
-                return result;
-            }
+            // Look for the given item in the directory. If we find it, 
+            // we can return a pointer directly into the mapped file.
+            // Note that a flush could be happening in a background 
+            // thread -- in that case, we will stall on the lock above.
+        const auto& directory = GetDirectory();
+        auto bi = directory.find(id);
+        if (bi == directory.end())
+            return BlockView();     // this block doesn't exist in the cache
+
+        const auto& mapping = GetMappedArchive();
+        if (!mapping || (size_t(bi->second._start) + size_t(bi->second._size)) > _mappedArchiveSize) {
+            LogWarning << "Archive cache block (" << id << ") is outside of the mapped archive file (" << _mainFileName << ")";
+            return BlockView();
         }
 
-        return nullptr;     // this block doesn't exist in the cache
+        return BlockView(
+            mapping, 
+            (const uint8*)PtrAdd(mapping->GetData(), bi->second._start), 
+            bi->second._size);
     }
     
     bool ArchiveCache::HasItem(uint64 id) const
@@ -177,20 +321,59 @@ namespace Assets
             return true;
         }
 
+        const auto& directory = GetDirectory();
+        return directory.find(id) != directory.end();
+    }
+
+    static BasicFile OpenForWrite(const char filename[])
+    {
+            // open an existing file without truncating it, or create a new one
         TRY {
-            auto blocks = LoadBlockList(_directoryFileName.c_str());
-            auto bi = std::lower_bound(blocks.begin(), blocks.end(), id, DirectoryChunk::CompareBlock());
-            return (bi != blocks.end() && bi->_id == id);
+            return BasicFile(filename, "r+b");
         } CATCH (...) {
-            return false;
         } CATCH_END
+        return BasicFile(filename, "wb");
     }
 
-    void ArchiveCache::FlushToDisk()
+    static void WriteDirectoryFile(
+        BasicFile& directoryFile, 
+        const std::vector<DirectoryChunk::Block>& blocks, const SpanningHeap<uint32>& spanningHeap,
+        const char buildVersionString[], const char buildDateString[])
     {
-        ScopedLock(_pendingBlocksLock);
-        if (_pendingBlocks.empty()) { return; }
+        using namespace Serialization::ChunkFile;
+
+        ChunkFileHeader fileHeader;
+        XlZeroMemory(fileHeader);
+        fileHeader._magic = MagicHeader;
+        fileHeader._fileVersionNumber = 0;
+        XlCopyString(fileHeader._buildVersion, dimof(fileHeader._buildVersion), buildVersionString);
+        XlCopyString(fileHeader._buildDate, dimof(fileHeader._buildDate), buildDateString);
+        fileHeader._chunkCount = 1;
+
+        auto flattenedHeap = spanningHeap.Flatten();
+
+        ChunkHeader chunkHeader(
+            ChunkType_ArchiveDirectory, 0, "ArchiveCache", unsigned(sizeof(DirectoryChunk) + blocks.size() * sizeof(DirectoryChunk::Block) + flattenedHeap.second));
+        chunkHeader._fileOffset = sizeof(ChunkFileHeader) + sizeof(ChunkHeader);
+
+        DirectoryChunk chunkData;
+        chunkData._blockCount = (unsigned)blocks.size();
+        chunkData._spanningHeapSize = (unsigned)flattenedHeap.second;
+
+            // Write blank header data to the file
+            //  note that there's a potential problem here, because
+            //  we don't truncate the file before writing this. So if there is
+            //  some data in there (but invalid data), then it will remain in the file
+        directoryFile.Seek(0, SEEK_SET);
+        directoryFile.Write(&fileHeader, sizeof(fileHeader), 1);
+        directoryFile.Write(&chunkHeader, sizeof(chunkHeader), 1);
+        directoryFile.Write(&chunkData, sizeof(chunkData), 1);
+        directoryFile.Write(AsPointer(blocks.begin()), sizeof(DirectoryChunk::Block), blocks.size());
+        directoryFile.Write(flattenedHeap.first.get(), 1, flattenedHeap.second);
+    }
 
+    void ArchiveCache::FlushRewrite(bool archivePinned)
+    {
             // 1.   Open the directory and initialize our heap
             //      representation
             // 2.   Find older versions of the same blocks we
@@ -205,148 +388,211 @@ namespace Assets
             //  searches) not in the order that they appear in the file.
 
         using namespace Serialization::ChunkFile;
-        {
-            DirectoryChunk dirHdr;
-            std::vector<DirectoryChunk::Block> blocks;
-            std::unique_ptr<uint8[]> flattenedSpanningHeap;
-        
-            BasicFile directoryFile;
-            bool directoryFileOpened = false;
 
-            TRY {
-                directoryFile = BasicFile(_directoryFileName.c_str(), "r+b");
+        DirectoryChunk dirHdr;
+        std::vector<DirectoryChunk::Block> blocks;
+        std::unique_ptr<uint8[]> flattenedSpanningHeap;
+    
+        BasicFile directoryFile;
+        bool directoryFileOpened = false;
 
-                auto chunkTable = LoadChunkTable(directoryFile);
-                auto chunk = FindChunk(_directoryFileName.c_str(), chunkTable, ChunkType_ArchiveDirectory, 0);
+        TRY {
+            directoryFile = BasicFile(_directoryFileName.c_str(), "r+b");
 
-                directoryFile.Seek(chunk._fileOffset, SEEK_SET);
-                directoryFile.Read(&dirHdr, sizeof(dirHdr), 1);
+            auto chunkTable = LoadChunkTable(directoryFile);
+            auto chunk = FindChunk(_directoryFileName.c_str(), chunkTable, ChunkType_ArchiveDirectory, 0);
 
-                blocks.resize(dirHdr._blockCount);
-                directoryFile.Read(AsPointer(blocks.begin()), sizeof(DirectoryChunk::Block), dirHdr._blockCount);
-                flattenedSpanningHeap = std::make_unique<uint8[]>(dirHdr._spanningHeapSize);
-                directoryFile.Read(flattenedSpanningHeap.get(), 1, dirHdr._spanningHeapSize);
-                directoryFileOpened = true;
-            } CATCH (...) {
-                    // any exceptions indicate the current file is empty
-            } CATCH_END
+            directoryFile.Seek(chunk._fileOffset, SEEK_SET);
+            directoryFile.Read(&dirHdr, sizeof(dirHdr), 1);
 
-            if (!directoryFileOpened) {
-                directoryFile = BasicFile();
-                directoryFile = BasicFile(_directoryFileName.c_str(), "wb");
-            }
+            blocks.resize(dirHdr._blockCount);
+            directoryFile.Read(AsPointer(blocks.begin()), sizeof(DirectoryChunk::Block), dirHdr._blockCount);
+            flattenedSpanningHeap = std::make_unique<uint8[]>(dirHdr._spanningHeapSize);
+            directoryFile.Read(flattenedSpanningHeap.get(), 1, dirHdr._spanningHeapSize);
+            directoryFileOpened = true;
+        } CATCH (...) {
+                // any exceptions indicate the current file is empty
+        } CATCH_END
 
-            SpanningHeap<uint32> spanningHeap(flattenedSpanningHeap.get(), dirHdr._spanningHeapSize);
-            for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
-                i->_pendingCommitPtr = ~unsigned(0x0);
-
-                // find an existing block with the same id
-                auto b = std::lower_bound(blocks.cbegin(), blocks.cend(), i->_id, DirectoryChunk::CompareBlock());
-                if (b != blocks.cend() && b->_id == i->_id) {
-                        // todo -- Often we just want to resize the last block. This would be better if
-                        //          we could reallocate that last block (by shortening or expanding it)
-                    if (b->_size == i->_data->size()) {
-                            // same size; just reuse
-                        i->_pendingCommitPtr = b->_start;
-                    } else {
-                            // destroy the old block (new block will be reallocated later)
-                        spanningHeap.Deallocate(b->_start, b->_size);
-                        blocks.erase(b);
-                    }
+        if (!directoryFileOpened) {
+            directoryFile = BasicFile();
+            directoryFile = BasicFile(_directoryFileName.c_str(), "wb");
+        }
+
+        SpanningHeap<uint32> spanningHeap(flattenedSpanningHeap.get(), dirHdr._spanningHeapSize);
+        for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
+            i->_pendingCommitPtr = ~unsigned(0x0);
+
+            // find an existing block with the same id
+            auto b = std::lower_bound(blocks.cbegin(), blocks.cend(), i->_id, DirectoryChunk::CompareBlock());
+            if (b != blocks.cend() && b->_id == i->_id) {
+                    // todo -- Often we just want to resize the last block. This would be better if
+                    //          we could reallocate that last block (by shortening or expanding it)
+                if (b->_size == i->_data->size() && !archivePinned) {
+                        // same size; just reuse
+                    i->_pendingCommitPtr = b->_start;
+                } else {
+                        // destroy the old block (new block will be reallocated later)
+                    spanningHeap.Deallocate(b->_start, b->_size);
+                    blocks.erase(b);
                 }
             }
+        }
 
-                // Allocate space for new blocks. Allocate from largest to smallest.
-            std::sort(_pendingBlocks.begin(), _pendingBlocks.end(), 
-                [](const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._data->size() > rhs._data->size(); });
-            for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
+            // Allocate space for new blocks. Allocate from largest to smallest.
+        std::sort(_pendingBlocks.begin(), _pendingBlocks.end(), 
+            [](const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._data->size() > rhs._data->size(); });
+        for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
+            if (i->_pendingCommitPtr == ~unsigned(0x0)) {
+
+                    // we need to allocate a new block
+                auto newBlockSize = (unsigned)i->_data->size();
+                
+                #if defined(_DEBUG)
+                    auto originalHeapSize = spanningHeap.CalculateHeapSize();
+                    auto originalAllocatedSize = spanningHeap.CalculateAllocatedSpace();
+                #endif
+
+                if (!archivePinned) {
+                    i->_pendingCommitPtr = spanningHeap.Allocate(newBlockSize);
+                }
                 if (i->_pendingCommitPtr == ~unsigned(0x0)) {
+                    i->_pendingCommitPtr = spanningHeap.AppendNewBlock(newBlockSize);
+                }
 
-                        // we need to allocate a new block
-                    auto newBlockSize = (unsigned)i->_data->size();
-                    
-                    #if defined(_DEBUG)
-                        auto originalHeapSize = spanningHeap.CalculateHeapSize();
-                        auto originalAllocatedSize = spanningHeap.CalculateAllocatedSpace();
-                    #endif
+                assert(spanningHeap.CalculateAllocatedSpace() >= (originalAllocatedSize + newBlockSize));
+                assert(spanningHeap.CalculateHeapSize() >= originalHeapSize);
 
-                    i->_pendingCommitPtr = spanningHeap.Allocate(newBlockSize);
-                    if (i->_pendingCommitPtr == ~unsigned(0x0)) {
-                        i->_pendingCommitPtr = spanningHeap.AppendNewBlock(newBlockSize);
+                    // make sure we're not overlapping another block (just to make sure the allocators are working)
+                #if defined(_DEBUG)
+                    for (auto b=blocks.cbegin(); b!=blocks.cend(); ++b) {
+                        assert((b->_start + b->_size) <= originalHeapSize);
+                        assert(
+                            ((i->_pendingCommitPtr + newBlockSize) <= b->_start)
+                            || (i->_pendingCommitPtr >= (b->_start + b->_size)));
                     }
+                #endif
 
-                    assert(spanningHeap.CalculateAllocatedSpace() >= (originalAllocatedSize + newBlockSize));
-                    assert(spanningHeap.CalculateHeapSize() >= originalHeapSize);
-
-                        // make sure we're not overlapping another block (just to make sure the allocators are working)
-                    #if defined(_DEBUG)
-                        for (auto b=blocks.cbegin(); b!=blocks.cend(); ++b) {
-                            assert((b->_start + b->_size) <= originalHeapSize);
-                            assert(
-                                ((i->_pendingCommitPtr + newBlockSize) <= b->_start)
-                                || (i->_pendingCommitPtr >= (b->_start + b->_size)));
-                        }
-                    #endif
-
-                    auto b = std::lower_bound(blocks.begin(), blocks.end(), i->_id, DirectoryChunk::CompareBlock());
-                    assert(b==blocks.cend() || b->_id != i->_id);
-                    DirectoryChunk::Block newBlock = { i->_id, i->_pendingCommitPtr, newBlockSize };
-                    blocks.insert(b, newBlock);
+                auto b = std::lower_bound(blocks.begin(), blocks.end(), i->_id, DirectoryChunk::CompareBlock());
+                assert(b==blocks.cend() || b->_id != i->_id);
+                DirectoryChunk::Block newBlock = { i->_id, i->_pendingCommitPtr, newBlockSize };
+                blocks.insert(b, newBlock);
 
-                }
             }
+        }
 
-                //  everything is allocated... we need to write the blocks to the data file
-                //  sort by pending commit ptr for convenience
-            std::sort(_pendingBlocks.begin(), _pendingBlocks.end(), 
-                [](const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._pendingCommitPtr < rhs._pendingCommitPtr; });
-            {
-                BasicFile dataFile;
-                bool good = false;
-                TRY {
-                    dataFile = BasicFile(_mainFileName.c_str(), "r+b");
-                    good = true;
-                } CATCH (...) {} CATCH_END
-                if (!good) {
-                    dataFile = BasicFile(_mainFileName.c_str(), "wb");
-                }
-                for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
-                    dataFile.Seek(i->_pendingCommitPtr, SEEK_SET);
-                    dataFile.Write(AsPointer(i->_data->cbegin()), 1, i->_data->size());
-                }
+            //  everything is allocated... we need to write the blocks to the data file
+            //  sort by pending commit ptr for convenience
+        std::sort(_pendingBlocks.begin(), _pendingBlocks.end(), 
+            [](const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._pendingCommitPtr < rhs._pendingCommitPtr; });
+        {
+            auto dataFile = OpenForWrite(_mainFileName.c_str());
+            for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
+                dataFile.Seek(i->_pendingCommitPtr, SEEK_SET);
+                dataFile.Write(AsPointer(i->_data->cbegin()), 1, i->_data->size());
             }
+            _archiveFileSize = (unsigned)dataFile.GetSize();
+        }
 
-                // write the new directory file (including the blocks list and spanning heap)
-            {
-                ChunkFileHeader fileHeader;
-                XlZeroMemory(fileHeader);
-                fileHeader._magic = MagicHeader;
-                fileHeader._fileVersionNumber = 0;
-                XlCopyString(fileHeader._buildVersion, dimof(fileHeader._buildVersion), _buildVersionString);
-                XlCopyString(fileHeader._buildDate, dimof(fileHeader._buildDate), _buildDateString);
-                fileHeader._chunkCount = 1;
-
-                auto flattenedHeap = spanningHeap.Flatten();
-            
-                ChunkHeader chunkHeader(
-                    ChunkType_ArchiveDirectory, 0, "ArchiveCache", unsigned(sizeof(DirectoryChunk) + blocks.size() * sizeof(DirectoryChunk::Block) + flattenedHeap.second));
-                chunkHeader._fileOffset = sizeof(ChunkFileHeader) + sizeof(ChunkHeader);
-
-                DirectoryChunk chunkData;
-                chunkData._blockCount = (unsigned)blocks.size();
-                chunkData._spanningHeapSize = (unsigned)flattenedHeap.second;
-
-                    // Write blank header data to the file
-                    //  note that there's a potential problem here, because
-                    //  we don't truncate the file before writing this. So if there is
-                    //  some data in there (but invalid data), then it will remain in the file
-                directoryFile.Seek(0, SEEK_SET);
-                directoryFile.Write(&fileHeader, sizeof(fileHeader), 1);
-                directoryFile.Write(&chunkHeader, sizeof(chunkHeader), 1);
-                directoryFile.Write(&chunkData, sizeof(chunkData), 1);
-                directoryFile.Write(AsPointer(blocks.begin()), sizeof(DirectoryChunk::Block), blocks.size());
-                directoryFile.Write(flattenedHeap.first.get(), 1, flattenedHeap.second);
+            // write the new directory file (including the blocks list and spanning heap)
+        WriteDirectoryFile(directoryFile, blocks, spanningHeap, _buildVersionString, _buildDateString);
+
+            // update our in-memory copy of the directory to match
+        _directory.clear();
+        _directory.reserve(blocks.size());
+        for (const auto& b:blocks) {
+            DirectoryEntry entry = { b._start, b._size };
+            _directory.insert(std::make_pair(b._id, entry));
+        }
+        _directoryLoaded = true;
+    }
+
+    void ArchiveCache::FlushAppend()
+    {
+            //  Append all of the pending blocks to the end of the archive file. Existing
+            //  data is never overwritten, so old versions of blocks remain valid (until the
+            //  next compaction). The data must be on disk before the directory log refers to it.
+        std::vector<DirectoryChunk::Block> newBlocks;
+        newBlocks.reserve(_pendingBlocks.size());
+        {
+            auto dataFile = OpenForWrite(_mainFileName.c_str());
+            auto writePoint = (unsigned)dataFile.GetSize();
+            dataFile.Seek(writePoint, SEEK_SET);
+            for (auto i=_pendingBlocks.begin(); i!=_pendingBlocks.end(); ++i) {
+                auto size = (unsigned)i->_data->size();
+                dataFile.Write(AsPointer(i->_data->cbegin()), 1, size);
+                i->_pendingCommitPtr = writePoint;
+                DirectoryChunk::Block newBlock = { i->_id, writePoint, size };
+                newBlocks.push_back(newBlock);
+                writePoint += size;
             }
+            dataFile.Flush();
+            _archiveFileSize = writePoint;
+        }
+
+            //  The log is applied on top of the base directory file, so make sure there is one
+            //  (even if it's empty). This also means the archive can be found by searching for "*.dir"
+        if (!DoesFileExist(_directoryFileName.c_str())) {
+            BasicFile directoryFile(_directoryFileName.c_str(), "wb");
+            WriteDirectoryFile(
+                directoryFile, std::vector<DirectoryChunk::Block>(), SpanningHeap<uint32>(nullptr, 0),
+                _buildVersionString, _buildDateString);
+        }
+
+            //  Append a new batch to the directory log. We write over the end of the last
+            //  valid batch, in case a previous write was interrupted part way through.
+        {
+            DirectoryLogBatch batch;
+            batch._magic = DirectoryLogMagic;
+            batch._entryCount = (unsigned)newBlocks.size();
+            batch._entriesHash = Hash64(AsPointer(newBlocks.cbegin()), AsPointer(newBlocks.cend()));
+
+            auto logFile = OpenForWrite(_directoryLogFileName.c_str());
+            logFile.Seek(_directoryLogSize, SEEK_SET);
+            logFile.Write(&batch, sizeof(batch), 1);
+            logFile.Write(AsPointer(newBlocks.cbegin()), sizeof(DirectoryChunk::Block), newBlocks.size());
+            logFile.Flush();
+
+            _directoryLogSize += unsigned(sizeof(batch) + newBlocks.size() * sizeof(DirectoryChunk::Block));
+            _directoryLogEntryCount += (unsigned)newBlocks.size();
+        }
+
+        for (const auto& b:newBlocks) {
+            DirectoryEntry entry = { b._start, b._size };
+            _directory[b._id] = entry;
+        }
+    }
+
+    void ArchiveCache::FlushToDisk()
+    {
+        ScopedLock(_pendingBlocksLock);
+        if (_pendingBlocks.empty()) { return; }
+
+            //  If there are any BlockViews still pointing into the mapped archive, we
+            //  must not overwrite any part of the file that might be referenced. In
+            //  that case, all blocks will be appended to the end of the file. The space
+            //  they leave behind is recovered by the background compaction (which writes
+            //  a new file, rather than overwriting this one).
+            //  The current mapping won't include any appended blocks, so we must retire
+            //  it, and remap on the next read.
+        bool archivePinned = HasLiveViews();
+        if (_mappedArchive) {
+            _retiredMappings.push_back(_mappedArchive);
+            _mappedArchive.reset();
+        }
+
+            //  Make sure the directory (and the state of the directory log) is loaded
+            //  before we start writing
+        GetDirectory();
+
+            //  While the directory log has entries, the spanning heap in the directory file
+            //  is out of date. So we can only append until the log has been compacted away.
+            //  We must also append while a compaction is copying blocks out of the archive.
+        bool appendOnly = (_flushMode == FlushMode::AppendLog) || (_directoryLogEntryCount != 0) || _compactionCopying;
+        if (appendOnly) {
+            FlushAppend();
+        } else {
+            FlushRewrite(archivePinned);
         }
 
         #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
@@ -421,30 +667,238 @@ namespace Assets
 
             // clear all pending block (now that they're flushed to disk)
         _pendingBlocks.clear();
+        ReleaseRetiredArchives();
+
+            //  In FlushMode::Rewrite, blocks are appended (rather than written in place) 
+            //  while BlockViews are alive. So we queue compaction in both modes, to keep
+            //  the archive from growing without bound.
+        QueueBackgroundCompaction();
     }
     
+    void ArchiveCache::QueueBackgroundCompaction()
+    {
+        if (!_backgroundCompactionEnabled || _compactionQueued.load()) return;
+
+        auto fragmentation = CalculateFragmentation();
+        if (fragmentation < _compactionThreshold 
+            || unsigned(fragmentation * float(_archiveFileSize)) < CompactionMinimumWaste)
+            return;
+
+        _compactionQueued = true;
+        if (!_backgroundCompaction)
+            _backgroundCompaction = std::make_unique<CompletionThreadPool::TaskGroup>(
+                ConsoleRig::GlobalServices::GetLongTaskThreadPool());
+
+            //  If Compact() fails, we'll just try again after the next flush.
+        auto* archive = this;
+        _backgroundCompaction->Run(
+            [archive]()
+            {
+                TRY {
+                    archive->Compact();
+                } CATCH (const std::exception& e) {
+                    LogWarning << "Suppressing exception while compacting archive (" << archive->_mainFileName << "): " << e.what();
+                } CATCH (...) {
+                    LogWarning << "Suppressing unknown exception while compacting archive (" << archive->_mainFileName << ")";
+                } CATCH_END
+                archive->_compactionQueued = false;
+            });
+    }
+
+    bool ArchiveCache::Compact()
+    {
+            //  1.  Take a snapshot of the directory
+            //  2.  Copy every block in the snapshot into a new archive file
+            //  3.  Lock, and copy any blocks that were committed after the snapshot
+            //  4.  Write the new directory, and swap in the new files
+            //
+            //  Step 2 is done without holding the lock (so OpenFromCache and FlushToDisk
+            //  aren't blocked while we copy). While "_compactionCopying" is set, FlushToDisk
+            //  only appends (even in FlushMode::Rewrite), so blocks in the snapshot are never 
+            //  overwritten in place while we're reading them.
+            //
+            //  BlockViews into the current archive don't prevent compaction. The current
+            //  archive file is renamed (not deleted), and the views keep their mapping of it.
+        ScopedLock(_compactionLock);
+        std::unique_lock<Threading::Mutex> lock(_pendingBlocksLock);
+
+        auto snapshot = GetDirectory();
+
+        auto compactedFileName = _mainFileName + ".compact";
+        SpanningHeap<uint32> spanningHeap(nullptr, 0);
+        std::vector<DirectoryChunk::Block> blocks;
+        blocks.reserve(snapshot.size());
+        {
+            BasicFile srcFile(_mainFileName.c_str(), "rb", BasicFile::ShareMode::Read | BasicFile::ShareMode::Write);
+            BasicFile dstFile(compactedFileName.c_str(), "wb");
+
+            std::vector<uint8> buffer;
+            auto copyBlock = [&](uint64 id, const DirectoryEntry& entry) -> DirectoryChunk::Block
+                {
+                    buffer.resize(entry._size);
+                    srcFile.Seek(entry._start, SEEK_SET);
+                    if (srcFile.Read(AsPointer(buffer.begin()), 1, entry._size) != entry._size)
+                        Throw(::Exceptions::BasicLabel("Read failed while compacting archive (%s)", _mainFileName.c_str()));
+
+                    DirectoryChunk::Block newBlock = { id, spanningHeap.AppendNewBlock(entry._size), entry._size };
+                    dstFile.Seek(newBlock._start, SEEK_SET);
+                    dstFile.Write(AsPointer(buffer.cbegin()), 1, entry._size);
+                    return newBlock;
+                };
+
+                // copy in the order the blocks appear in the file, so we read sequentially
+            std::vector<std::pair<uint64, DirectoryEntry>> orderedSnapshot(snapshot.begin(), snapshot.end());
+            std::sort(orderedSnapshot.begin(), orderedSnapshot.end(),
+                [](const std::pair<uint64, DirectoryEntry>& lhs, const std::pair<uint64, DirectoryEntry>& rhs)
+                { return lhs.second._start < rhs.second._start; });
+            _compactionCopying = true;
+            lock.unlock();
+            TRY {
+                for (const auto& b:orderedSnapshot)
+                    blocks.push_back(copyBlock(b.first, b.second));
+            } CATCH (...) {
+                lock.lock();
+                _compactionCopying = false;
+                RETHROW;
+            } CATCH_END
+            std::sort(blocks.begin(), blocks.end(), DirectoryChunk::CompareBlock());
+
+            lock.lock();
+            _compactionCopying = false;
+
+                // pick up anything that was flushed while we were copying
+            for (const auto& d:GetDirectory()) {
+                auto s = snapshot.find(d.first);
+                if (s != snapshot.end() && s->second._start == d.second._start && s->second._size == d.second._size)
+                    continue;
+
+                auto newBlock = copyBlock(d.first, d.second);
+                auto b = std::lower_bound(blocks.begin(), blocks.end(), d.first, DirectoryChunk::CompareBlock());
+                if (b != blocks.end() && b->_id == d.first) {
+                    spanningHeap.Deallocate(b->_start, b->_size);
+                    *b = newBlock;
+                } else {
+                    blocks.insert(b, newBlock);
+                }
+            }
+
+            dstFile.Flush();
+        }
+
+            //  Write the new directory into a temporary file, and then rename it to "<dir>.new"
+            //  Once "<dir>.new" exists, the compaction is committed (see CompleteCompaction)
+        auto tempDirectoryName = _directoryFileName + ".tmp";
+        auto newDirectoryName = _directoryFileName + ".new";
+        {
+            BasicFile directoryFile(tempDirectoryName.c_str(), "wb");
+            WriteDirectoryFile(directoryFile, blocks, spanningHeap, _buildVersionString, _buildDateString);
+            directoryFile.Flush();
+        }
+        XlDeleteFile((const utf8*)newDirectoryName.c_str());
+        XlMoveFile((const utf8*)newDirectoryName.c_str(), (const utf8*)tempDirectoryName.c_str());
+
+            //  Retire all of the mappings of the old archive. Views into them remain valid,
+            //  and the old file is deleted once they've all been released.
+        RetiredArchive retired;
+        retired._fileName = _mainFileName + ".retired" + std::to_string(_retiredArchiveCounter++);
+        retired._mappings = std::move(_retiredMappings);
+        _retiredMappings.clear();
+        if (_mappedArchive) {
+            retired._mappings.push_back(_mappedArchive);
+            _mappedArchive.reset();
+        }
+
+        if (!CompleteCompaction(retired._fileName)) {
+            _directoryLoaded = false;   // (reload whatever state we've ended up in)
+            _retiredMappings = std::move(retired._mappings);
+            return false;
+        }
+
+        _retiredArchives.push_back(std::move(retired));
+        ReleaseRetiredArchives();
+
+        _directory.clear();
+        _directory.reserve(blocks.size());
+        for (const auto& b:blocks) {
+            DirectoryEntry entry = { b._start, b._size };
+            _directory.insert(std::make_pair(b._id, entry));
+        }
+        _directoryLogSize = 0;
+        _directoryLogEntryCount = 0;
+        _archiveFileSize = unsigned(Utility::GetFileSize(_mainFileName.c_str()));
+        return true;
+    }
+
+    bool ArchiveCache::CompleteCompaction(const std::string& retiredArchiveName)
+    {
+            //  If "<dir>.new" exists, a compaction reached its commit point, and we must finish
+            //  swapping in the new files. Every step can be safely repeated, so this also 
+            //  completes a swap that was interrupted by a crash (it's called on construction).
+            //  If "<dir>.new" doesn't exist, any other files left behind belong to a compaction 
+            //  that never completed, and can just be discarded.
+            //
+            //  The old archive is renamed to "retiredArchiveName" rather than deleted, because
+            //  it may still be mapped. (Mapped files can't be deleted, but they can be renamed).
+        auto compactedFileName = _mainFileName + ".compact";
+        auto tempDirectoryName = _directoryFileName + ".tmp";
+        auto newDirectoryName = _directoryFileName + ".new";
+
+        if (!DoesFileExist(newDirectoryName.c_str())) {
+            XlDeleteFile((const utf8*)compactedFileName.c_str());
+            XlDeleteFile((const utf8*)tempDirectoryName.c_str());
+            return false;
+        }
+
+        if (DoesFileExist(compactedFileName.c_str())) {
+            if (DoesFileExist(_mainFileName.c_str()))
+                XlMoveFile((const utf8*)retiredArchiveName.c_str(), (const utf8*)_mainFileName.c_str());
+            if (!DoesFileExist(_mainFileName.c_str()))
+                XlMoveFile((const utf8*)_mainFileName.c_str(), (const utf8*)compactedFileName.c_str());
+            if (DoesFileExist(compactedFileName.c_str())) {
+                    //  Couldn't replace the archive (maybe another process has it open). Abandon
+                    //  this compaction; the old directory & log still match the old archive.
+                LogWarning << "Could not replace archive file (" << _mainFileName << ") during compaction";
+                if (!DoesFileExist(_mainFileName.c_str()))
+                    XlMoveFile((const utf8*)_mainFileName.c_str(), (const utf8*)retiredArchiveName.c_str());
+                XlDeleteFile((const utf8*)newDirectoryName.c_str());
+                XlDeleteFile((const utf8*)compactedFileName.c_str());
+                return false;
+            }
+        }
+
+            // the log only applies to the old archive
+        XlDeleteFile((const utf8*)_directoryLogFileName.c_str());
+        XlDeleteFile((const utf8*)_directoryFileName.c_str());
+        XlMoveFile((const utf8*)_directoryFileName.c_str(), (const utf8*)newDirectoryName.c_str());
+        return true;
+    }
+
+    void ArchiveCache::SetFlushMode(FlushMode mode, float compactionThreshold)
+    {
+        ScopedLock(_pendingBlocksLock);
+        _flushMode = mode;
+        _compactionThreshold = compactionThreshold;
+    }
+
     auto ArchiveCache::GetMetrics() const -> Metrics
     {
         using namespace Serialization::ChunkFile;
 
-            // We need to open the file and get metrics information
-            // for the blocks contained within
+        ScopedLock(_pendingBlocksLock);
+
+            // Get the list of blocks from our in-memory directory, and then open
+            // the debugging file to get attached strings for those blocks
         ////////////////////////////////////////////////////////////////////////////////////
         std::vector<DirectoryChunk::Block> fileBlocks;
-        TRY {
-            BasicFile directoryFile(_directoryFileName.c_str(), "rb");
-
-            auto chunkTable = LoadChunkTable(directoryFile);
-            auto chunk = FindChunk(_directoryFileName.c_str(), chunkTable, ChunkType_ArchiveDirectory, 0);
-
-            directoryFile.Seek(chunk._fileOffset, SEEK_SET);
-            DirectoryChunk dirHdr;
-            directoryFile.Read(&dirHdr, sizeof(dirHdr), 1);
-
-            fileBlocks.resize(dirHdr._blockCount);
-            directoryFile.Read(AsPointer(fileBlocks.begin()), sizeof(DirectoryChunk::Block), dirHdr._blockCount);
-        } CATCH (...) {
-        } CATCH_END
+        {
+            const auto& directory = GetDirectory();
+            fileBlocks.reserve(directory.size());
+            for (const auto& d:directory) {
+                DirectoryChunk::Block block = { d.first, d.second._start, d.second._size };
+                fileBlocks.push_back(block);
+            }
+            std::sort(fileBlocks.begin(), fileBlocks.end(), DirectoryChunk::CompareBlock());
+        }
 
         ////////////////////////////////////////////////////////////////////////////////////
         #if defined(ARCHIVE_CACHE_ATTACHED_STRINGS)
@@ -523,6 +977,8 @@ namespace Assets
         result._blocks = std::move(blocks);
         result._usedSpace = usedSpace;
         result._allocatedFileSize = unsigned(Utility::GetFileSize(_mainFileName.c_str()));
+        result._fragmentation = CalculateFragmentation();
+        result._directoryLogEntries = _directoryLogEntryCount;
         return result;
     }
 
@@ -531,21 +987,48 @@ namespace Assets
         const char buildVersionString[],
         const char buildDateString[]) 
         : _mainFileName(archiveName)
+        , _directoryLoaded(false)
+        , _directoryLogSize(0)
+        , _directoryLogEntryCount(0)
+        , _archiveFileSize(0)
+        , _mappedArchiveSize(0)
+        , _retiredArchiveCounter(0)
+        , _flushMode(FlushMode::Rewrite)
+        , _compactionThreshold(0.5f)
+        , _backgroundCompactionEnabled(true)
+        , _compactionQueued(false)
+        , _compactionCopying(false)
         , _buildVersionString(buildVersionString)
         , _buildDateString(buildDateString)
     {
         _directoryFileName = _mainFileName + ".dir";
+        _directoryLogFileName = _mainFileName + ".log";
 
             // (make sure the directory provided exists)
         char dirName[MaxPath];
         XlDirname(dirName, dimof(dirName), _mainFileName.c_str());
         CreateDirectoryRecursive(dirName);
+
+            // finish any compaction that was interrupted last time, and then clean up any
+            // old archive files that were still mapped when the last process exited
+        auto retiredPrefix = _mainFileName + ".retired";
+        CompleteCompaction(retiredPrefix + "0");
+        auto retiredFiles = FindFiles(retiredPrefix + "*", FindFilesFilter::File);
+        for (const auto& f:retiredFiles)
+            XlDeleteFile((const utf8*)f.c_str());
     }
 
     ArchiveCache::~ArchiveCache() 
     {
         TRY {
+                // wait for any background compaction before the final flush
+            _backgroundCompactionEnabled = false;
+            _backgroundCompaction.reset();
             FlushToDisk();
+
+                // (any retired archives still mapped now will be cleaned up next time we're opened)
+            ScopedLock(_pendingBlocksLock);
+            ReleaseRetiredArchives();
         } CATCH (const std::exception& e) {
             LogWarning << "Suppressing exception in ArchiveCache::~ArchiveCache: " << e.what();
         } CATCH (...) {
@@ -7,24 +7,86 @@
 #pragma once
 
 #include "../Utility/Threading/Mutex.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include "../Core/Types.h"
 
 #include <memory>
 #include <vector>
+#include <unordered_map>
+#include <functional>
+#include <string>
+#include <atomic>
 
 #define ARCHIVE_CACHE_ATTACHED_STRINGS
 
+namespace Utility { class MemoryMappedFile; }
+
 namespace Assets
 {
+    /// <summary>Archive of binary blocks, indexed by a 64 bit id</summary>
+    /// New blocks are committed into a pending list, and written to disk on FlushToDisk().
+    ///
+    /// Reads are done via a memory mapping of the archive file. OpenFromCache() doesn't
+    /// allocate or copy; it returns a BlockView that points directly into the mapped file
+    /// (and keeps that mapping alive for as long as the view exists). The directory is
+    /// loaded once and kept in memory as a hash table.
+    ///
+    /// In FlushMode::AppendLog, FlushToDisk() never overwrites existing data. New blocks
+    /// are appended to the archive file, and a small delta is appended to the directory log
+    /// (rather than rewriting the directory). Replaced blocks leave wasted space behind;
+    /// once the fragmentation passes the compaction threshold, the archive is compacted
+    /// in a background thread. Compaction writes a new archive and directory, and then swaps
+    /// them in such a way that an interrupted swap is completed the next time the archive is opened.
+    ///
+    /// BlockViews never stop a compaction. The old archive file is renamed out of the way
+    /// (rather than deleted), so outstanding views keep reading from the old mapping. The
+    /// old file is deleted after the last view into it is released.
     class ArchiveCache
     {
     public:
         typedef std::shared_ptr<std::vector<uint8>> BlockAndSize;
 
+        /// <summary>Reference counted read-only view of a block of data</summary>
+        /// The view keeps its owner alive (either the memory mapped archive, or the
+        /// vector in a pending commit). Can also be constructed directly from a BlockAndSize.
+        class BlockView
+        {
+        public:
+            const uint8*    begin() const   { return _start; }
+            const uint8*    end() const     { return _start + _size; }
+            const uint8*    data() const    { return _start; }
+            size_t          size() const    { return _size; }
+            bool            empty() const   { return _size == 0; }
+            void            reset();
+
+            BlockView();
+            BlockView(std::nullptr_t);
+            BlockView(const BlockAndSize& block);
+            BlockView(std::shared_ptr<const void> owner, const uint8* start, size_t size);
+        private:
+            std::shared_ptr<const void> _owner;
+            const uint8*    _start;
+            size_t          _size;
+        };
+
         void            Commit(uint64 id, BlockAndSize&& data, const std::string& attachedString, std::function<void()>&& onFlush);
-        BlockAndSize    OpenFromCache(uint64 id);
+        BlockView       OpenFromCache(uint64 id);
         bool            HasItem(uint64 id) const;
         void            FlushToDisk();
+
+        enum class FlushMode 
+        {
+            Rewrite,        ///< reuse space freed by old blocks, and rewrite the whole directory on every flush (appends, and then compacts, while BlockViews are alive)
+            AppendLog       ///< always append blocks, and only append a delta to the directory log
+        };
+        void            SetFlushMode(FlushMode mode, float compactionThreshold = 0.5f);
+
+        /// <summary>Rewrite the archive with no wasted space</summary>
+        /// Returns false if the new archive couldn't be swapped in (for example, if another
+        /// process has the archive open). Compaction is queued automatically in a background
+        /// thread once fragmentation passes the compaction threshold, so it's rarely necessary
+        /// to call this directly.
+        bool            Compact();
         
         class BlockMetrics
         {
@@ -38,6 +100,8 @@ namespace Assets
         public:
             unsigned _allocatedFileSize;
             unsigned _usedSpace;
+            float _fragmentation;               // fraction of the archive file that is wasted
+            unsigned _directoryLogEntries;      // entries in the directory log, not yet compacted
             std::vector<BlockMetrics> _blocks;
         };
 
@@ -75,6 +139,55 @@ namespace Assets
         std::vector<PendingCommit> _pendingBlocks;
         std::string _mainFileName, _directoryFileName;
 
+            // in-memory copy of the directory & the current mapping of the
+            // archive file. Both are protected by _pendingBlocksLock
+        class DirectoryEntry
+        {
+        public:
+            unsigned _start, _size;
+        };
+        typedef std::unordered_map<uint64, DirectoryEntry> Directory;
+        mutable Directory _directory;
+        mutable bool _directoryLoaded;
+        mutable unsigned _directoryLogSize;
+        mutable unsigned _directoryLogEntryCount;
+        mutable unsigned _archiveFileSize;
+        std::string _directoryLogFileName;
+
+        std::shared_ptr<Utility::MemoryMappedFile> _mappedArchive;
+        size_t _mappedArchiveSize;
+        std::vector<std::weak_ptr<Utility::MemoryMappedFile>> _retiredMappings;
+
+            // archive files that were replaced by a compaction, but that still
+            // have BlockViews pointing into them
+        class RetiredArchive
+        {
+        public:
+            std::string _fileName;
+            std::vector<std::weak_ptr<Utility::MemoryMappedFile>> _mappings;
+        };
+        std::vector<RetiredArchive> _retiredArchives;
+        unsigned _retiredArchiveCounter;
+
+        const Directory& GetDirectory() const;
+        const std::shared_ptr<Utility::MemoryMappedFile>& GetMappedArchive();
+        bool HasLiveViews();
+        void ReleaseRetiredArchives();
+
+        FlushMode _flushMode;
+        float _compactionThreshold;
+        bool _backgroundCompactionEnabled;
+        std::atomic<bool> _compactionQueued;
+        bool _compactionCopying;        // (protected by _pendingBlocksLock) flushes must only append while set
+        Threading::Mutex _compactionLock;
+        std::unique_ptr<CompletionThreadPool::TaskGroup> _backgroundCompaction;
+
+        void FlushRewrite(bool archivePinned);
+        void FlushAppend();
+        void QueueBackgroundCompaction();
+        bool CompleteCompaction(const std::string& retiredArchiveName);
+        float CalculateFragmentation() const;
+
         const char*     _buildVersionString;
         const char*     _buildDateString;
 
@@ -86,6 +199,4 @@ namespace Assets
             bool operator()(const PendingCommit& lhs, const PendingCommit& rhs) { return lhs._id < rhs._id; }
         };
     };
-
-
 }
\ No newline at end of file
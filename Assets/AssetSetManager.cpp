@@ -6,9 +6,11 @@
 
 #include "AssetSetManager.h"
 #include "../Utility/Threading/ThreadingUtils.h"
+#include "../Utility/Threading/Mutex.h"
 #include "../Utility/IteratorUtils.h"
 #include <vector>
 #include <memory>
+#include <atomic>
 #include <assert.h>
 
 namespace Assets
@@ -21,25 +23,30 @@ namespace Assets
     public:
         std::vector<std::pair<size_t, std::unique_ptr<IAssetSet>>> _sets;
         unsigned _boundThreadId;
+        Threading::Mutex _lock;
     };
 
     IAssetSet* AssetSetManager::GetSetForTypeCode(size_t typeCode)
     {
+        ScopedLock(_pimpl->_lock);
         auto i = LowerBound(_pimpl->_sets, typeCode);
         if (i != _pimpl->_sets.end() && i->first == typeCode)
             return i->second.get();
         return nullptr;
     }
 
-    void AssetSetManager::Add(size_t typeCode, std::unique_ptr<IAssetSet>&& set)
+    IAssetSet* AssetSetManager::Add(size_t typeCode, std::unique_ptr<IAssetSet>&& set)
     {
+        ScopedLock(_pimpl->_lock);
         auto i = LowerBound(_pimpl->_sets, typeCode);
-        assert(i == _pimpl->_sets.end() || i->first != typeCode);
-        _pimpl->_sets.insert(
+        if (i != _pimpl->_sets.end() && i->first == typeCode)
+            return i->second.get();     // another thread got here first
+
+        return _pimpl->_sets.insert(
             i,
             std::make_pair(
                 typeCode,
-                std::forward<std::unique_ptr<IAssetSet>>(set)));
+                std::forward<std::unique_ptr<IAssetSet>>(set)))->second.get();
     }
 
     void AssetSetManager::Clear()
@@ -56,6 +63,21 @@ namespace Assets
         }
     }
 
+    void AssetSetManager::OnFrameBarrier()
+    {
+            // release assets that were replaced by rebuilt versions during the last frame
+            // (sets are never removed, so we can release them outside of the lock)
+        std::vector<IAssetSet*> sets;
+        {
+            ScopedLock(_pimpl->_lock);
+            sets.reserve(_pimpl->_sets.size());
+            for (auto i=_pimpl->_sets.begin(); i!=_pimpl->_sets.end(); ++i)
+                sets.push_back(i->second.get());
+        }
+        for (auto* s:sets)
+            s->ReleaseSuperseded();
+    }
+
 	bool AssetSetManager::IsBoundThread() const
 	{
 		return _pimpl->_boundThreadId == Threading::CurrentThreadId();
@@ -71,8 +93,11 @@ namespace Assets
         return _pimpl->_sets[index].second.get();
     }
 
+    static std::atomic<unsigned> s_nextAssetSetManagerId(1);
+
     AssetSetManager::AssetSetManager()
     {
+        _instanceId = s_nextAssetSetManagerId++;
         auto pimpl = std::make_unique<Pimpl>();
         pimpl->_boundThreadId = Threading::CurrentThreadId();
         _pimpl = std::move(pimpl);
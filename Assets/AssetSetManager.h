@@ -23,6 +23,7 @@ namespace Assets
         virtual uint64          GetDivergentId(unsigned index) const = 0;
         virtual bool            DivergentHasChanges(unsigned index) const = 0;
         virtual std::string     GetAssetName(uint64 id) const = 0;
+        virtual void            ReleaseSuperseded() = 0;
         virtual ~IAssetSet();
     };
 
@@ -36,20 +37,25 @@ namespace Assets
 
         void Clear();
         void LogReport();
+        void OnFrameBarrier();
         unsigned BoundThreadId() const;
         bool IsBoundThread() const;
 
         unsigned GetAssetSetCount();
         const IAssetSet* GetAssetSet(unsigned index);
 
+            // unique for each AssetSetManager (so cached sets can tell when the manager has been replaced)
+        unsigned GetInstanceId() const { return _instanceId; }
+
         AssetSetManager();
         ~AssetSetManager();
     protected:
         class Pimpl;
         std::unique_ptr<Pimpl> _pimpl;
+        unsigned _instanceId;
 
         IAssetSet* GetSetForTypeCode(size_t typeCode);
-        void Add(size_t typeCode, std::unique_ptr<IAssetSet>&& set);
+        IAssetSet* Add(size_t typeCode, std::unique_ptr<IAssetSet>&& set);
     };
 
     template<typename Type>
@@ -61,10 +67,11 @@ namespace Assets
             return static_cast<Internal::AssetSet<Type>*>(existing);
         }
 
+            // (if another thread added a set for this type in the meantime, Add 
+            // will return that set instead)
         auto newPtr = std::make_unique<Internal::AssetSet<Type>>();
-        auto* result = newPtr.get();
-        Add(typeid(Type).hash_code(), std::move(newPtr));
-        return result;
+        return static_cast<Internal::AssetSet<Type>*>(
+            Add(typeid(Type).hash_code(), std::move(newPtr)));
     }
 
 }
@@ -106,7 +106,7 @@ namespace Assets
 
     DependencyValidation::DependencyValidation(DependencyValidation&& moveFrom) never_throws
     {
-        _validationIndex = moveFrom._validationIndex;
+        _validationIndex = moveFrom._validationIndex.load();
         for (unsigned c=0; c<dimof(_dependencies); ++c)
             _dependencies[c] = std::move(moveFrom._dependencies[c]);
         _dependenciesOverflow = std::move(moveFrom._dependenciesOverflow);
@@ -114,7 +114,7 @@ namespace Assets
 
     DependencyValidation& DependencyValidation::operator=(DependencyValidation&& moveFrom) never_throws
     {
-        _validationIndex = moveFrom._validationIndex;
+        _validationIndex = moveFrom._validationIndex.load();
         for (unsigned c=0; c<dimof(_dependencies); ++c)
             _dependencies[c] = std::move(moveFrom._dependencies[c]);
         _dependenciesOverflow = std::move(moveFrom._dependenciesOverflow);
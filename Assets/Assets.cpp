@@ -9,6 +9,7 @@
 #include "../Utility/MemoryUtils.h"
 #include "../Utility/StringUtils.h"
 #include "../ConsoleRig/Log.h"
+#include <algorithm>
 
 namespace Assets 
 {
@@ -49,5 +50,72 @@ namespace Assets
 
         std::basic_string<ResChar> AsString() { return std::basic_string<ResChar>(); }
 
+        class ConstructionWait
+        {
+        public:
+            std::thread::id _waiter;
+            std::thread::id _constructingThread;
+            const void* _entry;
+        };
+
+        static std::mutex s_constructionWaitsLock;
+        static std::vector<ConstructionWait> s_constructionWaits;
+        static std::atomic<unsigned> s_constructionWaitCount(0);
+
+        void BeginConstructionWait(const void* entry, std::thread::id constructingThread)
+        {
+                //  Follow the chain of waits starting at the thread constructing the asset
+                //  we want. If it leads back to this thread, waiting would deadlock.
+                //  Each thread waits on at most one asset at a time, so the chain is simple.
+            auto thisThread = std::this_thread::get_id();
+            std::unique_lock<std::mutex> lock(s_constructionWaitsLock);
+            auto t = constructingThread;
+            for (unsigned depth=0; depth<=unsigned(s_constructionWaits.size()); ++depth) {
+                if (t == thisThread)
+                    Throw(::Exceptions::BasicLabel("Cyclic asset construction detected across threads"));
+                auto i = std::find_if(s_constructionWaits.cbegin(), s_constructionWaits.cend(),
+                    [t](const ConstructionWait& w) { return w._waiter == t; });
+                if (i == s_constructionWaits.cend()) break;
+                t = i->_constructingThread;
+            }
+
+            ConstructionWait w;
+            w._waiter = thisThread;
+            w._constructingThread = constructingThread;
+            w._entry = entry;
+            s_constructionWaits.push_back(w);
+            ++s_constructionWaitCount;
+        }
+
+        void EndConstructionWait()
+        {
+            auto thisThread = std::this_thread::get_id();
+            std::unique_lock<std::mutex> lock(s_constructionWaitsLock);
+            auto i = std::find_if(s_constructionWaits.begin(), s_constructionWaits.end(),
+                [thisThread](const ConstructionWait& w) { return w._waiter == thisThread; });
+            if (i != s_constructionWaits.end()) {
+                s_constructionWaits.erase(i);
+                --s_constructionWaitCount;
+            }
+        }
+
+        void OnConstructionComplete(const void* entry)
+        {
+                //  Remove the waits on this entry immediately (rather than when the waiting
+                //  threads wake up). Otherwise a stale wait could look like a cycle to the 
+                //  constructing thread if it goes on to request an asset a waiter is building.
+                //  Waiters are registered while their shard is locked, and we're called after
+                //  the entry is marked complete under the same lock, so the count check can't 
+                //  miss one. Only waits on this thread's construction are removed (another thread
+                //  may already have started rebuilding the same entry).
+            if (s_constructionWaitCount.load() == 0) return;
+            auto thisThread = std::this_thread::get_id();
+            std::unique_lock<std::mutex> lock(s_constructionWaitsLock);
+            auto i = std::remove_if(s_constructionWaits.begin(), s_constructionWaits.end(),
+                [entry, thisThread](const ConstructionWait& w) { return w._entry == entry && w._constructingThread == thisThread; });
+            s_constructionWaitCount -= unsigned(s_constructionWaits.end() - i);
+            s_constructionWaits.erase(i, s_constructionWaits.end());
+        }
+
     }
 }
@@ -14,10 +14,15 @@
 #include "../Utility/IteratorUtils.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Core/Types.h"
+#include "../Core/Exceptions.h"
 #include <vector>
 #include <utility>
 #include <string>
 #include <sstream>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
 
 #if defined(_DEBUG)
     #define ASSETS_STORE_NAMES
@@ -54,16 +59,54 @@ namespace Assets
             uint64          GetDivergentId(unsigned index) const;
             bool            DivergentHasChanges(unsigned index) const;
             std::string     GetAssetName(uint64 id) const;
+            void            ReleaseSuperseded();
+
+                //  Assets are split between a number of "shards" (selected by hash value),
+                //  each with it's own lock. This allows GetAsset<> to be called from any
+                //  thread, and threads requesting different assets will rarely contend.
+                //  While an asset is being constructed, it's entry is marked with the 
+                //  constructing thread id, and other threads requesting the same asset
+                //  will wait on "_constructionComplete" (so each asset is only constructed
+                //  once). The shard lock is not held during construction.
+                //  Assets are held by shared_ptr. When an asset is rebuilt, the old version is 
+                //  moved into "_superseded", and only released at the next frame barrier (see
+                //  AssetSetManager::OnFrameBarrier). So references returned by GetAsset<> remain
+                //  valid for the rest of the frame, and GetAssetPtr<> can keep them alive longer.
+            class Entry
+            {
+            public:
+                std::shared_ptr<AssetType>  _asset;
+                std::thread::id             _constructingThread;
+            };
+
+            class Shard
+            {
+            public:
+                std::mutex                  _lock;
+                std::condition_variable     _constructionComplete;
+                std::vector<std::pair<uint64, std::unique_ptr<Entry>>> _assets;
+            };
 
-            static std::vector<std::pair<uint64, std::unique_ptr<AssetType>>> _assets;
+            static const unsigned ShardCount = 16;
+            static Shard _shards[ShardCount];
+            static Shard& GetShard(uint64 hash) { return _shards[unsigned(hash >> 32ull) % ShardCount]; }
+
+            static AssetType& InsertOrReplace(uint64 hash, std::unique_ptr<AssetType>&& asset);
+            static void Supersede(std::shared_ptr<AssetType>&& asset);
+
+            static std::vector<std::shared_ptr<AssetType>> _superseded;
+            static std::mutex _supersededLock;
 			
 			#if defined(ASSETS_STORE_DIVERGENT)
 				using DivAsset = typename AssetTraits<AssetType>::DivAsset;
 				static std::vector<std::pair<uint64, std::shared_ptr<DivAsset>>> _divergentAssets;
+                static std::atomic<unsigned> _divergentAssetCount;
+                static std::mutex _divergentLock;
 			#endif
 
             #if defined(ASSETS_STORE_NAMES)
                 static std::vector<std::pair<uint64, std::string>> _assetNames;
+                static std::mutex _assetNamesLock;
             #endif
         };
 
@@ -77,19 +120,30 @@ namespace Assets
             std::vector<std::pair<uint64, std::string>>& assetNames, 
             uint64 hash, const std::string& name);
 
+            //  Tracks which threads are waiting on assets under construction in other threads,
+            //  so that cycles (thread A waits on an asset thread B is building, while B waits on
+            //  one A is building) throw an exception, rather than deadlocking.
+        void BeginConstructionWait(const void* entry, std::thread::id constructingThread);
+        void EndConstructionWait();
+        void OnConstructionComplete(const void* entry);
+
         template<typename AssetType>
             AssetSet<AssetType>& GetAssetSet() 
         {
-            static AssetSet<AssetType>* set = nullptr;
-            if (!set)
-                set = Services::GetAssetSets().GetSetForType<AssetType>();
-            
-            assert(Services::GetAssetSets().IsBoundThread());  // currently not thread safe; we have to check the thread ids
-            #if defined(ASSETS_STORE_NAMES)
-                    // These should agree. If there's a mismatch, there may be a threading problem
-                assert(set->_assets.size() == set->_assetNames.size());
-            #endif
-            return *set;
+                // (GetSetForType is thread safe, and always returns the same set for a given type)
+                // The cached set is only valid for the manager that created it; if the asset 
+                // services are shut down and restarted, we must register with the new manager.
+                // "managerId" is stored after "set", and loaded before it.
+            static std::atomic<AssetSet<AssetType>*> set;
+            static std::atomic<unsigned> managerId;
+            auto& manager = Services::GetAssetSets();
+            if (managerId.load(std::memory_order_acquire) == manager.GetInstanceId())
+                return *set.load(std::memory_order_acquire);
+
+            auto* result = manager.GetSetForType<AssetType>();
+            set.store(result, std::memory_order_release);
+            managerId.store(manager.GetInstanceId(), std::memory_order_release);
+            return *result;
         }
 
         template<typename AssetType> using Ptr = std::unique_ptr<AssetType>;
@@ -127,7 +181,7 @@ namespace Assets
         std::basic_string<ResChar> AsString();
 
 		template<bool DoCheckDependancy, bool DoBackgroundCompile, typename AssetType, typename... Params>
-			const AssetType& GetAsset(Params... initialisers)
+			std::shared_ptr<const AssetType> GetAsset(Params... initialisers)
             {
                     //
                     //  This is the main bit of functionality in this file. Here we define
@@ -145,49 +199,116 @@ namespace Assets
 				#if defined(ASSETS_STORE_DIVERGENT)
 						// divergent assets will always shadow normal assets
 						// we also don't do a dependency check for these assets
-					auto di = LowerBound(assetSet._divergentAssets, hash);
-					if (di != assetSet._divergentAssets.end() && di->first == hash) {
-						return di->second->GetAsset();
-					}
+                        // (divergent assets are rare, so avoid the lock when there are none)
+                    if (assetSet._divergentAssetCount.load(std::memory_order_acquire) != 0) {
+                        std::unique_lock<std::mutex> divLock(assetSet._divergentLock);
+					    auto di = LowerBound(assetSet._divergentAssets, hash);
+					    if (di != assetSet._divergentAssets.end() && di->first == hash) {
+						    return std::shared_ptr<const AssetType>(di->second, &di->second->GetAsset());
+					    }
+                    }
 				#endif
 
-                auto& assets = assetSet._assets;
-				auto i = LowerBound(assets, hash);
-				if (i != assets.end() && i->first == hash) {
-                    if (CheckDependancy<DoCheckDependancy>::NeedsRefresh(i->second.get())) {
+                using Entry = typename AssetSet<AssetType>::Entry;
+                auto& shard = AssetSet<AssetType>::GetShard(hash);
+                auto thisThread = std::this_thread::get_id();
+                Entry* entry = nullptr;
+                bool newEntry = false;
+
+                {
+                    std::unique_lock<std::mutex> lock(shard._lock);
+                    for (;;) {
+                            // note that we must search again after every wait, because 
+                            // other threads may have changed the shard
+                        auto i = LowerBound(shard._assets, hash);
+                        if (i == shard._assets.end() || i->first != hash) {
+                                // Add an entry to reserve this hash. Other threads that request the same 
+                                // asset will wait until we've finished construction
+                            auto e = std::make_unique<Entry>();
+                            e->_constructingThread = thisThread;
+                            entry = e.get();
+                            newEntry = true;
+                            shard._assets.insert(i, std::make_pair(hash, std::move(e)));
+                            break;
+                        }
+
+                        auto& existing = *i->second;
+                        if (existing._constructingThread != std::thread::id()) {
+                            if (existing._constructingThread == thisThread)
+                                Throw(::Exceptions::BasicLabel("Recursive construction of asset detected (%s)", typeid(AssetType).name()));
+                            BeginConstructionWait(&existing, existing._constructingThread);
+                            shard._constructionComplete.wait(lock);
+                            EndConstructionWait();
+                            continue;
+                        }
+
+                        if (!CheckDependancy<DoCheckDependancy>::NeedsRefresh(existing._asset.get()))
+                            return existing._asset;
+
                             // note --  old resource will stay in memory until the new one has been constructed
                             //          If we get an exception during construct, we'll be left with a null ptr
-                            //          in this asset set
-                        auto oldResource = std::move(i->second);
-                        i->second = ConstructAsset<DoBackgroundCompile>::Create<AssetType>(std::forward<Params>(initialisers)...);
+                            //          in this asset set (and the old resource is superseded)
+                        existing._constructingThread = thisThread;
+                        entry = &existing;
+                        break;
                     }
-                    return *i->second;
                 }
 
                 #if defined(ASSETS_STORE_NAMES)
                     auto name = AsString(initialisers...);  // (have to do this before constructor (incase constructor does std::move operations)
                 #endif
 
-                auto newAsset = ConstructAsset<DoBackgroundCompile>::Create<AssetType>(std::forward<Params>(initialisers)...);
+                std::unique_ptr<AssetType> newAsset;
+                TRY {
+                    newAsset = ConstructAsset<DoBackgroundCompile>::Create<AssetType>(std::forward<Params>(initialisers)...);
+                } CATCH(...) {
+                        // release the entry, and wake any other threads waiting on it.
+                        // For a new asset, we remove the entry entirely (so the next request will try again)
+                    std::shared_ptr<AssetType> oldAsset;
+                    {
+                        std::unique_lock<std::mutex> lock(shard._lock);
+                        if (newEntry) {
+                            auto i = LowerBound(shard._assets, hash);
+                            assert(i != shard._assets.end() && i->second.get() == entry);
+                            shard._assets.erase(i);
+                        } else {
+                            oldAsset = std::move(entry->_asset);
+                            entry->_constructingThread = std::thread::id();
+                        }
+                    }
+                    OnConstructionComplete(entry);
+                    shard._constructionComplete.notify_all();
+                    AssetSet<AssetType>::Supersede(std::move(oldAsset));
+                    RETHROW;
+                } CATCH_END
+
                 #if defined(ASSETS_STORE_NAMES)
                         // This is extra functionality designed for debugging and profiling
                         // attach a name to this hash value, so we can query the contents
                         // of an asset set and get meaningful values
                         //  (only insert after we've completed creation; because creation can throw an exception)
-					InsertAssetName(assetSet._assetNames, hash, name);
+                    if (newEntry) {
+                        std::unique_lock<std::mutex> namesLock(assetSet._assetNamesLock);
+					    InsertAssetName(assetSet._assetNames, hash, name);
+                    }
                 #endif
 
-                    // we have to search again for the insertion point
-                    //  it's possible that while constructing the asset, we may have called GetAsset<>
-                    //  to create another asset. This can invalidate our iterator "i". If we had some way
-                    //  to test to make sure that the assetSet definitely hasn't changed, we coudl skip this.
-                    //  But just doing a size check wouldn't be 100% -- because there might be an add, then a remove
-                    //      (well, remove isn't possible currently. But it may happen at some point.
-                    //  For the future, we should consider threading problems, also. We will probably need
-                    //  a lock on the assetset -- and it may be best to release this lock while we're calling
-                    //  the constructor
-				i = LowerBound(assets, hash);
-				return *assets.insert(i, std::make_pair(hash, std::move(newAsset)))->second;
+                    // Entry objects are never moved (the shard only holds pointers to them), so 
+                    // "entry" is still valid, even if other assets have been added to the shard.
+                    // And since it's marked as under construction, no other thread will modify it
+                std::shared_ptr<AssetType> oldAsset;
+                std::shared_ptr<AssetType> result;
+                {
+                    std::unique_lock<std::mutex> lock(shard._lock);
+                    oldAsset = std::move(entry->_asset);
+                    entry->_asset = std::move(newAsset);
+                    entry->_constructingThread = std::thread::id();
+                    result = entry->_asset;
+                }
+                OnConstructionComplete(entry);
+                shard._constructionComplete.notify_all();
+                AssetSet<AssetType>::Supersede(std::move(oldAsset));
+                return std::move(result);
             }
 
 		template <typename AssetType, typename... Params>
@@ -200,6 +321,7 @@ namespace Assets
 					auto hash = BuildHash(initialisers...);
 					auto& assetSet = GetAssetSet<AssetType>();
                     (void)assetSet;
+                    assert(Services::GetAssetSets().IsBoundThread());  // divergent assets are only supported from the main thread
 					auto di = LowerBound(assetSet._divergentAssets, hash);
 					if (di != assetSet._divergentAssets.end() && di->first == hash) {
 						return di->second;
@@ -215,7 +337,7 @@ namespace Assets
                     bool constructNewAsset = false;
                     TRY {
                         newDivAsset = std::make_shared<typename AssetTraits<AssetType>::DivAsset>(
-                            GetAsset<true, false, AssetType>(std::forward<Params>(initialisers)...), 
+                            *GetAsset<true, false, AssetType>(std::forward<Params>(initialisers)...), 
                             hash, assetSet.GetTypeCode(), 
                             identifier, undoQueue);
                     } CATCH (const Assets::Exceptions::InvalidAsset&) {
@@ -234,15 +356,16 @@ namespace Assets
                         auto newBlankAsset = AssetType::CreateNew(initialisers...);
 
                         auto& assetSet = GetAssetSet<AssetType>();
-                        auto& assets = assetSet._assets;
 
                         #if defined(ASSETS_STORE_NAMES)
-					        InsertAssetNameNoCollision(assetSet._assetNames, hash, name);
+                            {
+                                std::unique_lock<std::mutex> namesLock(assetSet._assetNamesLock);
+					            InsertAssetNameNoCollision(assetSet._assetNames, hash, name);
+                            }
                         #endif
 
-                        auto i = LowerBound(assets, hash);
                         newDivAsset = std::make_shared<typename AssetTraits<AssetType>::DivAsset>(
-                            *assets.insert(i, std::make_pair(hash, std::move(newBlankAsset)))->second, 
+                            AssetSet<AssetType>::InsertOrReplace(hash, std::move(newBlankAsset)), 
                             hash, assetSet.GetTypeCode(), 
                             identifier, undoQueue);
                     }
@@ -251,7 +374,10 @@ namespace Assets
 						// is it possible that constructing an asset could create a new divergent
 						// asset of the same type? It seems unlikely
 					assert(di == LowerBound(assetSet._divergentAssets, hash));
-					return assetSet._divergentAssets.insert(di, std::make_pair(hash, std::move(newDivAsset)))->second;
+                    std::unique_lock<std::mutex> divLock(assetSet._divergentLock);
+					auto& result = assetSet._divergentAssets.insert(di, std::make_pair(hash, std::move(newDivAsset)))->second;
+                    ++assetSet._divergentAssetCount;
+                    return result;
 
 				#endif
 			}
@@ -259,44 +385,108 @@ namespace Assets
         template <typename AssetType>
             AssetSet<AssetType>::~AssetSet() {}
 
+        template <typename AssetType>
+            AssetType& AssetSet<AssetType>::InsertOrReplace(uint64 hash, std::unique_ptr<AssetType>&& asset)
+            {
+                std::shared_ptr<AssetType> oldAsset;
+                AssetType* result;
+                {
+                    auto& shard = GetShard(hash);
+                    std::unique_lock<std::mutex> lock(shard._lock);
+                    auto i = LowerBound(shard._assets, hash);
+                    if (i == shard._assets.end() || i->first != hash)
+                        i = shard._assets.insert(i, std::make_pair(hash, std::make_unique<Entry>()));
+                    assert(i->second->_constructingThread == std::thread::id());
+                    oldAsset = std::move(i->second->_asset);
+                    i->second->_asset = std::move(asset);
+                    result = i->second->_asset.get();
+                }
+                Supersede(std::move(oldAsset));
+                return *result;
+            }
+
+        template <typename AssetType>
+            void AssetSet<AssetType>::Supersede(std::shared_ptr<AssetType>&& asset)
+            {
+                if (!asset) return;
+                std::unique_lock<std::mutex> lock(_supersededLock);
+                _superseded.push_back(std::move(asset));
+            }
+
+        template <typename AssetType>
+            void AssetSet<AssetType>::ReleaseSuperseded()
+            {
+                    // destroy the old assets outside of the lock (in case their destructors
+                    // touch the asset sets)
+                std::vector<std::shared_ptr<AssetType>> superseded;
+                {
+                    std::unique_lock<std::mutex> lock(_supersededLock);
+                    superseded.swap(_superseded);
+                }
+            }
+
         template <typename AssetType>
             void AssetSet<AssetType>::Clear() 
             {
-                _assets.clear();
+                for (auto& shard:_shards) {
+                    std::unique_lock<std::mutex> lock(shard._lock);
+                    assert(std::find_if(shard._assets.begin(), shard._assets.end(), 
+                        [](const std::pair<uint64, std::unique_ptr<Entry>>& e) { return e.second->_constructingThread != std::thread::id(); })
+                        == shard._assets.end());
+                    shard._assets.clear();
+                }
+                ReleaseSuperseded();
 				#if defined(ASSETS_STORE_DIVERGENT)
-					_divergentAssets.clear();
+                    {
+                        std::unique_lock<std::mutex> divLock(_divergentLock);
+					    _divergentAssets.clear();
+                        _divergentAssetCount = 0;
+                    }
 				#endif
                 #if defined(ASSETS_STORE_NAMES)
-                    _assetNames.clear();
+                    {
+                        std::unique_lock<std::mutex> namesLock(_assetNamesLock);
+                        _assetNames.clear();
+                    }
                 #endif
             }
 
         template <typename AssetType>
             void AssetSet<AssetType>::LogReport() const 
             {
-                LogHeader(unsigned(_assets.size()), typeid(AssetType).name());
+                    // gather the hash values from all shards, in sorted order
+                std::vector<uint64> assets;
+                for (auto& shard:_shards) {
+                    std::unique_lock<std::mutex> lock(shard._lock);
+                    for (const auto& e:shard._assets)
+                        if (e.second->_asset) assets.push_back(e.first);
+                }
+                std::sort(assets.begin(), assets.end());
+
+                LogHeader(unsigned(assets.size()), typeid(AssetType).name());
                 #if defined(ASSETS_STORE_NAMES)
-                    auto i = _assets.cbegin();
+                    std::unique_lock<std::mutex> namesLock(_assetNamesLock);
+                    auto i = assets.cbegin();
                     auto ni = _assetNames.cbegin();
                     unsigned index = 0;
-                    for (;i != _assets.cend(); ++i, ++index) {
-                        while (ni->first < i->first && ni != _assetNames.cend()) { ++ni; }
-                        if (ni != _assetNames.cend() && ni->first == i->first) {
+                    for (;i != assets.cend(); ++i, ++index) {
+                        while (ni != _assetNames.cend() && ni->first < *i) { ++ni; }
+                        if (ni != _assetNames.cend() && ni->first == *i) {
                             LogAssetName(index, ni->second.c_str());
                         } else {
                             char buffer[256];
                             _snprintf_s(buffer, _TRUNCATE, "Unnamed asset with hash (0x%08x%08x)", 
-                                uint32(i->first>>32), uint32(i->first));
+                                uint32((*i)>>32), uint32(*i));
                             LogAssetName(index, buffer);
                         }
                     }
                 #else
-                    auto i = _assets.cbegin();
+                    auto i = assets.cbegin();
                     unsigned index = 0;
-                    for (;i != _assets.cend(); ++i, ++index) {
+                    for (;i != assets.cend(); ++i, ++index) {
                         char buffer[256];
                         _snprintf_s(buffer, _TRUNCATE, "Unnamed asset with hash (0x%08x%08x)", 
-                            uint32(i->first>>32), uint32(i->first));
+                            uint32((*i)>>32), uint32(*i));
                         LogAssetName(index, buffer);
                     }
                 #endif
@@ -338,6 +528,7 @@ namespace Assets
             std::string     AssetSet<AssetType>::GetAssetName(uint64 id) const
             {
                 #if defined(ASSETS_STORE_NAMES)
+                    std::unique_lock<std::mutex> namesLock(_assetNamesLock);
                     auto i = LowerBound(_assetNames, id);
                     if (i != _assetNames.end() && i->first == id)
                         return i->second;
@@ -348,21 +539,38 @@ namespace Assets
             }
 
         template <typename AssetType>
-            std::vector<std::pair<uint64, std::unique_ptr<AssetType>>> AssetSet<AssetType>::_assets;
+            typename AssetSet<AssetType>::Shard AssetSet<AssetType>::_shards[AssetSet<AssetType>::ShardCount];
+        template <typename AssetType>
+            std::vector<std::shared_ptr<AssetType>> AssetSet<AssetType>::_superseded;
+        template <typename AssetType>
+            std::mutex AssetSet<AssetType>::_supersededLock;
         #if defined(ASSETS_STORE_NAMES)
             template <typename AssetType>
                 std::vector<std::pair<uint64, std::string>> AssetSet<AssetType>::_assetNames;
+            template <typename AssetType>
+                std::mutex AssetSet<AssetType>::_assetNamesLock;
         #endif
 
         #if defined(ASSETS_STORE_DIVERGENT)
             template <typename AssetType>
                 std::vector<std::pair<uint64, std::shared_ptr<typename AssetSet<AssetType>::DivAsset>>> AssetSet<AssetType>::_divergentAssets;
+            template <typename AssetType>
+                std::atomic<unsigned> AssetSet<AssetType>::_divergentAssetCount;
+            template <typename AssetType>
+                std::mutex AssetSet<AssetType>::_divergentLock;
         #endif
     }
 
-    template<typename AssetType, typename... Params> const AssetType& GetAsset(Params... initialisers)		    { return Internal::GetAsset<false, false, AssetType>(std::forward<Params>(initialisers)...); }
-    template<typename AssetType, typename... Params> const AssetType& GetAssetDep(Params... initialisers)	    { return Internal::GetAsset<true, false, AssetType>(std::forward<Params>(initialisers)...); }
-    template<typename AssetType, typename... Params> const AssetType& GetAssetComp(Params... initialisers)	    { return Internal::GetAsset<true, true, AssetType>(std::forward<Params>(initialisers)...); }
+        //  The references returned by GetAsset<>, GetAssetDep<> and GetAssetComp<> remain valid until 
+        //  the next frame barrier after the asset is rebuilt. Background threads, or anything that keeps 
+        //  an asset across frames, should use the "Ptr" versions, which share ownership of the asset.
+    template<typename AssetType, typename... Params> const AssetType& GetAsset(Params... initialisers)		    { return *Internal::GetAsset<false, false, AssetType>(std::forward<Params>(initialisers)...); }
+    template<typename AssetType, typename... Params> const AssetType& GetAssetDep(Params... initialisers)	    { return *Internal::GetAsset<true, false, AssetType>(std::forward<Params>(initialisers)...); }
+    template<typename AssetType, typename... Params> const AssetType& GetAssetComp(Params... initialisers)	    { return *Internal::GetAsset<true, true, AssetType>(std::forward<Params>(initialisers)...); }
+
+    template<typename AssetType, typename... Params> std::shared_ptr<const AssetType> GetAssetPtr(Params... initialisers)		{ return Internal::GetAsset<false, false, AssetType>(std::forward<Params>(initialisers)...); }
+    template<typename AssetType, typename... Params> std::shared_ptr<const AssetType> GetAssetDepPtr(Params... initialisers)	{ return Internal::GetAsset<true, false, AssetType>(std::forward<Params>(initialisers)...); }
+    template<typename AssetType, typename... Params> std::shared_ptr<const AssetType> GetAssetCompPtr(Params... initialisers)	{ return Internal::GetAsset<true, true, AssetType>(std::forward<Params>(initialisers)...); }
 
     template<typename AssetType, typename... Params> 
         std::shared_ptr<typename Internal::AssetTraits<AssetType>::DivAsset>& GetDivergentAsset(Params... initialisers)	
@@ -419,7 +627,7 @@ namespace Assets
         DependencyValidation(const DependencyValidation&) = delete;
         DependencyValidation& operator=(const DependencyValidation&) = delete;
     private:
-        unsigned _validationIndex;
+        std::atomic<unsigned> _validationIndex;     // (OnChange can be called from any thread)
 
             // store a fixed number of dependencies (with room to grow)
             // this is just to avoid extra allocation where possible
@@ -138,6 +138,7 @@ namespace BufferUploads
         virtual std::shared_ptr<Marker>     BeginBackgroundLoad();
 
         FileDataSource(const void* fileHandle, size_t offset, size_t dataSize, TexturePitches pitches);
+        FileDataSource(const void* fileHandle, size_t offset, size_t dataSize, TexturePitches pitches, FileDataDecoder&& decoder, size_t decodedSize);
         virtual ~FileDataSource();
 
     protected:
@@ -145,6 +146,9 @@ namespace BufferUploads
         size_t      _dataSize;
         size_t      _offset;
 
+        FileDataDecoder _decoder;
+        size_t          _decodedSize;
+
         struct SpecialOverlapped
         {
             OVERLAPPED                      _internal;
@@ -167,7 +171,7 @@ namespace BufferUploads
         return _pkt.get();
     }
 
-    size_t FileDataSource::GetDataSize(SubResource subRes) const           { /*assert(subRes == 0);*/ return _dataSize; }
+    size_t FileDataSource::GetDataSize(SubResource subRes) const           { /*assert(subRes == 0);*/ return _decoder ? _decodedSize : _dataSize; }
     TexturePitches FileDataSource::GetPitches(SubResource subRes) const    { /*assert(subRes == 0);*/ return _pitches; }
 
     void CALLBACK FileDataSource::CompletionRoutine(
@@ -178,10 +182,17 @@ namespace BufferUploads
         assert(o && o->_returnPointer && o->_returnPointer->_marker);
         assert(o->_returnPointer->_marker->GetState() == Assets::AssetState::Pending);
 
-            // We don't have to do any extra processing right now. Just mark the asset as ready
-            // or invalid, based on the result...
-        o->_returnPointer->_marker->SetState(
-            (dwErrorCode == ERROR_SUCCESS) ? Assets::AssetState::Ready : Assets::AssetState::Invalid);
+            // If there's a decoder, we run it now (in the thread that started the read).
+            // Otherwise, just mark the asset as ready or invalid, based on the result...
+        auto* pkt = o->_returnPointer.get();
+        bool success = dwErrorCode == ERROR_SUCCESS;
+        if (success && pkt->_decoder) {
+            std::unique_ptr<byte[], PODAlignedDeletor> decoded((byte*)XlMemAlign(pkt->_decodedSize, 16));
+            success = success && pkt->_decoder(decoded.get(), pkt->_decodedSize, pkt->_pkt.get(), pkt->_dataSize);
+            pkt->_pkt = std::move(decoded);
+        }
+
+        pkt->_marker->SetState(success ? Assets::AssetState::Ready : Assets::AssetState::Invalid);
 
             // we can reset the "_returnPointer", which will also decrease the reference
             // count on the FileDataSource object
@@ -243,6 +254,15 @@ namespace BufferUploads
         _dataSize = dataSize;
         _pitches = pitches;
         _offset = offset;
+        _decodedSize = 0;
+    }
+
+    FileDataSource::FileDataSource(const void* fileHandle, size_t offset, size_t dataSize, TexturePitches pitches, FileDataDecoder&& decoder, size_t decodedSize)
+    : FileDataSource(fileHandle, offset, dataSize, pitches)
+    {
+        assert(decodedSize);
+        _decoder = std::move(decoder);
+        _decodedSize = decodedSize;
     }
 
     FileDataSource::~FileDataSource()
@@ -257,6 +277,13 @@ namespace BufferUploads
         return make_intrusive<FileDataSource>(fileHandle, offset, dataSize, pitches);
     }
 
+    intrusive_ptr<DataPacket> CreateFileDataSource(
+        const void* fileHandle, size_t offset, size_t dataSize, TexturePitches pitches, 
+        FileDataDecoder&& decoder, size_t decodedSize)
+    {
+        return make_intrusive<FileDataSource>(fileHandle, offset, dataSize, pitches, std::move(decoder), decodedSize);
+    }
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     class StreamingTexture : public DataPacket
@@ -10,6 +10,7 @@
 #include "../Assets/AssetUtils.h"                   // for ::Assets::PendingOperationMarker
 #include "../Utility/Threading/ThreadingUtils.h"    // for RefCountedObject
 #include "../Utility/MemoryUtils.h"
+#include <functional>
 
 namespace BufferUploads
 {
@@ -86,6 +87,17 @@ namespace BufferUploads
         const void* fileHandle, size_t offset, size_t dataSize,
         TexturePitches pitches);
 
+        /// Decodes data read by a file data source (for example, to decompress it).
+        /// Called in a background thread after the read completes. Writes exactly 
+        /// "dstSize" bytes to "dst", and returns false on failure.
+    typedef std::function<bool(void* dst, size_t dstSize, const void* src, size_t srcSize)> FileDataDecoder;
+
+        /// Reads "dataSize" bytes from the file, and then decodes them into a
+        /// packet of "decodedSize" bytes
+    buffer_upload_dll_export intrusive_ptr<DataPacket> CreateFileDataSource(
+        const void* fileHandle, size_t offset, size_t dataSize,
+        TexturePitches pitches, FileDataDecoder&& decoder, size_t decodedSize);
+
     namespace TextureLoadFlags { 
         enum Enum { GenerateMipmaps = 1<<0 };
         typedef unsigned BitField;
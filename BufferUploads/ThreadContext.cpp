@@ -58,9 +58,7 @@ namespace BufferUploads
             newCommandList._metrics._frameId = PlatformInterface::GetFrameID();
             newCommandList._metrics._commitTime = currentTime;
             #if defined(XL_BUFFER_UPLOAD_RECORD_THREAD_CONTEXT_METRICS)
-                while (!_recentRetirements.push(newCommandList._metrics)) {
-                    _recentRetirements.pop();   // note -- this might violate the single-popping-thread rule!
-                }
+                PushRecentRetirement(newCommandList._metrics);
             #endif
             _commandListIDCommittedToImmediate = std::max(_commandListIDCommittedToImmediate, _commandListIDUnderConstruction);
         }
@@ -113,9 +111,7 @@ namespace BufferUploads
                     commandList->_metrics._commitTime               = PlatformInterface::QueryPerformanceCounter();
                     commandList->_metrics._framePriorityStallTime   = stallEnd - stallStart;    // this should give us very small numbers, when we're not actually stalling for frame priority commits
                     #if defined(XL_BUFFER_UPLOAD_RECORD_THREAD_CONTEXT_METRICS)
-                        while (!_recentRetirements.push(commandList->_metrics)) {
-                            _recentRetirements.pop();   // note -- this might violate the single-popping-thread rule!
-                        }
+                        PushRecentRetirement(commandList->_metrics);
                     #endif
                     _queuedCommandLists.pop();
 
@@ -152,15 +148,23 @@ namespace BufferUploads
         XlSetEvent(_wakeupEvent);   // wake up the background thread -- it might be time for a resolve
     }
 
+    #if defined(XL_BUFFER_UPLOAD_RECORD_THREAD_CONTEXT_METRICS)
+        void ThreadContext::PushRecentRetirement(const CommandListMetrics& metrics)
+        {
+                // when the queue is full, drop the oldest metrics to make room
+            while (!_recentRetirements.try_push(metrics)) {
+                CommandListMetrics discard;
+                _recentRetirements.try_pop(discard);
+            }
+        }
+    #endif
+
     CommandListMetrics ThreadContext::PopMetrics()
     {
         #if defined(XL_BUFFER_UPLOAD_RECORD_THREAD_CONTEXT_METRICS)
-            CommandListMetrics* ptr;
-            if (_recentRetirements.try_front(ptr)) {
-                CommandListMetrics result = *ptr;
-                _recentRetirements.pop();
+            CommandListMetrics result;
+            if (_recentRetirements.try_pop(result))
                 return result;
-            }
         #endif
         return CommandListMetrics();
     }
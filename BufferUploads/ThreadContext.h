@@ -145,7 +145,10 @@ namespace BufferUploads
         CommitStep _commitStepUnderConstruction;
         LockFree::FixedSizeQueue<CommandList, 32> _queuedCommandLists;
         #if defined(XL_BUFFER_UPLOAD_RECORD_THREAD_CONTEXT_METRICS)
-            LockFree::FixedSizeQueue<CommandListMetrics, 32> _recentRetirements;
+                // (pushed by both the background and render threads, and popped by
+                // the pushers as well as PopMetrics -- so it must be multi-consumer)
+            LockFree::BoundedQueue<CommandListMetrics, 32> _recentRetirements;
+            void PushRecentRetirement(const CommandListMetrics& metrics);
         #endif
         PlatformInterface::UnderlyingDeviceContext _deviceContext;
         std::shared_ptr<RenderCore::IThreadContext> _underlyingContext;
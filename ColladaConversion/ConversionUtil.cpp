@@ -16,6 +16,7 @@
 #include "../Utility/Streams/StreamDOM.h"
 #include "../Utility/Streams/StreamFormatter.h"
 #include "../Utility/StringUtils.h"
+#include "../Utility/Conversion.h"
 #include "../Foreign/half-1.9.2/include/half.hpp"
 
 
@@ -24,6 +25,7 @@ namespace RenderCore { namespace ColladaConversion
     bool ImportCameras = true;
 
     ImportConfiguration::ImportConfiguration(const ::Assets::ResChar filename[])
+    : _vertexCacheSize(0), _weldVertices(false), _animationCompressionTolerance(0.f)
     {
         TRY 
         {
@@ -37,6 +39,43 @@ namespace RenderCore { namespace ColladaConversion
             _constantsBindings = BindingConfig(doc.Element(u("Constants")));
             _vertexSemanticBindings = BindingConfig(doc.Element(u("VertexSemantics")));
 
+            auto geometry = doc.Element(u("Geometry"));
+            if (geometry) {
+                _vertexCacheSize = geometry(u("VertexCacheSize"), _vertexCacheSize);
+
+                    // "Weld" contains the quantization epsilon for each vertex semantic 
+                    // (plus "Default" for everything else, and "Parallel")
+                auto weld = geometry.Element(u("Weld"));
+                if (weld) {
+                    _weldVertices = true;
+                    for (auto child = weld.FirstAttribute(); child; child = child.Next()) {
+                        auto name = Conversion::Convert<std::string>(child.Name());
+                        if (!XlCompareStringI(name.c_str(), "Default")) {
+                            _vertexWelding._defaultEpsilon = child.As<float>().second;
+                        } else if (!XlCompareStringI(name.c_str(), "Parallel")) {
+                            _vertexWelding._parallel = child.As<bool>().second;
+                        } else {
+                            _vertexWelding._semanticEpsilons.push_back(
+                                std::make_pair(name, child.As<float>().second));
+                        }
+                    }
+                }
+
+                auto lod = geometry.Element(u("LOD"));
+                if (lod) {
+                        // "Count" is the total number of LODs, including LOD 0 (so 1 disables the chain)
+                    auto lodCount = lod(u("Count"), _lodChain._lodCount + 1);
+                    _lodChain._lodCount = lodCount ? (lodCount - 1) : 0;
+                    _lodChain._reduction = lod(u("Reduction"), _lodChain._reduction);
+                    _lodChain._maxError = lod(u("MaxError"), _lodChain._maxError);
+                    _lodChain._attributeWeight = lod(u("AttributeWeight"), _lodChain._attributeWeight);
+                }
+            }
+
+            auto animation = doc.Element(u("Animation"));
+            if (animation)
+                _animationCompressionTolerance = animation(u("CompressionTolerance"), _animationCompressionTolerance);
+
         } CATCH(...) {
             LogWarning << "Problem while loading configuration file (" << filename << "). Using defaults.";
         } CATCH_END
@@ -44,7 +83,7 @@ namespace RenderCore { namespace ColladaConversion
         _depVal = std::make_shared<::Assets::DependencyValidation>();
         RegisterFileDependency(_depVal, filename);
     }
-    ImportConfiguration::ImportConfiguration() {}
+    ImportConfiguration::ImportConfiguration() : _vertexCacheSize(0), _weldVertices(false), _animationCompressionTolerance(0.f) {}
     ImportConfiguration::~ImportConfiguration()
     {}
 
@@ -6,6 +6,7 @@
 
 #pragma once
 
+#include "MeshDatabaseAdapter.h"        // for VertexWeldingConfig
 #include "../RenderCore/Metal/InputLayout.h"
 #include "../Assets/AssetsCore.h"
 #include "../Math/Vector.h"
@@ -41,6 +42,17 @@ namespace RenderCore { namespace ColladaConversion
         std::vector<String> _bindingSuppressed;
     };
 
+    class LODChainConfig
+    {
+    public:
+        unsigned    _lodCount;          ///< number of simplified LODs to generate (in addition to LOD 0)
+        float       _reduction;         ///< ratio of triangle counts between successive LODs
+        float       _maxError;          ///< largest allowed error, as a fraction of the geometry's bounding radius
+        float       _attributeWeight;   ///< weight of normal & texture coordinate differences in the simplification cost
+
+        LODChainConfig() : _lodCount(0), _reduction(.5f), _maxError(.05f), _attributeWeight(1.f) {}
+    };
+
     class ImportConfiguration
     {
     public:
@@ -48,6 +60,21 @@ namespace RenderCore { namespace ColladaConversion
         const BindingConfig& GetConstantBindings() const { return _constantsBindings; }
         const BindingConfig& GetVertexSemanticBindings() const { return _vertexSemanticBindings; }
 
+            //  Post-transform vertex cache optimisation (and vertex fetch reordering) for 
+            //  triangle lists. Disabled when the cache size is zero.
+        unsigned GetVertexCacheSize() const { return _vertexCacheSize; }
+
+            //  Merge unified vertices with matching attributes (see MeshDatabaseAdapter::WeldVertices)
+        bool GetWeldVertices() const { return _weldVertices; }
+        const VertexWeldingConfig& GetVertexWeldingConfig() const { return _vertexWelding; }
+
+            //  Simplified LODs for static geometry (see SimplifyTriangleList). Disabled when the lod count is zero.
+        const LODChainConfig& GetLODChainConfig() const { return _lodChain; }
+
+            //  Error bound for animation curve key reduction (see RawAnimationCurve::Compress).
+            //  Curves are stored uncompressed when this is zero.
+        float GetAnimationCompressionTolerance() const { return _animationCompressionTolerance; }
+
         const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const { return _depVal; }
 
         ImportConfiguration(const ::Assets::ResChar filename[]);
@@ -57,6 +84,11 @@ namespace RenderCore { namespace ColladaConversion
         BindingConfig _resourceBindings;
         BindingConfig _constantsBindings;
         BindingConfig _vertexSemanticBindings;
+        unsigned _vertexCacheSize;
+        bool _weldVertices;
+        VertexWeldingConfig _vertexWelding;
+        LODChainConfig _lodChain;
+        float _animationCompressionTolerance;
 
         std::shared_ptr<::Assets::DependencyValidation> _depVal;
     };
@@ -96,12 +96,13 @@ namespace RenderCore { namespace ColladaConversion
 
         for (unsigned c=0; c<scene->GetInstanceGeometryCount(); ++c) {
             TRY {
-                _cmdStream.Add(
-                    RenderCore::ColladaConversion::InstantiateGeometry(
-                        scene->GetInstanceGeometry(c),
-                        scene->GetInstanceGeometry_Attach(c),
-                        input._resolveContext, _geoObjects, jointRefs,
-                        input._cfg));
+                auto instances = RenderCore::ColladaConversion::InstantiateGeometry(
+                    scene->GetInstanceGeometry(c),
+                    scene->GetInstanceGeometry_Attach(c),
+                    input._resolveContext, _geoObjects, jointRefs,
+                    input._cfg);
+                for (auto& i:instances)
+                    _cmdStream.Add(std::move(i));
             } CATCH(...) {
             } CATCH_END
         }
@@ -127,17 +128,20 @@ namespace RenderCore { namespace ColladaConversion
                     //      only transform that can affect them is the parent node -- or maybe the skeleton root?)
                 LogWarning << "Could not instantiate controller as a skinned object. Falling back to rigid object.";
                 TRY {
-                    _cmdStream.Add(
-                        RenderCore::ColladaConversion::InstantiateGeometry(
-                            scene->GetInstanceController(c),
-                            scene->GetInstanceController_Attach(c),
-                            input._resolveContext, _geoObjects, jointRefs,
-                            input._cfg));
+                    auto instances = RenderCore::ColladaConversion::InstantiateGeometry(
+                        scene->GetInstanceController(c),
+                        scene->GetInstanceController_Attach(c),
+                        input._resolveContext, _geoObjects, jointRefs,
+                        input._cfg);
+                    for (auto& i:instances)
+                        _cmdStream.Add(std::move(i));
                 } CATCH(...) {
                 } CATCH_END
             }
         }
 
+        _cmdStream.PadLODChains();
+
         using namespace RenderCore::ColladaConversion;
         BuildMinimalSkeleton(_skeleton, scene->GetRootNode(), jointRefs);
         RegisterNodeBindingNames(_skeleton, jointRefs);
@@ -252,6 +256,56 @@ namespace RenderCore { namespace ColladaConversion
         result->push_back(NascentChunk(scaffoldChunk, std::vector<uint8>(block.get(), PtrAdd(block.get(), size))));
         result->push_back(NascentChunk(largeBlockChunk, std::move(largeResourcesBlock)));
 
+            // Vertex cache statistics for each raw geometry, followed by each skinned
+            // geometry (in the same order as the geometry in the scaffold). These are only 
+            // for diagnostics; the runtime doesn't require this chunk.
+        if (model._cfg.GetVertexCacheSize()) {
+            Serialization::NascentBlockSerializer metricsSerializer;
+            for (const auto& g:skinFile._geoObjects._rawGeos) {
+                g.second._originalCacheMetrics.Serialize(metricsSerializer);
+                g.second._optimizedCacheMetrics.Serialize(metricsSerializer);
+            }
+            for (const auto& g:skinFile._geoObjects._skinnedGeos) {
+                g.second._originalCacheMetrics.Serialize(metricsSerializer);
+                g.second._optimizedCacheMetrics.Serialize(metricsSerializer);
+            }
+
+            auto metricsBlock = metricsSerializer.AsMemoryBlock();
+            auto metricsSize = Serialization::Block_GetSize(metricsBlock.get());
+            Serialization::ChunkFile::ChunkHeader metricsChunk(
+                RenderCore::Assets::ChunkType_ModelScaffoldGeoMetrics, 0, model._name.c_str(), unsigned(metricsSize));
+            result->push_back(NascentChunk(metricsChunk, std::vector<uint8>(metricsBlock.get(), PtrAdd(metricsBlock.get(), metricsSize))));
+        }
+
+            // Largest simplification error for each LOD (in object space units). The runtime
+            // takes the max LOD from the size of this table (the errors are for diagnostics).
+            // Only written when there are generated LODs.
+        {
+            std::vector<float> lodErrors;
+            const auto& objs = skinFile._geoObjects;
+            for (const auto& inst:skinFile._cmdStream._geometryInstances) {
+                if (inst._levelOfDetail >= lodErrors.size())
+                    lodErrors.resize(inst._levelOfDetail+1, 0.f);
+                lodErrors[inst._levelOfDetail] = std::max(
+                    lodErrors[inst._levelOfDetail], 
+                    objs._rawGeos[inst._id].second._simplificationError);
+            }
+
+                // Skinned geometry isn't simplified; so if we wrote the table for a model with skinned
+                // parts, those parts would disappear in the lower LODs
+            if (lodErrors.size() > 1 && !skinFile._cmdStream._skinControllerInstances.empty()) {
+                LogWarning << "Generated LODs will not be used for model with skinned geometry (" << model._name << ")";
+                lodErrors.clear();
+            }
+
+            if (lodErrors.size() > 1) {
+                auto lodTableSize = lodErrors.size() * sizeof(float);
+                Serialization::ChunkFile::ChunkHeader lodTableChunk(
+                    RenderCore::Assets::ChunkType_ModelScaffoldLODTable, 0, model._name.c_str(), unsigned(lodTableSize));
+                result->push_back(NascentChunk(lodTableChunk, std::vector<uint8>((const uint8*)AsPointer(lodErrors.cbegin()), (const uint8*)PtrAdd(AsPointer(lodErrors.cbegin()), lodTableSize))));
+            }
+        }
+
         return std::move(result);
     }
 
@@ -384,8 +438,13 @@ namespace RenderCore { namespace ColladaConversion
             TRY {
                 auto anim = Convert(*i, input._resolveContext, jointRefs); 
 
+                const auto compressionTolerance = input._cfg.GetAnimationCompressionTolerance();
                 for (auto c=anim._curves.begin(); c!=anim._curves.end(); ++c) {
-                    _curves.emplace_back(std::move(c->_curve));
+                    if (compressionTolerance > 0.f) {
+                        _curves.emplace_back(c->_curve.Compress(compressionTolerance));
+                    } else {
+                        _curves.emplace_back(std::move(c->_curve));
+                    }
                     _animationSet.AddAnimationDriver(
                         c->_parameterName, unsigned(_curves.size()-1),
                         c->_samplerType, c->_samplerOffset);
@@ -428,7 +487,7 @@ namespace RenderCore { namespace ColladaConversion
         size_t size = Serialization::Block_GetSize(block.get());
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_AnimationSet, 0, animSet._name.c_str(), unsigned(size));
+            RenderCore::Assets::ChunkType_AnimationSet, RenderCore::Assets::ChunkVersion_AnimationSet, animSet._name.c_str(), unsigned(size));
 
         NascentChunkArray result(new std::vector<NascentChunk>(), &DestroyChunkArray);
         result->push_back(NascentChunk(scaffoldChunk, std::vector<uint8>(block.get(), PtrAdd(block.get(), size))));
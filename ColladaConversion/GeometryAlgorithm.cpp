@@ -6,8 +6,11 @@
 
 #include "GeometryAlgorithm.h"
 #include "MeshDatabaseAdapter.h"
+#include "../Assets/BlockSerializer.h"
 #include "../Math/Geometry.h"
 #include "../Utility/MemoryUtils.h"
+#include <algorithm>
+#include <unordered_set>
 
 namespace RenderCore { namespace ColladaConversion
 {
@@ -311,5 +314,355 @@ namespace RenderCore { namespace ColladaConversion
         return result/8;
     }
 
-}}
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    VertexCacheMetrics CalculateVertexCacheMetrics(
+        const unsigned indices[], size_t indexCount, 
+        size_t vertexCount, unsigned cacheSize)
+    {
+        VertexCacheMetrics result;
+        result._cacheSize = cacheSize;
+        if (!indexCount || !vertexCount || !cacheSize) return result;
+
+            // Simulate a FIFO cache by recording the "time" at which each vertex
+            // entered the cache. A vertex is still in the cache if fewer than
+            // "cacheSize" misses have happened since then.
+        std::vector<size_t> cacheEntryTime(vertexCount, ~size_t(0));
+        std::vector<bool> referenced(vertexCount, false);
+        size_t misses = 0, uniqueVertices = 0;
+        for (size_t c=0; c<indexCount; ++c) {
+            auto v = indices[c];
+            assert(v < vertexCount);
+            if (cacheEntryTime[v] == ~size_t(0) || (misses - cacheEntryTime[v]) >= cacheSize) {
+                cacheEntryTime[v] = misses;
+                ++misses;
+            }
+            if (!referenced[v]) { referenced[v] = true; ++uniqueVertices; }
+        }
+
+        result._acmr = float(misses) / float(indexCount / 3);
+        result._atvr = float(misses) / float(uniqueVertices);
+        return result;
+    }
+
+    void VertexCacheMetrics::Serialize(Serialization::NascentBlockSerializer& outputSerializer) const
+    {
+        outputSerializer.SerializeValue(_acmr);
+        outputSerializer.SerializeValue(_atvr);
+        outputSerializer.SerializeValue(_cacheSize);
+    }
+
+    void OptimizeVertexCache(
+        unsigned indices[], size_t indexCount, 
+        size_t vertexCount, unsigned cacheSize)
+    {
+        auto triangleCount = indexCount / 3;
+        if (triangleCount < 2 || !vertexCount) return;
+
+            // Build the vertex -> triangle adjacency (as a compressed array) 
+        std::vector<unsigned> liveTriangles(vertexCount, 0);
+        for (size_t c=0; c<triangleCount*3; ++c) {
+            assert(indices[c] < vertexCount);
+            ++liveTriangles[indices[c]];
+        }
+
+        std::vector<unsigned> adjacencyStart(vertexCount+1, 0);
+        for (size_t v=0; v<vertexCount; ++v)
+            adjacencyStart[v+1] = adjacencyStart[v] + liveTriangles[v];
+
+        std::vector<unsigned> adjacency(adjacencyStart[vertexCount]);
+        {
+            std::vector<unsigned> writeCursor(adjacencyStart.begin(), adjacencyStart.end()-1);
+            for (size_t c=0; c<triangleCount*3; ++c)
+                adjacency[writeCursor[indices[c]]++] = unsigned(c/3);
+        }
+
+        std::vector<unsigned> cacheTime(vertexCount, 0);
+        std::vector<bool> emitted(triangleCount, false);
+        std::vector<unsigned> deadEndStack;
+        std::vector<unsigned> candidates;
+        deadEndStack.reserve(triangleCount*3);
+        candidates.reserve(64);
+
+        std::vector<unsigned> output;
+        output.reserve(triangleCount*3);
+
+        unsigned timeStamp = cacheSize+1;
+        size_t cursor = 0;
+        auto fanningVertex = indices[0];
+        for (;;) {
+                // Emit all of the remaining triangles around the fanning vertex
+            candidates.clear();
+            for (auto a=adjacencyStart[fanningVertex]; a<adjacencyStart[fanningVertex+1]; ++a) {
+                auto t = adjacency[a];
+                if (emitted[t]) continue;
+
+                for (unsigned q=0; q<3; ++q) {
+                    auto v = indices[t*3+q];
+                    output.push_back(v);
+                    deadEndStack.push_back(v);
+                    candidates.push_back(v);
+                    --liveTriangles[v];
+                    if ((timeStamp - cacheTime[v]) > cacheSize) {
+                        cacheTime[v] = timeStamp;
+                        ++timeStamp;
+                    }
+                }
+                emitted[t] = true;
+            }
+
+                // Choose the next fanning vertex. Prefer candidates that will still
+                // be in the cache after their remaining triangles are emitted (and, of those,
+                // the one that has been in the cache the longest)
+            unsigned nextVertex = ~0u;
+            int bestPriority = -1;
+            for (auto v:candidates) {
+                if (!liveTriangles[v]) continue;
+                int priority = 0;
+                if ((timeStamp - cacheTime[v] + 2 * liveTriangles[v]) <= cacheSize)
+                    priority = int(timeStamp - cacheTime[v]);
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    nextVertex = v;
+                }
+            }
+
+                // If none of the candidates are useful, we're at a dead end. Go back
+                // to recently used vertices first, and then just scan forward through
+                // the vertex list
+            if (nextVertex == ~0u) {
+                while (!deadEndStack.empty()) {
+                    auto d = deadEndStack.back();
+                    deadEndStack.pop_back();
+                    if (liveTriangles[d]) { nextVertex = d; break; }
+                }
+            }
+            if (nextVertex == ~0u) {
+                while (cursor < vertexCount) {
+                    if (liveTriangles[cursor]) { nextVertex = unsigned(cursor); break; }
+                    ++cursor;
+                }
+            }
+            if (nextVertex == ~0u) break;
+            fanningVertex = nextVertex;
+        }
+
+        assert(output.size() == triangleCount*3);
+        std::copy(output.begin(), output.end(), indices);
+    }
+
+    std::vector<unsigned> BuildVertexFetchRemap(
+        const unsigned indices[], size_t indexCount, 
+        size_t vertexCount)
+    {
+        std::vector<unsigned> remap(vertexCount, ~0u);
+        unsigned nextIndex = 0;
+        for (size_t c=0; c<indexCount; ++c) {
+            assert(indices[c] < vertexCount);
+            if (remap[indices[c]] == ~0u)
+                remap[indices[c]] = nextIndex++;
+        }
+
+        for (auto& r:remap)
+            if (r == ~0u) r = nextIndex++;
+        assert(nextIndex == vertexCount);
+        return std::move(remap);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    class Quadric
+    {
+    public:
+            // symmetric 4x4 matrix: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33
+        double _a[10];
+
+        void AddPlane(const Float3& normal, float distance, double weight)
+        {
+            double n[4] = { normal[0], normal[1], normal[2], distance };
+            unsigned i = 0;
+            for (unsigned r=0; r<4; ++r)
+                for (unsigned c=r; c<4; ++c)
+                    _a[i++] += weight * n[r] * n[c];
+        }
+
+        double Evaluate(const Float3& p) const
+        {
+            double x = p[0], y = p[1], z = p[2];
+            double result = 
+                  _a[0]*x*x + 2.*_a[1]*x*y + 2.*_a[2]*x*z + 2.*_a[3]*x
+                + _a[4]*y*y + 2.*_a[5]*y*z + 2.*_a[6]*y
+                + _a[7]*z*z + 2.*_a[8]*z
+                + _a[9];
+            return std::max(result, 0.);
+        }
+
+        Quadric& operator+=(const Quadric& other)
+        {
+            for (unsigned c=0; c<dimof(_a); ++c) _a[c] += other._a[c];
+            return *this;
+        }
+
+        Quadric() { for (unsigned c=0; c<dimof(_a); ++c) _a[c] = 0.; }
+    };
+
+    static inline uint64 EdgeKey(unsigned a, unsigned b) { return (uint64(a) << 32ull) | uint64(b); }
+
+    float SimplifyTriangleList(
+        std::vector<unsigned>& indices,
+        const Float3 positions[], size_t vertexCount,
+        const float attributes[], unsigned attributesPerVertex, float attributeWeight,
+        size_t targetIndexCount, float maxError)
+    {
+        if (indices.size() <= targetIndexCount || indices.size() < 6) return 0.f;
+
+            //  Find border vertices (on edges that don't have a matching edge in the opposite direction).
+            //  These are locked, because the same vertices are shared with geometry we can't see
+            //  here (other draw calls, or the other side of a texture seam)
+        std::unordered_set<uint64> directedEdges;
+        directedEdges.reserve(indices.size());
+        for (size_t t=0; t<indices.size(); t+=3)
+            for (unsigned e=0; e<3; ++e)
+                directedEdges.insert(EdgeKey(indices[t+e], indices[t+(e+1)%3]));
+
+        std::vector<bool> isBorderVertex(vertexCount, false);
+        for (auto e:directedEdges) {
+            auto a = unsigned(e >> 32ull), b = unsigned(e);
+            if (directedEdges.find(EdgeKey(b, a)) == directedEdges.end())
+                isBorderVertex[a] = isBorderVertex[b] = true;
+        }
+
+            //  Build the initial quadrics from the triangle planes (weighted by area)
+        std::vector<Quadric> quadrics(vertexCount);
+        for (size_t t=0; t<indices.size(); t+=3) {
+            const unsigned v[] = { indices[t], indices[t+1], indices[t+2] };
+            auto cross = Cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+            auto doubleArea = Magnitude(cross);
+            if (doubleArea <= 0.f) continue;
+            auto normal = cross / doubleArea;
+
+            for (unsigned c=0; c<3; ++c)
+                quadrics[v[c]].AddPlane(normal, -Dot(normal, positions[v[0]]), .5 * doubleArea);
+        }
+
+        class Collapse
+        {
+        public:
+            unsigned _from, _to;
+            double _cost, _geometricError;
+            bool operator<(const Collapse& other) const { return _cost < other._cost; }
+        };
+
+        auto evaluateCollapse = [&](unsigned from, unsigned to) -> Collapse
+        {
+            Collapse result;
+            result._from = from; result._to = to;
+            auto q = quadrics[from]; q += quadrics[to];
+            result._geometricError = q.Evaluate(positions[to]);
+            double attributeError = 0.;
+            for (unsigned c=0; c<attributesPerVertex; ++c) {
+                double diff = attributes[from*attributesPerVertex+c] - attributes[to*attributesPerVertex+c];
+                attributeError += diff * diff;
+            }
+            result._cost = result._geometricError + attributeWeight * attributeError;
+            return result;
+        };
+
+        const double maxErrorSq = double(maxError) * double(maxError);
+        double largestError = 0.;
+
+        std::vector<unsigned> adjacencyStart(vertexCount+1);
+        std::vector<unsigned> adjacency;
+        std::vector<unsigned> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<Collapse> collapses;
+
+        for (;;) {
+            auto triangleCount = indices.size() / 3;
+            auto targetTriangleCount = targetIndexCount / 3;
+            if (triangleCount <= targetTriangleCount) break;
+
+                //  vertex -> triangle adjacency for the current triangles
+            std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+            for (auto i:indices) ++adjacencyStart[i+1];
+            for (size_t v=0; v<vertexCount; ++v) adjacencyStart[v+1] += adjacencyStart[v];
+            adjacency.resize(indices.size());
+            {
+                std::vector<unsigned> cursor(adjacencyStart.begin(), adjacencyStart.end()-1);
+                for (size_t c=0; c<indices.size(); ++c)
+                    adjacency[cursor[indices[c]]++] = unsigned(c/3);
+            }
+
+                //  find the cheapest direction for every edge, and sort by cost
+            collapses.clear();
+            for (size_t t=0; t<indices.size(); t+=3)
+                for (unsigned e=0; e<3; ++e) {
+                    auto a = indices[t+e], b = indices[t+(e+1)%3];
+                    if (a > b) continue;    // (interior edges will be visited from both sides, and border edges can't collapse)
+                    bool ab = !isBorderVertex[a], ba = !isBorderVertex[b];
+                    if (!ab && !ba) continue;
+                    if (ab && ba) {
+                        auto c0 = evaluateCollapse(a, b), c1 = evaluateCollapse(b, a);
+                        collapses.push_back((c0._cost <= c1._cost) ? c0 : c1);
+                    } else {
+                        collapses.push_back(ab ? evaluateCollapse(a, b) : evaluateCollapse(b, a));
+                    }
+                }
+            std::sort(collapses.begin(), collapses.end());
+
+            for (size_t v=0; v<vertexCount; ++v) remap[v] = unsigned(v);
+            std::fill(touched.begin(), touched.end(), false);
+
+            size_t removedTriangles = 0;
+            size_t collapseCount = 0;
+            for (const auto& c:collapses) {
+                if (triangleCount - removedTriangles <= targetTriangleCount) break;
+                if (c._cost > maxErrorSq) break;
+                if (touched[c._from] || touched[c._to]) continue;
+
+                    //  reject collapses that would flip any of the remaining triangles
+                bool flips = false;
+                unsigned sharedTriangles = 0;
+                for (auto a=adjacencyStart[c._from]; a<adjacencyStart[c._from+1] && !flips; ++a) {
+                    auto t = adjacency[a]*3;
+                    const unsigned v[] = { indices[t], indices[t+1], indices[t+2] };
+                    if (v[0] == c._to || v[1] == c._to || v[2] == c._to) { ++sharedTriangles; continue; }
+
+                    Float3 p[3], q[3];
+                    for (unsigned i=0; i<3; ++i) {
+                        p[i] = positions[v[i]];
+                        q[i] = positions[(v[i] == c._from) ? c._to : v[i]];
+                    }
+                    auto n0 = Cross(p[1] - p[0], p[2] - p[0]);
+                    auto n1 = Cross(q[1] - q[0], q[2] - q[0]);
+                    if (Dot(n0, n1) <= 0.f) flips = true;
+                }
+                if (flips) continue;
+
+                remap[c._from] = c._to;
+                quadrics[c._to] += quadrics[c._from];
+                for (auto a=adjacencyStart[c._from]; a<adjacencyStart[c._from+1]; ++a) {
+                    auto t = adjacency[a]*3;
+                    touched[indices[t]] = touched[indices[t+1]] = touched[indices[t+2]] = true;
+                }
+                largestError = std::max(largestError, c._geometricError);
+                removedTriangles += sharedTriangles;
+                ++collapseCount;
+            }
+
+            if (!collapseCount) break;
 
+                //  rewrite the triangles, and remove any that have become degenerate
+            size_t dst = 0;
+            for (size_t t=0; t<indices.size(); t+=3) {
+                auto a = remap[indices[t]], b = remap[indices[t+1]], c = remap[indices[t+2]];
+                if (a == b || b == c || c == a) continue;
+                indices[dst++] = a; indices[dst++] = b; indices[dst++] = c;
+            }
+            indices.resize(dst);
+        }
+
+        return float(std::sqrt(largestError));
+    }
+
+}}
@@ -8,6 +8,10 @@
 
 #include "../RenderCore/Metal/Format.h"
 #include "../RenderCore/Metal/InputLayout.h"
+#include "../Math/Vector.h"
+#include <vector>
+
+namespace Serialization { class NascentBlockSerializer; }
 
 namespace RenderCore { namespace ColladaConversion
 {
@@ -28,4 +32,64 @@ namespace RenderCore { namespace ColladaConversion
     unsigned CalculateVertexSize(
         const Metal::InputElementDesc* layoutBegin,  
         const Metal::InputElementDesc* layoutEnd);
+
+        ////////////////////////////////////////////////////////
+
+    /// <summary>Post-transform vertex cache statistics for a triangle list</summary>
+    /// These are calculated by simulating a FIFO cache of the given size.
+    class VertexCacheMetrics
+    {
+    public:
+        float       _acmr;          ///< average cache miss ratio (vertices transformed per triangle; 0.5 is ideal for large grids)
+        float       _atvr;          ///< average transform to vertex ratio (1.0 is ideal)
+        unsigned    _cacheSize;
+
+        void    Serialize(Serialization::NascentBlockSerializer& outputSerializer) const;
+
+        VertexCacheMetrics() : _acmr(0.f), _atvr(0.f), _cacheSize(0) {}
+    };
+
+    VertexCacheMetrics CalculateVertexCacheMetrics(
+        const unsigned indices[], size_t indexCount, 
+        size_t vertexCount, unsigned cacheSize);
+
+    /// <summary>Reorder triangles for the post-transform vertex cache</summary>
+    /// Uses the "Tipsify" algorithm (Sander, Nehab & Barczak, "Fast Triangle Reordering
+    /// for Vertex Locality and Reduced Overdraw"). This runs in linear time, and
+    /// only reorders triangles within the given list (vertices are not moved, and the
+    /// winding of each triangle is unchanged). "indices" is a triangle list; the
+    /// result is written back in place.
+    void OptimizeVertexCache(
+        unsigned indices[], size_t indexCount, 
+        size_t vertexCount, unsigned cacheSize);
+
+    /// <summary>Build a remapping that sorts vertices into the order they are first used</summary>
+    /// This improves the locality of vertex fetches (after the triangle order has been
+    /// optimised). remap[oldIndex] is the new index for each vertex. Vertices not referenced
+    /// by any index are moved to the end (in their original order).
+    std::vector<unsigned> BuildVertexFetchRemap(
+        const unsigned indices[], size_t indexCount, 
+        size_t vertexCount);
+
+        ////////////////////////////////////////////////////////
+
+    /// <summary>Reduce the triangle count of a triangle list using quadric error metrics</summary>
+    /// Performs repeated half edge collapses (ie, a vertex is merged into one of its neighbours).
+    /// Vertices are never moved or created, so the result references a subset of the original
+    /// vertices (and can share the same vertex data).
+    ///
+    /// The cost of each collapse is the quadric error (Garland & Heckbert) plus a penalty for the
+    /// difference in the optional per-vertex attributes (eg, normals and texture coordinates),
+    /// scaled by "attributeWeight". Vertices on open borders are never moved. This includes texture
+    /// seams and material boundaries (since those split vertices), so draw calls that share a
+    /// border can be simplified separately without opening cracks between them.
+    ///
+    /// Stops when the index count reaches "targetIndexCount", or when the next collapse would 
+    /// exceed "maxError" (a distance, in the same units as the positions). Returns the largest 
+    /// geometric error of any collapse performed.
+    float SimplifyTriangleList(
+        std::vector<unsigned>& indices,
+        const Float3 positions[], size_t vertexCount,
+        const float attributes[], unsigned attributesPerVertex, float attributeWeight,
+        size_t targetIndexCount, float maxError);
 }}
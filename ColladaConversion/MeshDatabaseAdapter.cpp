@@ -6,9 +6,15 @@
 
 #include "MeshDatabaseAdapter.h"
 #include "../RenderCore/Metal/Format.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../ConsoleRig/Log.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include "../Utility/StringUtils.h"
 #include "../Utility/MemoryUtils.h"
 #include "../Foreign/half-1.9.2/include/half.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 namespace RenderCore { namespace ColladaConversion
 {
@@ -219,6 +225,206 @@ namespace RenderCore { namespace ColladaConversion
         return std::move(finalVertexBuffer);
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    float VertexWeldingConfig::GetEpsilon(const std::string& semantic) const
+    {
+        for (const auto& e:_semanticEpsilons)
+            if (!XlCompareStringI(e.first.c_str(), semantic.c_str()))
+                return e.second;
+        return _defaultEpsilon;
+    }
+
+    class WeldStream
+    {
+    public:
+        const void*     _data;
+        size_t          _stride;
+        size_t          _dataSize;
+        unsigned        _componentCount;
+        ProcessingFlags::BitField _processingFlags;
+        const unsigned* _vertexMap;
+        float           _inverseEpsilon;
+        bool            _matchIndex;
+    };
+
+    static const unsigned WeldMaxStreams = 16;
+    static const unsigned WeldMaxKeyLength = WeldMaxStreams*5;
+    static const unsigned WeldBucketCount = 64;
+    static const size_t WeldParallelThreshold = 64 * 1024;
+    static const float WeldMaxQuantized = float(int64(1) << 62);
+
+    static unsigned QuantizeVertex(int64 dst[], const WeldStream streams[], unsigned streamCount, size_t vertex)
+    {
+            // Calculate the quantized values for every attribute of the given unified 
+            // vertex. Two vertices will be welded if these values match exactly.
+        unsigned result = 0;
+        for (unsigned s=0; s<streamCount; ++s) {
+            const auto& stream = streams[s];
+            auto srcIndex = stream._vertexMap ? stream._vertexMap[vertex] : unsigned(vertex);
+            assert(srcIndex * stream._stride + sizeof(float) <= stream._dataSize);
+            if (stream._matchIndex)
+                dst[result++] = int64(srcIndex);
+
+            float input[4];
+            GetVertData(input, (const float*)PtrAdd(stream._data, srcIndex * stream._stride), stream._componentCount, stream._processingFlags);
+
+            for (unsigned c=0; c<4; ++c) {
+                if (stream._inverseEpsilon > 0.f) {
+                        //  NaN, infinite and very large values can't be converted to an integer.
+                        //  These only weld with exactly the same bit pattern. Offsetting by the
+                        //  minimum int64 keeps them clear of every quantized value.
+                    auto scaled = input[c] * stream._inverseEpsilon;
+                    if (!(std::abs(scaled) < WeldMaxQuantized)) {
+                        uint32 bits = 0;
+                        XlCopyMemory(&bits, &input[c], sizeof(bits));
+                        dst[result++] = std::numeric_limits<int64>::min() + int64(bits);
+                    } else
+                        dst[result++] = int64(std::floor(scaled + .5f));
+                } else {
+                    uint32 bits = 0;
+                    if (input[c] != 0.f) XlCopyMemory(&bits, &input[c], sizeof(bits));    // (treat -0.f and 0.f as equal)
+                    dst[result++] = int64(bits);
+                }
+            }
+        }
+        return result;
+    }
+
+    template<typename Fn>
+        static void ForEachRange(size_t count, bool parallel, Fn&& fn)
+    {
+            // Call "fn" for ranges that cover [0, count). When "parallel" is set, 
+            // the ranges are distributed across the long task thread pool
+        if (!parallel || count < 2) {
+            fn(size_t(0), count);
+            return;
+        }
+
+        auto& pool = ConsoleRig::GlobalServices::GetLongTaskThreadPool();
+        auto rangeCount = std::min(size_t(pool.GetWorkerThreadCount()+1) * 4, count);
+        CompletionThreadPool::TaskGroup group(pool);
+        for (size_t r=0; r<rangeCount; ++r) {
+            auto begin = count * r / rangeCount, end = count * (r+1) / rangeCount;
+            if (begin < end)
+                group.Run([&fn, begin, end]() { fn(begin, end); });
+        }
+        group.Wait();
+    }
+
+    std::vector<unsigned> MeshDatabaseAdapter::WeldVertices(const VertexWeldingConfig& cfg)
+    {
+        std::vector<unsigned> remap(_unifiedVertexCount);
+        for (size_t v=0; v<_unifiedVertexCount; ++v) remap[v] = unsigned(v);
+        if (_unifiedVertexCount < 2 || _streams.empty()) return std::move(remap);
+
+        if (_streams.size() > WeldMaxStreams) {
+            LogWarning << "Skipping vertex welding because there are too many vertex streams (" << _streams.size() << ")";
+            return std::move(remap);
+        }
+
+        WeldStream streams[WeldMaxStreams];
+        auto streamCount = unsigned(_streams.size());
+        for (unsigned s=0; s<streamCount; ++s) {
+            const auto& src = _streams[s];
+            const auto& sourceData = *src._sourceData;
+            auto format = BreakdownFormat(sourceData.GetFormat());
+            if (format.first != ComponentType::Float32) {
+                LogWarning << "Skipping vertex welding because some vertex data isn't 32 bit float";
+                return std::move(remap);
+            }
+
+            auto epsilon = cfg.GetEpsilon(src._semanticName);
+            streams[s]._data = sourceData.GetData();
+            streams[s]._stride = sourceData.GetStride();
+            streams[s]._dataSize = sourceData.GetDataSize();
+            streams[s]._componentCount = format.second;
+            streams[s]._processingFlags = sourceData.GetProcessingFlags();
+            streams[s]._vertexMap = src._vertexMap.empty() ? nullptr : AsPointer(src._vertexMap.cbegin());
+            streams[s]._inverseEpsilon = (epsilon > 0.f) ? (1.f / epsilon) : 0.f;
+                // (the first stream is treated as the position by BuildUnifiedVertexIndexToPositionIndex)
+            streams[s]._matchIndex = cfg._matchPositionIndices && (s == 0);
+        }
+
+            //  Hash the quantized attributes of every vertex
+        const bool parallel = cfg._parallel && _unifiedVertexCount >= WeldParallelThreshold;
+        std::vector<uint64> hashes(_unifiedVertexCount);
+        ForEachRange(_unifiedVertexCount, parallel,
+            [&](size_t begin, size_t end)
+            {
+                int64 quantized[WeldMaxKeyLength];
+                for (size_t v=begin; v<end; ++v) {
+                    auto count = QuantizeVertex(quantized, streams, streamCount, v);
+                    hashes[v] = Hash64(quantized, &quantized[count]);
+                }
+            });
+
+            //  Split into buckets (by the top bits of the hash), so each bucket can be
+            //  processed independently. Within each bucket, sorting brings together
+            //  vertices with the same hash value. Since each bucket is built in vertex
+            //  order, the first vertex in each run is always the lowest index.
+        std::vector<std::vector<std::pair<uint64, unsigned>>> buckets(WeldBucketCount);
+        for (auto& b:buckets) b.reserve(_unifiedVertexCount / WeldBucketCount + 1);
+        for (size_t v=0; v<_unifiedVertexCount; ++v)
+            buckets[hashes[v] >> 58].push_back(std::make_pair(hashes[v], unsigned(v)));
+
+        std::vector<unsigned> representative(_unifiedVertexCount);
+        ForEachRange(WeldBucketCount, parallel,
+            [&](size_t begin, size_t end)
+            {
+                int64 q0[WeldMaxKeyLength], q1[WeldMaxKeyLength];
+                std::vector<unsigned> runRepresentatives;
+                for (size_t b=begin; b<end; ++b) {
+                    auto& bucket = buckets[b];
+                    std::sort(bucket.begin(), bucket.end());
+                    for (auto i=bucket.cbegin(); i!=bucket.cend();) {
+                        auto runEnd = std::find_if(i, bucket.cend(), 
+                            [i](const std::pair<uint64, unsigned>& p) { return p.first != i->first; });
+
+                            // Usually every vertex in the run is identical. But we must compare
+                            // the quantized values to protect against hash collisions
+                        runRepresentatives.clear();
+                        for (; i!=runEnd; ++i) {
+                            auto count = QuantizeVertex(q0, streams, streamCount, i->second);
+                            auto r = runRepresentatives.cbegin();
+                            for (; r!=runRepresentatives.cend(); ++r) {
+                                QuantizeVertex(q1, streams, streamCount, *r);
+                                if (std::equal(q0, &q0[count], q1)) break;
+                            }
+
+                            if (r != runRepresentatives.cend()) {
+                                representative[i->second] = *r;
+                            } else {
+                                representative[i->second] = i->second;
+                                runRepresentatives.push_back(i->second);
+                            }
+                        }
+                    }
+                }
+            });
+
+            //  Build the final mapping, keeping the original order of the remaining vertices
+        unsigned newVertexCount = 0;
+        for (size_t v=0; v<_unifiedVertexCount; ++v) {
+            auto r = representative[v];
+            remap[v] = (r == v) ? (newVertexCount++) : remap[r];
+        }
+
+        if (newVertexCount == _unifiedVertexCount) return std::move(remap);
+
+        for (auto& s:_streams) {
+            std::vector<unsigned> newVertexMap(newVertexCount);
+            for (size_t v=0; v<_unifiedVertexCount; ++v)
+                if (representative[v] == v)
+                    newVertexMap[remap[v]] = s._vertexMap.empty() ? unsigned(v) : s._vertexMap[v];
+            s._vertexMap = std::move(newVertexMap);
+        }
+
+        LogInfo << "Vertex welding merged " << (_unifiedVertexCount - newVertexCount) << " of " << _unifiedVertexCount << " vertices";
+        _unifiedVertexCount = newVertexCount;
+        return std::move(remap);
+    }
+
     void    MeshDatabaseAdapter::AddStream(
         std::shared_ptr<IVertexSourceData> dataSource,
         std::vector<unsigned>&& vertexMap,
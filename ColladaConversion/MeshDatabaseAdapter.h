@@ -54,6 +54,26 @@ namespace RenderCore { namespace ColladaConversion
         const void* dataBegin, const void* dataEnd, 
         Metal::NativeFormat::Enum srcFormat);
 
+    /// <summary>Settings for MeshDatabaseAdapter::WeldVertices</summary>
+    /// Attribute values are quantized to a grid with the given epsilon before comparison.
+    /// An epsilon of zero (the default) requires an exact match.
+    ///
+    /// When "_matchPositionIndices" is set, vertices are only welded if they also share
+    /// the same source position index. Skinned geometry requires this, because the skin
+    /// influences are bound per position index (see BuildUnifiedVertexIndexToPositionIndex).
+    class VertexWeldingConfig
+    {
+    public:
+        std::vector<std::pair<std::string, float>> _semanticEpsilons;   ///< per semantic name (case insensitive)
+        float   _defaultEpsilon;
+        bool    _parallel;
+        bool    _matchPositionIndices;
+
+        float   GetEpsilon(const std::string& semantic) const;
+
+        VertexWeldingConfig() : _defaultEpsilon(0.f), _parallel(true), _matchPositionIndices(false) {}
+    };
+
     class NativeVBLayout
     {
     public:
@@ -86,6 +106,12 @@ namespace RenderCore { namespace ColladaConversion
         auto    BuildNativeVertexBuffer(const NativeVBLayout& outputLayout) const -> std::unique_ptr<uint8[]>;
         auto    BuildUnifiedVertexIndexToPositionIndex() const -> std::unique_ptr<uint32[]>;
 
+            /// <summary>Merge unified vertices with matching attribute values</summary>
+            /// Returns a remapping from old unified vertex index to new unified vertex index
+            /// (the caller must apply this to any index buffers). The first vertex in each
+            /// group of duplicates is kept, and the relative order of vertices is unchanged.
+        auto    WeldVertices(const VertexWeldingConfig& cfg) -> std::vector<unsigned>;
+
         void    AddStream(  std::shared_ptr<IVertexSourceData> dataSource,
                             std::vector<unsigned>&& vertexMap,
                             const char semantic[], unsigned semanticIndex);
@@ -373,6 +373,8 @@ namespace RenderCore { namespace ColladaConversion
         }
 
         result._localBoundingBox = boundingBox;
+        result._originalCacheMetrics = sourceGeo._originalCacheMetrics;
+        result._optimizedCacheMetrics = sourceGeo._optimizedCacheMetrics;
         return std::move(result);
     }
 
@@ -476,6 +478,8 @@ namespace RenderCore { namespace ColladaConversion
     ,       _animatedVertexBufferSize(moveFrom._animatedVertexBufferSize)
     ,       _localBoundingBox(moveFrom._localBoundingBox)
     ,       _indexFormat(moveFrom._indexFormat)
+    ,       _originalCacheMetrics(moveFrom._originalCacheMetrics)
+    ,       _optimizedCacheMetrics(moveFrom._optimizedCacheMetrics)
     {}
 
     NascentBoundSkinnedGeometry& NascentBoundSkinnedGeometry::operator=(NascentBoundSkinnedGeometry&& moveFrom)
@@ -496,6 +500,8 @@ namespace RenderCore { namespace ColladaConversion
         _animatedVertexBufferSize = moveFrom._animatedVertexBufferSize;
         _localBoundingBox = moveFrom._localBoundingBox;
         _indexFormat = moveFrom._indexFormat;
+        _originalCacheMetrics = moveFrom._originalCacheMetrics;
+        _optimizedCacheMetrics = moveFrom._optimizedCacheMetrics;
         return *this;
     }
 
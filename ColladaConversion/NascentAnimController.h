@@ -46,6 +46,9 @@ namespace RenderCore { namespace ColladaConversion
 
         std::pair<Float3, Float3>           _localBoundingBox;
 
+        VertexCacheMetrics                  _originalCacheMetrics;
+        VertexCacheMetrics                  _optimizedCacheMetrics;
+
         void    Serialize(Serialization::NascentBlockSerializer& outputSerializer, std::vector<uint8>& largeResourcesBlock) const;
 
         NascentBoundSkinnedGeometry(DynamicArray<uint8>&&   unanimatedVertexElements,
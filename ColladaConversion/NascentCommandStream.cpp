@@ -327,6 +327,32 @@ namespace RenderCore { namespace ColladaConversion
         _skinControllerInstances.emplace_back(std::move(skinControllerInstance));
     }
 
+    void NascentModelCommandStream::PadLODChains()
+    {
+        unsigned maxLOD = 0;
+        for (const auto& i:_geometryInstances)
+            maxLOD = std::max(maxLOD, i._levelOfDetail);
+        if (!maxLOD) return;
+
+        std::vector<GeometryInstance> padded;
+        padded.reserve(_geometryInstances.size());
+        for (size_t i=0; i<_geometryInstances.size();) {
+            assert(_geometryInstances[i]._levelOfDetail == 0);
+            auto chainEnd = i+1;
+            while (chainEnd < _geometryInstances.size() && _geometryInstances[chainEnd]._levelOfDetail != 0) ++chainEnd;
+
+            for (; i<chainEnd; ++i)
+                padded.push_back(std::move(_geometryInstances[i]));
+
+            const auto last = padded.size()-1;
+            for (unsigned lod=padded[last]._levelOfDetail+1; lod<=maxLOD; ++lod) {
+                auto materials = padded[last]._materials;
+                padded.push_back(GeometryInstance(padded[last]._id, padded[last]._localToWorldId, std::move(materials), lod));
+            }
+        }
+        _geometryInstances = std::move(padded);
+    }
+
     NascentModelCommandStream::NascentModelCommandStream()
     {
     }
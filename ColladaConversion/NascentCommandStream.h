@@ -196,6 +196,13 @@ namespace RenderCore { namespace ColladaConversion
         void Add(CameraInstance&& geoInstance);
         void Add(SkinControllerInstance&& geoInstance);
 
+            //  The renderer only draws the geometry instances that match the selected LOD exactly.
+            //  So every geometry instance must have an entry for every LOD up to the model's max
+            //  LOD. Geometry with a shorter LOD chain reuses its last (lowest detail) level.
+            //  Expects the instances for each LOD chain to be added consecutively, starting at LOD 0
+            //  (as returned by InstantiateGeometry)
+        void PadLODChains();
+
         bool IsEmpty() const { return _geometryInstances.empty() && _cameraInstances.empty() && _skinControllerInstances.empty(); }
         void Serialize(Serialization::NascentBlockSerializer& serializer) const;
 
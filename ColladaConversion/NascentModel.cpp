@@ -1271,7 +1271,7 @@ namespace RenderCore { namespace ColladaConversion
         size_t size = Serialization::Block_GetSize(block.get());
 
         Serialization::ChunkFile::ChunkHeader scaffoldChunk(
-            RenderCore::Assets::ChunkType_AnimationSet, 0, _name.c_str(), unsigned(size));
+            RenderCore::Assets::ChunkType_AnimationSet, RenderCore::Assets::ChunkVersion_AnimationSet, _name.c_str(), unsigned(size));
 
         NascentChunkArray result(new std::vector<NascentChunk>(), &DestroyChunkArray);
         result->push_back(NascentChunk(scaffoldChunk, std::vector<uint8>(block.get(), PtrAdd(block.get(), size))));
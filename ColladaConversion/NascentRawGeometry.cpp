@@ -75,6 +75,7 @@ namespace RenderCore { namespace ColladaConversion
     ,       _indexFormat(indexFormat)
     ,       _unifiedVertexIndexToPositionIndex(std::forward<DynamicArray<uint32>>(unifiedVertexIndexToPositionIndex))
     ,       _matBindingSymbols(std::forward<std::vector<uint64>>(matBindingSymbols))
+    ,       _simplificationError(0.f)
     {
     }
 
@@ -86,6 +87,9 @@ namespace RenderCore { namespace ColladaConversion
     ,       _mainDrawCalls(std::move(moveFrom._mainDrawCalls))
     ,       _unifiedVertexIndexToPositionIndex(std::move(moveFrom._unifiedVertexIndexToPositionIndex))
     ,       _matBindingSymbols(std::move(moveFrom._matBindingSymbols))
+    ,       _originalCacheMetrics(moveFrom._originalCacheMetrics)
+    ,       _optimizedCacheMetrics(moveFrom._optimizedCacheMetrics)
+    ,       _simplificationError(moveFrom._simplificationError)
     {
     }
 
@@ -98,6 +102,9 @@ namespace RenderCore { namespace ColladaConversion
         _mainDrawCalls = std::move(moveFrom._mainDrawCalls);
         _unifiedVertexIndexToPositionIndex = std::move(moveFrom._unifiedVertexIndexToPositionIndex);
         _matBindingSymbols = std::move(moveFrom._matBindingSymbols);
+        _originalCacheMetrics = moveFrom._originalCacheMetrics;
+        _optimizedCacheMetrics = moveFrom._optimizedCacheMetrics;
+        _simplificationError = moveFrom._simplificationError;
         return *this;
     }
 
@@ -105,6 +112,7 @@ namespace RenderCore { namespace ColladaConversion
     : _vertices(nullptr, 0)
     , _indices(nullptr, 0)
     , _unifiedVertexIndexToPositionIndex(nullptr, 0)
+    , _simplificationError(0.f)
     {
         _indexFormat = Metal::NativeFormat::Unknown;
     }
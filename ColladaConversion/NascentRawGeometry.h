@@ -9,6 +9,7 @@
 #include "../RenderCore/Metal/Format.h"
 #include "../RenderCore/Metal/InputLayout.h"
 #include "../RenderCore/Metal/DeviceContext.h"  // for topology
+#include "GeometryAlgorithm.h"                  // for VertexCacheMetrics
 #include <vector>
 
 namespace Serialization { class NascentBlockSerializer; }
@@ -71,6 +72,15 @@ namespace RenderCore { namespace ColladaConversion
         std::vector<NascentDrawCallDesc>    _mainDrawCalls;
         std::vector<uint64>                 _matBindingSymbols;
 
+            //  Vertex cache statistics before and after optimisation
+            //  (only filled in when the vertex cache optimisation stage is enabled)
+        VertexCacheMetrics                  _originalCacheMetrics;
+        VertexCacheMetrics                  _optimizedCacheMetrics;
+
+            //  Largest object space error introduced by simplification (zero for
+            //  geometry that hasn't been simplified; see SimplifyTriangleList)
+        float                               _simplificationError;
+
             //  Only required during processing
         DynamicArray<uint32>    _unifiedVertexIndexToPositionIndex;
 
@@ -184,7 +184,12 @@ namespace RenderCore { namespace ColladaConversion
         return std::move(materialGuids);
     }
 
-    NascentModelCommandStream::GeometryInstance InstantiateGeometry(
+    static ObjectGuid LODGeoGuid(ObjectGuid lod0Guid, unsigned lod)
+    {
+        return ObjectGuid(HashCombine(lod0Guid._objectId, lod), lod0Guid._fileId);
+    }
+
+    std::vector<NascentModelCommandStream::GeometryInstance> InstantiateGeometry(
         const ::ColladaConversion::InstanceGeometry& instGeo,
         const ::ColladaConversion::Node& attachedNode,
         const URIResolveContext& resolveContext,
@@ -200,8 +205,13 @@ namespace RenderCore { namespace ColladaConversion
             if (!scaffoldGeo)
                 Throw(::Assets::Exceptions::FormatError("Could not found geometry object to instantiate (%s)",
                     AsString(instGeo._reference).c_str()));
-            objects._rawGeos.push_back(std::make_pair(geoId, Convert(*scaffoldGeo, resolveContext, cfg)));
+
+                // Lower LODs are stored as separate raw geometry objects, with guids derived from the LOD 0 guid
+            std::vector<NascentRawGeometry> lodChain;
+            objects._rawGeos.push_back(std::make_pair(geoId, Convert(*scaffoldGeo, resolveContext, cfg, &lodChain)));
             geo = (unsigned)(objects._rawGeos.size()-1);
+            for (unsigned c=0; c<lodChain.size(); ++c)
+                objects._rawGeos.push_back(std::make_pair(LODGeoGuid(geoId, c+1), std::move(lodChain[c])));
         }
 
         auto materials = BuildMaterialTable(
@@ -211,8 +221,18 @@ namespace RenderCore { namespace ColladaConversion
         auto bindingMatIndex = nodeRefs.GetOutputMatrixIndex(AsObjectGuid(attachedNode));
         nodeRefs.TryRegisterNode(AsObjectGuid(attachedNode), SkeletonBindingName(attachedNode).c_str());
 
-        return NascentModelCommandStream::GeometryInstance(
-            geo, bindingMatIndex, std::move(materials), 0);
+            // (all LODs share the same material binding symbols, so they can share the material table)
+        std::vector<NascentModelCommandStream::GeometryInstance> result;
+        for (unsigned lod=1;; ++lod) {
+            auto lodGeo = objects.GetGeo(LODGeoGuid(geoId, lod));
+            if (lodGeo == ~unsigned(0x0)) break;
+            auto lodMaterials = materials;
+            result.push_back(NascentModelCommandStream::GeometryInstance(
+                lodGeo, bindingMatIndex, std::move(lodMaterials), lod));
+        }
+        result.insert(result.begin(), NascentModelCommandStream::GeometryInstance(
+            geo, bindingMatIndex, std::move(materials), 0));
+        return std::move(result);
     }
 
     DynamicArray<uint16> BuildJointArray(
@@ -282,18 +302,21 @@ namespace RenderCore { namespace ColladaConversion
             // If the the raw geometry object is already converted, then we should use it. Otherwise
             // we need to do the conversion (but store it only in a temporary -- we don't need to
             // write it to disk)
+            // When welding is enabled, the existing conversion may have merged vertices with
+            // different position indices (and so different skin weights). In that case we must
+            // convert again, preserving position indices.
         NascentRawGeometry* source = nullptr;
         NascentRawGeometry tempBuffer;
         {
             auto geo = objects.GetGeo(controller._sourceRef);
-            if (geo == ~unsigned(0x0)) {
+            if (geo == ~unsigned(0x0) || cfg.GetWeldVertices()) {
                 auto* scaffoldGeo = FindElement(
                     GuidReference(controller._sourceRef._objectId, controller._sourceRef._fileId),
                     resolveContext, &IDocScopeIdResolver::FindMeshGeometry);
                 if (!scaffoldGeo)
                     Throw(::Assets::Exceptions::FormatError("Could not find geometry object to instantiate (%s)",
                         AsString(instGeo._reference).c_str()));
-                tempBuffer = Convert(*scaffoldGeo, resolveContext, cfg);
+                tempBuffer = Convert(*scaffoldGeo, resolveContext, cfg, nullptr, true);
                 source = &tempBuffer;
             } else {
                 source = &objects._rawGeos[geo].second;
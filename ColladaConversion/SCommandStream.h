@@ -42,7 +42,8 @@ namespace RenderCore { namespace ColladaConversion
             );
     };
 
-    NascentModelCommandStream::GeometryInstance InstantiateGeometry(
+        //  Returns one instance for each level of detail (see ImportConfiguration::GetLODChainConfig)
+    std::vector<NascentModelCommandStream::GeometryInstance> InstantiateGeometry(
         const ::ColladaConversion::InstanceGeometry& instGeo,
         const ::ColladaConversion::Node& attachedNode,
         const ::ColladaConversion::URIResolveContext& resolveContext,
@@ -538,10 +538,215 @@ namespace ColladaConversion
         return std::move(drawCall);
     }
 
+    static VertexCacheMetrics CalculateVertexCacheMetrics(
+        const std::vector<WorkingDrawOperation>& drawOperations, 
+        size_t vertexCount, unsigned cacheSize)
+    {
+            // Metrics for all draw calls together (ie, assuming they are drawn one after
+            // another, with the cache carrying over)
+        std::vector<unsigned> allIndices;
+        for (const auto& d:drawOperations)
+            if (d._topology == Metal::Topology::TriangleList)
+                allIndices.insert(allIndices.end(), d._indexBuffer.begin(), d._indexBuffer.end());
+        return RenderCore::ColladaConversion::CalculateVertexCacheMetrics(
+            AsPointer(allIndices.cbegin()), allIndices.size(), vertexCount, cacheSize);
+    }
+
+    template<typename IndexType>
+        static void RemapIndices(IndexType indices[], size_t indexCount, const unsigned remap[])
+    {
+        for (size_t c=0; c<indexCount; ++c)
+            indices[c] = IndexType(remap[indices[c]]);
+    }
+
+    static void ReorderVertices(
+        uint8 vb[], size_t vertexStride, uint32 unifiedVertexIndexToPositionIndex[],
+        uint8 ib[], size_t indexCount, Metal::NativeFormat::Enum indexFormat,
+        const unsigned remap[], size_t vertexCount)
+    {
+            // Move each vertex to the position given by "remap" (and update the index buffer to match)
+        auto newVB = std::make_unique<uint8[]>(vertexStride * vertexCount);
+        std::vector<uint32> newPositionIndices(vertexCount);
+        for (size_t v=0; v<vertexCount; ++v) {
+            assert(remap[v] < vertexCount);
+            XlCopyMemory(&newVB[remap[v] * vertexStride], &vb[v * vertexStride], vertexStride);
+            newPositionIndices[remap[v]] = unifiedVertexIndexToPositionIndex[v];
+        }
+        XlCopyMemory(vb, newVB.get(), vertexStride * vertexCount);
+        std::copy(newPositionIndices.begin(), newPositionIndices.end(), unifiedVertexIndexToPositionIndex);
+
+        if (indexFormat == Metal::NativeFormat::R16_UINT) {
+            RemapIndices((uint16*)ib, indexCount, remap);
+        } else {
+            assert(indexFormat == Metal::NativeFormat::R32_UINT);
+            RemapIndices((uint32*)ib, indexCount, remap);
+        }
+    }
+
+    class WorkingLOD
+    {
+    public:
+        std::vector<std::vector<unsigned>>  _drawOperationIndices;  // (parallel to the draw operations for LOD 0)
+        float                               _error;
+    };
+
+    static std::vector<WorkingLOD> BuildLODChain(
+        const MeshDatabaseAdapter& database,
+        const std::vector<WorkingDrawOperation>& drawOperations,
+        const LODChainConfig& cfg)
+    {
+        std::vector<WorkingLOD> result;
+        auto posElement = database.FindElement("POSITION");
+        if (posElement == ~0u) return result;
+
+        const auto vertexCount = database._unifiedVertexCount;
+        std::vector<Float3> positions(vertexCount);
+        Float3 mins(FLT_MAX, FLT_MAX, FLT_MAX), maxs(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (size_t v=0; v<vertexCount; ++v) {
+            positions[v] = database.GetUnifiedElement<Float3>(v, posElement);
+            for (unsigned c=0; c<3; ++c) {
+                mins[c] = std::min(mins[c], positions[v][c]);
+                maxs[c] = std::max(maxs[c], positions[v][c]);
+            }
+        }
+        auto radius = .5f * Magnitude(maxs - mins);
+        if (!(radius > 0.f)) return result;
+
+            //  Normals & texture coordinates contribute to the collapse cost (so we avoid collapsing
+            //  across creases and UV distortions). The attribute error is scaled by the radius, so it
+            //  can be compared to the geometric error.
+        auto normalElement = database.FindElement("NORMAL");
+        auto texCoordElement = database.FindElement("TEXCOORD");
+        unsigned attributesPerVertex = ((normalElement != ~0u) ? 3 : 0) + ((texCoordElement != ~0u) ? 2 : 0);
+        std::vector<float> attributes(vertexCount * attributesPerVertex);
+        for (size_t v=0; v<vertexCount; ++v) {
+            auto* a = &attributes[v * attributesPerVertex];
+            if (normalElement != ~0u) {
+                auto n = database.GetUnifiedElement<Float3>(v, normalElement);
+                *a++ = n[0]; *a++ = n[1]; *a++ = n[2];
+            }
+            if (texCoordElement != ~0u) {
+                auto tc = database.GetUnifiedElement<Float2>(v, texCoordElement);
+                *a++ = tc[0]; *a++ = tc[1];
+            }
+        }
+        const float attributeWeight = cfg._attributeWeight * radius * radius;
+
+        std::vector<std::vector<unsigned>> current;
+        size_t previousIndexCount = 0;
+        for (const auto& d:drawOperations) {
+            assert(d._topology == Metal::Topology::TriangleList);
+            current.push_back(d._indexBuffer);
+            previousIndexCount += d._indexBuffer.size();
+        }
+
+        const float maxError = cfg._maxError * radius;
+        float accumulatedError = 0.f;
+        for (unsigned lod=1; lod<=cfg._lodCount; ++lod) {
+                // each LOD is simplified from the previous one, so the errors accumulate
+            float lodError = 0.f;
+            size_t indexCount = 0;
+            for (auto& indices:current) {
+                auto target = size_t(float(indices.size()/3) * cfg._reduction) * 3;
+                lodError = std::max(lodError, SimplifyTriangleList(
+                    indices, AsPointer(positions.cbegin()), vertexCount,
+                    attributes.empty() ? nullptr : AsPointer(attributes.cbegin()), attributesPerVertex, attributeWeight,
+                    target, maxError - accumulatedError));
+                indexCount += indices.size();
+            }
+
+                // stop when simplification is no longer making much progress (we've hit the error limit)
+            if (!indexCount || indexCount * 10 > previousIndexCount * 9) break;
+
+            accumulatedError += lodError;
+            previousIndexCount = indexCount;
+
+            WorkingLOD workingLOD;
+            workingLOD._drawOperationIndices = current;
+            workingLOD._error = accumulatedError;
+            result.push_back(std::move(workingLOD));
+        }
+
+        return std::move(result);
+    }
+
+    static NascentRawGeometry BuildLODGeometry(
+        const WorkingLOD& lod,
+        const std::vector<WorkingDrawOperation>& drawOperations,
+        const std::set<uint64>& matBindingSymbols,
+        const uint8 vb[], const NativeVBLayout& vbLayout,
+        const uint32 unifiedVertexIndexToPositionIndex[],
+        const unsigned vertexFetchRemap[], size_t vertexCount,
+        unsigned vertexCacheSize)
+    {
+            //  The LOD uses a subset of the vertices from LOD 0. Build a compacted vertex buffer
+            //  containing just those vertices (in the order they are first used)
+        std::vector<std::vector<unsigned>> indices = lod._drawOperationIndices;
+        std::vector<unsigned> compaction(vertexCount, ~0u);
+        unsigned lodVertexCount = 0;
+        size_t indexCount = 0;
+        for (auto& d:indices) {
+            if (vertexFetchRemap)
+                for (auto& i:d) i = vertexFetchRemap[i];
+            if (vertexCacheSize)
+                OptimizeVertexCache(AsPointer(d.begin()), d.size(), vertexCount, vertexCacheSize);
+            for (auto& i:d) {
+                if (compaction[i] == ~0u) compaction[i] = lodVertexCount++;
+                i = compaction[i];
+            }
+            indexCount += d.size();
+        }
+
+        const auto stride = vbLayout._vertexStride;
+        auto lodVB = std::make_unique<uint8[]>(stride * lodVertexCount);
+        auto lodPositionIndices = std::make_unique<uint32[]>(lodVertexCount);
+        for (size_t v=0; v<vertexCount; ++v) {
+            if (compaction[v] == ~0u) continue;
+            XlCopyMemory(&lodVB[compaction[v] * stride], &vb[v * stride], stride);
+            lodPositionIndices[compaction[v]] = unifiedVertexIndexToPositionIndex[v];
+        }
+
+            // (the index format depends on the number of vertices referenced, not the number of indices)
+        auto indexFormat = (lodVertexCount <= 0xffff) ? Metal::NativeFormat::R16_UINT : Metal::NativeFormat::R32_UINT;
+        auto indexSize = (indexFormat == Metal::NativeFormat::R16_UINT) ? sizeof(uint16) : sizeof(uint32);
+        auto lodIB = std::make_unique<uint8[]>(indexCount * indexSize);
+
+        std::vector<NascentDrawCallDesc> drawCalls;
+        size_t firstIndex = 0;
+        for (size_t d=0; d<indices.size(); ++d) {
+            if (indices[d].empty()) continue;
+            if (indexFormat == Metal::NativeFormat::R16_UINT) {
+                std::copy(indices[d].begin(), indices[d].end(), &((uint16*)lodIB.get())[firstIndex]);
+            } else {
+                std::copy(indices[d].begin(), indices[d].end(), &((uint32*)lodIB.get())[firstIndex]);
+            }
+            drawCalls.push_back(
+                NascentDrawCallDesc(
+                    (unsigned)firstIndex, (unsigned)indices[d].size(), 0,
+                    (unsigned)std::distance(matBindingSymbols.begin(), matBindingSymbols.find(drawOperations[d]._materialBinding)),
+                    drawOperations[d]._topology));
+            firstIndex += indices[d].size();
+        }
+
+        auto elements = vbLayout._elements;
+        NascentRawGeometry result(
+            DynamicArray<uint8>(std::move(lodVB), stride * lodVertexCount),
+            DynamicArray<uint8>(std::move(lodIB), indexCount * indexSize),
+            GeometryInputAssembly(std::move(elements), stride),
+            indexFormat,
+            std::move(drawCalls),
+            DynamicArray<uint32>(std::move(lodPositionIndices), lodVertexCount),
+            std::vector<uint64>(matBindingSymbols.cbegin(), matBindingSymbols.cend()));
+        result._simplificationError = lod._error;
+        return std::move(result);
+    }
+
     NascentRawGeometry Convert(
         const MeshGeometry& mesh, 
         const URIResolveContext& pubEles, 
-        const ImportConfiguration& cfg)
+        const ImportConfiguration& cfg,
+        std::vector<NascentRawGeometry>* lodChain,
+        bool forSkinning)
     {
             // some exports can have empty meshes -- ideally, we just want to ignore them
         if (!mesh.GetPrimitivesCount()) return NascentRawGeometry();
@@ -732,6 +937,46 @@ namespace ColladaConversion
 
         auto database = BuildMeshDatabaseAdapter(composingVertex, composingUnified);
 
+            //
+            //      Optionally merge unified vertices that have the same attribute values
+            //      (the Collada indices can be different even when the values are identical)
+            //
+        if (cfg.GetWeldVertices()) {
+            auto weldingConfig = cfg.GetVertexWeldingConfig();
+            weldingConfig._matchPositionIndices |= forSkinning;
+            auto remap = database->WeldVertices(weldingConfig);
+            for (auto& d:drawOperations)
+                for (auto& i:d._indexBuffer)
+                    i = remap[i];
+        }
+
+            //
+            //      Optionally generate simplified versions of the triangle lists for lower LODs. 
+            //      These share the vertices of LOD 0 (but each LOD gets its own compacted copy
+            //      of the vertex buffer, below)
+            //      Skinned geometry is only ever drawn at LOD 0, so we don't build LODs for it.
+            //
+        std::vector<WorkingLOD> workingLODs;
+        if (lodChain && !forSkinning && cfg.GetLODChainConfig()._lodCount)
+            workingLODs = BuildLODChain(*database, drawOperations, cfg.GetLODChainConfig());
+
+            //
+            //      Optionally reorder the triangles within each draw call for the post transform
+            //      vertex cache. We reorder vertices to match (for vertex fetch locality) after
+            //      the vertex buffer has been built, below.
+            //
+        VertexCacheMetrics originalCacheMetrics, optimizedCacheMetrics;
+        const auto vertexCacheSize = cfg.GetVertexCacheSize();
+        if (vertexCacheSize) {
+            originalCacheMetrics = CalculateVertexCacheMetrics(drawOperations, database->_unifiedVertexCount, vertexCacheSize);
+            for (auto& d:drawOperations)
+                if (d._topology == Metal::Topology::TriangleList)
+                    OptimizeVertexCache(
+                        AsPointer(d._indexBuffer.begin()), d._indexBuffer.size(), 
+                        database->_unifiedVertexCount, vertexCacheSize);
+            optimizedCacheMetrics = CalculateVertexCacheMetrics(drawOperations, database->_unifiedVertexCount, vertexCacheSize);
+        }
+
             //
             //      Write data into the index buffer. Note we can select 16 bit or 32 bit index buffer
             //      here. Most of the time 16 bit should be enough (but sometimes we need 32 bits)
@@ -814,6 +1059,39 @@ namespace ColladaConversion
             // note -- this should actually be the mapping onto the input with the semantic "VERTEX" in the primitives' input array
         auto unifiedVertexIndexToPositionIndex = database->BuildUnifiedVertexIndexToPositionIndex();
 
+        std::vector<unsigned> vertexFetchRemap;
+        if (vertexCacheSize) {
+            std::vector<unsigned> allIndices;
+            allIndices.reserve(finalIndexCount);
+            for (const auto& d:drawOperations)
+                allIndices.insert(allIndices.end(), d._indexBuffer.begin(), d._indexBuffer.end());
+
+            vertexFetchRemap = BuildVertexFetchRemap(AsPointer(allIndices.cbegin()), allIndices.size(), database->_unifiedVertexCount);
+            ReorderVertices(
+                nativeVB.get(), vbLayout._vertexStride, unifiedVertexIndexToPositionIndex.get(), 
+                finalIndexBuffer.get(), finalIndexCount, indexFormat,
+                AsPointer(vertexFetchRemap.cbegin()), database->_unifiedVertexCount);
+
+            LogInfo 
+                << "Vertex cache optimisation for (" << mesh.GetName() << "): ACMR " 
+                << originalCacheMetrics._acmr << " -> " << optimizedCacheMetrics._acmr << ", ATVR " 
+                << originalCacheMetrics._atvr << " -> " << optimizedCacheMetrics._atvr;
+        }
+
+        for (const auto& l:workingLODs) {
+            lodChain->push_back(
+                BuildLODGeometry(
+                    l, drawOperations, matBindingSymbols,
+                    nativeVB.get(), vbLayout, unifiedVertexIndexToPositionIndex.get(),
+                    vertexFetchRemap.empty() ? nullptr : AsPointer(vertexFetchRemap.cbegin()),
+                    database->_unifiedVertexCount, vertexCacheSize));
+
+            const auto& g = lodChain->back();
+            LogInfo 
+                << "Generated LOD " << lodChain->size() << " for (" << mesh.GetName() << "): " 
+                << g._vertices.size() / g._mainDrawInputAssembly._vertexStride << " vertices, error " << g._simplificationError;
+        }
+
             //
             //      We've built everything:
             //          vertex buffer
@@ -824,7 +1102,7 @@ namespace ColladaConversion
             //      Create the final RawGeometry object with all this stuff
             //
 
-        return NascentRawGeometry(
+        NascentRawGeometry result(
             DynamicArray<uint8>(std::move(nativeVB), vbLayout._vertexStride * database->_unifiedVertexCount), 
             DynamicArray<uint8>(std::move(finalIndexBuffer), finalIndexBufferSize),
             GeometryInputAssembly(std::move(vbLayout._elements), (unsigned)vbLayout._vertexStride),
@@ -832,6 +1110,9 @@ namespace ColladaConversion
             std::move(finalDrawOperations),
             DynamicArray<uint32>(std::move(unifiedVertexIndexToPositionIndex), database->_unifiedVertexCount),
             std::vector<uint64>(matBindingSymbols.cbegin(), matBindingSymbols.cend()));
+        result._originalCacheMetrics = originalCacheMetrics;
+        result._optimizedCacheMetrics = optimizedCacheMetrics;
+        return std::move(result);
     }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -6,6 +6,8 @@
 
 #pragma once
 
+#include <vector>
+
 namespace RenderCore { namespace ColladaConversion
 {
     class NascentRawGeometry;
@@ -19,7 +21,14 @@ namespace ColladaConversion
     class SkinController;
     class URIResolveContext;
 
-    auto Convert(const MeshGeometry& mesh, const URIResolveContext& pubEles, const RenderCore::ColladaConversion::ImportConfiguration& cfg)
+        //  When "lodChain" is given, simplified versions of the geometry are appended to it
+        //  (for LOD 1 upwards), as configured by ImportConfiguration::GetLODChainConfig()
+        //  Set "forSkinning" when the result will be bound to a skin controller. Vertex welding 
+        //  must then preserve the source position indices (which the skin weights refer to)
+    auto Convert(
+        const MeshGeometry& mesh, const URIResolveContext& pubEles, const RenderCore::ColladaConversion::ImportConfiguration& cfg,
+        std::vector<RenderCore::ColladaConversion::NascentRawGeometry>* lodChain = nullptr,
+        bool forSkinning = false)
         -> RenderCore::ColladaConversion::NascentRawGeometry;
 
     auto Convert(const SkinController& controller, const URIResolveContext& pubEles, const RenderCore::ColladaConversion::ImportConfiguration& cfg)
@@ -5,8 +5,11 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "ScaffoldParsingUtil.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include "../Utility/ArithmeticUtils.h"
 #include "../Math/Math.h"
+#include <intrin.h>
 
 namespace ColladaConversion
 {
@@ -60,6 +63,115 @@ namespace ColladaConversion
         return chr == 0x20 || chr == 0x9 || chr == 0xD || chr == 0xA;
     }
 
+        ////////////////////////////////////////////////////////////////////////////////////////////
+            //  SSE helpers for scanning numeric lists.
+            //  Note that (like ProjectionMath) we're assuming SSE4.1 is available
+    
+    static __forceinline unsigned WhitespaceMask16(const utf8* start)
+    {
+            // returns a bit mask with one bit for each of the 16 characters at "start"
+            // (set when the character is whitespace)
+        auto chars = _mm_loadu_si128((const __m128i*)start);
+        auto ws = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(0x20)), _mm_cmpeq_epi8(chars, _mm_set1_epi8(0x9))),
+            _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(0xD)), _mm_cmpeq_epi8(chars, _mm_set1_epi8(0xA))));
+        return unsigned(_mm_movemask_epi8(ws));
+    }
+
+    template<typename CharType>
+        const CharType* SkipWhitespace(const CharType* start, const CharType* end)
+    {
+            // Elements in most lists are separated by a single space, so check the
+            // first character before doing anything more expensive
+        if (start >= end || !IsWhitespace(*start)) return start;
+        ++start;
+
+        if (constant_expression<sizeof(CharType)==1>::result()) {
+            while ((end - start) >= 16) {
+                auto nonWhitespace = ~WhitespaceMask16((const utf8*)start) & 0xffff;
+                if (nonWhitespace) return start + xl_ctz4(nonWhitespace);
+                start += 16;
+            }
+        }
+
+        while (start < end && IsWhitespace(*start)) ++start;
+        return start;
+    }
+
+        //  Row N of this table will shuffle the first N bytes of a register so that
+        //  they are right aligned (and set all other bytes to zero)
+    static const uint8 s_rightAlignShuffles[16][16] = 
+        {
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09 },
+            { 0x80, 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a },
+            { 0x80, 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b },
+            { 0x80, 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c },
+            { 0x80, 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d },
+            { 0x80, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e }
+        };
+
+    static __forceinline bool FastParseDigits_SSE(uint64& dst, const utf8*& iterator, const utf8* end)
+    {
+            // Parse a run of up to 15 decimal digits, 16 characters at a time.
+            // We need at least 16 readable characters, and the run must end within those
+            // 16 characters (otherwise we return false, and the caller should use the scalar path)
+        if ((end - iterator) < 16) return false;
+
+        auto chars = _mm_loadu_si128((const __m128i*)iterator);
+        auto digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+        auto isDigit = _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+        auto nonDigits = ~unsigned(_mm_movemask_epi8(isDigit)) & 0xffff;
+        if (!nonDigits) return false;
+        auto length = xl_ctz4(nonDigits);
+
+            // Right align the digits, and then combine adjacent pairs, then 
+            // groups of 4, then groups of 8. We end up with 2 32 bit values, each
+            // containing 8 digits.
+        auto aligned = _mm_shuffle_epi8(digits, _mm_loadu_si128((const __m128i*)s_rightAlignShuffles[length]));
+        auto pairs = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+        auto quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+        auto packed = _mm_packus_epi32(quads, quads);
+        auto octs = _mm_madd_epi16(packed, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+
+        auto high = uint64(uint32(_mm_cvtsi128_si32(octs)));
+        auto low = uint64(uint32(_mm_extract_epi32(octs, 1)));
+        dst = high * 100000000ull + low;
+        iterator += length;
+        return true;
+    }
+
+    static unsigned CountElements(const utf8* start, const utf8* end)
+    {
+            // Count the transitions from whitespace to non-whitespace. The character before
+            // "start" is treated as whitespace
+        unsigned count = 0;
+        unsigned previousIsWhitespace = 1;
+        while ((end - start) >= 16) {
+            auto ws = WhitespaceMask16(start);
+            auto elementStarts = ~ws & ((ws << 1) | previousIsWhitespace) & 0xffff;
+            while (elementStarts) { elementStarts &= elementStarts - 1; ++count; }
+            previousIsWhitespace = (ws >> 15) & 1;
+            start += 16;
+        }
+
+        for (; start < end; ++start) {
+            unsigned ws = IsWhitespace(*start);
+            count += (~ws & previousIsWhitespace) & 1;
+            previousIsWhitespace = ws;
+        }
+        return count;
+    }
+
     template<typename CharType>
         const CharType* FastParseElement(int64& dst, const CharType* start, const CharType* end)
     {
@@ -85,6 +197,12 @@ namespace ColladaConversion
     template<typename CharType>
         const CharType* FastParseElement(uint64& dst, const CharType* start, const CharType* end)
     {
+        if (constant_expression<sizeof(CharType)==1>::result()) {
+            auto* i = (const utf8*)start;
+            if (FastParseDigits_SSE(dst, i, (const utf8*)end))
+                return (const CharType*)i;
+        }
+
         uint64 result = 0;
         for (;;) {
             if (start >= end) break;
@@ -100,6 +218,15 @@ namespace ColladaConversion
     template<typename CharType>
         const CharType* FastParseElement(uint32& dst, const CharType* start, const CharType* end)
     {
+        if (constant_expression<sizeof(CharType)==1>::result()) {
+            auto* i = (const utf8*)start;
+            uint64 result64;
+            if (FastParseDigits_SSE(result64, i, (const utf8*)end)) {
+                dst = uint32(result64);
+                return (const CharType*)i;
+            }
+        }
+
         uint32 result = 0;
         for (;;) {
             if (start >= end) break;
@@ -118,6 +245,30 @@ namespace ColladaConversion
             return (shift < 0) ? (input << (-shift)) : (input >> shift);
         }
 
+        //  This table is built during static initialisation, so it's ready before
+        //  any thread might start parsing (see ParallelParseXMLList)
+    class ExponentTableType
+    {
+    public:
+        static const int32 Bias = 40;
+        std::tuple<int32, uint64, double> _table[32];
+
+        ExponentTableType()
+        {
+            for (unsigned c=0; c<dimof(_table); ++c) {
+                auto temp = std::log2(10.);
+                auto base2Exp = -double(c) * temp;
+                auto integerBase2Exp = std::ceil(base2Exp); // - .5);
+                auto fractBase2Exp = base2Exp - integerBase2Exp;
+                assert(fractBase2Exp <= 0.f);   // (std::powf(2.f, fractBase2Exp) must be smaller than 1 for precision reasons)
+                auto multiplier = uint64(std::exp2(fractBase2Exp + Bias));
+
+                _table[c] = std::make_tuple(int32(integerBase2Exp), multiplier, fractBase2Exp);
+            }
+        }
+    };
+    static ExponentTableType s_exponentTable;
+
     template<typename CharType>
         const CharType* ExperimentalFloatParser(float& dst, const CharType* start, const CharType* end)
     {
@@ -174,22 +325,8 @@ namespace ColladaConversion
         } else result = 0;
 
         if (afterPoint) {
-            static std::tuple<int32, uint64, double> ExponentTable[32];
-            static bool ExponentTableBuilt = false;
-            int32 bias = 40;
-            if (!ExponentTableBuilt) {
-                for (unsigned c=0; c<dimof(ExponentTable); ++c) {
-                    auto temp = std::log2(10.);
-                    auto base2Exp = -double(c) * temp;
-                    auto integerBase2Exp = std::ceil(base2Exp); // - .5);
-                    auto fractBase2Exp = base2Exp - integerBase2Exp;
-                    assert(fractBase2Exp <= 0.f);   // (std::powf(2.f, fractBase2Exp) must be smaller than 1 for precision reasons)
-                    auto multiplier = uint64(std::exp2(fractBase2Exp + bias));
-
-                    ExponentTable[c] = std::make_tuple(int32(integerBase2Exp), multiplier, fractBase2Exp);
-                }
-                ExponentTableBuilt = true;
-            }
+            const auto& ExponentTable = s_exponentTable._table;
+            int32 bias = ExponentTableType::Bias;
 
             const int32 idealBias = (int32)xl_clz8(afterPoint);
 
@@ -286,7 +423,115 @@ namespace ColladaConversion
         return newEnd;
     }
 
+        ////////////////////////////////////////////////////////////////////////////////////////////
+
+        //  We decide based on the number of elements requested, not the size of the section. 
+        //  Callers often pass a section that runs to the end of a much larger list, and read 
+        //  only a few elements from the front of it (eg, each polygon in a <polylist>)
+    static const unsigned ParallelParseMinimumElements = 128 * 1024;
+    static const size_t ParallelParseChunkBytes = 256 * 1024;
+
+    template<typename Type>
+        static bool ParallelParseXMLListInternal(
+            Type dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, 
+            unsigned* outEleCount, const utf8*& result)
+    {
+        assert(destCount > 0);
+        if (destCount < ParallelParseMinimumElements) return false;
+        auto byteCount = size_t(section._end - section._start);
+
+        auto& pool = ConsoleRig::GlobalServices::GetLongTaskThreadPool();
+        auto chunkCount = (unsigned)std::min(
+            size_t(pool.GetWorkerThreadCount()+1) * 4,
+            (byteCount + ParallelParseChunkBytes - 1) / ParallelParseChunkBytes);
+        if (chunkCount < 2) return false;
+
+            // Split into chunks of roughly equal size. Each boundary is moved forward
+            // onto whitespace, so an element is never split between chunks.
+        std::vector<const utf8*> boundaries(chunkCount+1);
+        boundaries[0] = section._start;
+        boundaries[chunkCount] = section._end;
+        for (unsigned c=1; c<chunkCount; ++c) {
+            auto* b = std::max(boundaries[c-1], section._start + byteCount * c / chunkCount);
+            while (b < section._end && !IsWhitespace(*b)) ++b;
+            boundaries[c] = b;
+        }
+
+            // Count the elements in each chunk, so we know where each chunk's
+            // elements will go in the destination array
+        std::vector<unsigned> counts(chunkCount, 0);
+        {
+            CompletionThreadPool::TaskGroup group(pool);
+            for (unsigned c=0; c<chunkCount; ++c)
+                group.Run([&counts, &boundaries, c]() { counts[c] = CountElements(boundaries[c], boundaries[c+1]); });
+            group.Wait();
+        }
+
+        std::vector<unsigned> offsets(chunkCount, 0);
+        unsigned usedChunks = 0;
+        for (unsigned c=0, offset=0; c<chunkCount && offset<destCount; ++c) {
+            offsets[c] = offset;
+            offset += counts[c];
+            ++usedChunks;
+        }
+
+            // Parse each chunk directly into the destination
+        std::vector<unsigned> parsedCounts(usedChunks, 0);
+        std::vector<const utf8*> ends(usedChunks, nullptr);
+        {
+            CompletionThreadPool::TaskGroup group(pool);
+            for (unsigned c=0; c<usedChunks; ++c)
+                group.Run(
+                    [&, c]()
+                    {
+                        auto count = std::min(counts[c], destCount - offsets[c]);
+                        XmlInputStreamFormatter<utf8>::InteriorSection chunk(boundaries[c], boundaries[c+1]);
+                        if (count) {
+                            ends[c] = ParseXMLListSequential(&dest[offsets[c]], count, chunk, &parsedCounts[c]);
+                        } else {
+                            ends[c] = SkipWhitespace(chunk._start, chunk._end);
+                        }
+                    });
+            group.Wait();
+        }
+
+            // Combine the results. If parsing stopped early in any chunk (because of a bad
+            // element), then we stop there, just as the sequential parse would.
+        unsigned elementCount = 0;
+        result = section._start;
+        bool complete = true;
+        for (unsigned c=0; c<usedChunks; ++c) {
+            auto expected = std::min(counts[c], destCount - offsets[c]);
+            elementCount += parsedCounts[c];
+            result = ends[c];
+            if (parsedCounts[c] < expected || (expected == counts[c] && ends[c] != boundaries[c+1])) {
+                complete = false;
+                break;
+            }
+        }
+        if (complete)
+            result = SkipWhitespace(result, section._end);
+
+        if (outEleCount) *outEleCount = elementCount;
+        return true;
+    }
+
+    bool ParallelParseXMLList(
+        float dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, 
+        unsigned* outEleCount, const utf8*& result)
+    {
+        return ParallelParseXMLListInternal(dest, destCount, section, outEleCount, result);
+    }
+
+    bool ParallelParseXMLList(
+        uint32 dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, 
+        unsigned* outEleCount, const utf8*& result)
+    {
+        return ParallelParseXMLListInternal(dest, destCount, section, outEleCount, result);
+    }
+
     template bool IsWhitespace(utf8 chr);
+    template const utf8* SkipWhitespace(const utf8* start, const utf8* end);
     template const utf8* FastParseElement(int64& dst, const utf8* start, const utf8* end);
     template const utf8* FastParseElement(uint64& dst, const utf8* start, const utf8* end);
     template const utf8* FastParseElement(uint32& dst, const utf8* start, const utf8* end);
@@ -27,13 +27,35 @@ namespace ColladaConversion
     }
 
     template<typename CharType> bool IsWhitespace(CharType chr);
+    template<typename CharType> const CharType* SkipWhitespace(const CharType* start, const CharType* end);
     template<typename CharType> const CharType* FastParseElement(uint32& dst, const CharType* start, const CharType* end);
     template<typename CharType> const CharType* FastParseElement(int64& dst, const CharType* start, const CharType* end);
     template<typename CharType> const CharType* FastParseElement(uint64& dst, const CharType* start, const CharType* end);
     template<typename CharType> const CharType* FastParseElement(float& dst, const CharType* start, const CharType* end);
 
+    /// <summary>Parse a very large list using multiple threads</summary>
+    /// The list is split into chunks (on whitespace boundaries). We count the elements in each
+    /// chunk first, and then parse all chunks in parallel, directly into their final place in
+    /// "dest". The result is the same as parsing sequentially. 
+    /// Returns false (without parsing anything) if "destCount" isn't large enough to be worth splitting.
+    /// Only implemented for float and uint32 lists.
+    bool ParallelParseXMLList(
+        float dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, 
+        unsigned* outEleCount, const utf8*& result);
+    bool ParallelParseXMLList(
+        uint32 dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, 
+        unsigned* outEleCount, const utf8*& result);
+
     template<typename Type>
-        auto ParseXMLList(Type dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, unsigned* outEleCount = nullptr) 
+        bool ParallelParseXMLList(
+            Type[], unsigned, XmlInputStreamFormatter<utf8>::InteriorSection, 
+            unsigned*, const utf8*&)
+    {
+        return false;
+    }
+
+    template<typename Type>
+        auto ParseXMLListSequential(Type dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, unsigned* outEleCount = nullptr) 
             -> decltype(XmlInputStreamFormatter<utf8>::InteriorSection::_start)
     {
         assert(destCount > 0);
@@ -42,7 +64,7 @@ namespace ColladaConversion
         unsigned elementCount = 0;
         auto* eleStart = section._start;
         while (elementCount < destCount) {
-            while (eleStart < section._end && IsWhitespace(*eleStart)) ++eleStart;
+            eleStart = SkipWhitespace(eleStart, section._end);
 
             auto* eleEnd = FastParseElement(dest[elementCount], eleStart, section._end);
             if (eleStart == eleEnd) {
@@ -54,7 +76,7 @@ namespace ColladaConversion
         }
 
         // skip forward over any trailing whitespace (which should bring us right to the end if the array ends in whitespace)
-        while (eleStart < section._end && IsWhitespace(*eleStart)) ++eleStart;
+        eleStart = SkipWhitespace(eleStart, section._end);
 
         if (outEleCount) {
             // while there are remaining elements, we must count them...
@@ -63,7 +85,7 @@ namespace ColladaConversion
             auto countingIterator = eleStart;
             Type temp;
             while (elementCount < destCount) {
-                while (countingIterator < section._end && IsWhitespace(*countingIterator)) ++countingIterator;
+                countingIterator = SkipWhitespace(countingIterator, section._end);
                 auto* eleEnd = FastParseElement(temp, countingIterator, section._end);
                 if (countingIterator == eleEnd) break;
                 ++elementCount;
@@ -74,6 +96,16 @@ namespace ColladaConversion
         return eleStart;
     }
 
+    template<typename Type>
+        auto ParseXMLList(Type dest[], unsigned destCount, XmlInputStreamFormatter<utf8>::InteriorSection section, unsigned* outEleCount = nullptr) 
+            -> decltype(XmlInputStreamFormatter<utf8>::InteriorSection::_start)
+    {
+        const utf8* result = nullptr;
+        if (ParallelParseXMLList(dest, destCount, section, outEleCount, result))
+            return result;
+        return ParseXMLListSequential(dest, destCount, section, outEleCount);
+    }
+
     template<typename Section>
         static std::string AsString(const Section& section)
     {
@@ -15,7 +15,7 @@
     #define dll_export      __declspec(dllexport)
     #define dll_import      __declspec(dllimport)
 
-	#if _MSC_VER <= 1600
+	#if _MSC_VER < 1900
 		#define thread_local    __declspec(thread)
 	#endif
 
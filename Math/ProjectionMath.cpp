@@ -387,6 +387,167 @@ namespace XLEMath
         return TestAABB_SSE(localToProjection, mins, maxs);
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    static inline void TestAABBs_SSE_Corner(
+        __m128 x, __m128 y, __m128 z, __m128 w,
+        __m128 andMasks[6], __m128& orMask)
+    {
+            //  Compare a single corner of 4 boxes against each frustum plane (using the
+            //  same rules as TestAABB_Basic).
+        auto negW = _mm_xor_ps(w, g_signMask);
+        auto zero = _mm_setzero_ps();
+        auto left   = _mm_cmplt_ps(x, negW);
+        auto right  = _mm_cmpgt_ps(x, w);
+        auto top    = _mm_cmplt_ps(y, negW);
+        auto bottom = _mm_cmpgt_ps(y, w);
+        auto nearP  = _mm_cmplt_ps(z, zero);
+        auto farP   = _mm_cmpgt_ps(z, w);
+
+        andMasks[0] = _mm_and_ps(andMasks[0], left);
+        andMasks[1] = _mm_and_ps(andMasks[1], right);
+        andMasks[2] = _mm_and_ps(andMasks[2], top);
+        andMasks[3] = _mm_and_ps(andMasks[3], bottom);
+        andMasks[4] = _mm_and_ps(andMasks[4], nearP);
+        andMasks[5] = _mm_and_ps(andMasks[5], farP);
+
+        orMask = _mm_or_ps(orMask, _mm_or_ps(_mm_or_ps(left, right), _mm_or_ps(top, bottom)));
+        orMask = _mm_or_ps(orMask, _mm_or_ps(nearP, farP));
+    }
+
+    static inline void TestAABBs_SSE_4(
+        const __m128 matrix[16], const AABBArraySoA& boxes, size_t offset,
+        unsigned& culledBits, unsigned& boundaryBits)
+    {
+            //  Test 4 boxes at once. Each register contains one component for 4 different
+            //  boxes; so the transformation doesn't require any shuffling or horizontal
+            //  operations.
+            //
+            //  Each corner is a combination of min/max in each axis. So we can calculate
+            //  the matrix * component products once for each axis, and then build each 
+            //  corner with just additions.
+        __m128 comp[3][2];
+        for (unsigned a=0; a<3; ++a) {
+            comp[a][0] = _mm_loadu_ps(boxes._mins[a] + offset);
+            comp[a][1] = _mm_loadu_ps(boxes._maxs[a] + offset);
+        }
+
+            //  xy[row][x-min/max][y-min/max] = m[row][0]*x + m[row][1]*y + m[row][3]
+        __m128 xy[4][2][2], zProducts[4][2];
+        for (unsigned r=0; r<4; ++r) {
+            auto x0 = _mm_mul_ps(matrix[r*4+0], comp[0][0]);
+            auto x1 = _mm_mul_ps(matrix[r*4+0], comp[0][1]);
+            auto y0 = _mm_add_ps(_mm_mul_ps(matrix[r*4+1], comp[1][0]), matrix[r*4+3]);
+            auto y1 = _mm_add_ps(_mm_mul_ps(matrix[r*4+1], comp[1][1]), matrix[r*4+3]);
+            xy[r][0][0] = _mm_add_ps(x0, y0);
+            xy[r][1][0] = _mm_add_ps(x1, y0);
+            xy[r][0][1] = _mm_add_ps(x0, y1);
+            xy[r][1][1] = _mm_add_ps(x1, y1);
+            zProducts[r][0] = _mm_mul_ps(matrix[r*4+2], comp[2][0]);
+            zProducts[r][1] = _mm_mul_ps(matrix[r*4+2], comp[2][1]);
+        }
+
+        auto allBits = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        __m128 andMasks[6] = { allBits, allBits, allBits, allBits, allBits, allBits };
+        auto orMask = _mm_setzero_ps();
+
+        for (unsigned c=0; c<8; ++c) {
+            auto ix = c&1, iy = (c>>1)&1, iz = (c>>2)&1;
+            TestAABBs_SSE_Corner(
+                _mm_add_ps(xy[0][ix][iy], zProducts[0][iz]),
+                _mm_add_ps(xy[1][ix][iy], zProducts[1][iz]),
+                _mm_add_ps(xy[2][ix][iy], zProducts[2][iz]),
+                _mm_add_ps(xy[3][ix][iy], zProducts[3][iz]),
+                andMasks, orMask);
+        }
+
+        auto culled = _mm_or_ps(
+            _mm_or_ps(_mm_or_ps(andMasks[0], andMasks[1]), _mm_or_ps(andMasks[2], andMasks[3])),
+            _mm_or_ps(andMasks[4], andMasks[5]));
+        culledBits = (unsigned)_mm_movemask_ps(culled);
+        boundaryBits = (unsigned)_mm_movemask_ps(orMask) & ~culledBits;
+    }
+
+    static void LoadMatrixComponents(__m128 dst[16], const float localToProjection[])
+    {
+        assert((size_t(localToProjection) & 0xf) == 0);
+        for (unsigned c=0; c<16; ++c)
+            dst[c] = _mm_set1_ps(localToProjection[c]);
+    }
+
+    static AABBIntersection::Enum TestAABB_Reference(
+        const Float4x4& localToProjection, const AABBArraySoA& boxes, size_t index)
+    {
+        return TestAABB_Basic(
+            localToProjection,
+            Float3(boxes._mins[0][index], boxes._mins[1][index], boxes._mins[2][index]),
+            Float3(boxes._maxs[0][index], boxes._maxs[1][index], boxes._maxs[2][index]));
+    }
+
+    void TestAABBs_Aligned(
+        const float localToProjection[], 
+        const AABBArraySoA& boxes,
+        AABBIntersection::Enum results[])
+    {
+        __m128 matrix[16];
+        LoadMatrixComponents(matrix, localToProjection);
+
+        size_t c=0;
+        for (; (c+4)<=boxes._count; c+=4) {
+            unsigned culledBits, boundaryBits;
+            TestAABBs_SSE_4(matrix, boxes, c, culledBits, boundaryBits);
+            for (unsigned q=0; q<4; ++q)
+                results[c+q] = 
+                    (culledBits & (1<<q)) ? AABBIntersection::Culled 
+                    : ((boundaryBits & (1<<q)) ? AABBIntersection::Boundary : AABBIntersection::Within);
+        }
+
+            // remainder (less than 4 boxes) goes via the scalar path
+        if (c < boxes._count) {
+            auto m = AsFloat4x4(localToProjection);
+            for (; c<boxes._count; ++c)
+                results[c] = TestAABB_Reference(m, boxes, c);
+        }
+    }
+
+    size_t CullAABBs_Aligned(
+        const float localToProjection[], 
+        const AABBArraySoA& boxes,
+        unsigned visibleIndices[])
+    {
+        __m128 matrix[16];
+        LoadMatrixComponents(matrix, localToProjection);
+
+        size_t visibleCount = 0;
+        size_t c=0;
+        for (; (c+4)<=boxes._count; c+=4) {
+            unsigned culledBits, boundaryBits;
+            TestAABBs_SSE_4(matrix, boxes, c, culledBits, boundaryBits);
+            for (unsigned q=0; q<4; ++q)
+                if (!(culledBits & (1<<q)))
+                    visibleIndices[visibleCount++] = unsigned(c+q);
+        }
+
+        if (c < boxes._count) {
+            auto m = AsFloat4x4(localToProjection);
+            for (; c<boxes._count; ++c)
+                if (TestAABB_Reference(m, boxes, c) != AABBIntersection::Culled)
+                    visibleIndices[visibleCount++] = unsigned(c);
+        }
+
+        return visibleCount;
+    }
+
+    void TestAABBs_Reference(
+        const float localToProjection[], 
+        const AABBArraySoA& boxes,
+        AABBIntersection::Enum results[])
+    {
+        auto m = AsFloat4x4(localToProjection);
+        for (size_t c=0; c<boxes._count; ++c)
+            results[c] = TestAABB_Reference(m, boxes, c);
+    }
+
     Float4 ExtractMinimalProjection(const Float4x4& projectionMatrix)
     {
         return Float4(projectionMatrix(0,0), projectionMatrix(1,1), projectionMatrix(2,2), projectionMatrix(2,3));
@@ -43,6 +43,42 @@ namespace XLEMath
             == AABBIntersection::Culled;
     }
 
+    /// <summary>Axially aligned bounding boxes in "structure of arrays" layout</summary>
+    /// Each component of the mins and maxs is stored in a separate array, so that many
+    /// boxes can be tested in parallel. See TestAABBs_Aligned and CullAABBs_Aligned.
+    class AABBArraySoA
+    {
+    public:
+        const float*    _mins[3];       ///< x, y and z components of the box minimums
+        const float*    _maxs[3];       ///< x, y and z components of the box maximums
+        size_t          _count;
+    };
+
+    /// <summary>Test many bounding boxes against the frustum</summary>
+    /// Equivalent to calling TestAABB_Aligned for each box, but boxes are tested 4 at a
+    /// time with SSE. "localToProjection" must be 16 byte aligned (as with TestAABB_Aligned).
+    /// Writes one result for each box.
+    void TestAABBs_Aligned(
+        const float localToProjection[], 
+        const AABBArraySoA& boxes,
+        AABBIntersection::Enum results[]);
+
+    /// <summary>Find the bounding boxes that are not culled by the frustum</summary>
+    /// Writes the indices of the boxes that aren't culled into "visibleIndices" (in 
+    /// increasing order), and returns the number written. "visibleIndices" must have
+    /// space for boxes._count elements.
+    size_t CullAABBs_Aligned(
+        const float localToProjection[], 
+        const AABBArraySoA& boxes,
+        unsigned visibleIndices[]);
+
+    /// <summary>Scalar reference version of TestAABBs_Aligned</summary>
+    /// Tests one box at a time, without SSE. Used for validating the batched version.
+    void TestAABBs_Reference(
+        const float localToProjection[], 
+        const AABBArraySoA& boxes,
+        AABBIntersection::Enum results[]);
+
     Float4 ExtractMinimalProjection(const Float4x4& projectionMatrix);
 }
 
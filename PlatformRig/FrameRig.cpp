@@ -20,6 +20,7 @@
 
 #include "../Assets/CompileAndAsyncManager.h"
 #include "../Assets/AssetServices.h"
+#include "../Assets/AssetSetManager.h"
 
 #include "../Utility/TimeUtils.h"
 #include "../Utility/IntrusivePtr.h"
@@ -195,6 +196,7 @@ namespace PlatformRig
 
         if (_pimpl->_updateAsyncMan)
             Assets::Services::GetAsyncMan().Update();
+        Assets::Services::GetAssetSets().OnFrameBarrier();
 
         auto device = context.GetDevice();
         assert(device);
@@ -54,12 +54,27 @@ namespace RenderCore { namespace Assets
             float       _beginTime, _endTime;
         };
 
+            //  "keyCursors" is optional per-instance state (one element per
+            //  animation driver, see GetAnimationDriverCount()) that speeds up
+            //  key searches when playing animations forward. See RawAnimationCurve.
         TransformationParameterSet  BuildTransformationParameterSet(
             const AnimationState&           animState,
             const TransformationMachine&    transformationMachine,
             const AnimationSetBinding&      binding,
             const RawAnimationCurve*        curves,
-            size_t                          curvesCount) const;
+            size_t                          curvesCount,
+            unsigned*                       keyCursors = nullptr) const;
+
+            //  Same as above, but writes into an existing parameter set. When
+            //  "result" is reused for many calls, its storage is reused as well.
+        void                        BuildTransformationParameterSet(
+            TransformationParameterSet&     result,
+            const AnimationState&           animState,
+            const TransformationMachine&    transformationMachine,
+            const AnimationSetBinding&      binding,
+            const RawAnimationCurve*        curves,
+            size_t                          curvesCount,
+            unsigned*                       keyCursors = nullptr) const;
 
         const AnimationDriver&  GetAnimationDriver(size_t index) const;
         size_t                  GetAnimationDriverCount() const;
@@ -27,8 +27,12 @@ namespace RenderCore { namespace Assets
 
     static const uint64 ChunkType_ModelScaffold = ConstHash64<'Mode', 'lSca', 'fold'>::Value;
     static const uint64 ChunkType_ModelScaffoldLargeBlocks = ConstHash64<'Mode', 'lSca', 'fold', 'Larg'>::Value;
+    static const uint64 ChunkType_ModelScaffoldGeoMetrics = ConstHash64<'Mode', 'lSca', 'fold', 'GeoM'>::Value;
+    static const uint64 ChunkType_ModelScaffoldLODTable = ConstHash64<'Mode', 'lSca', 'fold', 'LODT'>::Value;
     static const uint64 ChunkType_AnimationSet = ConstHash64<'Anim', 'Set'>::Value;
     static const uint64 ChunkType_Skeleton = ConstHash64<'Skel', 'eton'>::Value;
     static const uint64 ChunkType_RawMat = ConstHash64<'RawM', 'at'>::Value;
+
+    static const unsigned ChunkVersion_AnimationSet = 1;    // (1 added compressed animation curves)
 }}
 
@@ -0,0 +1,835 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "CPUSkinning.h"
+#include "ModelRunTime.h"
+#include "ModelRunTimeInternal.h"
+#include "../Metal/Format.h"
+#include "../Metal/DeviceContext.h"
+#include "../../ConsoleRig/GlobalServices.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
+#include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/StringUtils.h"
+#include "../../Utility/MemoryUtils.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Math/Transformations.h"
+#include "../../Core/Exceptions.h"
+#include <intrin.h>
+#include <algorithm>
+#include <cmath>
+
+namespace RenderCore { namespace Assets
+{
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //      v e r t e x   d e c o d i n g       //
+
+    static float Float16AsFloat32(uint16 input)
+    {
+        uint32 sign = uint32(input & 0x8000u) << 16;
+        uint32 exponent = (input >> 10) & 0x1fu;
+        uint32 mantissa = input & 0x3ffu;
+        uint32 bits;
+        if (exponent == 0) {
+                // zero or denormal
+            float value = float(mantissa) * (1.f / 16777216.f);
+            return sign ? -value : value;
+        } else if (exponent == 0x1f) {
+            bits = sign | 0x7f800000u | (mantissa << 13);   // infinity or nan
+        } else {
+            bits = sign | ((exponent + (127 - 15)) << 23) | (mantissa << 13);
+        }
+        float result;
+        XlCopyMemory(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    static Float4 ReadElement(const void* src, Metal::NativeFormat::Enum format)
+    {
+        using namespace Metal;
+        Float4 result(0.f, 0.f, 0.f, 0.f);
+        auto count = std::min(GetComponentCount(GetComponents(format)), 4u);
+        auto precision = GetComponentPrecision(format);
+        auto type = GetComponentType(format);
+        for (unsigned c=0; c<count; ++c) {
+            if (type == FormatComponentType::Float && precision == 32) {
+                result[c] = ((const float*)src)[c];
+            } else if (type == FormatComponentType::Float && precision == 16) {
+                result[c] = Float16AsFloat32(((const uint16*)src)[c]);
+            } else if (type == FormatComponentType::UNorm && precision == 8) {
+                result[c] = float(((const uint8*)src)[c]) / 255.f;
+            } else if (type == FormatComponentType::UNorm && precision == 16) {
+                result[c] = float(((const uint16*)src)[c]) / 65535.f;
+            } else if (type == FormatComponentType::SNorm && precision == 8) {
+                result[c] = std::max(float(((const int8*)src)[c]) / 127.f, -1.f);
+            } else if (type == FormatComponentType::SNorm && precision == 16) {
+                result[c] = std::max(float(((const int16*)src)[c]) / 32767.f, -1.f);
+            } else if (type == FormatComponentType::UInt && precision == 8) {
+                result[c] = float(((const uint8*)src)[c]);
+            } else if (type == FormatComponentType::UInt && precision == 16) {
+                result[c] = float(((const uint16*)src)[c]);
+            } else if (type == FormatComponentType::UInt && precision == 32) {
+                result[c] = float(((const uint32*)src)[c]);
+            } else {
+                Throw(::Exceptions::BasicLabel("Unsupported vertex format in CPU skinning (%i)", unsigned(format)));
+            }
+        }
+        return result;
+    }
+
+    static const VertexElement* FindElement(const GeoInputAssembly& ia, const char semantic[])
+    {
+        for (unsigned c=0; c<ia._elementCount; ++c)
+            if (!XlCompareStringI(ia._elements[c]._semantic, semantic) && ia._elements[c]._semanticIndex == 0)
+                return &ia._elements[c];
+        return nullptr;
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //      s k i n n i n g   k e r n e l s       //
+
+        //  Pointers to the start of each SoA stream. The kernels process the
+        //  4 vertices starting at a given index. Normal pointers are null when
+        //  the mesh has no normals.
+    class SourceBlock
+    {
+    public:
+        const float*    _position[3];
+        const float*    _normal[3];
+        const float*    _weight[4];
+        const uint16*   _joint[4];
+    };
+
+    class DestinationBlock
+    {
+    public:
+        float*          _position[3];
+        float*          _normal[3];
+    };
+
+    class DualQuaternion
+    {
+    public:
+        float   _real[4];       // rotation (x, y, z, w)
+        float   _dual[4];       // translation (x, y, z, w)
+    };
+
+    typedef void SkinBlockFn(const DestinationBlock& dst, const SourceBlock& src, unsigned vertex, const void* palette);
+
+    static __m128 TransformPoint(const __m128 row[4], __m128 x, __m128 y, __m128 z)
+    {
+        return _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(row[0], x), _mm_mul_ps(row[1], y)),
+            _mm_add_ps(_mm_mul_ps(row[2], z), row[3]));
+    }
+
+    static __m128 TransformVector(const __m128 row[4], __m128 x, __m128 y, __m128 z)
+    {
+        return _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(row[0], x), _mm_mul_ps(row[1], y)),
+            _mm_mul_ps(row[2], z));
+    }
+
+    template<unsigned InfluenceCount>
+        static void SkinBlock_LinearBlend(const DestinationBlock& dst, const SourceBlock& src, unsigned v, const void* paletteData)
+    {
+            //  Blend the weighted joint matrices for each vertex (one matrix row
+            //  per register), and then transpose so that each register holds a
+            //  single matrix element for all 4 vertices. The transform itself is
+            //  then straight SoA math.
+        auto palette = (const Float3x4*)paletteData;
+        __m128 row0[4], row1[4], row2[4];
+        for (unsigned l=0; l<4; ++l) {
+            const float* m = &palette[src._joint[0][v+l]](0,0);
+            auto w = _mm_set1_ps(src._weight[0][v+l]);
+            row0[l] = _mm_mul_ps(w, _mm_loadu_ps(m));
+            row1[l] = _mm_mul_ps(w, _mm_loadu_ps(m+4));
+            row2[l] = _mm_mul_ps(w, _mm_loadu_ps(m+8));
+            for (unsigned c=1; c<InfluenceCount; ++c) {
+                m = &palette[src._joint[c][v+l]](0,0);
+                w = _mm_set1_ps(src._weight[c][v+l]);
+                row0[l] = _mm_add_ps(row0[l], _mm_mul_ps(w, _mm_loadu_ps(m)));
+                row1[l] = _mm_add_ps(row1[l], _mm_mul_ps(w, _mm_loadu_ps(m+4)));
+                row2[l] = _mm_add_ps(row2[l], _mm_mul_ps(w, _mm_loadu_ps(m+8)));
+            }
+        }
+        _MM_TRANSPOSE4_PS(row0[0], row0[1], row0[2], row0[3]);
+        _MM_TRANSPOSE4_PS(row1[0], row1[1], row1[2], row1[3]);
+        _MM_TRANSPOSE4_PS(row2[0], row2[1], row2[2], row2[3]);
+
+        auto px = _mm_loadu_ps(src._position[0]+v);
+        auto py = _mm_loadu_ps(src._position[1]+v);
+        auto pz = _mm_loadu_ps(src._position[2]+v);
+        _mm_storeu_ps(dst._position[0]+v, TransformPoint(row0, px, py, pz));
+        _mm_storeu_ps(dst._position[1]+v, TransformPoint(row1, px, py, pz));
+        _mm_storeu_ps(dst._position[2]+v, TransformPoint(row2, px, py, pz));
+
+        if (src._normal[0]) {
+                // (like the shader, we don't renormalize here)
+            auto nx = _mm_loadu_ps(src._normal[0]+v);
+            auto ny = _mm_loadu_ps(src._normal[1]+v);
+            auto nz = _mm_loadu_ps(src._normal[2]+v);
+            _mm_storeu_ps(dst._normal[0]+v, TransformVector(row0, nx, ny, nz));
+            _mm_storeu_ps(dst._normal[1]+v, TransformVector(row1, nx, ny, nz));
+            _mm_storeu_ps(dst._normal[2]+v, TransformVector(row2, nx, ny, nz));
+        }
+    }
+
+    static void RotateVector(
+        __m128& ox, __m128& oy, __m128& oz,
+        __m128 qx, __m128 qy, __m128 qz, __m128 qw,
+        __m128 vx, __m128 vy, __m128 vz)
+    {
+            // v + 2 * cross(q.xyz, cross(q.xyz, v) + q.w * v)
+        auto tx = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qy, vz), _mm_mul_ps(qz, vy)), _mm_mul_ps(qw, vx));
+        auto ty = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qz, vx), _mm_mul_ps(qx, vz)), _mm_mul_ps(qw, vy));
+        auto tz = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(qx, vy), _mm_mul_ps(qy, vx)), _mm_mul_ps(qw, vz));
+        auto two = _mm_set1_ps(2.f);
+        ox = _mm_add_ps(vx, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qy, tz), _mm_mul_ps(qz, ty))));
+        oy = _mm_add_ps(vy, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qz, tx), _mm_mul_ps(qx, tz))));
+        oz = _mm_add_ps(vz, _mm_mul_ps(two, _mm_sub_ps(_mm_mul_ps(qx, ty), _mm_mul_ps(qy, tx))));
+    }
+
+    template<unsigned InfluenceCount>
+        static void SkinBlock_DualQuaternion(const DestinationBlock& dst, const SourceBlock& src, unsigned v, const void* paletteData)
+    {
+            //  Gather the dual quaternions for each influence, transpose into
+            //  SoA form and accumulate. Quaternions in the opposite hemisphere
+            //  to the first influence are negated, so we always blend along the
+            //  shortest path.
+        auto palette = (const DualQuaternion*)paletteData;
+        auto signMask = _mm_set1_ps(-0.f);
+        __m128 rx, ry, rz, rw, dx, dy, dz, dw;
+        __m128 fx, fy, fz, fw;
+        for (unsigned c=0; c<InfluenceCount; ++c) {
+            __m128 r[4], d[4];
+            for (unsigned l=0; l<4; ++l) {
+                const auto& q = palette[src._joint[c][v+l]];
+                r[l] = _mm_loadu_ps(q._real);
+                d[l] = _mm_loadu_ps(q._dual);
+            }
+            _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+            _MM_TRANSPOSE4_PS(d[0], d[1], d[2], d[3]);
+
+            auto w = _mm_loadu_ps(src._weight[c]+v);
+            if (c == 0) {
+                fx = r[0]; fy = r[1]; fz = r[2]; fw = r[3];
+                rx = _mm_mul_ps(w, r[0]); ry = _mm_mul_ps(w, r[1]); rz = _mm_mul_ps(w, r[2]); rw = _mm_mul_ps(w, r[3]);
+                dx = _mm_mul_ps(w, d[0]); dy = _mm_mul_ps(w, d[1]); dz = _mm_mul_ps(w, d[2]); dw = _mm_mul_ps(w, d[3]);
+            } else {
+                auto dot = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(fx, r[0]), _mm_mul_ps(fy, r[1])),
+                    _mm_add_ps(_mm_mul_ps(fz, r[2]), _mm_mul_ps(fw, r[3])));
+                w = _mm_xor_ps(w, _mm_and_ps(_mm_cmplt_ps(dot, _mm_setzero_ps()), signMask));
+                rx = _mm_add_ps(rx, _mm_mul_ps(w, r[0])); ry = _mm_add_ps(ry, _mm_mul_ps(w, r[1]));
+                rz = _mm_add_ps(rz, _mm_mul_ps(w, r[2])); rw = _mm_add_ps(rw, _mm_mul_ps(w, r[3]));
+                dx = _mm_add_ps(dx, _mm_mul_ps(w, d[0])); dy = _mm_add_ps(dy, _mm_mul_ps(w, d[1]));
+                dz = _mm_add_ps(dz, _mm_mul_ps(w, d[2])); dw = _mm_add_ps(dw, _mm_mul_ps(w, d[3]));
+            }
+        }
+
+            //  Normalize by the length of the real part. Vertices with no weight
+            //  at all end up with a zero quaternion, and so pass through unchanged.
+        auto lengthSq = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(rx, rx), _mm_mul_ps(ry, ry)),
+            _mm_add_ps(_mm_mul_ps(rz, rz), _mm_mul_ps(rw, rw)));
+        auto invLength = _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(_mm_max_ps(lengthSq, _mm_set1_ps(1e-20f))));
+        rx = _mm_mul_ps(rx, invLength); ry = _mm_mul_ps(ry, invLength); rz = _mm_mul_ps(rz, invLength); rw = _mm_mul_ps(rw, invLength);
+        dx = _mm_mul_ps(dx, invLength); dy = _mm_mul_ps(dy, invLength); dz = _mm_mul_ps(dz, invLength); dw = _mm_mul_ps(dw, invLength);
+
+            // translation = 2 * (real.w * dual.xyz - dual.w * real.xyz + cross(real.xyz, dual.xyz))
+        auto two = _mm_set1_ps(2.f);
+        auto tx = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dx), _mm_mul_ps(dw, rx)), _mm_sub_ps(_mm_mul_ps(ry, dz), _mm_mul_ps(rz, dy))));
+        auto ty = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dy), _mm_mul_ps(dw, ry)), _mm_sub_ps(_mm_mul_ps(rz, dx), _mm_mul_ps(rx, dz))));
+        auto tz = _mm_mul_ps(two, _mm_add_ps(_mm_sub_ps(_mm_mul_ps(rw, dz), _mm_mul_ps(dw, rz)), _mm_sub_ps(_mm_mul_ps(rx, dy), _mm_mul_ps(ry, dx))));
+
+        __m128 ox, oy, oz;
+        RotateVector(
+            ox, oy, oz, rx, ry, rz, rw,
+            _mm_loadu_ps(src._position[0]+v), _mm_loadu_ps(src._position[1]+v), _mm_loadu_ps(src._position[2]+v));
+        _mm_storeu_ps(dst._position[0]+v, _mm_add_ps(ox, tx));
+        _mm_storeu_ps(dst._position[1]+v, _mm_add_ps(oy, ty));
+        _mm_storeu_ps(dst._position[2]+v, _mm_add_ps(oz, tz));
+
+        if (src._normal[0]) {
+            RotateVector(
+                ox, oy, oz, rx, ry, rz, rw,
+                _mm_loadu_ps(src._normal[0]+v), _mm_loadu_ps(src._normal[1]+v), _mm_loadu_ps(src._normal[2]+v));
+            _mm_storeu_ps(dst._normal[0]+v, ox);
+            _mm_storeu_ps(dst._normal[1]+v, oy);
+            _mm_storeu_ps(dst._normal[2]+v, oz);
+        }
+    }
+
+    static void BuildDualQuaternion(DualQuaternion& result, const Float3x4& transform)
+    {
+            //  Scale is removed from the columns of the rotation part before
+            //  conversion (dual quaternions can only represent rigid transforms)
+        float m[3][3];
+        for (unsigned j=0; j<3; ++j) {
+            float length = std::sqrt(transform(0,j)*transform(0,j) + transform(1,j)*transform(1,j) + transform(2,j)*transform(2,j));
+            float scale = (length > 0.f) ? (1.f / length) : 0.f;
+            for (unsigned i=0; i<3; ++i)
+                m[i][j] = transform(i,j) * scale;
+        }
+
+        float x, y, z, w;
+        float trace = m[0][0] + m[1][1] + m[2][2];
+        if (trace > 0.f) {
+            float s = std::sqrt(trace + 1.f) * 2.f;
+            w = .25f * s; x = (m[2][1] - m[1][2]) / s; y = (m[0][2] - m[2][0]) / s; z = (m[1][0] - m[0][1]) / s;
+        } else if (m[0][0] > m[1][1] && m[0][0] > m[2][2]) {
+            float s = std::sqrt(1.f + m[0][0] - m[1][1] - m[2][2]) * 2.f;
+            w = (m[2][1] - m[1][2]) / s; x = .25f * s; y = (m[0][1] + m[1][0]) / s; z = (m[0][2] + m[2][0]) / s;
+        } else if (m[1][1] > m[2][2]) {
+            float s = std::sqrt(1.f + m[1][1] - m[0][0] - m[2][2]) * 2.f;
+            w = (m[0][2] - m[2][0]) / s; x = (m[0][1] + m[1][0]) / s; y = .25f * s; z = (m[1][2] + m[2][1]) / s;
+        } else {
+            float s = std::sqrt(1.f + m[2][2] - m[0][0] - m[1][1]) * 2.f;
+            w = (m[1][0] - m[0][1]) / s; x = (m[0][2] + m[2][0]) / s; y = (m[1][2] + m[2][1]) / s; z = .25f * s;
+        }
+
+            // dual = 0.5 * (translation, 0) * real
+        float tx = transform(0,3), ty = transform(1,3), tz = transform(2,3);
+        result._real[0] = x; result._real[1] = y; result._real[2] = z; result._real[3] = w;
+        result._dual[0] = .5f * ( tx*w + ty*z - tz*y);
+        result._dual[1] = .5f * (-tx*z + ty*w + tz*x);
+        result._dual[2] = .5f * ( tx*y - ty*x + tz*w);
+        result._dual[3] = -.5f * (tx*x + ty*y + tz*z);
+    }
+
+    static void SkinSection(
+        const DestinationBlock& dstBase, const SourceBlock& srcBase,
+        unsigned firstVertex, unsigned vertexCount,
+        SkinBlockFn* fn, const void* palette)
+    {
+        auto end = firstVertex + vertexCount;
+        auto v = firstVertex;
+        for (; (v+4)<=end; v+=4)
+            (*fn)(dstBase, srcBase, v, palette);
+
+        if (v < end) {
+                //  Partial block at the end of the section. Copy into temporaries,
+                //  so we don't read past the end of the streams (or write into the
+                //  next section)
+            auto tailCount = end - v;
+            float srcTemp[10][4]; uint16 jointTemp[4][4]; float dstTemp[6][4];
+            XlZeroMemory(srcTemp); XlZeroMemory(jointTemp);
+            SourceBlock tempSrc;
+            DestinationBlock tempDst;
+            for (unsigned c=0; c<3; ++c) {
+                XlCopyMemory(srcTemp[c], srcBase._position[c]+v, tailCount*sizeof(float));
+                tempSrc._position[c] = srcTemp[c];
+                tempDst._position[c] = dstTemp[c];
+                if (srcBase._normal[c]) {
+                    XlCopyMemory(srcTemp[3+c], srcBase._normal[c]+v, tailCount*sizeof(float));
+                    tempSrc._normal[c] = srcTemp[3+c];
+                    tempDst._normal[c] = dstTemp[3+c];
+                } else {
+                    tempSrc._normal[c] = nullptr;
+                    tempDst._normal[c] = nullptr;
+                }
+            }
+            for (unsigned c=0; c<4; ++c) {
+                XlCopyMemory(srcTemp[6+c], srcBase._weight[c]+v, tailCount*sizeof(float));
+                XlCopyMemory(jointTemp[c], srcBase._joint[c]+v, tailCount*sizeof(uint16));
+                tempSrc._weight[c] = srcTemp[6+c];
+                tempSrc._joint[c] = jointTemp[c];
+            }
+
+            (*fn)(tempDst, tempSrc, 0, palette);
+
+            for (unsigned c=0; c<3; ++c) {
+                XlCopyMemory(dstBase._position[c]+v, dstTemp[c], tailCount*sizeof(float));
+                if (dstBase._normal[c])
+                    XlCopyMemory(dstBase._normal[c]+v, dstTemp[3+c], tailCount*sizeof(float));
+            }
+        }
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //      C P U S k i n n i n g M e s h       //
+
+    void CPUSkinningMesh::Skin(
+        CPUSkinnedVertices& output,
+        const Float3x4 jointTransforms[], unsigned jointTransformCount,
+        CPUSkinningMethod::Enum method) const
+    {
+        if (jointTransformCount < _paletteSize)
+            Throw(::Exceptions::BasicLabel("Too few joint transforms for CPU skinning (%i, expecting %i)", jointTransformCount, _paletteSize));
+
+        output._vertexCount = _vertexCount;
+        output._stride = _stride;
+        output._hasNormals = HasNormals();
+        output._streams.resize((output._hasNormals ? 6 : 3) * _stride);
+
+        SourceBlock src;
+        DestinationBlock dst;
+        for (unsigned c=0; c<3; ++c) {
+            src._position[c] = &_positions[c*_stride];
+            src._normal[c] = HasNormals() ? &_normals[c*_stride] : nullptr;
+            dst._position[c] = &output._streams[c*_stride];
+            dst._normal[c] = HasNormals() ? &output._streams[(3+c)*_stride] : nullptr;
+        }
+        for (unsigned c=0; c<4; ++c) {
+            src._weight[c] = &_weights[c*_stride];
+            src._joint[c] = &_joints[c*_stride];
+        }
+
+        static SkinBlockFn* const linearBlendFns[] =
+            { &SkinBlock_LinearBlend<1>, &SkinBlock_LinearBlend<2>, &SkinBlock_LinearBlend<3>, &SkinBlock_LinearBlend<4> };
+        static SkinBlockFn* const dualQuaternionFns[] =
+            { &SkinBlock_DualQuaternion<1>, &SkinBlock_DualQuaternion<2>, &SkinBlock_DualQuaternion<3>, &SkinBlock_DualQuaternion<4> };
+
+        const void* palette = jointTransforms;
+        SkinBlockFn* const* fns = linearBlendFns;
+        std::vector<DualQuaternion> dualQuaternions;
+        if (method == CPUSkinningMethod::DualQuaternion) {
+            dualQuaternions.resize(_paletteSize);
+            for (unsigned c=0; c<_paletteSize; ++c)
+                BuildDualQuaternion(dualQuaternions[c], jointTransforms[c]);
+            palette = AsPointer(dualQuaternions.cbegin());
+            fns = dualQuaternionFns;
+        }
+
+        for (const auto& s:_sections) {
+            if (!s._influenceCount) {
+                    // no skinning, just pass through (like the P0 shader)
+                for (unsigned c=0; c<3; ++c) {
+                    XlCopyMemory(dst._position[c] + s._firstVertex, src._position[c] + s._firstVertex, s._vertexCount*sizeof(float));
+                    if (dst._normal[c])
+                        XlCopyMemory(dst._normal[c] + s._firstVertex, src._normal[c] + s._firstVertex, s._vertexCount*sizeof(float));
+                }
+                continue;
+            }
+
+            SkinSection(
+                dst, src, s._firstVertex, s._vertexCount,
+                fns[std::min(s._influenceCount, 4u)-1], palette);
+        }
+    }
+
+    float CPUSkinningMesh::RayTest(
+        const CPUSkinnedVertices& vertices,
+        const std::pair<Float3, Float3>& ray,
+        unsigned* triangleIndex) const
+    {
+        assert(vertices._vertexCount == _vertexCount);
+        const float* x = vertices.GetComponent(0);
+        const float* y = vertices.GetComponent(1);
+        const float* z = vertices.GetComponent(2);
+
+            //  Moller-Trumbore intersection against each triangle. We're testing
+            //  a line segment, so intersection parameters must be between 0 and 1.
+        Float3 direction = ray.second - ray.first;
+        float bestParameter = FLT_MAX;
+        unsigned bestTriangle = ~0u;
+        for (size_t t=0; t+2<_triangles.size(); t+=3) {
+            auto i0 = _triangles[t], i1 = _triangles[t+1], i2 = _triangles[t+2];
+            Float3 a(x[i0], y[i0], z[i0]);
+            Float3 edge1 = Float3(x[i1], y[i1], z[i1]) - a;
+            Float3 edge2 = Float3(x[i2], y[i2], z[i2]) - a;
+
+            Float3 p = Cross(direction, edge2);
+            float det = Dot(edge1, p);
+            if (std::abs(det) < 1e-20f) continue;
+            float invDet = 1.f / det;
+
+            Float3 s = ray.first - a;
+            float u = Dot(s, p) * invDet;
+            if (u < 0.f || u > 1.f) continue;
+
+            Float3 q = Cross(s, edge1);
+            float v = Dot(direction, q) * invDet;
+            if (v < 0.f || (u + v) > 1.f) continue;
+
+            float parameter = Dot(edge2, q) * invDet;
+            if (parameter >= 0.f && parameter <= 1.f && parameter < bestParameter) {
+                bestParameter = parameter;
+                bestTriangle = unsigned(t/3);
+            }
+        }
+
+        if (triangleIndex) *triangleIndex = bestTriangle;
+        if (bestParameter == FLT_MAX) return FLT_MAX;
+        return bestParameter * Magnitude(direction);
+    }
+
+    CPUSkinningMesh::SourceVertex CPUSkinningMesh::GetSourceVertex(unsigned vertex) const
+    {
+        assert(vertex < _vertexCount);
+        SourceVertex result;
+        result._normal = Float3(0.f, 0.f, 0.f);
+        for (unsigned c=0; c<3; ++c) {
+            result._position[c] = _positions[c*_stride+vertex];
+            if (HasNormals()) result._normal[c] = _normals[c*_stride+vertex];
+        }
+        for (unsigned c=0; c<4; ++c) {
+            result._weights[c] = _weights[c*_stride+vertex];
+            result._jointIndices[c] = _joints[c*_stride+vertex];
+        }
+        result._influenceCount = 0;
+        for (const auto& s:_sections)
+            if (vertex >= s._firstVertex && vertex < (s._firstVertex + s._vertexCount)) {
+                result._influenceCount = s._influenceCount;
+                break;
+            }
+        return result;
+    }
+
+    void CPUSkinningMesh::Allocate(unsigned vertexCount, bool hasNormals)
+    {
+            //  Streams are padded to a multiple of 4, so that full blocks
+            //  never run off the end
+        _vertexCount = vertexCount;
+        _stride = (vertexCount + 3) & ~3u;
+        _positions.resize(3*_stride, 0.f);
+        if (hasNormals) _normals.resize(3*_stride, 0.f);
+        _weights.resize(4*_stride, 0.f);
+        _joints.resize(4*_stride, 0);
+    }
+
+    void CPUSkinningMesh::CompleteSections()
+    {
+            //  Sort the sections and fill in any gaps with pass-through sections,
+            //  so every vertex gets written. Then find the largest joint index that
+            //  will actually be used.
+        std::sort(
+            _sections.begin(), _sections.end(),
+            [](const Section& lhs, const Section& rhs) { return lhs._firstVertex < rhs._firstVertex; });
+
+        std::vector<Section> completed;
+        completed.reserve(_sections.size() * 2 + 1);
+        unsigned cursor = 0;
+        for (auto s:_sections) {
+            s._firstVertex = std::max(s._firstVertex, cursor);
+            auto end = std::min(s._firstVertex + s._vertexCount, _vertexCount);
+            if (end <= s._firstVertex) continue;
+            if (s._firstVertex > cursor) {
+                Section gap = { cursor, s._firstVertex - cursor, 0 };
+                completed.push_back(gap);
+            }
+            s._vertexCount = end - s._firstVertex;
+            s._influenceCount = std::min(s._influenceCount, 4u);
+            completed.push_back(s);
+            cursor = end;
+        }
+        if (cursor < _vertexCount) {
+            Section gap = { cursor, _vertexCount - cursor, 0 };
+            completed.push_back(gap);
+        }
+        _sections = std::move(completed);
+
+        _paletteSize = 0;
+        for (const auto& s:_sections)
+            for (unsigned c=0; c<s._influenceCount; ++c)
+                for (unsigned v=s._firstVertex; v<s._firstVertex+s._vertexCount; ++v)
+                    _paletteSize = std::max(_paletteSize, unsigned(_joints[c*_stride+v]) + 1);
+
+            // drop any triangles that reference vertices out of range
+        std::vector<unsigned> triangles;
+        triangles.reserve(_triangles.size());
+        for (size_t t=0; t+2<_triangles.size(); t+=3)
+            if (_triangles[t] < _vertexCount && _triangles[t+1] < _vertexCount && _triangles[t+2] < _vertexCount)
+                triangles.insert(triangles.end(), &_triangles[t], &_triangles[t+3]);
+        _triangles = std::move(triangles);
+    }
+
+    CPUSkinningMesh::CPUSkinningMesh(
+        const BoundSkinnedGeometry& geo,
+        const void* animatedVertices,
+        const void* skeletonBindingVertices,
+        const void* indices)
+    {
+        auto& animIA = geo._animatedVertexElements._ia;
+        auto& bindingIA = geo._skeletonBinding._ia;
+        auto* positionElement = FindElement(animIA, "POSITION");
+        auto* normalElement = FindElement(animIA, "NORMAL");
+        auto* weightsElement = FindElement(bindingIA, "WEIGHTS");
+        auto* jointsElement = FindElement(bindingIA, "JOINTINDICES");
+        if (!positionElement || !weightsElement || !jointsElement || !animIA._vertexStride || !bindingIA._vertexStride)
+            Throw(::Exceptions::BasicLabel("Skinned geometry is missing vertex elements required for CPU skinning"));
+
+        auto vertexCount = std::min(
+            geo._animatedVertexElements._size / animIA._vertexStride,
+            geo._skeletonBinding._size / bindingIA._vertexStride);
+        Allocate(vertexCount, normalElement != nullptr);
+
+        for (unsigned v=0; v<vertexCount; ++v) {
+            auto* animVertex = PtrAdd(animatedVertices, v*animIA._vertexStride);
+            auto* bindingVertex = PtrAdd(skeletonBindingVertices, v*bindingIA._vertexStride);
+
+            auto p = ReadElement(PtrAdd(animVertex, positionElement->_startOffset), Metal::NativeFormat::Enum(positionElement->_format));
+            for (unsigned c=0; c<3; ++c) _positions[c*_stride+v] = p[c];
+            if (normalElement) {
+                auto n = ReadElement(PtrAdd(animVertex, normalElement->_startOffset), Metal::NativeFormat::Enum(normalElement->_format));
+                for (unsigned c=0; c<3; ++c) _normals[c*_stride+v] = n[c];
+            }
+
+            auto w = ReadElement(PtrAdd(bindingVertex, weightsElement->_startOffset), Metal::NativeFormat::Enum(weightsElement->_format));
+            auto j = ReadElement(PtrAdd(bindingVertex, jointsElement->_startOffset), Metal::NativeFormat::Enum(jointsElement->_format));
+            for (unsigned c=0; c<4; ++c) {
+                _weights[c*_stride+v] = w[c];
+                _joints[c*_stride+v] = uint16(j[c]);
+            }
+        }
+
+            //  The preskinning draw calls are point lists over the vertices, with
+            //  the influence count in the sub material index
+        for (unsigned c=0; c<geo._preskinningDrawCallCount; ++c) {
+            const auto& d = geo._preskinningDrawCalls[c];
+            Section s = { d._firstVertex, d._indexCount, d._subMaterialIndex };
+            _sections.push_back(s);
+        }
+
+        if (indices) {
+            bool shortIndices = geo._ib._format == unsigned(Metal::NativeFormat::R16_UINT);
+            unsigned indexCount = geo._ib._size / (shortIndices ? 2 : 4);
+            for (unsigned c=0; c<geo._drawCallsCount; ++c) {
+                const auto& d = geo._drawCalls[c];
+                if (d._topology != unsigned(Metal::Topology::TriangleList)) continue;
+                auto end = std::min(d._firstIndex + d._indexCount, indexCount);
+                for (unsigned i=d._firstIndex; (i+3)<=end; i+=3)
+                    for (unsigned c=0; c<3; ++c) {
+                        auto index = shortIndices ? unsigned(((const uint16*)indices)[i+c]) : ((const uint32*)indices)[i+c];
+                        _triangles.push_back(index + d._firstVertex);
+                    }
+            }
+        }
+
+        CompleteSections();
+    }
+
+    CPUSkinningMesh::CPUSkinningMesh(
+        const Float3 positions[], const Float3 normals[],
+        const Float4 weights[], const UInt4 jointIndices[],
+        unsigned vertexCount,
+        const Section sections[], unsigned sectionCount,
+        const unsigned triangleIndices[], unsigned indexCount)
+    {
+        Allocate(vertexCount, normals != nullptr);
+        for (unsigned v=0; v<vertexCount; ++v) {
+            for (unsigned c=0; c<3; ++c) {
+                _positions[c*_stride+v] = positions[v][c];
+                if (normals) _normals[c*_stride+v] = normals[v][c];
+            }
+            for (unsigned c=0; c<4; ++c) {
+                _weights[c*_stride+v] = weights[v][c];
+                _joints[c*_stride+v] = uint16(jointIndices[v][c]);
+            }
+        }
+        _sections.insert(_sections.end(), sections, &sections[sectionCount]);
+        _triangles.insert(_triangles.end(), triangleIndices, &triangleIndices[indexCount - indexCount%3]);
+        CompleteSections();
+    }
+
+    CPUSkinningMesh::CPUSkinningMesh()
+    : _vertexCount(0), _stride(0), _paletteSize(0)
+    {}
+
+    CPUSkinningMesh::CPUSkinningMesh(CPUSkinningMesh&& moveFrom)
+    : _positions(std::move(moveFrom._positions))
+    , _normals(std::move(moveFrom._normals))
+    , _weights(std::move(moveFrom._weights))
+    , _joints(std::move(moveFrom._joints))
+    , _sections(std::move(moveFrom._sections))
+    , _triangles(std::move(moveFrom._triangles))
+    , _vertexCount(moveFrom._vertexCount)
+    , _stride(moveFrom._stride)
+    , _paletteSize(moveFrom._paletteSize)
+    {}
+
+    CPUSkinningMesh& CPUSkinningMesh::operator=(CPUSkinningMesh&& moveFrom)
+    {
+        _positions = std::move(moveFrom._positions);
+        _normals = std::move(moveFrom._normals);
+        _weights = std::move(moveFrom._weights);
+        _joints = std::move(moveFrom._joints);
+        _sections = std::move(moveFrom._sections);
+        _triangles = std::move(moveFrom._triangles);
+        _vertexCount = moveFrom._vertexCount;
+        _stride = moveFrom._stride;
+        _paletteSize = moveFrom._paletteSize;
+        return *this;
+    }
+
+    CPUSkinningMesh::~CPUSkinningMesh() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    Float3 CPUSkinnedVertices::GetPosition(unsigned vertex) const
+    {
+        assert(vertex < _vertexCount);
+        return Float3(_streams[vertex], _streams[_stride+vertex], _streams[2*_stride+vertex]);
+    }
+
+    Float3 CPUSkinnedVertices::GetNormal(unsigned vertex) const
+    {
+        assert(_hasNormals && vertex < _vertexCount);
+        return Float3(_streams[3*_stride+vertex], _streams[4*_stride+vertex], _streams[5*_stride+vertex]);
+    }
+
+    CPUSkinnedVertices::CPUSkinnedVertices()
+    : _vertexCount(0), _stride(0), _hasNormals(false)
+    {}
+
+    CPUSkinnedVertices::CPUSkinnedVertices(CPUSkinnedVertices&& moveFrom)
+    : _streams(std::move(moveFrom._streams))
+    , _vertexCount(moveFrom._vertexCount)
+    , _stride(moveFrom._stride)
+    , _hasNormals(moveFrom._hasNormals)
+    {}
+
+    CPUSkinnedVertices& CPUSkinnedVertices::operator=(CPUSkinnedVertices&& moveFrom)
+    {
+        _streams = std::move(moveFrom._streams);
+        _vertexCount = moveFrom._vertexCount;
+        _stride = moveFrom._stride;
+        _hasNormals = moveFrom._hasNormals;
+        return *this;
+    }
+
+    CPUSkinnedVertices::~CPUSkinnedVertices() {}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void CPUSkinMeshes(
+        const CPUSkinningJob jobs[], size_t jobCount,
+        CPUSkinningMethod::Enum method)
+    {
+            //  Exceptions thrown from the pool tasks won't reach the caller, so validate
+            //  the palettes here (Skin would otherwise throw within the task)
+        for (size_t j=0; j<jobCount; ++j)
+            if (jobs[j]._jointTransformCount < jobs[j]._mesh->GetPaletteSize())
+                Throw(::Exceptions::BasicLabel(
+                    "Too few joint transforms for CPU skinning job %i (%i, expecting %i)", 
+                    int(j), jobs[j]._jointTransformCount, jobs[j]._mesh->GetPaletteSize()));
+
+            //  (callers wait for the result, normally within a frame; so this belongs
+            //  in the short task pool)
+        auto& pool = ConsoleRig::GlobalServices::GetShortTaskThreadPool();
+        auto rangeCount = std::min(size_t(pool.GetWorkerThreadCount()+1) * 4, jobCount);
+        if (rangeCount <= 1) {
+            for (size_t j=0; j<jobCount; ++j)
+                jobs[j]._mesh->Skin(*jobs[j]._output, jobs[j]._jointTransforms, jobs[j]._jointTransformCount, method);
+            return;
+        }
+
+        CompletionThreadPool::TaskGroup group(pool);
+        for (size_t r=0; r<rangeCount; ++r) {
+            auto begin = jobCount * r / rangeCount, end = jobCount * (r+1) / rangeCount;
+            group.Run(
+                [jobs, begin, end, method]()
+                {
+                    for (auto j=begin; j<end; ++j)
+                        jobs[j]._mesh->Skin(*jobs[j]._output, jobs[j]._jointTransforms, jobs[j]._jointTransformCount, method);
+                });
+        }
+        group.Wait();
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+    //      C P U S k i n n e d M o d e l       //
+
+    void CPUSkinnedModel::Skin(
+        std::vector<CPUSkinnedVertices>& output,
+        const Float4x4 transformationMachineResult[],
+        const SkeletonBinding& skeletonBinding,
+        CPUSkinningMethod::Enum method) const
+    {
+        auto& data = _scaffold->ImmutableData();
+        output.resize(_meshes.size());
+
+        std::vector<unsigned> paletteOffsets;
+        paletteOffsets.reserve(_meshes.size());
+        unsigned paletteTotal = 0;
+        for (unsigned m=0; m<_meshes.size(); ++m) {
+            paletteOffsets.push_back(paletteTotal);
+            paletteTotal += std::max(unsigned(data._boundSkinnedControllers[m]._jointMatrixCount), _meshes[m].GetPaletteSize());
+        }
+
+        std::vector<Float3x4> palettes(paletteTotal, Identity<Float3x4>());
+        std::vector<CPUSkinningJob> jobs;
+        jobs.reserve(_meshes.size());
+        for (unsigned m=0; m<_meshes.size(); ++m) {
+            auto paletteSize = ((m+1) < _meshes.size() ? paletteOffsets[m+1] : paletteTotal) - paletteOffsets[m];
+            auto* palette = &palettes[paletteOffsets[m]];
+            WriteJointTransforms(
+                palette, paletteSize, data._boundSkinnedControllers[m],
+                transformationMachineResult, skeletonBinding);
+
+            CPUSkinningJob job = { &_meshes[m], palette, paletteSize, &output[m] };
+            jobs.push_back(job);
+        }
+
+        CPUSkinMeshes(AsPointer(jobs.cbegin()), jobs.size(), method);
+    }
+
+    auto CPUSkinnedModel::RayTest(
+        const std::vector<CPUSkinnedVertices>& vertices,
+        const std::pair<Float3, Float3>& modelSpaceRay) const -> Intersection
+    {
+        Intersection result;
+        for (unsigned m=0; m<std::min(_meshes.size(), vertices.size()); ++m) {
+            unsigned triangle = ~0u;
+            auto distance = _meshes[m].RayTest(vertices[m], modelSpaceRay, &triangle);
+            if (distance < result._distance) {
+                result._distance = distance;
+                result._meshIndex = m;
+                result._triangleIndex = triangle;
+            }
+        }
+        return result;
+    }
+
+    CPUSkinnedModel::Intersection::Intersection()
+    : _distance(FLT_MAX), _meshIndex(~0u), _triangleIndex(~0u)
+    {}
+
+    CPUSkinnedModel::CPUSkinnedModel(const ModelScaffold& scaffold)
+    : _scaffold(&scaffold)
+    {
+        auto& data = scaffold.ImmutableData();
+        auto largeBlocksOffset = scaffold.LargeBlocksOffset();
+        BasicFile file(scaffold.Filename().c_str(), "rb");
+
+        auto loadBlock = [&file, largeBlocksOffset](std::vector<uint8>& dst, unsigned offset, unsigned size)
+        {
+            dst.resize(size);
+            if (!size) return;
+            file.Seek(largeBlocksOffset + offset, SEEK_SET);
+            file.Read(AsPointer(dst.begin()), 1, size);
+        };
+
+        std::vector<uint8> animated, binding, indices;
+        _meshes.reserve(data._boundSkinnedControllerCount);
+        for (unsigned c=0; c<data._boundSkinnedControllerCount; ++c) {
+            const auto& geo = data._boundSkinnedControllers[c];
+            loadBlock(animated, geo._animatedVertexElements._offset, geo._animatedVertexElements._size);
+            loadBlock(binding, geo._skeletonBinding._offset, geo._skeletonBinding._size);
+            loadBlock(indices, geo._ib._offset, geo._ib._size);
+            _meshes.push_back(CPUSkinningMesh(
+                geo, AsPointer(animated.cbegin()), AsPointer(binding.cbegin()),
+                indices.empty() ? nullptr : AsPointer(indices.cbegin())));
+        }
+    }
+
+    CPUSkinnedModel::CPUSkinnedModel(CPUSkinnedModel&& moveFrom)
+    : _meshes(std::move(moveFrom._meshes))
+    , _scaffold(moveFrom._scaffold)
+    {}
+
+    CPUSkinnedModel& CPUSkinnedModel::operator=(CPUSkinnedModel&& moveFrom)
+    {
+        _meshes = std::move(moveFrom._meshes);
+        _scaffold = moveFrom._scaffold;
+        return *this;
+    }
+
+    CPUSkinnedModel::~CPUSkinnedModel() {}
+
+}}
+
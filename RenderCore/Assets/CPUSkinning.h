@@ -0,0 +1,209 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Vector.h"
+#include "../../Math/Matrix.h"
+#include "../../Core/Types.h"
+#include <vector>
+#include <utility>
+
+namespace RenderCore { namespace Assets
+{
+    class BoundSkinnedGeometry;
+    class SkeletonBinding;
+    class ModelScaffold;
+
+    /// Container for CPUSkinningMethod::Enum
+    namespace CPUSkinningMethod
+    {
+        enum Enum
+        {
+            LinearBlend,        ///< same result as the GPU skinning shaders
+            DualQuaternion      ///< avoids "candy wrapper" collapse, but ignores scale in the joint transforms
+        };
+    }
+
+    /// <summary>Skinned vertex positions (and normals) written by CPUSkinningMesh</summary>
+    /// The vertices are stored in "structure of arrays" form. All of the x components
+    /// come first, then all of the y components, and so on. Each component array is
+    /// _stride floats long. When there are normals, they follow the positions in the
+    /// same form.
+    class CPUSkinnedVertices
+    {
+    public:
+        std::vector<float>  _streams;
+        unsigned            _vertexCount, _stride;
+        bool                _hasNormals;
+
+        Float3      GetPosition(unsigned vertex) const;
+        Float3      GetNormal(unsigned vertex) const;
+        const float* GetComponent(unsigned component) const { return &_streams[component*_stride]; }
+
+        CPUSkinnedVertices();
+        CPUSkinnedVertices(CPUSkinnedVertices&& moveFrom);
+        CPUSkinnedVertices& operator=(CPUSkinnedVertices&& moveFrom);
+        ~CPUSkinnedVertices();
+    };
+
+    /// <summary>Reference implementation of skinning on the CPU</summary>
+    /// This applies the same skinning as the GPU skinning shaders (see SkinningRunTime.cpp
+    /// and skinning.vsh), using the same joint matrices. But there is no device involved,
+    /// so it can be used for picking against animated meshes, for server side hit tests
+    /// and for tests and benchmarks in headless builds.
+    ///
+    /// The source vertices are rearranged into "structure of arrays" form when the
+    /// mesh is constructed. Skinning then processes 4 vertices at a time with SSE.
+    /// As with the GPU path, vertices are split into sections by the number of weights
+    /// they use (the "preskinning" draw calls in BoundSkinnedGeometry).
+    ///
+    /// The object is immutable after construction, so many threads can skin the same
+    /// mesh at the same time (into different outputs).
+    class CPUSkinningMesh
+    {
+    public:
+        class Section
+        {
+        public:
+            unsigned _firstVertex, _vertexCount, _influenceCount;
+        };
+
+        void Skin(
+            CPUSkinnedVertices& output,
+            const Float3x4 jointTransforms[], unsigned jointTransformCount,
+            CPUSkinningMethod::Enum method = CPUSkinningMethod::LinearBlend) const;
+
+            /// <summary>Finds the closest triangle that intersects the given ray</summary>
+            /// The ray is a start and end point, in the same space as the skinned vertices
+            /// (model space). Returns the distance from the ray start to the intersection,
+            /// or FLT_MAX if there is no intersection. Triangles are tested from both sides.
+        float RayTest(
+            const CPUSkinnedVertices& vertices,
+            const std::pair<Float3, Float3>& ray,
+            unsigned* triangleIndex = nullptr) const;
+
+        unsigned    GetVertexCount() const      { return _vertexCount; }
+        unsigned    GetTriangleCount() const    { return unsigned(_triangles.size()/3); }
+        unsigned    GetPaletteSize() const      { return _paletteSize; }
+        bool        HasNormals() const          { return !_normals.empty(); }
+
+            /// <summary>The unskinned data for a single vertex</summary>
+            /// Only the first _influenceCount weights and joint indices are used
+            /// (vertices with no influences pass through unchanged). This is slow;
+            /// it's intended for tests and debugging tools.
+        class SourceVertex
+        {
+        public:
+            Float3      _position, _normal;
+            Float4      _weights;
+            UInt4       _jointIndices;
+            unsigned    _influenceCount;
+        };
+        SourceVertex GetSourceVertex(unsigned vertex) const;
+
+            /// <summary>Build from the data in a model file</summary>
+            /// The pointers are the raw bytes of the animated vertex elements, the
+            /// skeleton binding elements and the index buffer (as they appear in the
+            /// large blocks of the model file).
+        CPUSkinningMesh(
+            const BoundSkinnedGeometry& geo,
+            const void* animatedVertices,
+            const void* skeletonBindingVertices,
+            const void* indices);
+
+            /// <summary>Build from plain arrays</summary>
+            /// "normals" can be null. Each section uses the first _influenceCount entries
+            /// in the weights and joint indices for its vertices.
+        CPUSkinningMesh(
+            const Float3 positions[], const Float3 normals[],
+            const Float4 weights[], const UInt4 jointIndices[],
+            unsigned vertexCount,
+            const Section sections[], unsigned sectionCount,
+            const unsigned triangleIndices[], unsigned indexCount);
+
+        CPUSkinningMesh();
+        CPUSkinningMesh(CPUSkinningMesh&& moveFrom);
+        CPUSkinningMesh& operator=(CPUSkinningMesh&& moveFrom);
+        ~CPUSkinningMesh();
+
+    private:
+        std::vector<float>      _positions;     // 3 * _stride (x, y, z)
+        std::vector<float>      _normals;       // 3 * _stride, or empty
+        std::vector<float>      _weights;       // 4 * _stride
+        std::vector<uint16>     _joints;        // 4 * _stride
+        std::vector<Section>    _sections;
+        std::vector<unsigned>   _triangles;
+        unsigned                _vertexCount, _stride;
+        unsigned                _paletteSize;
+
+        void Allocate(unsigned vertexCount, bool hasNormals);
+        void CompleteSections();
+    };
+
+    /// <summary>One mesh to skin with CPUSkinMeshes</summary>
+    class CPUSkinningJob
+    {
+    public:
+        const CPUSkinningMesh*  _mesh;
+        const Float3x4*         _jointTransforms;
+        unsigned                _jointTransformCount;
+        CPUSkinnedVertices*     _output;
+    };
+
+    /// <summary>Skins a batch of meshes, in parallel</summary>
+    /// The jobs are split across the short task thread pool, and this function returns
+    /// when they are all complete. Gather the meshes from many characters into a single
+    /// call, so there are enough jobs to keep the workers busy.
+    void CPUSkinMeshes(
+        const CPUSkinningJob jobs[], size_t jobCount,
+        CPUSkinningMethod::Enum method = CPUSkinningMethod::LinearBlend);
+
+    /// <summary>CPU skinning for every skinned mesh in a model</summary>
+    /// Loads the skinned geometry from the model file, and then works with the same
+    /// transformation machine output and SkeletonBinding as ModelRenderer::PrepareAnimation.
+    /// There is one mesh for each BoundSkinnedGeometry in the scaffold, and outputs
+    /// are in model space.
+    ///
+    /// The scaffold must remain valid for the lifetime of this object.
+    class CPUSkinnedModel
+    {
+    public:
+        void Skin(
+            std::vector<CPUSkinnedVertices>& output,
+            const Float4x4 transformationMachineResult[],
+            const SkeletonBinding& skeletonBinding,
+            CPUSkinningMethod::Enum method = CPUSkinningMethod::LinearBlend) const;
+
+        class Intersection
+        {
+        public:
+            float       _distance;
+            unsigned    _meshIndex, _triangleIndex;
+            Intersection();
+        };
+
+            /// <summary>Closest intersection between a model space ray and the skinned meshes</summary>
+            /// "vertices" should be the result of Skin(). _distance is FLT_MAX if there is
+            /// no intersection.
+        Intersection RayTest(
+            const std::vector<CPUSkinnedVertices>& vertices,
+            const std::pair<Float3, Float3>& modelSpaceRay) const;
+
+        unsigned                GetMeshCount() const            { return unsigned(_meshes.size()); }
+        const CPUSkinningMesh&  GetMesh(unsigned index) const   { return _meshes[index]; }
+
+        CPUSkinnedModel(const ModelScaffold& scaffold);
+        CPUSkinnedModel(CPUSkinnedModel&& moveFrom);
+        CPUSkinnedModel& operator=(CPUSkinnedModel&& moveFrom);
+        ~CPUSkinnedModel();
+
+    private:
+        std::vector<CPUSkinningMesh>    _meshes;
+        const ModelScaffold*            _scaffold;
+    };
+}}
+
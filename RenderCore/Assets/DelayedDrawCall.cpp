@@ -22,6 +22,65 @@ namespace RenderCore { namespace Assets
         return _guid;
     }
 
+    void DelayedDrawCallSet::Append(const DelayedDrawCallSet& src)
+    {
+        assert(src._guid == _guid);
+        auto transformBase = unsigned(_transforms.size());
+        _transforms.insert(_transforms.end(), src._transforms.cbegin(), src._transforms.cend());
+        for (unsigned c=0; c<dimof(_entries); ++c) {
+            auto& dst = _entries[c];
+            auto start = dst.size();
+            dst.insert(dst.end(), src._entries[c].cbegin(), src._entries[c].cend());
+            for (auto i=dst.begin()+start; i!=dst.end(); ++i)
+                i->_meshToWorld += transformBase;
+        }
+    }
+
+    void DelayedDrawCallSet::BuildInstances()
+    {
+        std::vector<Float4x4> packedTransforms;
+        packedTransforms.reserve(_transforms.size());
+
+        for (unsigned c=0; c<dimof(_entries); ++c) {
+            auto& entries = _entries[c];
+            if (entries.empty()) continue;
+
+                //  Draw calls are uniquely identified by the renderer and the draw call
+                //  index. Everything else (except the transform) should be identical.
+                //  Stable sort so the instances stay in the same order they were prepared
+            std::stable_sort(
+                entries.begin(), entries.end(),
+                [](const DelayedDrawCall& lhs, const DelayedDrawCall& rhs)
+                {
+                    if (lhs._renderer != rhs._renderer) return lhs._renderer < rhs._renderer;
+                    return lhs._drawCallIndex < rhs._drawCallIndex;
+                });
+
+            auto dst = entries.begin();
+            for (auto i=entries.cbegin(); i!=entries.cend();) {
+                auto groupEnd = i+1;
+                while (groupEnd != entries.cend() && groupEnd->_renderer == i->_renderer && groupEnd->_drawCallIndex == i->_drawCallIndex)
+                    ++groupEnd;
+
+                DelayedDrawCall instanced = *i;
+                instanced._meshToWorld = unsigned(packedTransforms.size());
+                instanced._instanceCount = 0;
+                for (auto g=i; g!=groupEnd; ++g) {
+                    packedTransforms.insert(
+                        packedTransforms.end(), 
+                        _transforms.cbegin() + g->_meshToWorld, 
+                        _transforms.cbegin() + g->_meshToWorld + g->_instanceCount);
+                    instanced._instanceCount += g->_instanceCount;
+                }
+                *dst++ = instanced;
+                i = groupEnd;
+            }
+            entries.erase(dst, entries.end());
+        }
+
+        _transforms.swap(packedTransforms);
+    }
+
     DelayedDrawCallSet::DelayedDrawCallSet(size_t rendererGuid) 
     {
         _guid = rendererGuid;
@@ -28,6 +28,7 @@ namespace RenderCore { namespace Assets
         const void*     _subMesh;
         unsigned        _drawCallIndex;
         unsigned        _meshToWorld;       // index into "_transforms" in the DelayedDrawCallSet
+        unsigned        _instanceCount;     // transforms for each instance follow on from _meshToWorld
 
             // 
         unsigned        _indexCount, _firstIndex, _firstVertex;
@@ -74,6 +75,19 @@ namespace RenderCore { namespace Assets
         
         void        Reset();
         void        Filter(const Predicate& predicate);
+
+        /// <summary>Append all of the draw calls from another set</summary>
+        /// Transform indices in the appended draw calls are adjusted to
+        /// match. Both sets must be associated with the same renderer type.
+        void        Append(const DelayedDrawCallSet& src);
+
+        /// <summary>Collapse repeated draw calls into instanced draw calls</summary>
+        /// Draw calls that differ only by transform (ie, the same draw call from the
+        /// same renderer) are merged into a single entry, and the transforms for
+        /// all instances are packed into a contiguous range of "_transforms". This
+        /// range can be used directly as the source for an instance buffer.
+        /// The relative order of instances is preserved.
+        void        BuildInstances();
         size_t      GetRendererGUID() const;
             
         DelayedDrawCallSet(size_t rendererGuid);
@@ -0,0 +1,374 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "FlatTransformationMachine.h"
+#include "TransformationCommands.h"
+#include "../../Math/Transformations.h"
+#include "../../ConsoleRig/Log.h"
+#include "../../Core/Exceptions.h"
+#include <intrin.h>
+
+namespace RenderCore { namespace Assets
+{
+    static const unsigned NoNode = ~unsigned(0x0);
+
+    static_assert(sizeof(Float4x4) == 16*sizeof(float), "Expecting tightly packed 4x4 matrices");
+
+    static inline void Concatenate(Float4x4& dst, const Float4x4& lhs, const Float4x4& rhs)
+    {
+            //  dst = lhs * rhs (ie, the same as Combine(rhs, lhs))
+            //  Float4x4 is stored row-major, so each row of the result is
+            //  a linear combination of the rows of rhs. All of rhs is loaded
+            //  before anything is written, and each row of lhs is read before
+            //  the same row of dst is written, so dst can alias either input.
+        const float* a = AsFloatArray(lhs);
+        const float* b = AsFloatArray(rhs);
+        float* d = AsFloatArray(dst);
+        auto b0 = _mm_loadu_ps(b), b1 = _mm_loadu_ps(b+4), b2 = _mm_loadu_ps(b+8), b3 = _mm_loadu_ps(b+12);
+        for (unsigned r=0; r<4; ++r) {
+            auto row = _mm_mul_ps(_mm_set1_ps(a[r*4+0]), b0);
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[r*4+1]), b1));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[r*4+2]), b2));
+            row = _mm_add_ps(row, _mm_mul_ps(_mm_set1_ps(a[r*4+3]), b3));
+            _mm_storeu_ps(d+r*4, row);
+        }
+    }
+
+    void FlatTransformationMachine::GenerateOutputTransforms(
+        Float4x4 output[], unsigned outputCount,
+        const TransformationParameterSet* parameterSet,
+        Float4x4 workingSpace[]) const
+    {
+        if (outputCount < _outputMatrixCount) {
+            Throw(::Exceptions::BasicLabel("Output buffer to FlatTransformationMachine::GenerateOutputTransforms is too small"));
+        }
+
+        const float*    float1s = nullptr;
+        const Float3*   float3s = nullptr;
+        const Float4*   float4s = nullptr;
+        const Float4x4* float4x4s = nullptr;
+        size_t float1Count = 0, float3Count = 0, float4Count = 0, float4x4Count = 0;
+        if (parameterSet) {
+            float1s         = parameterSet->GetFloat1Parameters();
+            float3s         = parameterSet->GetFloat3Parameters();
+            float4s         = parameterSet->GetFloat4Parameters();
+            float4x4s       = parameterSet->GetFloat4x4Parameters();
+            float1Count     = parameterSet->GetFloat1ParametersCount();
+            float3Count     = parameterSet->GetFloat3ParametersCount();
+            float4Count     = parameterSet->GetFloat4ParametersCount();
+            float4x4Count   = parameterSet->GetFloat4x4ParametersCount();
+        }
+
+        for (size_t n=0; n<_nodes.size(); ++n) {
+            const auto& node = _nodes[n];
+            auto& world = workingSpace[n];
+            if (node._constantWorld != NoNode) {
+                world = _staticMatrices[node._constantWorld];
+                continue;
+            }
+
+            auto op = &_ops[node._firstOp], opEnd = op + node._opCount;
+            const Float4x4* parent = (node._parent != NoNode) ? &workingSpace[node._parent] : nullptr;
+            if (parent && op->_command == TransformStackCommand::TransformFloat4x4_Static) {
+                Concatenate(world, *parent, _staticMatrices[op->_index]);
+                ++op;
+            } else {
+                world = parent ? *parent : Identity<Float4x4>();
+            }
+
+            for (; op!=opEnd; ++op) {
+                auto parameterIndex = op->_index;
+                switch (op->_command) {
+                case TransformStackCommand::TransformFloat4x4_Static:
+                    Concatenate(world, world, _staticMatrices[parameterIndex]);
+                    break;
+
+                case TransformStackCommand::ArbitraryScale_Static:
+                    Combine_InPlace(ArbitraryScale(_staticScales[parameterIndex]), world);
+                    break;
+
+                case TransformStackCommand::TransformFloat4x4_Parameter:
+                    if (parameterIndex < float4x4Count) {
+                        Concatenate(world, world, float4x4s[parameterIndex]);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for TransformFloat4x4_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::Translate_Parameter:
+                    if (parameterIndex < float3Count) {
+                        Combine_InPlace(float3s[parameterIndex], world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for Translate_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::RotateX_Parameter:
+                    if (parameterIndex < float1Count) {
+                        Combine_InPlace(RotationX(Deg2Rad(float1s[parameterIndex])), world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for RotateX_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::RotateY_Parameter:
+                    if (parameterIndex < float1Count) {
+                        Combine_InPlace(RotationY(Deg2Rad(float1s[parameterIndex])), world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for RotateY_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::RotateZ_Parameter:
+                    if (parameterIndex < float1Count) {
+                        Combine_InPlace(RotationZ(Deg2Rad(float1s[parameterIndex])), world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for RotateZ_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::Rotate_Parameter:
+                    if (parameterIndex < float4Count) {
+                        world = Combine(MakeRotationMatrix(Truncate(float4s[parameterIndex]), Deg2Rad(float4s[parameterIndex][3])), world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for Rotate_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::UniformScale_Parameter:
+                    if (parameterIndex < float1Count) {
+                        Combine_InPlace(UniformScale(float1s[parameterIndex]), world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for UniformScale_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+
+                case TransformStackCommand::ArbitraryScale_Parameter:
+                    if (parameterIndex < float3Count) {
+                        Combine_InPlace(ArbitraryScale(float3s[parameterIndex]), world);
+                    } else {
+                        LogWarning << "Warning -- bad parameter index for ArbitraryScale_Parameter command (" << parameterIndex << ")";
+                    }
+                    break;
+                }
+            }
+        }
+
+        for (auto i=_outputs.cbegin(); i!=_outputs.cend(); ++i) {
+            output[i->first] = (i->second != NoNode) ? workingSpace[i->second] : Identity<Float4x4>();
+        }
+    }
+
+    FlatTransformationMachine::FlatTransformationMachine(
+        const uint32* commandStreamBegin, const uint32* commandStreamEnd,
+        unsigned outputMatrixCount)
+    : _outputMatrixCount(outputMatrixCount)
+    {
+            //
+            //      Walk through the command stream, in the same way as
+            //      GenerateOutputTransformsFree. But instead of a stack of matrices,
+            //      we have a stack of node indices. A node can only be extended while
+            //      nothing else depends on it -- once it's been used as a parent or
+            //      written to the output, further transforms start a new child node.
+            //
+        unsigned workingStack[64];
+        unsigned* workingNode = workingStack;
+        *workingNode = NoNode;
+        std::vector<bool> sealed;
+
+        auto currentNode = [&]() -> Node&
+        {
+            if (*workingNode == NoNode || sealed[*workingNode]) {
+                Node node;
+                node._parent = *workingNode;
+                node._firstOp = unsigned(_ops.size());
+                node._opCount = 0;
+                node._constantWorld = NoNode;
+                *workingNode = unsigned(_nodes.size());
+                _nodes.push_back(node);
+                sealed.push_back(false);
+            }
+            return _nodes[*workingNode];
+        };
+
+        auto staticTransform = [&]() -> Float4x4&
+        {
+                //  consecutive static transforms on the same node get folded together
+            auto& node = currentNode();
+            if (!node._opCount || _ops[node._firstOp+node._opCount-1]._command != TransformStackCommand::TransformFloat4x4_Static) {
+                Op op = { TransformStackCommand::TransformFloat4x4_Static, uint32(_staticMatrices.size()) };
+                _ops.push_back(op);
+                ++node._opCount;
+                _staticMatrices.push_back(Identity<Float4x4>());
+            }
+            return _staticMatrices[_ops[node._firstOp+node._opCount-1]._index];
+        };
+
+        auto parameterTransform = [&](uint32 command, uint32 parameterIndex)
+        {
+            auto& node = currentNode();
+            Op op = { command, parameterIndex };
+            _ops.push_back(op);
+            ++node._opCount;
+        };
+
+        for (auto i=commandStreamBegin; i!=commandStreamEnd;) {
+            auto commandIndex = *i++;
+            switch (commandIndex) {
+            case TransformStackCommand::PushLocalToWorld:
+                if ((workingNode+1) >= &workingStack[dimof(workingStack)]) {
+                    Throw(::Exceptions::BasicLabel("Exceeded maximum stack depth in FlatTransformationMachine"));
+                }
+                if (*workingNode != NoNode) { sealed[*workingNode] = true; }
+                *(workingNode+1) = *workingNode;
+                ++workingNode;
+                break;
+
+            case TransformStackCommand::PopLocalToWorld:
+                {
+                    auto popCount = *i++;
+                    if (workingNode < workingStack+popCount) {
+                        Throw(::Exceptions::BasicLabel("Stack underflow in FlatTransformationMachine"));
+                    }
+                    workingNode -= popCount;
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4_Static:
+                {
+                    const Float4x4& transformMatrix = *reinterpret_cast<const Float4x4*>(i);
+                    i += 16;
+                    auto& m = staticTransform();
+                    m = Combine(transformMatrix, m);
+                }
+                break;
+
+            case TransformStackCommand::Translate_Static:
+                Combine_InPlace(AsFloat3(reinterpret_cast<const float*>(i)), staticTransform());
+                i += 3;
+                break;
+
+            case TransformStackCommand::RotateX_Static:
+                Combine_InPlace(RotationX(Deg2Rad(*reinterpret_cast<const float*>(i))), staticTransform());
+                i++;
+                break;
+
+            case TransformStackCommand::RotateY_Static:
+                Combine_InPlace(RotationY(Deg2Rad(*reinterpret_cast<const float*>(i))), staticTransform());
+                i++;
+                break;
+
+            case TransformStackCommand::RotateZ_Static:
+                Combine_InPlace(RotationZ(Deg2Rad(*reinterpret_cast<const float*>(i))), staticTransform());
+                i++;
+                break;
+
+            case TransformStackCommand::Rotate_Static:
+                {
+                    auto& m = staticTransform();
+                    m = Combine(MakeRotationMatrix(AsFloat3(reinterpret_cast<const float*>(i)), Deg2Rad(*reinterpret_cast<const float*>(i+3))), m);
+                    i += 4;
+                }
+                break;
+
+            case TransformStackCommand::UniformScale_Static:
+                Combine_InPlace(UniformScale(*reinterpret_cast<const float*>(i)), staticTransform());
+                i++;
+                break;
+
+            case TransformStackCommand::ArbitraryScale_Static:
+                    //  Combine_InPlace with an ArbitraryScale scales the rows of the 3x3
+                    //  part. That isn't the same as multiplying by a scale matrix, so this
+                    //  can't be folded in with the other static transforms.
+                {
+                    auto& node = currentNode();
+                    Op op = { TransformStackCommand::ArbitraryScale_Static, uint32(_staticScales.size()) };
+                    _ops.push_back(op);
+                    ++node._opCount;
+                    _staticScales.push_back(AsFloat3(reinterpret_cast<const float*>(i)));
+                    i+=3;
+                }
+                break;
+
+            case TransformStackCommand::TransformFloat4x4_Parameter:
+            case TransformStackCommand::Translate_Parameter:
+            case TransformStackCommand::RotateX_Parameter:
+            case TransformStackCommand::RotateY_Parameter:
+            case TransformStackCommand::RotateZ_Parameter:
+            case TransformStackCommand::Rotate_Parameter:
+            case TransformStackCommand::UniformScale_Parameter:
+            case TransformStackCommand::ArbitraryScale_Parameter:
+                parameterTransform(commandIndex, *i++);
+                break;
+
+            case TransformStackCommand::WriteOutputMatrix:
+                {
+                    uint32 outputIndex = *i++;
+                    if (outputIndex < outputMatrixCount) {
+                        if (*workingNode != NoNode) { sealed[*workingNode] = true; }
+                        _outputs.push_back(std::make_pair(unsigned(outputIndex), *workingNode));
+                    } else {
+                        LogWarning << "Warning -- bad output matrix index (" << outputIndex << ")";
+                    }
+                }
+                break;
+            }
+        }
+
+            //  Nodes that have only static transforms, and a parent that is either
+            //  the root or also constant, never change. We can evaluate them now.
+        for (auto n=_nodes.begin(); n!=_nodes.end(); ++n) {
+            if (n->_parent != NoNode && _nodes[n->_parent]._constantWorld == NoNode) continue;
+
+            auto op = _ops.cbegin() + n->_firstOp, opEnd = op + n->_opCount;
+            bool allStatic = true;
+            for (auto o=op; o!=opEnd; ++o)
+                allStatic &= (o->_command == TransformStackCommand::TransformFloat4x4_Static || o->_command == TransformStackCommand::ArbitraryScale_Static);
+            if (!allStatic) continue;
+
+            Float4x4 world = (n->_parent != NoNode) ? _staticMatrices[_nodes[n->_parent]._constantWorld] : Identity<Float4x4>();
+            for (; op!=opEnd; ++op) {
+                if (op->_command == TransformStackCommand::TransformFloat4x4_Static) {
+                    Concatenate(world, world, _staticMatrices[op->_index]);
+                } else {
+                    Combine_InPlace(ArbitraryScale(_staticScales[op->_index]), world);
+                }
+            }
+            n->_constantWorld = unsigned(_staticMatrices.size());
+            _staticMatrices.push_back(world);
+        }
+    }
+
+    FlatTransformationMachine::FlatTransformationMachine()
+    : _outputMatrixCount(0)
+    {}
+
+    FlatTransformationMachine::FlatTransformationMachine(FlatTransformationMachine&& moveFrom)
+    : _nodes(std::move(moveFrom._nodes))
+    , _ops(std::move(moveFrom._ops))
+    , _staticMatrices(std::move(moveFrom._staticMatrices))
+    , _staticScales(std::move(moveFrom._staticScales))
+    , _outputs(std::move(moveFrom._outputs))
+    , _outputMatrixCount(moveFrom._outputMatrixCount)
+    {
+        moveFrom._outputMatrixCount = 0;
+    }
+
+    FlatTransformationMachine& FlatTransformationMachine::operator=(FlatTransformationMachine&& moveFrom)
+    {
+        _nodes = std::move(moveFrom._nodes);
+        _ops = std::move(moveFrom._ops);
+        _staticMatrices = std::move(moveFrom._staticMatrices);
+        _staticScales = std::move(moveFrom._staticScales);
+        _outputs = std::move(moveFrom._outputs);
+        _outputMatrixCount = moveFrom._outputMatrixCount;
+        moveFrom._outputMatrixCount = 0;
+        return *this;
+    }
+
+    FlatTransformationMachine::~FlatTransformationMachine() {}
+}}
+
@@ -0,0 +1,77 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../../Math/Vector.h"
+#include "../../Math/Matrix.h"
+#include "../../Core/Types.h"
+#include <vector>
+
+namespace RenderCore { namespace Assets
+{
+    class TransformationParameterSet;
+
+    /// <summary>Transformation machine command stream compiled into a flat table</summary>
+    /// The command stream in a TransformationMachine is a small stack machine, and
+    /// GenerateOutputTransformsFree interprets it from scratch every time. Here, the
+    /// push and pop operations are resolved once, when the object is constructed. The
+    /// result is a list of nodes, each with a parent index and a short list of local
+    /// transforms. Parents always come before their children, so evaluation is a
+    /// single forward loop with no stack.
+    ///
+    /// Runs of static transforms are folded into a single matrix, and nodes that
+    /// only depend on static transforms are evaluated completely up front. Matrix
+    /// concatenation uses SSE.
+    ///
+    /// The results should match GenerateOutputTransformsFree (other than rounding from
+    /// the folded static transforms). The object is immutable after construction, so
+    /// it can be used from multiple threads at the same time, as long as each thread
+    /// provides its own working space.
+    class FlatTransformationMachine
+    {
+    public:
+        void GenerateOutputTransforms(
+            Float4x4 output[], unsigned outputCount,
+            const TransformationParameterSet* parameterSet,
+            Float4x4 workingSpace[]) const;
+
+        unsigned    GetOutputMatrixCount() const    { return _outputMatrixCount; }
+        unsigned    GetWorkingSpaceCount() const    { return unsigned(_nodes.size()); }
+
+        FlatTransformationMachine(
+            const uint32* commandStreamBegin, const uint32* commandStreamEnd,
+            unsigned outputMatrixCount);
+        FlatTransformationMachine();
+        FlatTransformationMachine(FlatTransformationMachine&& moveFrom);
+        FlatTransformationMachine& operator=(FlatTransformationMachine&& moveFrom);
+        ~FlatTransformationMachine();
+
+    private:
+        class Node
+        {
+        public:
+            unsigned    _parent;            // ~0u for the root (identity)
+            unsigned    _firstOp, _opCount;
+            unsigned    _constantWorld;     // index into _staticMatrices, or ~0u if the node is animated
+        };
+
+        class Op
+        {
+        public:
+            uint32      _command;           // TransformStackCommand::Enum
+            uint32      _index;             // parameter index, or index into _staticMatrices or _staticScales for static transforms
+        };
+
+        std::vector<Node>       _nodes;
+        std::vector<Op>         _ops;
+        std::vector<Float4x4>   _staticMatrices;
+        std::vector<Float3>     _staticScales;
+        std::vector<std::pair<unsigned, unsigned>> _outputs;    // (output matrix index, node index)
+        unsigned                _outputMatrixCount;
+    };
+}}
+
@@ -268,6 +268,8 @@ namespace RenderCore { namespace Assets
         char intName[MaxPath];
         intermediateStore.MakeIntermediateName(intName, dimof(intName), shaderBaseFilename);
         auto newArchive = std::make_shared<::Assets::ArchiveCache>(intName, VersionString, BuildDateString);
+            // many shader variants get committed during a session; so append rather than rewriting
+        newArchive->SetFlushMode(::Assets::ArchiveCache::FlushMode::AppendLog);
         _archives.insert(existing, std::make_pair(hashedName, newArchive));
         return std::move(newArchive);
     }
@@ -12,6 +12,7 @@
 #include "../../Assets/CompileAndAsyncManager.h"
 #include "../../Assets/IntermediateAssets.h"
 #include "../../Utility/HeapUtils.h"
+#include "../../Utility/Threading/Mutex.h"
 #include <map>
 
 namespace RenderCore { namespace Assets
@@ -21,10 +22,14 @@ namespace RenderCore { namespace Assets
     {
     public:
         std::map<uint64, BoundingBox> _boundingBoxes;
+        Threading::Mutex _boundingBoxesLock;
 
-        LRUCache<ModelScaffold>     _modelScaffolds;
-        LRUCache<MaterialScaffold>  _materialScaffolds;
-        LRUCache<ModelRenderer>     _modelRenderers;
+        ConcurrentLRUCache<ModelScaffold>     _modelScaffolds;
+        ConcurrentLRUCache<MaterialScaffold>  _materialScaffolds;
+        ConcurrentLRUCache<ModelRenderer>     _modelRenderers;
+
+            // ModelRenderer construction uses the SharedStateSet, which isn't thread safe
+        Threading::Mutex _rendererConstructionLock;
 
         std::shared_ptr<RenderCore::Assets::IModelFormat> _format;
         std::unique_ptr<SharedStateSet> _sharedStateSet;
@@ -36,7 +41,7 @@ namespace RenderCore { namespace Assets
     ModelCache::Pimpl::Pimpl(const ModelCache::Config& cfg)
     : _modelScaffolds(cfg._modelScaffoldCount)
     , _materialScaffolds(cfg._materialScaffoldCount)
-    , _modelRenderers(cfg._rendererCount)
+    , _modelRenderers(cfg._rendererCount, 4)      // (few shards, because there are few renderers)
     {
     }
 
@@ -69,6 +74,19 @@ namespace RenderCore { namespace Assets
                 inits, dimof(inits), store);
             return std::make_shared<MaterialScaffold>(std::move(marker));
         }
+
+            //  ModelRenderer keeps pointers into the scaffolds it was built from. So the
+            //  cached renderer owns references to them, and they won't be destroyed while
+            //  the renderer is alive (even if they're evicted from the scaffold caches).
+            //  This also means the scaffold addresses in the renderer hash can't be reused
+            //  by other scaffolds while the renderer is in the cache.
+        class PinnedRenderer
+        {
+        public:
+            std::shared_ptr<ModelScaffold> _model;
+            std::shared_ptr<MaterialScaffold> _material;
+            std::unique_ptr<ModelRenderer> _renderer;
+        };
     }
 
     auto ModelCache::GetScaffolds(
@@ -77,12 +95,7 @@ namespace RenderCore { namespace Assets
     {
         Scaffolds result;
         result._hashedModelName = Hash64(modelFilename);
-        result._model = _pimpl->_modelScaffolds.Get(result._hashedModelName).get();
-        if (!result._model || result._model->GetDependencyValidation()->GetValidationIndex() > 0) {
-            auto model = Internal::CreateModelScaffold(modelFilename, *_pimpl->_format);
-            _pimpl->_modelScaffolds.Insert(result._hashedModelName, model);
-            result._model = model.get();
-        }
+        result._model = GetModelScaffold(modelFilename);
 
             // We can't build the material properly until the material scaffold is ready
             // So don't even try unless we get a successful resolve
@@ -90,12 +103,12 @@ namespace RenderCore { namespace Assets
             result._hashedMaterialName = HashCombine(Hash64(materialFilename), result._hashedModelName);
             auto matNamePtr = materialFilename;
 
-            result._material = _pimpl->_materialScaffolds.Get(result._hashedMaterialName).get();
-            if (!result._material || result._material->GetDependencyValidation()->GetValidationIndex() > 0) {
-                auto mat = Internal::CreateMaterialScaffold(modelFilename, matNamePtr, *_pimpl->_format);
-                _pimpl->_materialScaffolds.Insert(result._hashedMaterialName, mat);
-                result._material = mat.get();
+            auto mat = _pimpl->_materialScaffolds.Get(result._hashedMaterialName);
+            if (!mat || mat->GetDependencyValidation()->GetValidationIndex() > 0) {
+                auto newMat = Internal::CreateMaterialScaffold(modelFilename, matNamePtr, *_pimpl->_format);
+                mat = _pimpl->_materialScaffolds.CompareAndInsert(result._hashedMaterialName, mat, std::move(newMat));
             }
+            result._material = std::move(mat);
         } else {
             result._material = nullptr;
         }
@@ -115,32 +128,44 @@ namespace RenderCore { namespace Assets
         auto maxLOD = scaffold._model->GetMaxLOD();
         LOD = std::min(LOD, maxLOD);
 
-        uint64 hashedModel = (uint64(scaffold._model) << 2ull) | (uint64(scaffold._material) << 48ull) | uint64(LOD);
+        uint64 hashedModel = (uint64(scaffold._model.get()) << 2ull) | (uint64(scaffold._material.get()) << 48ull) | uint64(LOD);
         auto renderer = _pimpl->_modelRenderers.Get(hashedModel);
         if (!renderer) {
-            auto searchRules = ::Assets::DefaultDirectorySearchRules(modelFilename);
-            searchRules.AddSearchDirectoryFromFilename(materialFilename);
-            renderer = std::make_shared<ModelRenderer>(
-                std::ref(*scaffold._model), std::ref(*scaffold._material), 
-                std::ref(*_pimpl->_sharedStateSet), &searchRules, LOD);
-
-            _pimpl->_modelRenderers.Insert(hashedModel, renderer);
+            ScopedLock(_pimpl->_rendererConstructionLock);
+                // (another thread may have built it while we were waiting for the lock)
+            renderer = _pimpl->_modelRenderers.Get(hashedModel);
+            if (!renderer) {
+                auto searchRules = ::Assets::DefaultDirectorySearchRules(modelFilename);
+                searchRules.AddSearchDirectoryFromFilename(materialFilename);
+                auto pinned = std::make_shared<Internal::PinnedRenderer>();
+                pinned->_model = scaffold._model;
+                pinned->_material = scaffold._material;
+                pinned->_renderer = std::make_unique<ModelRenderer>(
+                    std::ref(*scaffold._model), std::ref(*scaffold._material), 
+                    std::ref(*_pimpl->_sharedStateSet), &searchRules, LOD);
+                renderer = std::shared_ptr<ModelRenderer>(pinned, pinned->_renderer.get());
+
+                _pimpl->_modelRenderers.Insert(hashedModel, renderer);
+            }
         }
 
             // cache the bounding box, because it's an expensive operation to recalculate
         BoundingBox boundingBox;
-        auto boundingBoxI = _pimpl->_boundingBoxes.find(scaffold._hashedModelName);
-        if (boundingBoxI== _pimpl->_boundingBoxes.end()) {
-            boundingBox = scaffold._model->GetStaticBoundingBox(0);
-            _pimpl->_boundingBoxes.insert(std::make_pair(scaffold._hashedModelName, boundingBox));
-        } else {
-            boundingBox = boundingBoxI->second;
+        {
+            ScopedLock(_pimpl->_boundingBoxesLock);
+            auto boundingBoxI = _pimpl->_boundingBoxes.find(scaffold._hashedModelName);
+            if (boundingBoxI != _pimpl->_boundingBoxes.end()) {
+                boundingBox = boundingBoxI->second;
+            } else {
+                boundingBox = scaffold._model->GetStaticBoundingBox(0);
+                _pimpl->_boundingBoxes.insert(std::make_pair(scaffold._hashedModelName, boundingBox));
+            }
         }
 
         Model result;
-        result._renderer = renderer.get();
+        result._renderer = std::move(renderer);
         result._sharedStateSet = _pimpl->_sharedStateSet.get();
-        result._model = scaffold._model;
+        result._model = std::move(scaffold._model);
         result._boundingBox = boundingBox;
         result._hashedModelName = scaffold._hashedModelName;
         result._hashedMaterialName = scaffold._hashedMaterialName;
@@ -149,16 +174,15 @@ namespace RenderCore { namespace Assets
         return result;
     }
 
-    ModelScaffold* ModelCache::GetModelScaffold(const ResChar modelFilename[])
+    std::shared_ptr<ModelScaffold> ModelCache::GetModelScaffold(const ResChar modelFilename[])
     {
         auto hashedModelName = Hash64(modelFilename);
-        auto* result = _pimpl->_modelScaffolds.Get(hashedModelName).get();
-        if (!result || result->GetDependencyValidation()->GetValidationIndex() > 0) {
-            auto model = Internal::CreateModelScaffold(modelFilename, *_pimpl->_format);
-            _pimpl->_modelScaffolds.Insert(hashedModelName, model);
-            result = model.get();
+        auto model = _pimpl->_modelScaffolds.Get(hashedModelName);
+        if (!model || model->GetDependencyValidation()->GetValidationIndex() > 0) {
+            auto newModel = Internal::CreateModelScaffold(modelFilename, *_pimpl->_format);
+            model = _pimpl->_modelScaffolds.CompareAndInsert(hashedModelName, model, std::move(newModel));
         }
-        return result;
+        return model;
     }
 
     SharedStateSet& ModelCache::GetSharedStateSet() { return *_pimpl->_sharedStateSet; }
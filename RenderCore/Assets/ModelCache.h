@@ -10,6 +10,7 @@
 #include "../../Math/Vector.h"
 #include "../../Core/Types.h"
 #include <utility>
+#include <memory>
 
 namespace RenderCore { namespace Assets
 {
@@ -19,15 +20,24 @@ namespace RenderCore { namespace Assets
     class SharedStateSet;
     class IModelFormat;
 
+    /// <summary>Caches model and material scaffolds, and model renderers</summary>
+    /// The caches are ConcurrentLRUCaches, so GetScaffolds() and GetModelScaffold() can
+    /// be called from loader threads. GetModel() is also thread safe, but renderer
+    /// construction is serialised (because it uses the shared state set).
+    ///
+    /// The results hold shared pointers, so objects stay alive for as long as the caller
+    /// holds on to them, even if another thread evicts them from the cache in the meantime.
+    /// Each cached renderer also keeps its scaffolds alive. Still, the cache sizes in
+    /// Config should be larger than the working set, or objects will be rebuilt frequently.
     class ModelCache
     {
     public:
         class Model
         {
         public:
-            ModelRenderer* _renderer;
+            std::shared_ptr<ModelRenderer> _renderer;
             SharedStateSet* _sharedStateSet;
-            ModelScaffold* _model;
+            std::shared_ptr<ModelScaffold> _model;
             std::pair<Float3, Float3> _boundingBox;
             uint64 _hashedModelName;
             uint64 _hashedMaterialName;
@@ -43,8 +53,8 @@ namespace RenderCore { namespace Assets
         class Scaffolds
         {
         public:
-            ModelScaffold* _model;
-            MaterialScaffold* _material;
+            std::shared_ptr<ModelScaffold> _model;
+            std::shared_ptr<MaterialScaffold> _material;
             uint64 _hashedModelName;
             uint64 _hashedMaterialName;
         };
@@ -69,7 +79,7 @@ namespace RenderCore { namespace Assets
             const ResChar modelFilename[], 
             const ResChar materialFilename[]);
 
-        ModelScaffold* GetModelScaffold(const ResChar modelFilename[]);
+        std::shared_ptr<ModelScaffold> GetModelScaffold(const ResChar modelFilename[]);
 
         SharedStateSet& GetSharedStateSet();
 
@@ -190,7 +190,8 @@ namespace RenderCore { namespace Assets
 
         static unsigned BuildGeoParamBox(
             const GeoInputAssembly& ia, SharedStateSet& sharedStateSet, 
-            ModelConstruction::ParamBoxDescriptions& paramBoxDesc, bool normalFromSkinning)
+            ModelConstruction::ParamBoxDescriptions& paramBoxDesc, bool normalFromSkinning,
+            bool instancedTransforms)
         {
                 //  Build a parameter box for this geometry configuration. The input assembly
             ParameterBox geoParameters;
@@ -202,6 +203,8 @@ namespace RenderCore { namespace Assets
             if (HasElement(ia, "TEXBITANGENT"))    { geoParameters.SetParameter((const utf8*)"GEO_HAS_BITANGENT", 1); }
             if (HasElement(ia, "BONEINDICES") && HasElement(ia, "BONEWEIGHTS"))
                 { geoParameters.SetParameter((const utf8*)"GEO_HAS_SKIN_WEIGHTS", 1); }
+            if (instancedTransforms)
+                { geoParameters.SetParameter((const utf8*)"GEO_INSTANCED_TRANSFORMS", 1); }
             auto result = sharedStateSet.InsertParameterBox(geoParameters);
             paramBoxDesc.Add(result, geoParameters);
             return result;
@@ -226,6 +229,7 @@ namespace RenderCore { namespace Assets
             auto skinCallCount = cmdStream.GetSkinCallCount();
             for (unsigned gi=0; gi<geoCallCount + skinCallCount; ++gi) {
                 auto& geoInst = (gi < geoCallCount) ? cmdStream.GetGeoCall(gi) : cmdStream.GetSkinCall(gi - geoCallCount);
+                    // (the converter gives every geometry instance an entry for every LOD; see NascentModelCommandStream::PadLODChains)
                 if (geoInst._levelOfDetail != levelOfDetail) { continue; }
 
                     //  Lookup the mesh geometry and material information from their respective inputs.
@@ -806,7 +810,8 @@ namespace RenderCore { namespace Assets
         result._id = geoInst._geoId;
         result._indexFormat = geo._ib._format;
         result._vertexStride = geo._vb._ia._vertexStride;
-        result._geoParamBox = ModelConstruction::BuildGeoParamBox(geo._vb._ia, sharedStateSet, paramBoxDesc, normalFromSkinning);
+        result._geoParamBox = ModelConstruction::BuildGeoParamBox(geo._vb._ia, sharedStateSet, paramBoxDesc, normalFromSkinning, false);
+        result._instancedGeoParamBox = ModelConstruction::BuildGeoParamBox(geo._vb._ia, sharedStateSet, paramBoxDesc, normalFromSkinning, true);
 
             // (source file locators)
         result._sourceFileIBOffset = geo._ib._offset;
@@ -1089,6 +1094,7 @@ namespace RenderCore { namespace Assets
             DelayedDrawCall entry;
             entry._drawCallIndex = drawCallIndex;
             entry._renderer = this;
+            entry._instanceCount = 1;
             if (transforms) {
                 auto trans = Combine(
                     transforms->GetMeshToModel(geoCall._transformMarker), 
@@ -1130,6 +1136,7 @@ namespace RenderCore { namespace Assets
             DelayedDrawCall entry;
             entry._drawCallIndex = drawCallIndex;
             entry._renderer = this;
+            entry._instanceCount = 1;
             if (transforms) {
                 auto trans = Combine(
                     transforms->GetMeshToModel(geoCall._transformMarker), 
@@ -1175,6 +1182,44 @@ namespace RenderCore { namespace Assets
         }
     }
 
+    class InstancedTransformsBox
+    {
+    public:
+        class Desc {};
+
+        static const unsigned MaxInstances = 256;
+        static const unsigned BindSlot = 16;        // "InstanceTransforms" in Vegetation/InstanceVS.h
+
+        intrusive_ptr<ID3D::Buffer> _buffer;
+        Metal::ShaderResourceView _srv;
+
+        InstancedTransformsBox(const Desc&)
+        {
+                // dynamic Buffer<float4>, with 3 rows per LocalToWorld transform
+            D3D11_BUFFER_DESC bufferDesc;
+            bufferDesc.ByteWidth = (UINT)(MaxInstances * sizeof(Float3x4));
+            bufferDesc.Usage = D3D11_USAGE_DYNAMIC;
+            bufferDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+            bufferDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+            bufferDesc.MiscFlags = 0;
+            bufferDesc.StructureByteStride = 0;
+
+            Metal::ObjectFactory objFactory;
+            auto buffer = objFactory.CreateBuffer(&bufferDesc);
+
+            D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+            srvDesc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+            srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+            srvDesc.Buffer.ElementOffset = 0;
+            srvDesc.Buffer.ElementWidth = MaxInstances * 3;
+            auto srv = objFactory.CreateShaderResourceView(buffer.get(), &srvDesc);
+
+            _buffer = std::move(buffer);
+            _srv = Metal::ShaderResourceView(std::move(srv));
+        }
+        ~InstancedTransformsBox() {}
+    };
+
     template<bool HasCallback>
         void ModelRenderer::RenderPreparedInternal(
             const ModelRendererContext& context, const SharedStateSet& sharedStateSet,
@@ -1201,6 +1246,8 @@ namespace RenderCore { namespace Assets
         unsigned currentTextureSet = ~unsigned(0x0);
         unsigned currentConstantBufferIndex = ~unsigned(0x0);
         unsigned currentTechniqueInterface = ~unsigned(0x0);
+        bool currentInstanced = false, currentInstancingSupported = false;
+        InstancedTransformsBox* instancedTransforms = nullptr;
 
         for (auto d=entries.cbegin(); d!=entries.cend(); ++d) {
             auto& renderer = *(const ModelRenderer*)d->_renderer;
@@ -1235,12 +1282,28 @@ namespace RenderCore { namespace Assets
                 //          variations that we're going to need and use another value as the
                 //          sorting priority instead... That might reduce the API thrashing
                 //          in some cases.
-            if (currentVariationHash != d->_shaderVariationHash) {
-                auto& mesh = *(const Pimpl::Mesh*)d->_subMesh;
+                //  Entries collapsed by DelayedDrawCallSet::BuildInstances are drawn with
+                //  a single instanced draw call, using the GEO_INSTANCED_TRANSFORMS variation.
+                //  The callback can only draw one instance at a time, so it never uses this.
+                //  Techniques that don't inherit "Shared:Instancing" filter out GEO_INSTANCED_TRANSFORMS,
+                //  and resolve to the same shader as the non-instanced box. Those shaders read
+                //  LocalToWorld from the constant buffer, so we must draw the instances one by one.
+            bool instanced = !constant_expression<HasCallback>::result() && d->_instanceCount > 1;
+            if (currentVariationHash != d->_shaderVariationHash || currentInstanced != instanced) {
                 boundUniforms = sharedStateSet.BeginVariation(
-                    context, drawCallRes._shaderName, currentTechniqueInterface, drawCallRes._geoParamBox, 
-                    drawCallRes._materialParamBox);
+                    context, drawCallRes._shaderName, currentTechniqueInterface, 
+                    drawCallRes._geoParamBox, drawCallRes._materialParamBox);
+                currentInstancingSupported = false;
+                if (instanced && boundUniforms) {
+                    auto& mesh = *(const Pimpl::Mesh*)d->_subMesh;
+                    auto* instancedUniforms = sharedStateSet.BeginVariation(
+                        context, drawCallRes._shaderName, currentTechniqueInterface, 
+                        mesh._instancedGeoParamBox, drawCallRes._materialParamBox);
+                    currentInstancingSupported = instancedUniforms && instancedUniforms != boundUniforms;
+                    boundUniforms = instancedUniforms;
+                }
                 currentVariationHash = d->_shaderVariationHash;
+                currentInstanced = instanced;
                 currentTextureSet = ~unsigned(0x0);
             }
 
@@ -1249,17 +1312,6 @@ namespace RenderCore { namespace Assets
             static Utility::ParameterBox tempGlobalStatesBox;
             sharedStateSet.BeginRenderState(context, tempGlobalStatesBox, drawCallRes._renderStateSet);
 
-                // We have to do this transform update very frequently! isn't there a better way?
-            {
-                D3D11_MAPPED_SUBRESOURCE result;
-                HRESULT hresult = context._context->GetUnderlying()->Map(
-                    localTransformBuffer.GetUnderlying(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
-                assert(SUCCEEDED(hresult) && result.pData); (void)hresult;
-                WriteLocalTransform<WLTFlags::LocalToWorld|WLTFlags::MaterialGuid>(
-                    result.pData, context, drawCalls._transforms[d->_meshToWorld], drawCallRes._materialBindingGuid);
-                context._context->GetUnderlying()->Unmap(localTransformBuffer.GetUnderlying(), 0);
-            }
-            
             auto textureSet = drawCallRes._textureSet;
             auto constantBufferIndex = drawCallRes._constantBuffer;
 
@@ -1275,10 +1327,58 @@ namespace RenderCore { namespace Assets
             }
 
             context._context->Bind((Metal::Topology::Enum)(d->_topology & 0xff));
-            if (constant_expression<HasCallback>::result()) {
-                (*callback)(d->_indexCount, d->_firstIndex, d->_firstVertex);
-            } else
-                context._context->DrawIndexed(d->_indexCount, d->_firstIndex, d->_firstVertex);
+
+            if (instanced && currentInstancingSupported) {
+                    // LocalToWorld in the constant buffer is ignored by the instanced variation
+                {
+                    D3D11_MAPPED_SUBRESOURCE result;
+                    HRESULT hresult = context._context->GetUnderlying()->Map(
+                        localTransformBuffer.GetUnderlying(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
+                    assert(SUCCEEDED(hresult) && result.pData); (void)hresult;
+                    WriteLocalTransform<WLTFlags::MaterialGuid>(
+                        result.pData, context, Identity<Float4x4>(), drawCallRes._materialBindingGuid);
+                    context._context->GetUnderlying()->Unmap(localTransformBuffer.GetUnderlying(), 0);
+                }
+
+                if (!instancedTransforms)
+                    instancedTransforms = &Techniques::FindCachedBox<InstancedTransformsBox>(InstancedTransformsBox::Desc());
+
+                for (unsigned i=0; i<d->_instanceCount; i+=InstancedTransformsBox::MaxInstances) {
+                    auto count = std::min(d->_instanceCount - i, unsigned(InstancedTransformsBox::MaxInstances));
+                    {
+                        D3D11_MAPPED_SUBRESOURCE result;
+                        HRESULT hresult = context._context->GetUnderlying()->Map(
+                            instancedTransforms->_buffer.get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
+                        assert(SUCCEEDED(hresult) && result.pData); (void)hresult;
+                        auto* dst = (Float3x4*)result.pData;
+                        for (unsigned c=0; c<count; ++c)
+                            CopyTransform(dst[c], drawCalls._transforms[d->_meshToWorld + i + c]);
+                        context._context->GetUnderlying()->Unmap(instancedTransforms->_buffer.get(), 0);
+                    }
+
+                    context._context->BindVS(MakeResourceList(InstancedTransformsBox::BindSlot, instancedTransforms->_srv));
+                    context._context->DrawIndexedInstanced(d->_indexCount, count, d->_firstIndex, d->_firstVertex);
+                }
+                continue;
+            }
+
+            for (unsigned i=0; i<d->_instanceCount; ++i) {
+                    // We have to do this transform update very frequently! isn't there a better way?
+                {
+                    D3D11_MAPPED_SUBRESOURCE result;
+                    HRESULT hresult = context._context->GetUnderlying()->Map(
+                        localTransformBuffer.GetUnderlying(), 0, D3D11_MAP_WRITE_DISCARD, 0, &result);
+                    assert(SUCCEEDED(hresult) && result.pData); (void)hresult;
+                    WriteLocalTransform<WLTFlags::LocalToWorld|WLTFlags::MaterialGuid>(
+                        result.pData, context, drawCalls._transforms[d->_meshToWorld + i], drawCallRes._materialBindingGuid);
+                    context._context->GetUnderlying()->Unmap(localTransformBuffer.GetUnderlying(), 0);
+                }
+
+                if (constant_expression<HasCallback>::result()) {
+                    (*callback)(d->_indexCount, d->_firstIndex, d->_firstVertex);
+                } else
+                    context._context->DrawIndexed(d->_indexCount, d->_firstIndex, d->_firstVertex);
+            }
         }
     }
 
@@ -1510,7 +1610,7 @@ namespace RenderCore { namespace Assets
 
         ////////////////////////////////////////////////////////////
 
-    static std::pair<std::unique_ptr<uint8[]>, unsigned> LoadRawData(const char filename[])
+    static std::pair<std::unique_ptr<uint8[]>, unsigned> LoadRawData(const char filename[], std::vector<float>& lodErrors)
     {
         BasicFile file(filename, "rb");
         auto chunks = Serialization::ChunkFile::LoadChunkTable(file);
@@ -1518,6 +1618,7 @@ namespace RenderCore { namespace Assets
             // look for the first model scaffold chunk
         Serialization::ChunkFile::ChunkHeader largeBlocksChunk;
         Serialization::ChunkFile::ChunkHeader scaffoldChunk;
+        Serialization::ChunkFile::ChunkHeader lodTableChunk;
 
         for (auto i=chunks.begin(); i!=chunks.end(); ++i) {
             if (i->_type == ChunkType_ModelScaffold && !scaffoldChunk._fileOffset) {
@@ -1526,6 +1627,9 @@ namespace RenderCore { namespace Assets
             if (i->_type == ChunkType_ModelScaffoldLargeBlocks && !largeBlocksChunk._fileOffset) {
                 largeBlocksChunk = *i;
             }
+            if (i->_type == ChunkType_ModelScaffoldLODTable && !lodTableChunk._fileOffset) {
+                lodTableChunk = *i;
+            }
         }
 
         if (    !scaffoldChunk._fileOffset
@@ -1541,6 +1645,14 @@ namespace RenderCore { namespace Assets
         file.Seek(scaffoldChunk._fileOffset, SEEK_SET);
         file.Read(rawMemoryBlock.get(), 1, scaffoldChunk._size);
 
+            // the lod table is optional (it's only written when the model has generated LODs)
+        lodErrors.clear();
+        if (lodTableChunk._fileOffset && lodTableChunk._chunkVersion == 0) {
+            lodErrors.resize(lodTableChunk._size / sizeof(float));
+            file.Seek(lodTableChunk._fileOffset, SEEK_SET);
+            file.Read(AsPointer(lodErrors.begin()), sizeof(float), lodErrors.size());
+        }
+
         return std::make_pair(std::move(rawMemoryBlock), largeBlocksChunk._fileOffset);
     }
 
@@ -1548,7 +1660,7 @@ namespace RenderCore { namespace Assets
     {
         std::unique_ptr<uint8[]> rawMemoryBlock;
         unsigned largeBlocksOffset = 0;
-        std::tie(rawMemoryBlock, largeBlocksOffset) = LoadRawData(filename);
+        std::tie(rawMemoryBlock, largeBlocksOffset) = LoadRawData(filename, _lodErrors);
         
         Serialization::Block_Initialize(rawMemoryBlock.get());        
         _data = (const ModelImmutableData*)Serialization::Block_GetFirstObject(rawMemoryBlock.get());
@@ -1579,6 +1691,7 @@ namespace RenderCore { namespace Assets
     , _filename(std::move(moveFrom._filename))
     , _marker(std::move(moveFrom._marker))
     , _validationCallback(std::move(moveFrom._validationCallback))
+    , _lodErrors(std::move(moveFrom._lodErrors))
     {
         _data = moveFrom._data;
         moveFrom._data = nullptr;
@@ -1594,6 +1707,7 @@ namespace RenderCore { namespace Assets
         _filename = std::move(moveFrom._filename);
         _marker = std::move(moveFrom._marker);
         _validationCallback = std::move(moveFrom._validationCallback);
+        _lodErrors = std::move(moveFrom._lodErrors);
         return *this;
     }
 
@@ -1653,7 +1767,7 @@ namespace RenderCore { namespace Assets
         std::unique_ptr<uint8[]> rawMemoryBlock;
         unsigned largeBlocksOffset = 0;
 
-        std::tie(rawMemoryBlock, largeBlocksOffset) = LoadRawData(marker._sourceID0);
+        std::tie(rawMemoryBlock, largeBlocksOffset) = LoadRawData(marker._sourceID0, _lodErrors);
 
         Serialization::Block_Initialize(rawMemoryBlock.get());        
         _data = (const ModelImmutableData*)Serialization::Block_GetFirstObject(rawMemoryBlock.get());
@@ -1672,6 +1786,7 @@ namespace RenderCore { namespace Assets
     const ModelCommandStream&       ModelScaffold::CommandStream() const                { Resolve(); return _data->_visualScene; }
     const TransformationMachine&    ModelScaffold::EmbeddedSkeleton() const             { Resolve(); return _data->_embeddedSkeleton; }
     std::pair<Float3, Float3>       ModelScaffold::GetStaticBoundingBox(unsigned) const { Resolve(); return _data->_boundingBox; }
+    unsigned                        ModelScaffold::GetMaxLOD() const                    { Resolve(); return _lodErrors.empty() ? 0 : unsigned(_lodErrors.size()-1); }
 
 }}
 
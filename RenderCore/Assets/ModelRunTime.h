@@ -79,7 +79,7 @@ namespace RenderCore { namespace Assets
         const ModelImmutableData&   ImmutableData() const;
         const TransformationMachine& EmbeddedSkeleton() const;
         std::pair<Float3, Float3>   GetStaticBoundingBox(unsigned lodIndex = 0) const;
-        unsigned                    GetMaxLOD() const { return 0; }
+        unsigned                    GetMaxLOD() const;
 
         const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const { return _validationCallback; }
 
@@ -99,6 +99,7 @@ namespace RenderCore { namespace Assets
         const ModelImmutableData*   _data;
         std::string                 _filename;
         unsigned                    _largeBlocksOffset;
+        std::vector<float>          _lodErrors;
 
         mutable std::shared_ptr<::Assets::PendingCompileMarker>     _marker;
         std::shared_ptr<::Assets::DependencyValidation>     _validationCallback;
@@ -170,6 +171,7 @@ namespace RenderCore { namespace Assets
             Metal::VertexBuffer         _skinningBuffer;
             AnimationState              _animState;
             std::vector<unsigned>       _vbOffsets;
+            std::vector<unsigned>       _keyCursors;
 
             PreparedAnimation();
             PreparedAnimation(PreparedAnimation&&);
@@ -330,11 +332,19 @@ namespace RenderCore { namespace Assets
     ///
     /// Of course, this structure allows flexibility for caching and scheduling as
     /// needed.
+    ///
+    /// For crowds of characters that share the same skeleton and animation set,
+    /// use the batch version of PrepareAnimation. It splits the characters across
+    /// the short task thread pool, and each worker reuses its parameter set and
+    /// working space for all of the characters it evaluates.
     class SkinPrepareMachine
     {
     public:
         void PrepareAnimation(  Metal::DeviceContext* context, 
                                 ModelRenderer::PreparedAnimation& state) const;
+        void PrepareAnimation(  Metal::DeviceContext* context, 
+                                ModelRenderer::PreparedAnimation* const states[], 
+                                size_t stateCount) const;
         const SkeletonBinding& GetSkeletonBinding() const;
         unsigned GetSkeletonOutputCount() const;
 
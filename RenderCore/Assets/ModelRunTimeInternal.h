@@ -209,6 +209,9 @@ namespace RenderCore { namespace Assets
         const InputInterface&   GetInputInterface() const   { return _inputInterface; }
         const OutputInterface&  GetOutputInterface() const  { return _outputInterface; }
 
+        const uint32*   GetCommandStream() const        { return _commandStream; }
+        size_t          GetCommandStreamSize() const    { return _commandStreamSize; }
+
         TransformationMachine();
         ~TransformationMachine();
     protected:
@@ -220,9 +223,6 @@ namespace RenderCore { namespace Assets
         InputInterface      _inputInterface;
         OutputInterface     _outputInterface;
 
-        const uint32*   GetCommandStream()      { return _commandStream; }
-        const size_t    GetCommandStreamSize()  { return _commandStreamSize; }
-
         template<typename IteratorType>
             void GenerateOutputTransformsInternal(
                 Float4x4 output[], unsigned outputCount,
@@ -284,6 +284,15 @@ namespace RenderCore { namespace Assets
         std::vector<Float4x4>   _modelJointIndexToInverseBindMatrix;
     };
 
+        /// <summary>Builds the joint palette for a skinned geometry</summary>
+        /// Each entry is the joint's inverse-bind-by-bind-shape matrix, combined with
+        /// the matching transformation machine output. Joints that aren't bound to the
+        /// skeleton get identity. Shared by the GPU skinning path and CPUSkinnedModel.
+    void WriteJointTransforms(  Float3x4 destination[], size_t destinationCount,
+                                const BoundSkinnedGeometry& controller,
+                                const Float4x4              transformationMachineResult[],
+                                const SkeletonBinding&      skeletonBinding);
+
 ////////////////////////////////////////////////////////////////////////////////////////////
     //      r e n d e r e r         //
 
@@ -305,6 +314,7 @@ namespace RenderCore { namespace Assets
             unsigned _vertexStride;
             NativeFormatPlaceholder _indexFormat;
             unsigned _geoParamBox;
+            unsigned _instancedGeoParamBox;     // same as _geoParamBox, but with GEO_INSTANCED_TRANSFORMS set
             TechniqueInterface _techniqueInterface;
 
             unsigned _sourceFileVBOffset, _sourceFileVBSize;
@@ -9,7 +9,10 @@
 #include "RawAnimationCurve.h"
 #include "../../Math/Matrix.h"
 #include "../../Math/Interpolation.h"
+#include "../../Math/Transformations.h"
 #include "../../Core/Exceptions.h"
+#include <algorithm>
+#include <vector>
 
 namespace RenderCore { namespace Assets
 {
@@ -24,29 +27,221 @@ namespace RenderCore { namespace Assets
         return (input - A) / (B-A);
     }
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+        //  Compressed keys
+        //
+        //  The parameter data for a compressed curve starts with a small header
+        //  (the quantization ranges), followed by the packed keys:
+        //      Quantized       -- header: float min[N], float step[N]
+        //                         key: uint16[N]
+        //      QuantizedTRS    -- header: translation min[3], step[3], scale min[3], step[3]
+        //                         key: uint16 rotation[3], translation[3], scale[3]
+        //
+        //  Rotations use the "smallest three" encoding. We drop the largest component
+        //  of the quaternion (after flipping the sign so that it's positive) and store
+        //  the other 3 in 15 bits each. Those components must be in the range 
+        //  [-1/sqrt(2), 1/sqrt(2)]. The index of the dropped component goes into the 
+        //  spare high bits.
+
+    static const float SmallestThreeRange = 0.70710678f;
+    static const unsigned TRSKeyElements = 9;
+    static const unsigned TRSHeaderElements = 12;
+
+    static void EncodeSmallestThree(uint16 dst[3], const Quaternion& input)
+    {
+        unsigned largest = 0;
+        float magnitudeSq = 0.f;
+        for (unsigned c=0; c<4; ++c) {
+            magnitudeSq += input[c] * input[c];
+            if (XlAbs(input[c]) > XlAbs(input[largest])) largest = c;
+        }
+
+        float scale = ((input[largest] < 0.f) ? -1.f : 1.f) / XlSqrt(magnitudeSq);
+        for (unsigned c=0, o=0; c<4; ++c) {
+            if (c == largest) continue;
+            float n = Clamp((input[c] * scale / SmallestThreeRange) * .5f + .5f, 0.f, 1.f);
+            dst[o++] = uint16(n * float(0x7fff) + .5f);
+        }
+        dst[0] |= uint16((largest & 1) << 15);
+        dst[1] |= uint16((largest >> 1) << 15);
+    }
+
+    static Quaternion DecodeSmallestThree(const uint16 src[3])
+    {
+        unsigned largest = (src[0] >> 15) | ((src[1] >> 15) << 1);
+        Quaternion result;
+        float sumSq = 0.f;
+        for (unsigned c=0, i=0; c<4; ++c) {
+            if (c == largest) continue;
+            float v = (float(src[i++] & 0x7fff) * (2.f / float(0x7fff)) - 1.f) * SmallestThreeRange;
+            result[c] = v;
+            sumSq += v * v;
+        }
+        result[largest] = XlSqrt(std::max(0.f, 1.f - sumSq));
+        return result;
+    }
+
+    template<typename Type>
+        static Type DecodeQuantized(const float header[], const uint16 key[])
+    {
+        const unsigned N = sizeof(Type)/sizeof(float);
+        Type result;
+        float* dst = (float*)&result;
+        for (unsigned c=0; c<N; ++c)
+            dst[c] = header[c] + float(key[c]) * header[N+c];
+        return result;
+    }
+
+    template<typename Type>
+        static void BuildQuantizationHeader(float header[], const Type* begin, const Type* end)
+    {
+        const unsigned N = sizeof(Type)/sizeof(float);
+        for (unsigned c=0; c<N; ++c) {
+            float minValue = FLT_MAX, maxValue = -FLT_MAX;
+            for (auto i=begin; i<end; ++i) {
+                minValue = std::min(minValue, ((const float*)&*i)[c]);
+                maxValue = std::max(maxValue, ((const float*)&*i)[c]);
+            }
+            header[c] = minValue;
+            header[N+c] = (maxValue - minValue) / float(0xffff);
+        }
+    }
+
+    template<typename Type>
+        static void EncodeQuantized(uint16 dst[], const float header[], const Type& value)
+    {
+        const unsigned N = sizeof(Type)/sizeof(float);
+        for (unsigned c=0; c<N; ++c) {
+            float q = (header[N+c] > 0.f) ? ((((const float*)&value)[c] - header[c]) / header[N+c]) : 0.f;
+            dst[c] = uint16(Clamp(q + .5f, 0.f, float(0xffff)));
+        }
+    }
+
+    static RotationScaleTranslation DecodeTRS(const float header[], const uint16 key[])
+    {
+        return RotationScaleTranslation(
+            DecodeSmallestThree(key),
+            DecodeQuantized<Float3>(&header[6], &key[6]),
+            DecodeQuantized<Float3>(header, &key[3]));
+    }
+
+    static Float4x4 InterpolateTRS(const RotationScaleTranslation& lhs, RotationScaleTranslation rhs, float alpha)
+    {
+            // Take the shortest path between the rotations. The encoding
+            // flips the sign of quaternions freely, so we can't rely on it
+        float d = 0.f;
+        for (unsigned c=0; c<4; ++c) d += lhs._rotation[c] * rhs._rotation[c];
+        if (d < 0.f)
+            for (unsigned c=0; c<4; ++c) rhs._rotation[c] = -rhs._rotation[c];
+        return AsFloat4x4(SphericalInterpolate(lhs, rhs, alpha));
+    }
+
     template<typename OutType>
-        OutType        RawAnimationCurve::Calculate(float inputTime) const never_throws
+        static OutType DecodeKey(const float header[], const uint16 key[])
+    {
+        return DecodeQuantized<OutType>(header, key);
+    }
+
+    template<typename OutType>
+        static OutType DecodeAndInterpolate(const float header[], const uint16 key0[], const uint16 key1[], float alpha)
+    {
+        return SphericalInterpolate(DecodeQuantized<OutType>(header, key0), DecodeQuantized<OutType>(header, key1), alpha);
+    }
+
+    template<>
+        Float4x4 DecodeKey(const float header[], const uint16 key[])
+    {
+        return AsFloat4x4(DecodeTRS(header, key));
+    }
+
+    template<>
+        Float4x4 DecodeAndInterpolate(const float header[], const uint16 key0[], const uint16 key1[], float alpha)
+    {
+        return InterpolateTRS(DecodeTRS(header, key0), DecodeTRS(header, key1), alpha);
+    }
+
+    template<typename OutType>
+        OutType     RawAnimationCurve::CalculateCompressed(float inputTime, unsigned* keyCursor) const never_throws
+    {
+        assert(_keyEncoding == ((ExpectedFormat<OutType>() == Metal::NativeFormat::Matrix4x4) ? QuantizedTRS : Quantized));
+        const unsigned headerSize = (_keyEncoding == QuantizedTRS) 
+            ? (TRSHeaderElements * sizeof(float)) 
+            : (2 * sizeof(OutType));
+        const auto* header = (const float*)_parameterData.get();
+        const auto* keys = PtrAdd(_parameterData.get(), headerSize);
+
+            // (NaN times fail this comparison, and so clamp to the first key)
+        if (!(inputTime >= _timeMarkers[0]))
+            return DecodeKey<OutType>(header, (const uint16*)keys);
+        if (inputTime >= _timeMarkers[_keyCount-1])
+            return DecodeKey<OutType>(header, (const uint16*)PtrAdd(keys, (_keyCount-1) * _elementSize));
+
+        auto c = FindKey(inputTime, keyCursor);
+        float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
+        return DecodeAndInterpolate<OutType>(
+            header, 
+            (const uint16*)PtrAdd(keys, c * _elementSize),
+            (const uint16*)PtrAdd(keys, (c+1) * _elementSize),
+            alpha);
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    unsigned    RawAnimationCurve::FindKey(float inputTime, unsigned* keyCursor) const never_throws
+    {
+            // Find the key "c" such that _timeMarkers[c] <= inputTime < _timeMarkers[c+1]
+            // The caller must deal with times outside of the range of the curve.
+        assert(_keyCount >= 2);
+        assert(inputTime >= _timeMarkers[0] && inputTime < _timeMarkers[_keyCount-1]);
+
+        if (keyCursor) {
+                // Check the cached key and the key immediately after it. During
+                // normal playback this will succeed almost every time.
+            auto c = *keyCursor;
+            if (c < (_keyCount-1) && inputTime >= _timeMarkers[c]) {
+                if (inputTime < _timeMarkers[c+1])
+                    return c;
+                if ((c+2) < _keyCount && inputTime < _timeMarkers[c+2]) {
+                    *keyCursor = c+1;
+                    return c+1;
+                }
+            }
+        }
+
+        auto i = std::upper_bound(_timeMarkers.get(), &_timeMarkers[_keyCount], inputTime);
+        auto c = unsigned(i - _timeMarkers.get()) - 1;
+            // (never return the last key, even if the assert above would fail)
+        c = std::min(c, unsigned(_keyCount-2));
+        if (keyCursor) *keyCursor = c;
+        return c;
+    }
+
+    template<typename OutType>
+        OutType        RawAnimationCurve::Calculate(float inputTime, unsigned* keyCursor) const never_throws
     {
         assert(_positionFormat == ExpectedFormat<OutType>());
+        if (_keyEncoding != Uncompressed)
+            return CalculateCompressed<OutType>(inputTime, keyCursor);
 
             // note -- clamping at start and end positions of the curve
-        if (inputTime < _timeMarkers[0])
+            //          (NaN times fail the first comparison, and so clamp to the first key)
+        if (!(inputTime >= _timeMarkers[0]))
             return *(OutType*)_parameterData.get();
+        if (inputTime >= _timeMarkers[_keyCount-1])
+            return *(OutType*)PtrAdd(_parameterData.get(), (_keyCount-1) * _elementSize);
 
-        if (_interpolationType == Linear) {
+        auto c = FindKey(inputTime, keyCursor);
+        assert(_timeMarkers[c+1] > _timeMarkers[c]);
+        float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
 
-            for (unsigned c=0; c<(_keyCount-1); ++c) {
-                if (inputTime < _timeMarkers[c+1]) {
-                    assert(_timeMarkers[c+1] > _timeMarkers[c]);
-                    float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
+        const OutType& P0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize);
+        const OutType& P1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize);
 
-                    const OutType& P0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize);
-                    const OutType& P1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize);
-                    return SphericalInterpolate(P0, P1, alpha);
-                }
-            }
+        if (_interpolationType == Linear) {
 
-        } else if (_interpolationType == Bezier || _interpolationType == Hermite) {
+            return SphericalInterpolate(P0, P1, alpha);
+
+        } else if (_interpolationType == Bezier) {
 
             assert(_inTangentFormat != Metal::NativeFormat::Unknown);
             assert(_outTangentFormat != Metal::NativeFormat::Unknown);
@@ -54,32 +249,33 @@ namespace RenderCore { namespace Assets
             const size_t inTangentOffset = Metal::BitsPerPixel(_positionFormat)/8;
             const size_t outTangentOffset = inTangentOffset + Metal::BitsPerPixel(_inTangentFormat)/8;
 
-            if (_interpolationType == Bezier) {
-
-                for (unsigned c=0; c<(_keyCount-1); ++c) {
-                    if (inputTime < _timeMarkers[c+1]) {
-                        assert(_timeMarkers[c+1] > _timeMarkers[c]);
-                        float alpha = LerpParameter(_timeMarkers[c], _timeMarkers[c+1], inputTime);
+            const OutType& C0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize + outTangentOffset);
+            const OutType& C1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize + inTangentOffset);
 
-                        const OutType& P0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize);
-                        const OutType& P1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize);
-
-                        const OutType& C0 = *(const OutType*)PtrAdd(_parameterData.get(), c * _elementSize + outTangentOffset);
-                        const OutType& C1 = *(const OutType*)PtrAdd(_parameterData.get(), (c+1) * _elementSize + inTangentOffset);
-
-                        return SphericalBezierInterpolate(P0, C0, C1, P1, alpha);
-                    }
-                }
-
-            } else {
-                assert(0);      // hermite version not implemented (though we could just convert on load in)
-            }
+            return SphericalBezierInterpolate(P0, C0, C1, P1, alpha);
 
+        } else {
+            assert(0);      // hermite version not implemented (though we could just convert on load in)
         }
 
         return *(OutType*)PtrAdd(_parameterData.get(), (_keyCount-1) * _elementSize );
     }
 
+    template<typename OutType>
+        void    RawAnimationCurve::Calculate(
+            OutType dst[], float inputTime,
+            const RawAnimationCurve* const curves[], size_t curveCount,
+            unsigned keyCursors[]) never_throws
+    {
+        if (keyCursors) {
+            for (size_t c=0; c<curveCount; ++c)
+                dst[c] = curves[c]->Calculate<OutType>(inputTime, &keyCursors[c]);
+        } else {
+            for (size_t c=0; c<curveCount; ++c)
+                dst[c] = curves[c]->Calculate<OutType>(inputTime);
+        }
+    }
+
     float       RawAnimationCurve::StartTime() const
     {
         if (!_keyCount) {
@@ -96,17 +292,224 @@ namespace RenderCore { namespace Assets
         return _timeMarkers[_keyCount-1];
     }
 
-    template float      RawAnimationCurve::Calculate(float inputTime) const never_throws;
-    template Float3     RawAnimationCurve::Calculate(float inputTime) const never_throws;
-    template Float4     RawAnimationCurve::Calculate(float inputTime) const never_throws;
-    template Float4x4   RawAnimationCurve::Calculate(float inputTime) const never_throws;
+    size_t      RawAnimationCurve::KeyCount() const
+    {
+        return _keyCount;
+    }
+
+    size_t      RawAnimationCurve::DataSize() const
+    {
+        return _keyCount * sizeof(float) + _parameterData.size();
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace Internal
+    {
+            //  During key reduction we interpolate between candidate keys in the
+            //  same way as the runtime decoder. For Float4x4 curves that means 
+            //  interpolating the decomposed transforms.
+        template<typename OutType> struct CurveKey
+        {
+            typedef OutType Type;
+            static bool     CanDecompose(const OutType&)        { return true; }
+            static Type     Decompose(const OutType& value)     { return value; }
+            static OutType  Interpolate(const Type& lhs, const Type& rhs, float alpha) { return SphericalInterpolate(lhs, rhs, alpha); }
+        };
+
+        template<> struct CurveKey<Float4x4>
+        {
+            typedef RotationScaleTranslation Type;
+            static bool     CanDecompose(const Float4x4& value)
+            {
+                    //  Decompose rebuilds the 3rd axis from the first 2, which would
+                    //  un-mirror transforms with a negative determinant (and degenerate
+                    //  transforms can't be decomposed at all)
+                Float3 c0(value(0,0), value(1,0), value(2,0));
+                Float3 c1(value(0,1), value(1,1), value(2,1));
+                Float3 c2(value(0,2), value(1,2), value(2,2));
+                return Dot(Cross(c0, c1), c2) > 0.f;
+            }
+            static Type     Decompose(const Float4x4& value)
+            {
+                    //  Bezier interpolation of matrices doesn't preserve orthogonality, 
+                    //  so we need to clean up the rotation part before decomposing
+                Float3 c0(value(0,0), value(1,0), value(2,0));
+                Float3 c1(value(0,1), value(1,1), value(2,1));
+                Float3 c2(value(0,2), value(1,2), value(2,2));
+                Float3 scale(Magnitude(c0), Magnitude(c1), Magnitude(c2));
+                c0 = Normalize(c0);
+                c1 = Normalize(c1 - Dot(c1, c0) * c0);
+                c2 = Cross(c0, c1);
+                Float4x4 cleaned(
+                    c0[0] * scale[0], c1[0] * scale[1], c2[0] * scale[2], value(0,3),
+                    c0[1] * scale[0], c1[1] * scale[1], c2[1] * scale[2], value(1,3),
+                    c0[2] * scale[0], c1[2] * scale[1], c2[2] * scale[2], value(2,3),
+                    0.f, 0.f, 0.f, 1.f);
+                return RotationScaleTranslation(cleaned);
+            }
+            static Float4x4 Interpolate(const Type& lhs, const Type& rhs, float alpha) { return InterpolateTRS(lhs, rhs, alpha); }
+        };
+
+        template<typename OutType>
+            static float MaxDifference(const OutType& lhs, const OutType& rhs)
+        {
+            float result = 0.f;
+            for (unsigned c=0; c<sizeof(OutType)/sizeof(float); ++c)
+                result = std::max(result, XlAbs(((const float*)&lhs)[c] - ((const float*)&rhs)[c]));
+            return result;
+        }
+    }
+
+    template<typename Type>
+        static void WriteCompressedKeys(
+            float header[], uint16 keys[], 
+            const std::vector<unsigned>& keptSamples, const std::vector<Type>& samples)
+    {
+        std::vector<Type> values;
+        for (auto k:keptSamples) values.push_back(samples[k]);
+        BuildQuantizationHeader(header, AsPointer(values.cbegin()), AsPointer(values.cend()));
+        const auto N = sizeof(Type)/sizeof(float);
+        for (size_t c=0; c<values.size(); ++c)
+            EncodeQuantized(&keys[c*N], header, values[c]);
+    }
+
+    static void WriteCompressedKeys(
+        float header[], uint16 keys[], 
+        const std::vector<unsigned>& keptSamples, const std::vector<RotationScaleTranslation>& samples)
+    {
+        std::vector<Float3> translations, scales;
+        for (auto k:keptSamples) {
+            translations.push_back(samples[k]._translation);
+            scales.push_back(samples[k]._scale);
+        }
+        BuildQuantizationHeader(header, AsPointer(translations.cbegin()), AsPointer(translations.cend()));
+        BuildQuantizationHeader(&header[6], AsPointer(scales.cbegin()), AsPointer(scales.cend()));
+        for (size_t c=0; c<keptSamples.size(); ++c) {
+            auto* k = &keys[c*TRSKeyElements];
+            EncodeSmallestThree(k, samples[keptSamples[c]]._rotation);
+            EncodeQuantized(&k[3], header, translations[c]);
+            EncodeQuantized(&k[6], &header[6], scales[c]);
+        }
+    }
+
+    template<typename OutType>
+        RawAnimationCurve   RawAnimationCurve::BuildCompressed(float tolerance) const
+    {
+        typedef Internal::CurveKey<OutType> CurveKey;
+
+            //  Sample the original curve at every key. For bezier curves, we also
+            //  sample some points between the keys, so that the shape of the curve
+            //  is retained after we convert to linear interpolation.
+        const unsigned subdivisions = (_interpolationType == Bezier) ? 4 : 1;
+        std::vector<float> sampleTimes;
+        std::vector<OutType> samples;
+        std::vector<typename CurveKey::Type> decomposed;
+        sampleTimes.reserve((_keyCount-1) * subdivisions + 1);
+        for (size_t c=0; c<_keyCount; ++c) {
+            sampleTimes.push_back(_timeMarkers[c]);
+            if ((c+1) < _keyCount)
+                for (unsigned s=1; s<subdivisions; ++s)
+                    sampleTimes.push_back(LinearInterpolate(_timeMarkers[c], _timeMarkers[c+1], s / float(subdivisions)));
+        }
+        for (auto t:sampleTimes) {
+            samples.push_back(Calculate<OutType>(t));
+            if (!CurveKey::CanDecompose(samples.back()))
+                return RawAnimationCurve(*this);
+            decomposed.push_back(CurveKey::Decompose(samples.back()));
+        }
+
+            //  Greedy key reduction. Starting from each key we keep, extend the 
+            //  segment as far as possible while all of the skipped samples are within 
+            //  tolerance. Segments are limited in length to put a bound on the cost.
+            //  Part of the tolerance is left over for the quantization error.
+        const float reductionTolerance = .75f * tolerance;
+        const size_t maxSegmentLength = 64;
+        std::vector<unsigned> keptSamples;
+        keptSamples.push_back(0);
+        size_t start = 0;
+        while ((start+1) < samples.size()) {
+            size_t end = start+1;
+            for (size_t e=end+1; e<samples.size() && (e-start) <= maxSegmentLength; ++e) {
+                bool good = true;
+                for (size_t k=start+1; k<e && good; ++k) {
+                    float alpha = LerpParameter(sampleTimes[start], sampleTimes[e], sampleTimes[k]);
+                    good = Internal::MaxDifference(CurveKey::Interpolate(decomposed[start], decomposed[e], alpha), samples[k]) <= reductionTolerance;
+                }
+                if (!good) break;
+                end = e;
+            }
+            keptSamples.push_back(unsigned(end));
+            start = end;
+        }
+
+            //  Write out the header & the quantized keys
+        const auto keyCount = keptSamples.size();
+        std::unique_ptr<float[], BlockSerializerDeleter<float[]>> timeMarkers(new float[keyCount]);
+        for (size_t c=0; c<keyCount; ++c)
+            timeMarkers[c] = sampleTimes[keptSamples[c]];
+
+        const bool trs = ExpectedFormat<OutType>() == Metal::NativeFormat::Matrix4x4;
+        const size_t elementSize = trs ? (TRSKeyElements * sizeof(uint16)) : (sizeof(OutType) / sizeof(float) * sizeof(uint16));
+        const size_t headerSize = trs ? (TRSHeaderElements * sizeof(float)) : (2 * sizeof(OutType));
+        const size_t dataSize = headerSize + keyCount * elementSize;
+        std::unique_ptr<uint8[], BlockSerializerDeleter<uint8[]>> data(new uint8[dataSize]);
+        auto* header = (float*)data.get();
+        auto* keys = (uint16*)PtrAdd(data.get(), headerSize);
+
+        WriteCompressedKeys(header, keys, keptSamples, decomposed);
+
+        RawAnimationCurve result(
+            keyCount, std::move(timeMarkers),
+            DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>(std::move(data), dataSize),
+            elementSize, Linear, _positionFormat, 
+            Metal::NativeFormat::Unknown, Metal::NativeFormat::Unknown,
+            trs ? QuantizedTRS : Quantized);
+
+            //  Check every sample (including the kept keys) against the final encoded curve.
+            //  This catches the quantization error and anything lost in the decomposition. 
+            //  If anything is out of tolerance, we just keep the original curve.
+        unsigned cursor = 0;
+        for (size_t c=0; c<samples.size(); ++c)
+            if (Internal::MaxDifference(result.CalculateCompressed<OutType>(sampleTimes[c], &cursor), samples[c]) > tolerance)
+                return RawAnimationCurve(*this);
+
+        return result;
+    }
+
+    RawAnimationCurve   RawAnimationCurve::Compress(float tolerance) const
+    {
+            //  Hermite curves can't be evaluated currently, and curves with a single
+            //  key are already as small as they will get
+        if (_keyEncoding != Uncompressed || _interpolationType == Hermite || _keyCount < 2)
+            return RawAnimationCurve(*this);
+
+        switch (_positionFormat) {
+        case Metal::NativeFormat::Matrix4x4:            return BuildCompressed<Float4x4>(tolerance);
+        case Metal::NativeFormat::R32G32B32A32_FLOAT:   return BuildCompressed<Float4>(tolerance);
+        case Metal::NativeFormat::R32G32B32_FLOAT:      return BuildCompressed<Float3>(tolerance);
+        case Metal::NativeFormat::R32_FLOAT:            return BuildCompressed<float>(tolerance);
+        default:                                        return RawAnimationCurve(*this);
+        }
+    }
+
+    template float      RawAnimationCurve::Calculate(float inputTime, unsigned* keyCursor) const never_throws;
+    template Float3     RawAnimationCurve::Calculate(float inputTime, unsigned* keyCursor) const never_throws;
+    template Float4     RawAnimationCurve::Calculate(float inputTime, unsigned* keyCursor) const never_throws;
+    template Float4x4   RawAnimationCurve::Calculate(float inputTime, unsigned* keyCursor) const never_throws;
+
+    template void   RawAnimationCurve::Calculate(float dst[], float, const RawAnimationCurve* const[], size_t, unsigned[]) never_throws;
+    template void   RawAnimationCurve::Calculate(Float3 dst[], float, const RawAnimationCurve* const[], size_t, unsigned[]) never_throws;
+    template void   RawAnimationCurve::Calculate(Float4 dst[], float, const RawAnimationCurve* const[], size_t, unsigned[]) never_throws;
+    template void   RawAnimationCurve::Calculate(Float4x4 dst[], float, const RawAnimationCurve* const[], size_t, unsigned[]) never_throws;
 
     RawAnimationCurve::RawAnimationCurve(   size_t keyCount, 
                                             std::unique_ptr<float[], BlockSerializerDeleter<float[]>>&&  timeMarkers, 
                                             DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>&&       keyPositions,
                                             size_t elementSize, InterpolationType interpolationType,
                                             Metal::NativeFormat::Enum positionFormat, Metal::NativeFormat::Enum inTangentFormat, 
-                                            Metal::NativeFormat::Enum outTangentFormat)
+                                            Metal::NativeFormat::Enum outTangentFormat,
+                                            KeyEncoding keyEncoding)
     :       _keyCount(keyCount)
     ,       _timeMarkers(std::forward<std::unique_ptr<float[], BlockSerializerDeleter<float[]>>>(timeMarkers))
     ,       _parameterData(std::forward<DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>>(keyPositions))
@@ -115,6 +518,8 @@ namespace RenderCore { namespace Assets
     ,       _positionFormat(positionFormat)
     ,       _inTangentFormat(inTangentFormat)
     ,       _outTangentFormat(outTangentFormat)
+    ,       _keyEncoding(keyEncoding)
+    ,       _dummy(0)
     {}
 
     RawAnimationCurve::RawAnimationCurve(RawAnimationCurve&& curve)
@@ -126,6 +531,8 @@ namespace RenderCore { namespace Assets
     ,       _positionFormat(curve._positionFormat)
     ,       _inTangentFormat(curve._inTangentFormat)
     ,       _outTangentFormat(curve._outTangentFormat)
+    ,       _keyEncoding(curve._keyEncoding)
+    ,       _dummy(0)
     {}
 
     RawAnimationCurve::RawAnimationCurve(const RawAnimationCurve& copyFrom)
@@ -136,6 +543,8 @@ namespace RenderCore { namespace Assets
     ,       _positionFormat(copyFrom._positionFormat)
     ,       _inTangentFormat(copyFrom._inTangentFormat)
     ,       _outTangentFormat(copyFrom._outTangentFormat)
+    ,       _keyEncoding(copyFrom._keyEncoding)
+    ,       _dummy(0)
     {
         _timeMarkers.reset(new float[_keyCount]);
         std::copy(copyFrom._timeMarkers.get(), &copyFrom._timeMarkers[_keyCount], _timeMarkers.get());
@@ -151,6 +560,7 @@ namespace RenderCore { namespace Assets
         _positionFormat = curve._positionFormat;
         _inTangentFormat = curve._inTangentFormat;
         _outTangentFormat = curve._outTangentFormat;
+        _keyEncoding = curve._keyEncoding;
         return *this;
     }
 
@@ -19,12 +19,20 @@ namespace RenderCore { namespace Assets
     public:
         enum InterpolationType { Linear, Bezier, Hermite };
 
+            //  Compressed curves store their keys in a packed format (rather
+            //  than in _positionFormat), see Compress()
+            //      Quantized       -- 16 bit quantized components, relative to a per-curve range
+            //      QuantizedTRS    -- Float4x4 curves decomposed into rotation (smallest-three 
+            //                         quaternion), translation & scale, each 48 bits
+        enum KeyEncoding { Uncompressed, Quantized, QuantizedTRS };
+
         RawAnimationCurve(  size_t keyCount, 
                             std::unique_ptr<float[], BlockSerializerDeleter<float[]>>&&  timeMarkers, 
                             DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>&&       keyPositions,
                             size_t elementSize, InterpolationType interpolationType,
                             Metal::NativeFormat::Enum positionFormat, Metal::NativeFormat::Enum inTangentFormat, 
-                            Metal::NativeFormat::Enum outTangentFormat);
+                            Metal::NativeFormat::Enum outTangentFormat,
+                            KeyEncoding keyEncoding = Uncompressed);
         RawAnimationCurve(RawAnimationCurve&& curve);
         RawAnimationCurve(const RawAnimationCurve& copyFrom);
         RawAnimationCurve& operator=(RawAnimationCurve&& curve);
@@ -34,9 +42,36 @@ namespace RenderCore { namespace Assets
 
         float       StartTime() const;
         float       EndTime() const;
+        size_t      KeyCount() const;
+        size_t      DataSize() const;
+        KeyEncoding GetKeyEncoding() const { return _keyEncoding; }
+
+            //  Build a compressed version of this curve. Keys are removed where
+            //  linear interpolation between the remaining keys stays within
+            //  "tolerance" of the original curve (measured per component; so for
+            //  Float4x4 curves, per matrix element). Bezier curves are resampled,
+            //  so the result always uses linear interpolation. Finally the keys
+            //  are quantized. Every sample of the original curve is checked against
+            //  the final result; if any is outside of the tolerance (or for Float4x4
+            //  curves with mirroring transforms) the curve is returned uncompressed.
+        RawAnimationCurve   Compress(float tolerance) const;
+
+            //  "keyCursor" is optional per-instance state that caches the last
+            //  key used. When time moves forward monotonically (normal playback)
+            //  we can usually find the next key without searching. Initialize
+            //  cursors to 0; any value is safe, it's just a hint.
+        template<typename OutType>
+            OutType        Calculate(float inputTime, unsigned* keyCursor = nullptr) const never_throws;
 
+            //  Evaluate many curves at the same time, writing the results into
+            //  a single contiguous output array (one array per output type).
+            //  "keyCursors" is optional, but must have "curveCount" elements
+            //  if it is given.
         template<typename OutType>
-            OutType        Calculate(float inputTime) const never_throws;
+            static void    Calculate(
+                OutType dst[], float inputTime,
+                const RawAnimationCurve* const curves[], size_t curveCount,
+                unsigned keyCursors[] = nullptr) never_throws;
 
     protected:
         size_t                          _keyCount;
@@ -48,9 +83,17 @@ namespace RenderCore { namespace Assets
         Metal::NativeFormat::Enum       _positionFormat;
         Metal::NativeFormat::Enum       _inTangentFormat;
         Metal::NativeFormat::Enum       _outTangentFormat;
+        KeyEncoding                     _keyEncoding;
+        unsigned                        _dummy;
 
         template<typename OutType>
             static Metal::NativeFormat::Enum   ExpectedFormat();
+        template<typename OutType>
+            OutType             CalculateCompressed(float inputTime, unsigned* keyCursor) const never_throws;
+        template<typename OutType>
+            RawAnimationCurve   BuildCompressed(float tolerance) const;
+
+        unsigned        FindKey(float inputTime, unsigned* keyCursor) const never_throws;
     };
 
     template<typename Serializer>
@@ -64,6 +107,8 @@ namespace RenderCore { namespace Assets
         ::Serialize(outputSerializer, unsigned(_positionFormat));
         ::Serialize(outputSerializer, unsigned(_inTangentFormat));
         ::Serialize(outputSerializer, unsigned(_outTangentFormat));
+        ::Serialize(outputSerializer, unsigned(_keyEncoding));
+        ::Serialize(outputSerializer, unsigned(0));
     }
 
 }}
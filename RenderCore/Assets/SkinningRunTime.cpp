@@ -7,6 +7,7 @@
 #include "ModelRunTime.h"
 #include "ModelRunTimeInternal.h"
 #include "RawAnimationCurve.h"
+#include "FlatTransformationMachine.h"
 #include "SharedStateSet.h"
 #include "AssetUtils.h"     // actually just needed for chunk id
 #include "DeferredShaderResource.h"
@@ -24,8 +25,10 @@
 #include "../Techniques/ParsingContext.h"
 #include "../../ConsoleRig/Console.h"
 #include "../../ConsoleRig/Log.h"
+#include "../../ConsoleRig/GlobalServices.h"
 #include "../../Assets/ChunkFile.h"
 #include "../../Utility/Streams/FileUtils.h"
+#include "../../Utility/Threading/CompletionThreadPool.h"
 
 // #include "../DX11/Metal/IncludeDX11.h"
 
@@ -300,10 +303,10 @@ namespace RenderCore { namespace Assets
         }
     }
 
-    static void WriteJointTransforms(   Float3x4 destination[], size_t destinationCount,
-                                        const BoundSkinnedGeometry& controller,
-                                        const Float4x4              transformationMachineResult[],
-                                        const SkeletonBinding&      skeletonBinding)
+    void WriteJointTransforms(  Float3x4 destination[], size_t destinationCount,
+                                const BoundSkinnedGeometry& controller,
+                                const Float4x4              transformationMachineResult[],
+                                const SkeletonBinding&      skeletonBinding)
     {
         for (unsigned c=0; c<std::min(controller._jointMatrixCount, destinationCount); ++c) {
             unsigned jointMatrixIndex = controller._jointMatrices[c];
@@ -692,6 +695,7 @@ namespace RenderCore { namespace Assets
     : _finalMatrices(std::move(moveFrom._finalMatrices))
     , _skinningBuffer(std::move(moveFrom._skinningBuffer))
     , _vbOffsets(std::move(moveFrom._vbOffsets))
+    , _keyCursors(std::move(moveFrom._keyCursors))
     , _animState(moveFrom._animState) {}
 
     ModelRenderer::PreparedAnimation& ModelRenderer::PreparedAnimation::operator=(PreparedAnimation&& moveFrom)
@@ -699,6 +703,7 @@ namespace RenderCore { namespace Assets
         _finalMatrices = std::move(moveFrom._finalMatrices);
         _skinningBuffer = std::move(moveFrom._skinningBuffer);
         _vbOffsets = std::move(moveFrom._vbOffsets);
+        _keyCursors = std::move(moveFrom._keyCursors);
         _animState = moveFrom._animState;
         return *this;
     }
@@ -712,14 +717,69 @@ namespace RenderCore { namespace Assets
         bool operator()(uint64 lhs, const AnimationSet::Animation& rhs) const { return lhs < rhs._name; }
     };
 
+        //  A group of animation drivers with the same output type, evaluated
+        //  together with the batch version of RawAnimationCurve::Calculate
+    template<typename OutType>
+        class DriverBatch
+    {
+    public:
+        static const unsigned Capacity = 64;
+        const RawAnimationCurve*    _curves[Capacity];
+        unsigned                    _keyCursors[Capacity];
+        size_t                      _drivers[Capacity];
+        OutType                     _results[Capacity];
+        unsigned                    _count;
+
+            // returns true when the batch is full
+        bool Add(const RawAnimationCurve& curve, size_t driver, const unsigned keyCursors[])
+        {
+            assert(_count < Capacity);
+            _curves[_count] = &curve;
+            _keyCursors[_count] = keyCursors ? keyCursors[driver] : 0;
+            _drivers[_count] = driver;
+            return ++_count == Capacity;
+        }
+
+        template<typename WriteFn>
+            void Flush(float time, unsigned keyCursors[], WriteFn& write)
+        {
+            if (!_count) return;
+            RawAnimationCurve::Calculate(_results, time, _curves, _count, keyCursors ? _keyCursors : nullptr);
+            for (unsigned c=0; c<_count; ++c) {
+                if (keyCursors) keyCursors[_drivers[c]] = _keyCursors[c];
+                write(_drivers[c], _results[c]);
+            }
+            _count = 0;
+        }
+
+        DriverBatch() : _count(0) {}
+    };
+
     TransformationParameterSet      AnimationSet::BuildTransformationParameterSet(
+        const AnimationState&           animState,
+        const TransformationMachine&    transformationMachine,
+        const AnimationSetBinding&      binding,
+        const RawAnimationCurve*        curves,
+        size_t                          curvesCount,
+        unsigned*                       keyCursors) const
+    {
+        TransformationParameterSet result;
+        BuildTransformationParameterSet(
+            result, animState, transformationMachine, binding,
+            curves, curvesCount, keyCursors);
+        return result;
+    }
+
+    void    AnimationSet::BuildTransformationParameterSet(
+        TransformationParameterSet&     result,
         const AnimationState&           animState__,
         const TransformationMachine&    transformationMachine,
         const AnimationSetBinding&      binding,
         const RawAnimationCurve*        curves,
-        size_t                          curvesCount) const
+        size_t                          curvesCount,
+        unsigned*                       keyCursors) const
     {
-        TransformationParameterSet result(transformationMachine.GetDefaultParameters());
+        result = transformationMachine.GetDefaultParameters();
         float* float1s      = result.GetFloat1Parameters();
         Float3* float3s     = result.GetFloat3Parameters();
         Float4* float4s     = result.GetFloat4Parameters();
@@ -743,62 +803,101 @@ namespace RenderCore { namespace Assets
 
         const TransformationMachine::InputInterface& inputInterface 
             = transformationMachine.GetInputInterface();
+        auto parameterForDriver = 
+            [&](size_t c) -> const TransformationMachine::InputInterface::Parameter&
+            {
+                unsigned transInputIndex = binding._animDriverToMachineParameter[_animationDrivers[c]._parameterIndex];
+                assert(transInputIndex < inputInterface._parameterCount);
+                return inputInterface._parameters[transInputIndex];
+            };
+
+            //  Write the results of each batch into the parameter set
+        auto writeFloat4x4 = 
+            [&](size_t c, const Float4x4& value)
+            {
+                const auto& p = parameterForDriver(c);
+                assert(p._type == TransformationParameterSet::Type::Float4x4);
+                float4x4s[p._index] = value;
+            };
+        auto writeFloat4 = 
+            [&](size_t c, const Float4& value)
+            {
+                const auto& p = parameterForDriver(c);
+                if (p._type == TransformationParameterSet::Type::Float4) {
+                    float4s[p._index] = value;
+                } else if (p._type == TransformationParameterSet::Type::Float3) {
+                    float3s[p._index] = Truncate(value);
+                } else {
+                    assert(p._type == TransformationParameterSet::Type::Float1);
+                    float1s[p._index] = value[0];
+                }
+            };
+        auto writeFloat3 = 
+            [&](size_t c, const Float3& value)
+            {
+                const auto& p = parameterForDriver(c);
+                if (p._type == TransformationParameterSet::Type::Float3) {
+                    float3s[p._index] = value;
+                } else {
+                    assert(p._type == TransformationParameterSet::Type::Float1);
+                    float1s[p._index] = value[0];
+                }
+            };
+        auto writeFloat1 = 
+            [&](size_t c, float value)
+            {
+                const auto& driver = _animationDrivers[c];
+                const auto& p = parameterForDriver(c);
+                if (p._type == TransformationParameterSet::Type::Float1) {
+                    float1s[p._index] = value;
+                } else if (p._type == TransformationParameterSet::Type::Float3) {
+                    assert(driver._samplerOffset < 3);
+                    float3s[p._index][driver._samplerOffset] = value;
+                } else if (p._type == TransformationParameterSet::Type::Float4) {
+                    assert(driver._samplerOffset < 4);
+                    float4s[p._index][driver._samplerOffset] = value;
+                }
+            };
+
+            //  Curves are evaluated in batches of the same output type, with one
+            //  contiguous result array per type (see RawAnimationCurve::Calculate).
+            //  The batches are flushed in a fixed order, so Float1 drivers that
+            //  write single components always come after drivers that write the
+            //  whole parameter.
+        DriverBatch<Float4x4> float4x4Batch;
+        DriverBatch<Float4> float4Batch;
+        DriverBatch<Float3> float3Batch;
+        DriverBatch<float> float1Batch;
+        auto flushAll = 
+            [&]()
+            {
+                float4x4Batch.Flush(animState._time, keyCursors, writeFloat4x4);
+                float4Batch.Flush(animState._time, keyCursors, writeFloat4);
+                float3Batch.Flush(animState._time, keyCursors, writeFloat3);
+                float1Batch.Flush(animState._time, keyCursors, writeFloat1);
+            };
+
         for (size_t c=driverStart; c<driverEnd; ++c) {
             const AnimationDriver& driver = _animationDrivers[c];
             unsigned transInputIndex = binding._animDriverToMachineParameter[driver._parameterIndex];
-            if (transInputIndex == ~unsigned(0x0)) {
+            if (transInputIndex == ~unsigned(0x0) || driver._curveId >= curvesCount) {
                 continue;   // (unbound output)
             }
 
-            assert(transInputIndex < inputInterface._parameterCount);
-            const TransformationMachine::InputInterface::Parameter& p 
-                = inputInterface._parameters[transInputIndex];
-
+            const RawAnimationCurve& curve = curves[driver._curveId];
+            bool full = false;
             if (driver._samplerType == TransformationParameterSet::Type::Float4x4) {
-                if (driver._curveId < curvesCount) {
-                    const RawAnimationCurve& curve = curves[driver._curveId];
-                    assert(p._type == TransformationParameterSet::Type::Float4x4);
-                    // assert(i->_index < float4x4s.size());
-                    float4x4s[p._index] = curve.Calculate<Float4x4>(animState._time);
-                }
+                full = float4x4Batch.Add(curve, c, keyCursors);
             } else if (driver._samplerType == TransformationParameterSet::Type::Float4) {
-                if (driver._curveId < curvesCount) {
-                    const RawAnimationCurve& curve = curves[driver._curveId];
-                    if (p._type == TransformationParameterSet::Type::Float4) {
-                        float4s[p._index] = curve.Calculate<Float4>(animState._time);
-                    } else if (p._type == TransformationParameterSet::Type::Float3) {
-                        float3s[p._index] = Truncate(curve.Calculate<Float4>(animState._time));
-                    } else {
-                        assert(p._type == TransformationParameterSet::Type::Float1);
-                        float1s[p._index] = curve.Calculate<Float4>(animState._time)[0];
-                    }
-                }
+                full = float4Batch.Add(curve, c, keyCursors);
             } else if (driver._samplerType == TransformationParameterSet::Type::Float3) {
-                if (driver._curveId < curvesCount) {
-                    const RawAnimationCurve& curve = curves[driver._curveId];
-                    if (p._type == TransformationParameterSet::Type::Float3) {
-                        float3s[p._index] = curve.Calculate<Float3>(animState._time);
-                    } else {
-                        assert(p._type == TransformationParameterSet::Type::Float1);
-                        float1s[p._index] = curve.Calculate<Float3>(animState._time)[0];
-                    }
-                }
+                full = float3Batch.Add(curve, c, keyCursors);
             } else if (driver._samplerType == TransformationParameterSet::Type::Float1) {
-                if (driver._curveId < curvesCount) {
-                    const RawAnimationCurve& curve = curves[driver._curveId];
-                    float result = curve.Calculate<float>(animState._time);
-                    if (p._type == TransformationParameterSet::Type::Float1) {
-                        float1s[p._index] = result;
-                    } else if (p._type == TransformationParameterSet::Type::Float3) {
-                        assert(driver._samplerOffset < 3);
-                        float3s[p._index][driver._samplerOffset] = result;
-                    } else if (p._type == TransformationParameterSet::Type::Float4) {
-                        assert(driver._samplerOffset < 4);
-                        float4s[p._index][driver._samplerOffset] = result;
-                    }
-                }
+                full = float1Batch.Add(curve, c, keyCursors);
             }
+            if (full) flushAll();
         }
+        flushAll();
 
         for (   size_t c=constantDriverStartIndex; c<constantDriverEndIndex; ++c) {
             const ConstantDriver& driver = _constantDrivers[c];
@@ -836,8 +935,6 @@ namespace RenderCore { namespace Assets
                 }
             }
         }
-
-        return result;
     }
 
     AnimationSet::Animation AnimationSet::FindAnimation(uint64 animation) const
@@ -883,28 +980,86 @@ namespace RenderCore { namespace Assets
         std::unique_ptr<SkeletonBinding> _skeletonBinding;
         const AnimationSetScaffold* _animationSetScaffold;
         const SkeletonScaffold* _skeletonScaffold;
+        FlatTransformationMachine _flatSkeleton;
+
+        void PrepareRange(
+            ModelRenderer::PreparedAnimation* const states[], size_t stateCount,
+            bool basePose) const;
     };
 
+    void SkinPrepareMachine::Pimpl::PrepareRange(
+        ModelRenderer::PreparedAnimation* const states[], size_t stateCount,
+        bool basePose) const
+    {
+            //  The parameter set and working space are reused for every
+            //  state in the range (so we only allocate once per range)
+        auto& skeleton = _skeletonScaffold->GetTransformationMachine();
+        auto& animSet = _animationSetScaffold->ImmutableData();
+        auto finalMatCount = _flatSkeleton.GetOutputMatrixCount();
+        auto workingSpace = std::make_unique<Float4x4[]>(_flatSkeleton.GetWorkingSpaceCount());
+        TransformationParameterSet params;
+
+        for (size_t c=0; c<stateCount; ++c) {
+            auto& state = *states[c];
+            state._finalMatrices = std::make_unique<Float4x4[]>(finalMatCount);
+            if (!basePose) {
+                state._keyCursors.resize(animSet._animationSet.GetAnimationDriverCount(), 0);
+                animSet._animationSet.BuildTransformationParameterSet(
+                    params, state._animState, 
+                    skeleton, *_animationSetBinding, 
+                    animSet._curves, animSet._curvesCount,
+                    AsPointer(state._keyCursors.begin()));
+
+                _flatSkeleton.GenerateOutputTransforms(
+                    state._finalMatrices.get(), finalMatCount, &params, workingSpace.get());
+            } else {
+                _flatSkeleton.GenerateOutputTransforms(
+                    state._finalMatrices.get(), finalMatCount, &skeleton.GetDefaultParameters(), workingSpace.get());
+            }
+        }
+    }
+
     void SkinPrepareMachine::PrepareAnimation(   
             Metal::DeviceContext* context, 
             ModelRenderer::PreparedAnimation& state) const
     {
-        auto& skeleton = _pimpl->_skeletonScaffold->GetTransformationMachine();
-        auto& animSet = _pimpl->_animationSetScaffold->ImmutableData();
-            
-        auto finalMatCount = skeleton.GetOutputMatrixCount();
-        state._finalMatrices = std::make_unique<Float4x4[]>(finalMatCount);
-        if (!Tweakable("AnimBasePose", false)) {
-            auto params = animSet._animationSet.BuildTransformationParameterSet(
-                state._animState, 
-                skeleton, *_pimpl->_animationSetBinding, 
-                animSet._curves, animSet._curvesCount);
+        ModelRenderer::PreparedAnimation* states[] = { &state };
+        _pimpl->PrepareRange(states, dimof(states), Tweakable("AnimBasePose", false));
+    }
 
-            
-            skeleton.GenerateOutputTransforms(state._finalMatrices.get(), finalMatCount, &params);
-        } else {
-            skeleton.GenerateOutputTransforms(state._finalMatrices.get(), finalMatCount, &skeleton.GetDefaultParameters());
+    void SkinPrepareMachine::PrepareAnimation(   
+            Metal::DeviceContext* context, 
+            ModelRenderer::PreparedAnimation* const states[], 
+            size_t stateCount) const
+    {
+            //  Each state is independent, so we can just split them into
+            //  contiguous ranges. We want a few ranges per thread for load
+            //  balancing, but enough states in each range to make the
+            //  scheduling overhead insignificant.
+            //  We wait for the result within the frame, so use the short task pool
+            //  (the long pool can be busy with loading and compiling for a while)
+        const size_t minStatesPerRange = 8;
+        bool basePose = Tweakable("AnimBasePose", false);
+        auto& pool = ConsoleRig::GlobalServices::GetShortTaskThreadPool();
+        auto rangeCount = std::min(
+            size_t(pool.GetWorkerThreadCount()+1) * 4, 
+            (stateCount + minStatesPerRange - 1) / minStatesPerRange);
+        if (rangeCount <= 1) {
+            _pimpl->PrepareRange(states, stateCount, basePose);
+            return;
+        }
+
+        const auto* pimpl = _pimpl.get();
+        CompletionThreadPool::TaskGroup group(pool);
+        for (size_t r=0; r<rangeCount; ++r) {
+            auto begin = stateCount * r / rangeCount, end = stateCount * (r+1) / rangeCount;
+            group.Run(
+                [pimpl, states, begin, end, basePose]()
+                {
+                    pimpl->PrepareRange(states+begin, end-begin, basePose);
+                });
         }
+        group.Wait();
     }
 
     const SkeletonBinding& SkinPrepareMachine::GetSkeletonBinding() const
@@ -928,6 +1083,11 @@ namespace RenderCore { namespace Assets
             skinScaffold.CommandStream().GetInputInterface());
         pimpl->_animationSetScaffold = &animationScaffold;
         pimpl->_skeletonScaffold = &skeletonScaffold;
+
+        auto& skeleton = skeletonScaffold.GetTransformationMachine();
+        pimpl->_flatSkeleton = FlatTransformationMachine(
+            skeleton.GetCommandStream(), skeleton.GetCommandStream() + skeleton.GetCommandStreamSize(),
+            skeleton.GetOutputMatrixCount());
         _pimpl = std::move(pimpl);
     }
 
@@ -969,7 +1129,7 @@ namespace RenderCore { namespace Assets
 
     AnimationSetScaffold::AnimationSetScaffold(const ::Assets::ResChar filename[])
     {
-        auto memBlock = Serialization::ChunkFile::RawChunkAsMemoryBlock(filename, ChunkType_AnimationSet, 0);
+        auto memBlock = Serialization::ChunkFile::RawChunkAsMemoryBlock(filename, ChunkType_AnimationSet, ChunkVersion_AnimationSet);
         Serialization::Block_Initialize(memBlock.get());        
         _data = (const AnimationImmutableData*)Serialization::Block_GetFirstObject(memBlock.get());
         _filename = filename;
@@ -144,6 +144,11 @@ namespace RenderCore { namespace Metal_DX11
         _underlying->DrawIndexed(indexCount, startIndexLocation, baseVertexLocation);
     }
 
+    void DeviceContext::DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndexLocation, unsigned baseVertexLocation, unsigned startInstanceLocation)
+    {
+        _underlying->DrawIndexedInstanced(indexCount, instanceCount, startIndexLocation, baseVertexLocation, startInstanceLocation);
+    }
+
     void DeviceContext::Clear(RenderTargetView& renderTargets, const Float4& clearColour)
     {
         _underlying->ClearRenderTargetView(renderTargets.GetUnderlying(), &clearColour[0]);
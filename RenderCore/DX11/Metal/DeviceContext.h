@@ -227,6 +227,7 @@ namespace RenderCore { namespace Metal_DX11
 
         void        Draw(unsigned vertexCount, unsigned startVertexLocation=0);
         void        DrawIndexed(unsigned indexCount, unsigned startIndexLocation=0, unsigned baseVertexLocation=0);
+        void        DrawIndexedInstanced(unsigned indexCount, unsigned instanceCount, unsigned startIndexLocation=0, unsigned baseVertexLocation=0, unsigned startInstanceLocation=0);
         void        Dispatch(unsigned countX, unsigned countY=1, unsigned countZ=1);
 
         void        Clear(RenderTargetView& renderTargets, const Float4& clearColour);
@@ -49,7 +49,7 @@ namespace RenderCore
                 // if immediately ready, we can do a resolve right now.
             if (_marker->GetState() != ::Assets::AssetState::Pending) {
                 ResolveFromCompileMarker();
-                if (!_shader || _shader->empty())
+                if (_shader.empty())
                     Throw(Assets::Exceptions::InvalidAsset(Initializer(), ""));
             }
         }
@@ -111,7 +111,7 @@ namespace RenderCore
             ResolveFromCompileMarker();
         }
 
-        if (!_shader || _shader->empty()) {
+        if (_shader.empty()) {
             _shader.reset();
             Throw(Assets::Exceptions::InvalidAsset(Initializer(), ""));
         }
@@ -148,24 +148,27 @@ namespace RenderCore
     {
         Resolve();
         return std::make_pair(
-            PtrAdd(AsPointer(_shader->begin()), sizeof(ShaderService::ShaderHeader)),
-            _shader->size() - sizeof(ShaderService::ShaderHeader));
+            PtrAdd(_shader.begin(), sizeof(ShaderService::ShaderHeader)),
+            _shader.size() - sizeof(ShaderService::ShaderHeader));
     }
 
     ::Assets::AssetState CompiledShaderByteCode::TryGetByteCode(
         void const*& byteCode, size_t& size)
     {
-        if (_shader) {
-            byteCode = PtrAdd(AsPointer(_shader->begin()), sizeof(ShaderService::ShaderHeader));
-            size = _shader->size() - sizeof(ShaderService::ShaderHeader);
+        if (!_shader.empty()) {
+            byteCode = PtrAdd(_shader.begin(), sizeof(ShaderService::ShaderHeader));
+            size = _shader.size() - sizeof(ShaderService::ShaderHeader);
             return ::Assets::AssetState::Ready;
         }
 
         if (_compileHelper) {
-            auto resolveRes = _compileHelper->TryResolve(_shader, Initializer(), _validationCallback);
+            ShaderService::IPendingMarker::Payload payload;
+            auto resolveRes = _compileHelper->TryResolve(payload, Initializer(), _validationCallback);
             if (resolveRes != ::Assets::AssetState::Ready)
                 return resolveRes;
 
+            _shader = payload;
+
             _compileHelper.reset();
         } else if (_marker) {
             auto markerState = _marker->GetState();
@@ -175,13 +178,13 @@ namespace RenderCore
             ResolveFromCompileMarker();
         }
 
-        if (!_shader || _shader->empty()) {
+        if (_shader.empty()) {
             _shader.reset();
             return ::Assets::AssetState::Invalid;
         }
 
-        byteCode = PtrAdd(AsPointer(_shader->begin()), sizeof(ShaderService::ShaderHeader));
-        size = _shader->size() - sizeof(ShaderService::ShaderHeader);
+        byteCode = PtrAdd(_shader.begin(), sizeof(ShaderService::ShaderHeader));
+        size = _shader.size() - sizeof(ShaderService::ShaderHeader);
         return ::Assets::AssetState::Ready;
     }
 
@@ -190,8 +193,8 @@ namespace RenderCore
         if (_stage == ShaderStage::Null) return false;
 
         Resolve();
-        if (_shader->size() < sizeof(ShaderService::ShaderHeader)) return false;
-        auto* hdr = (const ShaderService::ShaderHeader*)AsPointer(_shader->begin());
+        if (_shader.size() < sizeof(ShaderService::ShaderHeader)) return false;
+        auto* hdr = (const ShaderService::ShaderHeader*)_shader.begin();
         assert(hdr->_version == ShaderService::ShaderHeader::Version);
         return hdr->_dynamicLinkageEnabled != 0;
     }
@@ -7,6 +7,7 @@
 #pragma once
 
 #include "../Assets/AssetsCore.h"
+#include "../Assets/ArchiveCache.h"
 #include "../Core/Prefix.h"
 #include "../Core/Types.h"
 #include <memory>
@@ -198,7 +199,7 @@ namespace RenderCore
         static const uint64 CompileProcessType;
 
     private:
-        mutable std::shared_ptr<std::vector<uint8>> _shader;
+        mutable ::Assets::ArchiveCache::BlockView _shader;
 
         ShaderStage::Enum _stage;
         std::shared_ptr<::Assets::DependencyValidation>   _validationCallback;
@@ -212,10 +212,10 @@ namespace RenderCore { namespace Techniques
 		}
         
         uint64 globalHashWithInterface = inputHash ^ techniqueInterface.GetHashValue();
-        auto i = std::lower_bound(_globalToResolved.begin(), _globalToResolved.end(), globalHashWithInterface, CompareFirst<uint64, ResolvedShader>());
-        if (i!=_globalToResolved.cend() && i->first == globalHashWithInterface) {
-            if (i->second._shaderProgram && (i->second._shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0)) {
-                ResolveAndBind(i->second, globalState, techniqueInterface);
+        auto* i = _globalToResolved.Find(globalHashWithInterface);
+        if (i) {
+            if (i->_shaderProgram && (i->_shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0)) {
+                ResolveAndBind(*i, globalState, techniqueInterface);
             }
 
             #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
@@ -225,16 +225,16 @@ namespace RenderCore { namespace Techniques
 
                 OutputDebugString((BuildParamsAsString(_baseParameters, ti->second._globalState) + "\r\n").c_str());
             #endif
-            return i->second;
+            return *i;
         }
 
         uint64 filteredHashValue = _baseParameters.CalculateFilteredHash(inputHash, globalState);
         uint64 filteredHashWithInterface = filteredHashValue ^ techniqueInterface.GetHashValue();
-        auto i2 = std::lower_bound(_filteredToResolved.begin(), _filteredToResolved.end(), filteredHashWithInterface, CompareFirst<uint64, ResolvedShader>());
-        if (i2!=_filteredToResolved.cend() && i2->first == filteredHashWithInterface) {
-            _globalToResolved.insert(i, std::make_pair(globalHashWithInterface, i2->second));
-            if (i2->second._shaderProgram && (i2->second._shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0)) {
-                ResolveAndBind(i2->second, globalState, techniqueInterface);
+        auto* i2 = _filteredToResolved.Find(filteredHashWithInterface);
+        if (i2) {
+            _globalToResolved.Insert(globalHashWithInterface, *i2);
+            if (i2->_shaderProgram && (i2->_shaderProgram->GetDependencyValidation()->GetValidationIndex()!=0)) {
+                ResolveAndBind(*i2, globalState, techniqueInterface);
             }
 
             #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
@@ -247,14 +247,14 @@ namespace RenderCore { namespace Techniques
 
                 OutputDebugString((BuildParamsAsString(_baseParameters, lti->second._globalState) + "\r\n").c_str());
             #endif
-            return i2->second;
+            return *i2;
         }
 
         ResolvedShader newResolvedShader;
         newResolvedShader._variationHash = filteredHashValue;
         ResolveAndBind(newResolvedShader, globalState, techniqueInterface);
-        _filteredToResolved.insert(i2, std::make_pair(filteredHashWithInterface, newResolvedShader));
-        _globalToResolved.insert(i, std::make_pair(globalHashWithInterface, newResolvedShader));
+        _filteredToResolved.Insert(filteredHashWithInterface, newResolvedShader);
+        _globalToResolved.Insert(globalHashWithInterface, newResolvedShader);
 
         #if defined(CHECK_TECHNIQUE_HASH_CONFLICTS)
             auto gti = std::lower_bound(_globalToResolvedTest.begin(), _globalToResolvedTest.end(), globalHashWithInterface, CompareFirst<uint64, HashConflictTest>());
@@ -678,6 +678,18 @@ namespace RenderCore { namespace Techniques
         _name = name;
     }
 
+    auto Technique::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        result._globalToResolved = _globalToResolved.GetMetrics();
+        result._filteredToResolved = _filteredToResolved.GetMetrics();
+        result._globalToFiltered = _baseParameters._globalToFilteredTable.GetMetrics();
+        result._filterMaskCount = 0;
+        for (unsigned c=0; c<ShaderParameters::Source::Max; ++c)
+            result._filterMaskCount += _baseParameters._filterMasks[c].GetSize();
+        return result;
+    }
+
     Technique::Technique(Technique&& moveFrom)
     :       _name(moveFrom._name)
     ,       _baseParameters(std::move(moveFrom._baseParameters))
@@ -795,11 +807,24 @@ namespace RenderCore { namespace Techniques
 
     uint64      ShaderParameters::CalculateFilteredHash(const ParameterBox* globalState[Source::Max]) const
     {
-		uint64 filteredState = _parameters[0].CalculateFilteredHashValue(*globalState[0]);
+            //  Matching the parameter names in the global state against our parameters
+            //  only depends on the layout of the global state boxes, not on their values.
+            //  So we keep a filter mask for each layout we've seen, and only need to 
+            //  apply it here.
+        uint64 filteredValues[Source::Max];
+        for (unsigned c=0; c<Source::Max; ++c) {
+            auto layoutHash = globalState[c]->CalculateLayoutHash();
+            auto* mask = _filterMasks[c].Find(layoutHash);
+            if (!mask)
+                mask = &_filterMasks[c].Insert(layoutHash, _parameters[c].BuildFilterMask(*globalState[c]));
+            filteredValues[c] = _parameters[c].CalculateFilteredHashValue(*globalState[c], *mask);
+        }
+
+		uint64 filteredState = filteredValues[0];
         for (unsigned c=1; c<Source::Max; ++c) {
               // filteredState ^= _parameters[c].TranslateHash(*globalState[c]) << (c*6);     // we have to be careful of cases where 2 boxes have their filtered tables sort of swapped... Those cases should produce distinctive hashes
 
-			filteredState = HashCombine(_parameters[c].CalculateFilteredHashValue(*globalState[c]), filteredState);
+			filteredState = HashCombine(filteredValues[c], filteredState);
         }
         return filteredState;
     }
@@ -807,16 +832,16 @@ namespace RenderCore { namespace Techniques
     uint64      ShaderParameters::CalculateFilteredHash(uint64 inputHash, const ParameterBox* globalState[Source::Max]) const
     {
             //      Find a local state to match
-        auto i = LowerBound(_globalToFilteredTable, inputHash);
-        if (i!=_globalToFilteredTable.cend() && i->first == inputHash) {
-            return i->second;
+        auto* i = _globalToFilteredTable.Find(inputHash);
+        if (i) {
+            return *i;
         }
 
             //  The call to "CalculateFilteredHash" here is quite expensive... Ideally we should only get here during
             //  initialisation steps (or perhaps on the first few frames. We ideally don't want to be going through
             //  all of this during normal frames.
         uint64 filteredState = CalculateFilteredHash(globalState);
-        _globalToFilteredTable.insert(i, std::make_pair(inputHash, filteredState));
+        _globalToFilteredTable.Insert(inputHash, filteredState);
         return filteredState;
     }
 
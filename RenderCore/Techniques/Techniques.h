@@ -9,6 +9,7 @@
 #include "../Metal/Forward.h"
 #include "../../Assets/AssetsCore.h"
 #include "../../Utility/ParameterBox.h"
+#include "../../Utility/HeapUtils.h"
 #include "../../Core/Prefix.h"
 #include "../../Core/Types.h"
 #include <string>
@@ -31,7 +32,8 @@ namespace RenderCore { namespace Techniques
 
     private:
         uint64      CalculateFilteredHash(const ParameterBox* globalState[Source::Max]) const;
-        mutable std::vector<std::pair<uint64, uint64>>  _globalToFilteredTable;
+        mutable FlatHashTable<uint64>                       _globalToFilteredTable;
+        mutable FlatHashTable<ParameterBox::FilterMask>     _filterMasks[Source::Max];     // keyed by ParameterBox::CalculateLayoutHash() of the global state
 
         friend class Technique;
     };
@@ -122,6 +124,15 @@ namespace RenderCore { namespace Techniques
 
         bool                IsValid() const { return !_vertexShaderName.empty(); }
 
+        class Metrics
+        {
+        public:
+            FlatHashTable<ResolvedShader>::Metrics  _globalToResolved, _filteredToResolved;
+            FlatHashTable<uint64>::Metrics          _globalToFiltered;
+            unsigned                                _filterMaskCount;
+        };
+        Metrics             GetMetrics() const;
+
         Technique(
             Utility::InputStreamFormatter<utf8>& formatter, 
             const std::string& name,
@@ -132,8 +143,8 @@ namespace RenderCore { namespace Techniques
     protected:
         std::string         _name;
         ShaderParameters    _baseParameters;
-        mutable std::vector<std::pair<uint64, ResolvedShader>>  _filteredToResolved;
-        mutable std::vector<std::pair<uint64, ResolvedShader>>  _globalToResolved;
+        mutable FlatHashTable<ResolvedShader>   _filteredToResolved;
+        mutable FlatHashTable<ResolvedShader>   _globalToResolved;
         ::Assets::rstring   _vertexShaderName;
         ::Assets::rstring   _pixelShaderName;
         ::Assets::rstring   _geometryShaderName;
@@ -20,6 +20,7 @@
 #include "../../Math/ProjectionMath.h"
 #include "../../Utility/Mixins.h"
 #include "../../Utility/Profiling/CPUProfiler.h"
+#include <algorithm>
 
 namespace Sample
 {
@@ -221,16 +222,35 @@ namespace Sample
             //      Separate state preparation from rendering, so we can profile
             //      them both separately
             //  
-        auto si = _pimpl->_preallocatedState.begin();
-        for (auto i=_pimpl->_stateCache.begin(); i!=_pimpl->_stateCache.end(); ++i, ++si) {
+            //  2 prepare steps
+            //      * first, we need to generate the transform matrices
+            //      * second, we generate the animated vertex positions
+            //  The transform matrices for all of the states that share a model are
+            //  generated together with the batch PrepareAnimation (which splits them
+            //  across the thread pool)
+        const auto stateCount = std::min(_pimpl->_stateCache.size(), _pimpl->_preallocatedState.size());
+        for (size_t c=0; c<stateCount; ++c)
+            _pimpl->_preallocatedState[c]._animState = RenderCore::Assets::AnimationState(
+                _pimpl->_stateCache[c]._time, _pimpl->_stateCache[c]._animation);
+
+        std::vector<Pimpl::PreparedAnimation*> modelStates;
+        modelStates.reserve(stateCount);
+        for (size_t c=0; c<stateCount; ++c) {
+            const auto* model = _pimpl->_stateCache[c]._model;
+            bool alreadyPrepared = false;
+            for (size_t c2=0; c2<c && !alreadyPrepared; ++c2)
+                alreadyPrepared = _pimpl->_stateCache[c2]._model == model;
+            if (alreadyPrepared) continue;
+
+            modelStates.clear();
+            for (size_t c2=c; c2<stateCount; ++c2)
+                if (_pimpl->_stateCache[c2]._model == model)
+                    modelStates.push_back(&_pimpl->_preallocatedState[c2]);
+
             TRY {
-                const auto& model = *i->_model;
-                    // 2 prepare steps
-                    //      * first, we need to generate the transform matrices
-                    //      * second, we generate the animated vertex positions
-                si->_animState = RenderCore::Assets::AnimationState(i->_time, i->_animation);
-                model.GetPrepareMachine().PrepareAnimation(context, *si);
-                model.GetRenderer().PrepareAnimation(context, *si, model.GetPrepareMachine().GetSkeletonBinding());
+                model->GetPrepareMachine().PrepareAnimation(context, AsPointer(modelStates.cbegin()), modelStates.size());
+                for (auto s=modelStates.cbegin(); s!=modelStates.cend(); ++s)
+                    model->GetRenderer().PrepareAnimation(context, **s, model->GetPrepareMachine().GetSkeletonBinding());
             } CATCH(const std::exception&) {
             } CATCH_END
         }
@@ -28,6 +28,7 @@
 
 #include "../ConsoleRig/Log.h"
 #include "../ConsoleRig/Console.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include "../Math/Matrix.h"
 #include "../Math/Transformations.h"
 #include "../Math/ProjectionMath.h"
@@ -37,6 +38,8 @@
 #include "../Utility/HeapUtils.h"
 #include "../Utility/IteratorUtils.h"
 #include "../Utility/StringFormat.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/Streams/StreamFormatter.h"
@@ -85,28 +88,50 @@ namespace SceneEngine
         const ObjectReference*  GetObjectReferences() const;
         unsigned                GetObjectReferenceCount() const;
         const void*             GetFilenamesBuffer() const;
+        unsigned                GetFilenamesBufferSize() const;
+
+            //  Prebuilt PlacementsQuadTree (see PlacementsQuadTree::Serialize), or 
+            //  null if the file doesn't have one
+        std::pair<const void*, size_t> GetQuadTreeData() const { return std::make_pair(_quadTreeData, _quadTreeDataSize); }
 
         const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const { return _dependencyValidation; }
 
         void Write(const Assets::ResChar destinationFile[]) const;
         void LogDetails(const char title[]) const;
 
-        Placements(const ResChar filename[]);
+        typedef PlacementsManager::CellLoadMode LoadMode;
+        Placements(const ResChar filename[], LoadMode::Enum loadMode = LoadMode::MemoryBlock);
         Placements();
+        Placements(const Placements& copyFrom);
         ~Placements();
     protected:
         std::vector<ObjectReference>    _objects;
         std::vector<uint8>              _filenamesBuffer;
 
+            //  When loaded from a file, the object references, filenames and quad
+            //  tree are all used in-place, from either a memory mapping or a 
+            //  single block with the file contents
+        std::shared_ptr<MemoryMappedFile>   _mappedFile;
+        std::unique_ptr<uint8[]>            _fileBlock;
+        const ObjectReference*  _inPlaceObjects;
+        unsigned                _inPlaceObjectCount;
+        const void*             _inPlaceFilenames;
+        unsigned                _inPlaceFilenamesSize;
+        const void*             _quadTreeData;
+        size_t                  _quadTreeDataSize;
+
         std::shared_ptr<::Assets::DependencyValidation>   _dependencyValidation;
         void ReplaceString(const char oldString[], const char newString[]);
+        bool LoadInPlace(const ResChar filename[], const void* fileData, size_t fileSize);
     };
 
-    auto        Placements::GetObjectReferences() const -> const ObjectReference*   { return AsPointer(_objects.begin()); }
-    unsigned    Placements::GetObjectReferenceCount() const                         { return unsigned(_objects.size()); }
-    const void* Placements::GetFilenamesBuffer() const                              { return AsPointer(_filenamesBuffer.begin()); }
+    auto        Placements::GetObjectReferences() const -> const ObjectReference*   { return _inPlaceObjects ? _inPlaceObjects : AsPointer(_objects.begin()); }
+    unsigned    Placements::GetObjectReferenceCount() const                         { return _inPlaceObjects ? _inPlaceObjectCount : unsigned(_objects.size()); }
+    const void* Placements::GetFilenamesBuffer() const                              { return _inPlaceObjects ? _inPlaceFilenames : AsPointer(_filenamesBuffer.begin()); }
+    unsigned    Placements::GetFilenamesBufferSize() const                          { return _inPlaceObjects ? _inPlaceFilenamesSize : unsigned(_filenamesBuffer.size()); }
 
     static const uint64 ChunkType_Placements = ConstHash64<'Plac','emen','ts'>::Value;
+    static const uint64 ChunkType_PlacementsQuadTree = ConstHash64<'Plac','emen','tsQT'>::Value;
 
     class PlacementsHeader
     {
@@ -117,51 +142,78 @@ namespace SceneEngine
         unsigned _dummy;
     };
 
+        //  Version 1 chunks are used in-place after loading. Each chunk begins on a
+        //  16 byte boundary in the file (and so, in memory)
+    static const unsigned PlacementsChunkVersion = 1;
+    static const unsigned PlacementsQuadTreeChunkVersion = 1;
+
+    static void AlignChunkStart(Serialization::ChunkFile::SimpleChunkFileWriter& fileWriter)
+    {
+        static const uint8 zeroes[16] = {0};
+        auto padding = (16 - (fileWriter.TellP() & 0xf)) & 0xf;
+        if (padding && fileWriter.Write(zeroes, 1, padding) != padding)
+            Throw(::Exceptions::BasicLabel("Failure in file write while saving placements"));
+    }
+
     void Placements::Write(const Assets::ResChar destinationFile[]) const
     {
         using namespace Serialization::ChunkFile;
         SimpleChunkFileWriter fileWriter(
-            1, RenderCore::VersionString, RenderCore::BuildDateString,
+            2, RenderCore::VersionString, RenderCore::BuildDateString,
             std::make_tuple(destinationFile, "wb", 0));
-        fileWriter.BeginChunk(ChunkType_Placements, 0, "Placements");
+        AlignChunkStart(fileWriter);
+        fileWriter.BeginChunk(ChunkType_Placements, PlacementsChunkVersion, "Placements");
 
+        auto* objects = GetObjectReferences();
         PlacementsHeader hdr;
-        hdr._version = 0;
-        hdr._objectRefCount = (unsigned)_objects.size();
-        hdr._filenamesBufferSize = unsigned(_filenamesBuffer.size());
+        hdr._version = PlacementsChunkVersion;
+        hdr._objectRefCount = GetObjectReferenceCount();
+        hdr._filenamesBufferSize = GetFilenamesBufferSize();
         hdr._dummy = 0;
         auto writeResult0 = fileWriter.Write(&hdr, sizeof(hdr), 1);
-        auto writeResult1 = fileWriter.Write(AsPointer(_objects.begin()), sizeof(ObjectReference), hdr._objectRefCount);
-        auto writeResult2 = fileWriter.Write(AsPointer(_filenamesBuffer.begin()), 1, hdr._filenamesBufferSize);
+        auto writeResult1 = fileWriter.Write(objects, sizeof(ObjectReference), hdr._objectRefCount);
+        auto writeResult2 = fileWriter.Write(GetFilenamesBuffer(), 1, hdr._filenamesBufferSize);
 
         if (    writeResult0 != 1
             ||  writeResult1 != hdr._objectRefCount
             ||  writeResult2 != hdr._filenamesBufferSize)
             Throw(::Exceptions::BasicLabel("Failure in file write while saving placements"));
+
+            //  Build the culling tree now, so we don't have to do it at load time
+        auto quadTreeData = PlacementsQuadTree(
+            hdr._objectRefCount ? &objects[0]._cellSpaceBoundary : nullptr,
+            sizeof(ObjectReference), hdr._objectRefCount).Serialize();
+        AlignChunkStart(fileWriter);
+        fileWriter.BeginChunk(ChunkType_PlacementsQuadTree, PlacementsQuadTreeChunkVersion, "PlacementsQuadTree");
+        if (fileWriter.Write(AsPointer(quadTreeData.begin()), 1, quadTreeData.size()) != quadTreeData.size())
+            Throw(::Exceptions::BasicLabel("Failure in file write while saving placements"));
     }
 
     void Placements::LogDetails(const char title[]) const
     {
         // write some details about this placements file to the log
         LogInfo << "---<< Placements file: " << title << " >>---";
-        LogInfo << "    (" << _objects.size() << ") object references -- " << sizeof(ObjectReference) * _objects.size() / 1024.f << "k in objects, " << _filenamesBuffer.size() / 1024.f << "k in string table";
+        auto* objBegin = GetObjectReferences();
+        auto* objEnd = objBegin + GetObjectReferenceCount();
+        auto* filenamesBuffer = GetFilenamesBuffer();
+        LogInfo << "    (" << (objEnd - objBegin) << ") object references -- " << sizeof(ObjectReference) * (objEnd - objBegin) / 1024.f << "k in objects, " << GetFilenamesBufferSize() / 1024.f << "k in string table";
 
         unsigned configCount = 0;
-        auto i = _objects.cbegin();
-        while (i != _objects.cend()) {
+        auto i = objBegin;
+        while (i != objEnd) {
             auto starti = i;
-            while (i != _objects.cend() && i->_materialFilenameOffset == starti->_materialFilenameOffset && i->_modelFilenameOffset == starti->_modelFilenameOffset) { ++i; }
+            while (i != objEnd && i->_materialFilenameOffset == starti->_materialFilenameOffset && i->_modelFilenameOffset == starti->_modelFilenameOffset) { ++i; }
             ++configCount;
         }
         LogInfo << "    (" << configCount << ") configurations";
 
-        i = _objects.cbegin();
-        while (i != _objects.cend()) {
+        i = objBegin;
+        while (i != objEnd) {
             auto starti = i;
-            while (i != _objects.cend() && i->_materialFilenameOffset == starti->_materialFilenameOffset && i->_modelFilenameOffset == starti->_modelFilenameOffset) { ++i; }
+            while (i != objEnd && i->_materialFilenameOffset == starti->_materialFilenameOffset && i->_modelFilenameOffset == starti->_modelFilenameOffset) { ++i; }
 
-            auto modelName = (const ResChar*)PtrAdd(AsPointer(_filenamesBuffer.begin()), starti->_modelFilenameOffset + sizeof(uint64));
-            auto materialName = (const ResChar*)PtrAdd(AsPointer(_filenamesBuffer.begin()), starti->_materialFilenameOffset + sizeof(uint64));
+            auto modelName = (const ResChar*)PtrAdd(filenamesBuffer, starti->_modelFilenameOffset + sizeof(uint64));
+            auto materialName = (const ResChar*)PtrAdd(filenamesBuffer, starti->_materialFilenameOffset + sizeof(uint64));
             LogInfo << "    [" << (i-starti) << "] objects (" << modelName << "), (" << materialName << ")";
         }
     }
@@ -225,7 +277,68 @@ namespace SceneEngine
         }
     }
 
-    Placements::Placements(const ResChar filename[])
+    bool Placements::LoadInPlace(const ResChar filename[], const void* fileData, size_t fileSize)
+    {
+            //  Find the chunks within the file data, and point directly into them.
+            //  No parsing or copying is required; we just validate the sizes.
+        using namespace Serialization::ChunkFile;
+        if (fileSize < sizeof(ChunkFileHeader))
+            Throw(::Assets::Exceptions::InvalidAsset(filename, "Incomplete file header"));
+
+        const auto& fileHeader = *(const ChunkFileHeader*)fileData;
+        if (fileHeader._magic != MagicHeader || fileHeader._fileVersionNumber != ChunkFileVersion
+            || fileSize < sizeof(ChunkFileHeader) + fileHeader._chunkCount * sizeof(ChunkHeader))
+            Throw(::Assets::Exceptions::InvalidAsset(filename, "Unrecognised chunk file format"));
+
+        auto* chunksBegin = (const ChunkHeader*)PtrAdd(fileData, sizeof(ChunkFileHeader));
+        auto* chunksEnd = chunksBegin + fileHeader._chunkCount;
+        auto i = std::find_if(
+            chunksBegin, chunksEnd,
+            [](const ChunkHeader& hdr) { return hdr._type == ChunkType_Placements; });
+        if (i == chunksEnd || (size_t(i->_fileOffset) + i->_size) > fileSize || i->_size < sizeof(PlacementsHeader)) {
+            Throw(::Assets::Exceptions::InvalidAsset(filename, "Missing correct chunks"));
+        }
+
+        const auto& hdr = *(const PlacementsHeader*)PtrAdd(fileData, i->_fileOffset);
+        if (hdr._version > PlacementsChunkVersion) {
+            Throw(::Assets::Exceptions::InvalidAsset(filename, 
+                StringMeld<128>() << "Unexpected version number (" << hdr._version << ")"));
+        }
+
+        if ((sizeof(hdr) + sizeof(ObjectReference) * size_t(hdr._objectRefCount) + hdr._filenamesBufferSize) > i->_size)
+            Throw(::Assets::Exceptions::InvalidAsset(filename, "Placements chunk is truncated"));
+
+        auto* objects = (const ObjectReference*)PtrAdd(fileData, i->_fileOffset + sizeof(hdr));
+        auto* filenames = (const uint8*)PtrAdd(objects, sizeof(ObjectReference) * hdr._objectRefCount);
+
+            //  Version 0 chunks have the same layout, but aren't aligned. So we copy
+            //  them out (and ignore any prebuilt tree, which was also an older format)
+        if (hdr._version < PlacementsChunkVersion) {
+            _objects.insert(_objects.end(), objects, objects + hdr._objectRefCount);
+            _filenamesBuffer.insert(_filenamesBuffer.end(), filenames, filenames + hdr._filenamesBufferSize);
+            return false;
+        }
+
+        _inPlaceObjects = objects;
+        _inPlaceObjectCount = hdr._objectRefCount;
+        _inPlaceFilenames = filenames;
+        _inPlaceFilenamesSize = hdr._filenamesBufferSize;
+
+        auto qt = std::find_if(
+            chunksBegin, chunksEnd,
+            [](const ChunkHeader& hdr) { return hdr._type == ChunkType_PlacementsQuadTree; });
+        if (qt != chunksEnd && qt->_chunkVersion == PlacementsQuadTreeChunkVersion 
+            && (size_t(qt->_fileOffset) + qt->_size) <= fileSize) {
+            _quadTreeData = PtrAdd(fileData, qt->_fileOffset);
+            _quadTreeDataSize = qt->_size;
+        }
+        return true;
+    }
+
+    Placements::Placements(const ResChar filename[], LoadMode::Enum loadMode)
+    : _inPlaceObjects(nullptr), _inPlaceObjectCount(0)
+    , _inPlaceFilenames(nullptr), _inPlaceFilenamesSize(0)
+    , _quadTreeData(nullptr), _quadTreeDataSize(0)
     {
             //
             //      Extremely simple file format for placements
@@ -236,56 +349,65 @@ namespace SceneEngine
             //      because many of the string will be referenced multiple
             //      times. It just helps reduce file size.
             //
-
-        using namespace Serialization::ChunkFile;
-        std::vector<ObjectReference> objects;
-        std::vector<uint8> filenamesBuffer;
-
-        TRY {
-            BasicFile file(filename, "rb");
-            auto chunks = LoadChunkTable(file);
-            auto i = std::find_if(
-                chunks.begin(), chunks.end(), 
-                [](const ChunkHeader& hdr) { return hdr._type == ChunkType_Placements; });
-            if (i == chunks.end()) {
-                Throw(::Assets::Exceptions::InvalidAsset(filename, "Missing correct chunks"));
-            }
-
-            file.Seek(i->_fileOffset, SEEK_SET);
-            PlacementsHeader hdr;
-            file.Read(&hdr, sizeof(hdr), 1);
-            if (hdr._version != 0) {
-                Throw(::Assets::Exceptions::InvalidAsset(filename, 
-                    StringMeld<128>() << "Unexpected version number (" << hdr._version << ")"));
-            }
-
-            objects.resize(hdr._objectRefCount);
-            filenamesBuffer.resize(hdr._filenamesBufferSize);
-            file.Read(AsPointer(objects.begin()), sizeof(ObjectReference), hdr._objectRefCount);
-            file.Read(AsPointer(filenamesBuffer.begin()), 1, hdr._filenamesBufferSize);
-        } CATCH (const Utility::Exceptions::IOException&) { // catch file errors
-        } CATCH_END
+            //      Each string is prefixed with its 64 bit hash, so the renderer
+            //      can compare strings without touching the string data.
+            //
+            //      There's also an optional prebuilt culling tree.
+            //
+            //      All of this is used in-place. In MemoryMap mode, the file
+            //      is mapped and only the pages we touch are read. But the file
+            //      remains locked while mapped, so the default mode just reads
+            //      the whole file into a single block (still without parsing).
+            //
 
         auto depValidation = std::make_shared<Assets::DependencyValidation>();
         RegisterFileDependency(depValidation, filename);
-
-        _objects = std::move(objects);
-        _filenamesBuffer = std::move(filenamesBuffer);
         _dependencyValidation = std::move(depValidation);
 
+        if (loadMode == LoadMode::MemoryMap) {
+            auto mappedFile = std::make_shared<MemoryMappedFile>(
+                filename, 0, MemoryMappedFile::Access::Read, BasicFile::ShareMode::Read);
+            if (!mappedFile->IsValid()) return;     // (missing files are treated as empty)
+            if (LoadInPlace(filename, mappedFile->GetData(), mappedFile->GetSize()))
+                _mappedFile = std::move(mappedFile);
+        } else {
+            size_t fileSize = 0;
+            auto fileBlock = LoadFileAsMemoryBlock(filename, &fileSize);
+            if (!fileBlock) return;
+            if (LoadInPlace(filename, fileBlock.get(), fileSize))
+                _fileBlock = std::move(fileBlock);
+        }
+
         #if defined(_DEBUG)
-            if (!_objects.empty()) {
+            if (GetObjectReferenceCount()) {
                 LogDetails(filename);
             }
         #endif
     }
 
     Placements::Placements()
+    : _inPlaceObjects(nullptr), _inPlaceObjectCount(0)
+    , _inPlaceFilenames(nullptr), _inPlaceFilenamesSize(0)
+    , _quadTreeData(nullptr), _quadTreeDataSize(0)
     {
         auto depValidation = std::make_shared<Assets::DependencyValidation>();
         _dependencyValidation = std::move(depValidation);
     }
 
+    Placements::Placements(const Placements& copyFrom)
+    : _objects(copyFrom.GetObjectReferences(), copyFrom.GetObjectReferences() + copyFrom.GetObjectReferenceCount())
+    , _filenamesBuffer(
+        (const uint8*)copyFrom.GetFilenamesBuffer(), 
+        (const uint8*)copyFrom.GetFilenamesBuffer() + copyFrom.GetFilenamesBufferSize())
+    , _inPlaceObjects(nullptr), _inPlaceObjectCount(0)
+    , _inPlaceFilenames(nullptr), _inPlaceFilenamesSize(0)
+    , _quadTreeData(nullptr), _quadTreeDataSize(0)
+    , _dependencyValidation(copyFrom._dependencyValidation)
+    {
+            //  The copy always has its own (modifiable) copy of the objects and strings;
+            //  and never a prebuilt tree (because the objects are expected to change)
+    }
+
     Placements::~Placements()
     {}
 
@@ -311,7 +433,8 @@ namespace SceneEngine
             ::Assets::rstring _filename;
             std::unique_ptr<Placements> _placements;
 
-            void Reload();
+            void Reload(Placements::LoadMode::Enum loadMode);
+            void ReleaseMappedData();
 
             Item() {}
             Item(Item&& moveFrom) : _filename(std::move(moveFrom._filename)), _placements(std::move(moveFrom._placements)) {}
@@ -326,6 +449,9 @@ namespace SceneEngine
             Item(const Item&) = delete;
         };
         Item* Get(uint64 filenameHash, const ResChar filename[] = nullptr);
+        Item* Find(uint64 filenameHash);
+
+        Placements::LoadMode::Enum _loadMode;
 
         PlacementsCache();
         ~PlacementsCache();
@@ -338,7 +464,7 @@ namespace SceneEngine
         auto i = LowerBound(_items, filenameHash);
         if (i != _items.end() && i->first == filenameHash) {
             if (i->second->_placements->GetDependencyValidation()->GetValidationIndex()!=0)
-                i->second->Reload();
+                i->second->Reload(_loadMode);
             return i->second.get();
         } 
 
@@ -348,18 +474,34 @@ namespace SceneEngine
 
         auto newItem = std::make_unique<Item>();
         newItem->_filename = filename;
-        newItem->Reload();
+        newItem->Reload(_loadMode);
         i = _items.emplace(i, std::make_pair(filenameHash, std::move(newItem)));
         return i->second.get();
     }
 
-    void PlacementsCache::Item::Reload()
+    auto PlacementsCache::Find(uint64 filenameHash) -> Item*
+    {
+        auto i = LowerBound(_items, filenameHash);
+        if (i != _items.end() && i->first == filenameHash)
+            return i->second.get();
+        return nullptr;
+    }
+
+    void PlacementsCache::Item::Reload(Placements::LoadMode::Enum loadMode)
     {
         _placements.reset();
-        _placements = std::make_unique<Placements>(_filename.c_str());
+        _placements = std::make_unique<Placements>(_filename.c_str(), loadMode);
     }
 
-    PlacementsCache::PlacementsCache() {}
+    void PlacementsCache::Item::ReleaseMappedData()
+    {
+            //  Replace the memory mapped placements with a copy, so the file is
+            //  unlocked. We will reload from the file after it changes.
+        if (_placements)
+            _placements = std::make_unique<Placements>(*_placements);
+    }
+
+    PlacementsCache::PlacementsCache() : _loadMode(Placements::LoadMode::MemoryBlock) {}
     PlacementsCache::~PlacementsCache() {}
 
     class PlacementsRenderer
@@ -373,7 +515,9 @@ namespace SceneEngine
             RenderCore::Metal::DeviceContext* context,
             RenderCore::Techniques::ParsingContext& parserContext,
             unsigned techniqueIndex, RenderCore::Assets::DelayStep delayStep);
-        void FilterDrawCalls(const std::function<bool(const DelayedDrawCall&)>& predicate);
+        void FilterDrawCalls(
+            RenderCore::Techniques::ParsingContext& parserContext,
+            const std::function<bool(const DelayedDrawCall&)>& predicate);
 
         void Render(
             RenderCore::Metal::DeviceContext* context,
@@ -382,8 +526,10 @@ namespace SceneEngine
             const uint64* filterStart = nullptr, const uint64* filterEnd = nullptr);
 
         void SetOverride(uint64 guid, std::shared_ptr<Placements> placements);
+        void ReleaseMappedData(uint64 cellFilenameHash);
         auto GetCachedQuadTree(uint64 cellFilenameHash) const -> const PlacementsQuadTree*;
         ModelCache& GetModelCache() { return *_cache; }
+        auto GetPrepareStats() const -> const PlacementsPrepareStats&;
 
         PlacementsRenderer(std::shared_ptr<PlacementsCache> placementsCache, std::shared_ptr<ModelCache> modelCache);
         ~PlacementsRenderer();
@@ -393,13 +539,16 @@ namespace SceneEngine
         public:
             PlacementsCache::Item* _placements;
             std::unique_ptr<PlacementsQuadTree> _quadTree;
+            const Placements* _quadTreeSource;      // the quad tree may point into this object's data
 
-            CellRenderInfo() {}
+            CellRenderInfo() : _placements(nullptr), _quadTreeSource(nullptr) {}
             CellRenderInfo(CellRenderInfo&& moveFrom) never_throws
             : _placements(moveFrom._placements)
             , _quadTree(std::move(moveFrom._quadTree))
+            , _quadTreeSource(moveFrom._quadTreeSource)
             {
                 moveFrom._placements = nullptr;
+                moveFrom._quadTreeSource = nullptr;
             }
 
             CellRenderInfo& operator=(CellRenderInfo&& moveFrom) never_throws
@@ -407,6 +556,8 @@ namespace SceneEngine
                 _placements = moveFrom._placements;
                 moveFrom._placements = nullptr;
                 _quadTree = std::move(moveFrom._quadTree);
+                _quadTreeSource = moveFrom._quadTreeSource;
+                moveFrom._quadTreeSource = nullptr;
                 return *this;
             }
 
@@ -423,13 +574,47 @@ namespace SceneEngine
 
         std::shared_ptr<RenderCore::Assets::IModelFormat> _modelFormat;
 
-        void Render(
-            RenderCore::Metal::DeviceContext* context,
+            //  Cells are queued by Render(), and then culled & prepared together
+            //  in PrepareQueuedCells() (before _preparedRenders is used)
+        class ModelRun
+        {
+        public:
+            unsigned            _end;       // end of the run in QueuedCell::_visibleObjects
+            uint64              _modelHash, _materialHash;
+            unsigned            _LOD;
+            ModelCache::Model   _model;
+        };
+
+        class QueuedCell
+        {
+        public:
+            const Placements*           _placements;
+            const PlacementsQuadTree*   _quadTree;
+            Float3x4                    _cellToWorld;
+            Float4x4                    _worldToProjection;
+            Float3                      _cameraPosition;    // in cell space
+            std::vector<uint64>         _filter;
+            std::vector<unsigned>       _visibleObjects;
+            std::vector<ModelRun>       _modelRuns;
+        };
+
+        std::vector<QueuedCell> _queuedCells;
+        unsigned _queuedCellCount;
+        std::vector<std::unique_ptr<DelayedDrawCallSet>> _threadPreparedRenders;
+        PlacementsPrepareStats _prepareStats;
+
+        void QueueCell(
             RenderCore::Techniques::ParsingContext& parserContext,
             const Placements& placements,
             const PlacementsQuadTree* quadTree,
             const Float3x4& cellToWorld,
             const uint64* filterStart, const uint64* filterEnd);
+        void PrepareQueuedCells(RenderCore::Techniques::ParsingContext& parserContext);
+        void ResolveQueuedCell(
+            RenderCore::Techniques::ParsingContext& parserContext,
+            QueuedCell& cell, ModelCache::Model& current);
+        static void CullQueuedCell(QueuedCell& cell);
+        static void PrepareQueuedCell(ModelCache& cache, DelayedDrawCallSet& dest, const QueuedCell& cell);
     };
 
     class PlacementsManager::Pimpl
@@ -446,6 +631,7 @@ namespace SceneEngine
     void PlacementsRenderer::BeginRender(RenderCore::Metal::DeviceContext* devContext)
     {
         _preparedRenders.Reset();
+        _queuedCellCount = 0;
         _cache->GetSharedStateSet().CaptureState(devContext);
     }
 
@@ -454,6 +640,8 @@ namespace SceneEngine
         RenderCore::Techniques::ParsingContext& parserContext,
         unsigned techniqueIndex)
     {
+        PrepareQueuedCells(parserContext);
+
             // we can commit the opaque-render part now...
         TRY
         {
@@ -473,6 +661,7 @@ namespace SceneEngine
         unsigned techniqueIndex, RenderCore::Assets::DelayStep delayStep)
     {
             // draw the translucent parts of models that were previously prepared
+        PrepareQueuedCells(parserContext);
         _cache->GetSharedStateSet().CaptureState(context);
         TRY
         {
@@ -487,8 +676,10 @@ namespace SceneEngine
     }
 
     void PlacementsRenderer::FilterDrawCalls(
+        RenderCore::Techniques::ParsingContext& parserContext,
         const std::function<bool(const RenderCore::Assets::DelayedDrawCall&)>& predicate)
     {
+        PrepareQueuedCells(parserContext);
         _preparedRenders.Filter(predicate);
     }
 
@@ -501,6 +692,20 @@ namespace SceneEngine
         return nullptr;
     }
 
+    void PlacementsRenderer::ReleaseMappedData(uint64 cellFilenameHash)
+    {
+            //  Must be called before writing to a placements file that might be in
+            //  the cache (because the file can't be written while it is mapped).
+        auto i2 = LowerBound(_cells, cellFilenameHash);
+        if (i2!=_cells.end() && i2->first == cellFilenameHash) {
+            i2->second._quadTree.reset();
+            i2->second._quadTreeSource = nullptr;
+        }
+
+        auto* item = _placementsCache->Find(cellFilenameHash);
+        if (item) item->ReleaseMappedData();
+    }
+
     void PlacementsRenderer::SetOverride(uint64 guid, std::shared_ptr<Placements> placements)
     {
         auto i = LowerBound(_cellOverrides, guid);
@@ -552,7 +757,7 @@ namespace SceneEngine
         {
             auto i = LowerBound(_cellOverrides, cell._filenameHash);
             if (i != _cellOverrides.end() && i->first == cell._filenameHash) {
-                Render(context, parserContext, *i->second.get(), nullptr, cell._cellToWorld, filterStart, filterEnd);
+                QueueCell(parserContext, *i->second.get(), nullptr, cell._cellToWorld, filterStart, filterEnd);
             } else {
                 auto i2 = LowerBound(_cells, cell._filenameHash);
                 if (i2 == _cells.end() || i2->first != cell._filenameHash) {
@@ -563,19 +768,41 @@ namespace SceneEngine
 
                     // check if we need to reload placements
                 if (i2->second._placements->_placements->GetDependencyValidation()->GetValidationIndex() != 0) {
+                    i2->second._quadTree.reset();       // (may point into the old placements data)
                     i2->second._placements->Reload();
-                    i2->second._quadTree.reset();
                 }
 
+                    //  The placements can also be reloaded or replaced through the cache, so
+                    //  make sure the tree was built for the current object
+                if (i2->second._quadTreeSource != i2->second._placements->_placements.get())
+                    i2->second._quadTree.reset();
+
                 if (!i2->second._quadTree) {
-                    i2->second._quadTree = std::make_unique<PlacementsQuadTree>(
-                        &i2->second._placements->_placements->GetObjectReferences()->_cellSpaceBoundary,
-                        sizeof(Placements::ObjectReference), 
-                        i2->second._placements->_placements->GetObjectReferenceCount());
+                    auto& placements = *i2->second._placements->_placements;
+                    i2->second._quadTreeSource = &placements;
+                    auto* boxes = &placements.GetObjectReferences()->_cellSpaceBoundary;
+                    auto quadTreeData = placements.GetQuadTreeData();
+
+                        //  Use the prebuilt tree from the placements file, if we can.
+                        //  Otherwise (older file, or mismatched data) build it now.
+                    if (quadTreeData.first) {
+                        TRY {
+                            i2->second._quadTree = std::make_unique<PlacementsQuadTree>(
+                                quadTreeData.first, quadTreeData.second,
+                                placements.GetObjectReferenceCount());
+                        } CATCH (const std::exception& e) {
+                            LogWarning << "Rebuilding placements quad tree, because prebuilt tree is invalid (" << e.what() << ")";
+                        } CATCH_END
+                    }
+
+                    if (!i2->second._quadTree)
+                        i2->second._quadTree = std::make_unique<PlacementsQuadTree>(
+                            boxes, sizeof(Placements::ObjectReference), 
+                            placements.GetObjectReferenceCount());
                 }
 
-                Render(
-                    context, parserContext, 
+                QueueCell(
+                    parserContext, 
                     *i2->second._placements->_placements, 
                     i2->second._quadTree.get(),
                     cell._cellToWorld, filterStart, filterEnd);
@@ -587,91 +814,7 @@ namespace SceneEngine
         CATCH_END
     }
 
-    namespace Internal
-    {
-        class RendererHelper
-        {
-        public:
-            void Render(
-                ModelCache& cache,
-                DelayedDrawCallSet& delayedDrawCalls,
-                const void* filenamesBuffer,
-                const Placements::ObjectReference& obj,
-                const Float3x4& cellToWorld,
-                const Float3& cameraPosition);
-
-            RendererHelper()
-            {
-                _currentModel = _currentMaterial = 0ull;
-            }
-        protected:
-            uint64 _currentModel, _currentMaterial;
-            ModelCache::Model _current;
-        };
-
-        void RendererHelper::Render(
-            ModelCache& cache,
-            DelayedDrawCallSet& delayedDrawCalls,
-            const void* filenamesBuffer,
-            const Placements::ObjectReference& obj,
-            const Float3x4& cellToWorld,
-            const Float3& cameraPosition)
-        {
-                // Basic draw distance calculation
-                // many objects don't need to render out to the far clip
-
-            float distanceSq = MagnitudeSquared(
-                .5f * (obj._cellSpaceBoundary.first + obj._cellSpaceBoundary.second) - cameraPosition);
-            const float maxDistanceSq = 1000.f * 1000.f;
-            if (distanceSq > maxDistanceSq) { return; }
-
-                //  Objects should be sorted by model & material. This is important for
-                //  reducing the work load in "_cache". Typically cells will only refer
-                //  to a limited number of different types of objects, but the same object
-                //  may be repeated many times. In these cases, we want to minimize the
-                //  workload for every repeat.
-            auto modelHash = *(uint64*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset);
-            auto materialHash = *(uint64*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset);
-            materialHash = HashCombine(materialHash, modelHash);
-
-                // Simple LOD calculation based on distanceSq from camera...
-                //      Currently all models have only the single LOD. But this
-                //      may cause problems with models with multiple LOD, because
-                //      it may mean rapidly switching back and forth between 
-                //      renderers (which can be expensive)
-            auto LOD = unsigned(distanceSq / (150.f*150.f));
-
-            if (    modelHash != _currentModel || materialHash != _currentMaterial 
-                ||  std::min(_current._maxLOD, LOD) != _current._selectedLOD) {
-                _current = cache.GetModel(
-                    (const ResChar*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset + sizeof(uint64)),
-                    (const ResChar*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset + sizeof(uint64)),
-                    LOD);
-                _currentModel = modelHash;
-                _currentMaterial = materialHash;
-            }
-                
-            auto localToWorld = Combine(obj._localToCell, cellToWorld);
-
-                //  if we have internal transforms, we must use them.
-                //  But some models don't have any internal transforms -- in these
-                //  cases, the _defaultTransformCount will be zero
-            if (_current._model->ImmutableData()._defaultTransformCount) {
-                ModelRenderer::MeshToModel mtm(
-                    _current._model->ImmutableData()._defaultTransforms, 
-                    (unsigned)_current._model->ImmutableData()._defaultTransformCount);
-                _current._renderer->Prepare(
-                    delayedDrawCalls, 
-                    cache.GetSharedStateSet(), 
-                    AsFloat4x4(localToWorld), &mtm);
-            } else {
-                _current._renderer->Prepare(delayedDrawCalls, cache.GetSharedStateSet(), AsFloat4x4(localToWorld));
-            }
-        }
-    }
-
-    void PlacementsRenderer::Render(
-        RenderCore::Metal::DeviceContext* context,
+    void PlacementsRenderer::QueueCell(
         RenderCore::Techniques::ParsingContext& parserContext,
         const Placements& placements,
         const PlacementsQuadTree* quadTree,
@@ -710,79 +853,357 @@ namespace SceneEngine
             //  So, to that end... Let's find all of the objects to render (using
             //  whatever culling/occlusion methods we need) and prepare them all
             //  for rendering.
+            //
+            //  We don't do that work immediately, though. The cell is just queued
+            //  here, and all queued cells are culled and prepared together (across
+            //  multiple threads) in PrepareQueuedCells().
             //  
 
-        auto placementCount = placements.GetObjectReferenceCount();
-        if (!placementCount) {
-            return;
-        }
-        
-        __declspec(align(16)) auto cellToCullSpace = Combine(cellToWorld, parserContext.GetProjectionDesc()._worldToProjection);
+            //  Queued cells are reused from frame to frame, so the vectors within
+            //  them don't need to be reallocated every frame.
+        if (_queuedCellCount >= _queuedCells.size())
+            _queuedCells.resize(_queuedCellCount+1);
+
+        auto& queued = _queuedCells[_queuedCellCount++];
+        queued._placements = &placements;
+        queued._quadTree = quadTree;
+        queued._cellToWorld = cellToWorld;
+        queued._worldToProjection = parserContext.GetProjectionDesc()._worldToProjection;
         auto cameraPosition = ExtractTranslation(parserContext.GetProjectionDesc()._cameraToWorld);
-        cameraPosition = TransformPoint(InvertOrthonormalTransform(cellToWorld), cameraPosition);
+        queued._cameraPosition = TransformPoint(InvertOrthonormalTransform(cellToWorld), cameraPosition);
+        queued._filter.clear();
+        if (filterStart != filterEnd)
+            queued._filter.insert(queued._filter.end(), filterStart, filterEnd);
+        queued._visibleObjects.clear();
+        queued._modelRuns.clear();
+    }
 
-        const uint64* filterIterator = filterStart;
-        const bool doFilter = filterStart != filterEnd;
-        Internal::RendererHelper helper;
-        
+    void PlacementsRenderer::CullQueuedCell(QueuedCell& cell)
+    {
+            //  Find the visible objects in this cell, and group them into runs
+            //  that share the same model, material & LOD. 
+            //  This must be thread safe -- it's run for many cells in parallel.
+        cell._visibleObjects.clear();
+        cell._modelRuns.clear();
+
+        const auto& placements = *cell._placements;
+        auto placementCount = placements.GetObjectReferenceCount();
         const auto* filenamesBuffer = placements.GetFilenamesBuffer();
         const auto* objRef = placements.GetObjectReferences();
         
-        if (quadTree) {
+        __declspec(align(16)) auto cellToCullSpace = Combine(cell._cellToWorld, cell._worldToProjection);
+        auto filterIterator = cell._filter.cbegin();
+        const bool doFilter = !cell._filter.empty();
+
+        auto addVisible = [&](unsigned objIndex)
+        {
+            auto& obj = objRef[objIndex];
+
+                // Filtering is required in some cases (for example, if we want to render only
+                // a single object in highlighted state). Rendering only part of a cell isn't
+                // ideal for this architecture. Mostly the cell is intended to work as a 
+                // immutable atomic object. However, we really need filtering for some things.
+
+            if (doFilter) {
+                while (filterIterator != cell._filter.cend() && *filterIterator < obj._guid) { ++filterIterator; }
+                if (filterIterator == cell._filter.cend() || *filterIterator != obj._guid) { return; }
+            }
+
+                // Basic draw distance calculation
+                // many objects don't need to render out to the far clip
+
+            float distanceSq = MagnitudeSquared(
+                .5f * (obj._cellSpaceBoundary.first + obj._cellSpaceBoundary.second) - cell._cameraPosition);
+            const float maxDistanceSq = 1000.f * 1000.f;
+            if (distanceSq > maxDistanceSq) { return; }
+
+            cell._visibleObjects.push_back(objIndex);
+        };
+        
+        if (cell._quadTree) {
 
             unsigned visibleObjs[10*1024];
             unsigned visibleObjCount = 0;
-            quadTree->CalculateVisibleObjects(
-                AsFloatArray(cellToCullSpace), &objRef->_cellSpaceBoundary,
-                sizeof(Placements::ObjectReference),
+            cell._quadTree->CalculateVisibleObjects(
+                AsFloatArray(cellToCullSpace),
                 visibleObjs, visibleObjCount, dimof(visibleObjs));
 
                 // we have to sort to return to our expected order
             std::sort(visibleObjs, &visibleObjs[visibleObjCount]);
 
-            for (unsigned c=0; c<visibleObjCount; ++c) {
-                auto& obj = objRef[visibleObjs[c]];
+            for (unsigned c=0; c<visibleObjCount; ++c)
+                addVisible(visibleObjs[c]);
+
+        } else {
+                // Cull in batches. The bounding boxes are stored within the object 
+                // references, so we gather them into a small SoA buffer first
+            const unsigned batchSize = 256;
+            float batchBoxes[6][batchSize];
+            unsigned batchVisible[batchSize];
+            AABBArraySoA boxes = 
+            {
+                { batchBoxes[0], batchBoxes[1], batchBoxes[2] },
+                { batchBoxes[3], batchBoxes[4], batchBoxes[5] },
+                0
+            };
 
-                if (doFilter) {
-                    while (filterIterator != filterEnd && *filterIterator < obj._guid) { ++filterIterator; }
-                    if (filterIterator == filterEnd || *filterIterator != obj._guid) { continue; }
+            for (unsigned batchStart=0; batchStart<placementCount; batchStart+=batchSize) {
+                boxes._count = std::min(placementCount - batchStart, batchSize);
+                for (unsigned c=0; c<boxes._count; ++c) {
+                    const auto& boundary = objRef[batchStart+c]._cellSpaceBoundary;
+                    for (unsigned q=0; q<3; ++q) {
+                        batchBoxes[q][c] = boundary.first[q];
+                        batchBoxes[3+q][c] = boundary.second[q];
+                    }
                 }
 
-                helper.Render(
-                    *_cache, _preparedRenders, 
-                    filenamesBuffer, obj, cellToWorld, cameraPosition);
+                auto visibleCount = CullAABBs_Aligned(AsFloatArray(cellToCullSpace), boxes, batchVisible);
+                for (size_t v=0; v<visibleCount; ++v)
+                    addVisible(batchStart + batchVisible[v]);
             }
+        }
 
-        } else {
-            for (unsigned c=0; c<placementCount; ++c) {
-                auto& obj = objRef[c];
-                if (CullAABB_Aligned(AsFloatArray(cellToCullSpace), obj._cellSpaceBoundary.first, obj._cellSpaceBoundary.second)) {
-                    continue;
+            //  Objects should be sorted by model & material. This is important for
+            //  reducing the work load in "_cache". Typically cells will only refer
+            //  to a limited number of different types of objects, but the same object
+            //  may be repeated many times. In these cases, we want to minimize the
+            //  workload for every repeat.
+        for (unsigned c=0; c<unsigned(cell._visibleObjects.size()); ++c) {
+            auto& obj = objRef[cell._visibleObjects[c]];
+            auto modelHash = *(uint64*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset);
+            auto materialHash = *(uint64*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset);
+            materialHash = HashCombine(materialHash, modelHash);
+
+                // Simple LOD calculation based on distanceSq from camera...
+                //      Currently all models have only the single LOD. But this
+                //      may cause problems with models with multiple LOD, because
+                //      it may mean rapidly switching back and forth between 
+                //      renderers (which can be expensive)
+            float distanceSq = MagnitudeSquared(
+                .5f * (obj._cellSpaceBoundary.first + obj._cellSpaceBoundary.second) - cell._cameraPosition);
+            auto LOD = unsigned(distanceSq / (150.f*150.f));
+
+            if (    cell._modelRuns.empty() 
+                ||  cell._modelRuns.back()._modelHash != modelHash 
+                ||  cell._modelRuns.back()._materialHash != materialHash
+                ||  cell._modelRuns.back()._LOD != LOD) {
+                ModelRun run;
+                run._modelHash = modelHash;
+                run._materialHash = materialHash;
+                run._LOD = LOD;
+                cell._modelRuns.push_back(run);
+            }
+            cell._modelRuns.back()._end = c+1;
+        }
+    }
+
+    void PlacementsRenderer::ResolveQueuedCell(
+        RenderCore::Techniques::ParsingContext& parserContext,
+        QueuedCell& cell, ModelCache::Model& current)
+    {
+            //  Find the model renderer for each run. The model cache isn't
+            //  thread safe, so this must happen on the main thread. Consecutive runs
+            //  that resolve to the same renderer (eg, LODs beyond the model's max LOD)
+            //  share the previous result.
+        const auto* filenamesBuffer = cell._placements->GetFilenamesBuffer();
+        const auto* objRef = cell._placements->GetObjectReferences();
+
+        unsigned runBegin = 0;
+        for (auto r=cell._modelRuns.begin(); r!=cell._modelRuns.end(); ++r) {
+            TRY
+            {
+                if (    r->_modelHash != current._hashedModelName || r->_materialHash != current._hashedMaterialName 
+                    ||  std::min(current._maxLOD, r->_LOD) != current._selectedLOD) {
+                    auto& obj = objRef[cell._visibleObjects[runBegin]];
+                    current = _cache->GetModel(
+                        (const ResChar*)PtrAdd(filenamesBuffer, obj._modelFilenameOffset + sizeof(uint64)),
+                        (const ResChar*)PtrAdd(filenamesBuffer, obj._materialFilenameOffset + sizeof(uint64)),
+                        r->_LOD);
+                    current._hashedModelName = r->_modelHash;
+                    current._hashedMaterialName = r->_materialHash;
+
+                        // (ensure the scaffold is resolved here, so PrepareQueuedCell doesn't modify it)
+                    current._model->ImmutableData();
+                }
+                r->_model = current;
+            }
+            CATCH(const ::Assets::Exceptions::InvalidAsset& e) { parserContext.Process(e); cell._modelRuns.erase(r, cell._modelRuns.end()); current = ModelCache::Model(); return; }
+            CATCH(const ::Assets::Exceptions::PendingAsset& e) { parserContext.Process(e); cell._modelRuns.erase(r, cell._modelRuns.end()); current = ModelCache::Model(); return; }
+            CATCH (...) { cell._modelRuns.erase(r, cell._modelRuns.end()); current = ModelCache::Model(); return; } 
+            CATCH_END
+            runBegin = r->_end;
+        }
+    }
+
+    void PlacementsRenderer::PrepareQueuedCell(
+        ModelCache& cache, DelayedDrawCallSet& dest, const QueuedCell& cell)
+    {
+            //  Generate the draw calls for a cell, after CullQueuedCell & ResolveQueuedCell.
+            //  This is thread safe, so long as each thread writes to a separate
+            //  DelayedDrawCallSet
+        const auto* objRef = cell._placements->GetObjectReferences();
+        const auto& sharedStateSet = cache.GetSharedStateSet();
+
+        unsigned runBegin = 0;
+        for (auto r=cell._modelRuns.cbegin(); r!=cell._modelRuns.cend(); ++r) {
+            const auto& immutableData = r->_model._model->ImmutableData();
+            for (auto c=runBegin; c<r->_end; ++c) {
+                auto& obj = objRef[cell._visibleObjects[c]];
+                auto localToWorld = Combine(obj._localToCell, cell._cellToWorld);
+
+                    //  if we have internal transforms, we must use them.
+                    //  But some models don't have any internal transforms -- in these
+                    //  cases, the _defaultTransformCount will be zero
+                if (immutableData._defaultTransformCount) {
+                    ModelRenderer::MeshToModel mtm(
+                        immutableData._defaultTransforms, 
+                        (unsigned)immutableData._defaultTransformCount);
+                    r->_model._renderer->Prepare(dest, sharedStateSet, AsFloat4x4(localToWorld), &mtm);
+                } else {
+                    r->_model._renderer->Prepare(dest, sharedStateSet, AsFloat4x4(localToWorld));
                 }
+            }
+            runBegin = r->_end;
+        }
+    }
+
+    void PlacementsRenderer::PrepareQueuedCells(RenderCore::Techniques::ParsingContext& parserContext)
+    {
+            //  Cull and prepare all of the cells queued since the last call. This happens
+            //  in 3 phases:
+            //      1. cull each cell (parallel)
+            //      2. find the model renderers (main thread only, because the model cache
+            //          isn't thread safe)
+            //      3. prepare draw calls (parallel) into a separate DelayedDrawCallSet for
+            //          each thread
+            //  Each thread in phase 3 works on a contiguous range of cells, and the results
+            //  are appended to _preparedRenders in order. So the final list of draw calls is
+            //  identical to preparing every cell in order on a single thread.
+        auto cellCount = _queuedCellCount;
+        _queuedCellCount = 0;
+        if (!cellCount) return;
+
+            //  This is per-frame work, so it goes in the short task pool (it shouldn't queue
+            //  up behind long tasks like shader compiles and file loads)
+        auto frequency = float(GetPerformanceCounterFrequency()) / 1000.f;
+        auto& pool = ConsoleRig::GlobalServices::GetShortTaskThreadPool();
+        const bool parallel = Tweakable("PlacementsParallelPrepare", true) && cellCount > 1;
+        auto* cells = AsPointer(_queuedCells.begin());
+
+        auto cullStart = GetPerformanceCounter();
+        if (parallel) {
+            auto rangeCount = std::min((pool.GetWorkerThreadCount()+1) * 4, cellCount);
+            CompletionThreadPool::TaskGroup group(pool);
+            for (unsigned r=0; r<rangeCount; ++r) {
+                auto begin = cellCount * r / rangeCount, end = cellCount * (r+1) / rangeCount;
+                group.Run([cells, begin, end]() { for (auto c=begin; c<end; ++c) CullQueuedCell(cells[c]); });
+            }
+            group.Wait();
+        } else {
+            for (unsigned c=0; c<cellCount; ++c) CullQueuedCell(cells[c]);
+        }
+
+        auto resolveStart = GetPerformanceCounter();
+        unsigned totalObjects = 0;
+        {
+            ModelCache::Model current;
+            for (unsigned c=0; c<cellCount; ++c) {
+                ResolveQueuedCell(parserContext, cells[c], current);
+                totalObjects += cells[c]._modelRuns.empty() ? 0 : cells[c]._modelRuns.back()._end;
+            }
+        }
 
-                    // Filtering is required in some cases (for example, if we want to render only
-                    // a single object in highlighted state). Rendering only part of a cell isn't
-                    // ideal for this architecture. Mostly the cell is intended to work as a 
-                    // immutable atomic object. However, we really need filtering for some things.
+            //  Split the cells into contiguous ranges with roughly the same
+            //  number of objects in each
+        auto prepareStart = GetPerformanceCounter();
+        auto threadCount = parallel ? std::min(pool.GetWorkerThreadCount()+1, cellCount) : 1u;
+        while (_threadPreparedRenders.size() < threadCount)
+            _threadPreparedRenders.push_back(std::make_unique<DelayedDrawCallSet>(typeid(ModelRenderer).hash_code()));
 
-                if (doFilter) {
-                    while (filterIterator != filterEnd && *filterIterator < obj._guid) { ++filterIterator; }
-                    if (filterIterator == filterEnd || *filterIterator != obj._guid) { continue; }
+        unsigned rangeBoundaries[65];
+        threadCount = std::min(threadCount, unsigned(dimof(rangeBoundaries)-1));
+        rangeBoundaries[0] = 0;
+        {
+            unsigned cell = 0, accumulated = 0;
+            for (unsigned t=1; t<threadCount; ++t) {
+                auto target = unsigned(uint64(totalObjects) * t / threadCount);
+                while (cell < cellCount && accumulated < target) {
+                    accumulated += cells[cell]._modelRuns.empty() ? 0 : cells[cell]._modelRuns.back()._end;
+                    ++cell;
                 }
+                rangeBoundaries[t] = cell;
+            }
+            rangeBoundaries[threadCount] = cellCount;
+        }
 
-                helper.Render(
-                    *_cache, _preparedRenders, 
-                    filenamesBuffer, obj, cellToWorld, cameraPosition);
+        _prepareStats._threadPrepareTimes.resize(threadCount);
+        _prepareStats._threadObjectCounts.resize(threadCount);
+            //  Repeated objects are collapsed into instanced draw calls in 2 levels:
+            //  first within each thread's set, and then again after merging (to 
+            //  collapse instances of the same model across threads)
+        const bool instancing = Tweakable("PlacementsInstancing", true);
+        auto prepareRange = [this, cells, &rangeBoundaries, frequency, instancing](unsigned t)
+        {
+            auto start = GetPerformanceCounter();
+            auto& dest = *_threadPreparedRenders[t];
+            dest.Reset();
+            unsigned objectCount = 0;
+            for (auto c=rangeBoundaries[t]; c<rangeBoundaries[t+1]; ++c) {
+                PrepareQueuedCell(*_cache, dest, cells[c]);
+                objectCount += cells[c]._modelRuns.empty() ? 0 : cells[c]._modelRuns.back()._end;
             }
+            if (instancing) dest.BuildInstances();
+            _prepareStats._threadPrepareTimes[t] = float(GetPerformanceCounter() - start) / frequency;
+            _prepareStats._threadObjectCounts[t] = objectCount;
+        };
+
+        if (threadCount > 1) {
+            CompletionThreadPool::TaskGroup group(pool);
+            for (unsigned t=0; t<threadCount; ++t)
+                group.Run([&prepareRange, t]() { prepareRange(t); });
+            group.Wait();
+        } else {
+            prepareRange(0);
+        }
+
+        auto mergeStart = GetPerformanceCounter();
+        for (unsigned t=0; t<threadCount; ++t)
+            _preparedRenders.Append(*_threadPreparedRenders[t]);
+        if (instancing && threadCount > 1)
+            _preparedRenders.BuildInstances();
+        auto mergeEnd = GetPerformanceCounter();
+
+        _prepareStats._cellCount = cellCount;
+        _prepareStats._objectCount = totalObjects;
+        _prepareStats._cullTime = float(resolveStart - cullStart) / frequency;
+        _prepareStats._resolveTime = float(prepareStart - resolveStart) / frequency;
+        _prepareStats._prepareTime = float(mergeStart - prepareStart) / frequency;
+        _prepareStats._mergeTime = float(mergeEnd - mergeStart) / frequency;
+        _prepareStats._drawRecordCount = 0;
+        for (unsigned c=0; c<dimof(_preparedRenders._entries); ++c)
+            _prepareStats._drawRecordCount += unsigned(_preparedRenders._entries[c].size());
+
+        if (Tweakable("PlacementsPrepareStats", false)) {
+            LogInfo << "Placements prepare: (" << cellCount << ") cells, (" << totalObjects << ") objects, (" << _prepareStats._drawRecordCount << ") draw records. Cull: " 
+                << _prepareStats._cullTime << "ms, resolve: " << _prepareStats._resolveTime << "ms, prepare: " 
+                << _prepareStats._prepareTime << "ms, merge: " << _prepareStats._mergeTime << "ms";
+            for (unsigned t=0; t<threadCount; ++t)
+                LogInfo << "    thread [" << t << "]: (" << _prepareStats._threadObjectCounts[t] << ") objects in " << _prepareStats._threadPrepareTimes[t] << "ms";
         }
     }
 
+    auto PlacementsRenderer::GetPrepareStats() const -> const PlacementsPrepareStats&
+    {
+        return _prepareStats;
+    }
+
     PlacementsRenderer::PlacementsRenderer(
         std::shared_ptr<PlacementsCache> placementsCache, 
         std::shared_ptr<ModelCache> modelCache)
     : _placementsCache(std::move(placementsCache))
     , _cache(std::move(modelCache))
     , _preparedRenders(typeid(ModelRenderer).hash_code())
+    , _queuedCellCount(0)
     {}
 
     PlacementsRenderer::~PlacementsRenderer() {}
@@ -857,6 +1278,17 @@ namespace SceneEngine
         return std::move(result);
     }
     
+    auto PlacementsManager::GetPrepareStats() const -> const PlacementsPrepareStats&
+    {
+        return _pimpl->_renderer->GetPrepareStats();
+    }
+
+    void PlacementsManager::SetCellLoadMode(CellLoadMode::Enum loadMode)
+    {
+            // (only affects cells loaded or reloaded after this call)
+        _pimpl->_placementsCache->_loadMode = loadMode;
+    }
+
     std::shared_ptr<PlacementsRenderer> PlacementsManager::GetRenderer()
     {
         return _pimpl->_renderer;
@@ -1432,7 +1864,7 @@ namespace SceneEngine
     {
             // get the local bounding box for a model
             // ... but stall waiting for any pending resources
-        auto* model = _editorPimpl->_renderer->GetModelCache().GetModelScaffold(filename);
+        auto model = _editorPimpl->_renderer->GetModelCache().GetModelScaffold(filename);
         auto state = model->StallAndResolve();
         if (state != ::Assets::AssetState::Ready) {
             result = std::make_pair(Float3(FLT_MAX, FLT_MAX, FLT_MAX), Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
@@ -1947,7 +2379,7 @@ namespace SceneEngine
         }
 
         if (predicate) {
-            _pimpl->_renderer->FilterDrawCalls(predicate);
+            _pimpl->_renderer->FilterDrawCalls(parserContext, predicate);
         }
         _pimpl->_renderer->EndRender(context, parserContext, techniqueIndex);
 
@@ -2043,6 +2475,7 @@ namespace SceneEngine
             auto& placements = *i->second;
 
             auto* cellName = _pimpl->GetCellName(cellGuid);
+            _pimpl->_renderer->ReleaseMappedData(cellGuid);
             SavePlacements(cellName, placements);
 
                 // clear the renderer links
@@ -2062,6 +2495,7 @@ namespace SceneEngine
                 continue;
 
             auto& placements = *i->second;
+            _pimpl->_renderer->ReleaseMappedData(cellId);
             placements.Write(destinationFile);
             return;
         }
@@ -13,6 +13,7 @@
 #include "../Math/Matrix.h"
 #include "../Core/Types.h"
 #include <string>
+#include <vector>
 #include <functional>
 
 namespace RenderCore { namespace Assets { class ModelCache; class DelayedDrawCall; } }
@@ -44,6 +45,27 @@ namespace SceneEngine
     class PlacementsEditor;
     class PlacementsQuadTree;
 
+    /// <summary>Timing information from the most recent placements render</summary>
+    /// Times are in milliseconds. Draw calls are prepared on multiple threads;
+    /// "_threadPrepareTimes" and "_threadObjectCounts" have one entry per thread.
+    class PlacementsPrepareStats
+    {
+    public:
+        unsigned                _cellCount;
+        unsigned                _objectCount;
+        unsigned                _drawRecordCount;
+        float                   _cullTime;
+        float                   _resolveTime;
+        float                   _prepareTime;
+        float                   _mergeTime;
+        std::vector<float>      _threadPrepareTimes;
+        std::vector<unsigned>   _threadObjectCounts;
+
+        PlacementsPrepareStats() 
+        : _cellCount(0), _objectCount(0), _drawRecordCount(0)
+        , _cullTime(0.f), _resolveTime(0.f), _prepareTime(0.f), _mergeTime(0.f) {}
+    };
+
     /// <summary>Manages stream and organization of object placements</summary>
     /// In this context, placements are static objects placed in the world. Most
     /// scenes will have a large number of essentially static objects. This object
@@ -67,6 +89,14 @@ namespace SceneEngine
         auto GetObjectBoundingBoxes(const Float4x4& worldToClip) const
             -> std::vector<std::pair<Float3x4, ObjectBoundingBoxes>>;
 
+        auto GetPrepareStats() const -> const PlacementsPrepareStats&;
+
+            //  Cell files are used in-place, either read into a single memory block
+            //  (the default) or memory mapped. Memory mapped files only read the pages
+            //  we touch, but remain locked while mapped.
+        struct CellLoadMode { enum Enum { MemoryBlock, MemoryMap }; };
+        void SetCellLoadMode(CellLoadMode::Enum loadMode);
+
         std::shared_ptr<PlacementsRenderer> GetRenderer();
         std::shared_ptr<PlacementsEditor> CreateEditor();
 
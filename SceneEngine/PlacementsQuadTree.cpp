@@ -7,8 +7,11 @@
 #include "PlacementsQuadTree.h"
 #include "../Math/ProjectionMath.h"
 #include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
 #include "../Core/Prefix.h"
-#include <stack>
+#include "../Core/Types.h"
+#include <algorithm>
+#include <float.h>
 
 #include "PlacementsQuadTreeDebugger.h"
 #include "PlacementsManager.h"
@@ -24,47 +27,119 @@ namespace SceneEngine
     class PlacementsQuadTree::Pimpl
     {
     public:
+            //  Flattened 4-wide bounding volume hierarchy. Nodes are stored breadth
+            //  first, and the bounding boxes of each node's children are quantized 
+            //  to 8 bits per component, relative to the node's own bounding box.
+            //  Each child covers a contiguous range of "_objects" (leaves are children
+            //  without a node).
         class Node
         {
         public:
-            BoundingBox     _boundary;
-            unsigned        _payloadID;
-            unsigned        _treeDepth;
-            unsigned        _children[4];
+            Float3      _origin;
+            Float3      _scale;             // (node maxs - node mins) / 255
+            unsigned    _children[4];       // index of the child node, or ~0u for leaves
+            unsigned    _objectsBegin[4];   // range in "_objects" for each child's subtree
+            unsigned    _objectsEnd[4];
+            uint8       _childMins[4][3];
+            uint8       _childMaxs[4][3];
+            uint8       _childCount;
+            uint8       _treeDepth;
+            uint8       _dummy[2];
+
+            BoundingBox GetChildBoundary(unsigned child) const;
         };
 
-        class Payload
+            //  Serialized form is:
+            //      SerializedHeader
+            //      Node[_nodeCount]
+            //      unsigned[_objectCount]              (objects)
+            //      (padding to 16 byte alignment)
+            //      float[6*_objectCount]               (SoA bounding boxes)
+            //  It's used in-place (see the constructor), so must stay POD.
+        class SerializedHeader
         {
         public:
-            std::vector<unsigned> _objects;
+            unsigned    _version;
+            unsigned    _objectCount;
+            unsigned    _nodeCount;
+            unsigned    _dummy;
+            BoundingBox _boundary;
+            unsigned    _dummy2[2];
         };
 
-        std::vector<Node> _nodes;
-        std::vector<Payload> _payloads;
+        const Node*             _nodes;
+        unsigned                _nodeCount;
+        const unsigned*         _objects;
+        unsigned                _objectCount;
+        BoundingBox             _boundary;
+
+            //  Copy of the object bounding boxes in "structure of arrays" form
+            //  (mins x, y, z then maxs x, y, z; each array is _objectCount long),
+            //  in the same order as "_objects" (so each leaf is a contiguous range)
+        const float*            _boundingBoxes;
+
+            //  When the tree is built at runtime, the pointers above point into these.
+            //  Otherwise they point directly into the serialized data.
+        std::vector<Node>       _nodeStorage;
+        std::vector<unsigned>   _objectStorage;
+        std::vector<float>      _boundingBoxStorage;
+
+        AABBArraySoA AsAABBArray(unsigned begin, unsigned end) const
+        {
+            auto count = _objectCount;
+            auto* base = _boundingBoxes + begin;
+            AABBArraySoA result = 
+            {
+                { base, base + count, base + 2*count },
+                { base + 3*count, base + 4*count, base + 5*count },
+                end - begin
+            };
+            return result;
+        }
+
+        void BuildBoundingBoxes(const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride);
+        bool ValidateNodes() const;
 
         class WorkingObject
         {
         public:
             BoundingBox     _boundary;
-            int             _id;
+            Float3          _centroid;
+            unsigned        _id;
+        };
+
+        class BuildNode
+        {
+        public:
+            BoundingBox     _boundary;
+            unsigned        _begin, _end;
+            unsigned        _children[4];
+            unsigned        _childCount;
         };
 
-        void PushNode(  unsigned parentNode, unsigned childIndex,
-                        const std::vector<WorkingObject>& workingObjects);
+        static const unsigned LeafThreshold = 12;
+        static const unsigned SAHBinCount = 16;
+        static const unsigned SerializedVersion = 1;
 
-        static void InitPayload(Payload& p, const std::vector<WorkingObject>& workingObjects)
+        static size_t BoundingBoxesOffset(unsigned nodeCount, unsigned objectCount)
         {
-            for (auto i=workingObjects.cbegin(); i!=workingObjects.cend(); ++i) {
-                p._objects.push_back(i->_id);
-            }
+            auto offset = sizeof(SerializedHeader) + sizeof(Node) * nodeCount + sizeof(unsigned) * objectCount;
+            return (offset + 15) & ~size_t(15);
         }
 
-        static BoundingBox CalculateBoundary(const std::vector<WorkingObject>& workingObjects)
+        static unsigned Build(
+            std::vector<BuildNode>& buildNodes, 
+            std::vector<WorkingObject>& workingObjects, 
+            unsigned begin, unsigned end);
+        static unsigned SplitSAH(std::vector<WorkingObject>& workingObjects, unsigned begin, unsigned end);
+        void Flatten(const std::vector<BuildNode>& buildNodes, unsigned root);
+
+        static BoundingBox CalculateBoundary(const WorkingObject* begin, const WorkingObject* end)
         {
             BoundingBox result;
             result.first  = Float3( FLT_MAX,  FLT_MAX,  FLT_MAX);
             result.second = Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX);
-            for (auto i=workingObjects.cbegin(); i!=workingObjects.cend(); ++i) {
+            for (auto i=begin; i!=end; ++i) {
                 assert(i->_boundary.first[0] <= i->_boundary.second[0]);
                 assert(i->_boundary.first[1] <= i->_boundary.second[1]);
                 assert(i->_boundary.first[2] <= i->_boundary.second[2]);
@@ -78,376 +153,346 @@ namespace SceneEngine
             return result;
         }
 
-        static std::tuple<unsigned, unsigned, unsigned> DividingLineMetricsX(float dividingLineX, const std::vector<WorkingObject>& workingObjects)
-        {
-            auto result = std::make_tuple(0,0,0);
-            for (auto i=workingObjects.cbegin(); i!=workingObjects.cend(); ++i) {
-                std::get<0>(result) += (i->_boundary.second[0] <= dividingLineX);
-                std::get<1>(result) += (i->_boundary.first[0] < dividingLineX) && (i->_boundary.second[0] > dividingLineX);
-                std::get<2>(result) += (i->_boundary.first[0] >= dividingLineX);
-            }
-            return result;
-        }
-
-        static std::tuple<unsigned, unsigned, unsigned> DividingLineMetricsY(float dividingLineY, const std::vector<WorkingObject>& workingObjects)
+        static float HalfSurfaceArea(const BoundingBox& box)
         {
-            auto result = std::make_tuple(0,0,0);
-            for (auto i=workingObjects.cbegin(); i!=workingObjects.cend(); ++i) {
-                std::get<0>(result) += (i->_boundary.second[1] <= dividingLineY);
-                std::get<1>(result) += (i->_boundary.first[1] < dividingLineY) && (i->_boundary.second[1] > dividingLineY);
-                std::get<2>(result) += (i->_boundary.first[1] >= dividingLineY);
-            }
-            return result;
-        }
-
-        static float Volume(const BoundingBox& box)
-        {
-            return (box.second[2] - box.first[2]) * (box.second[1] - box.first[1]) * (box.second[0] - box.first[0]);
+            auto size = box.second - box.first;
+            return size[0]*size[1] + size[1]*size[2] + size[2]*size[0];
         }
     };
 
-    void PlacementsQuadTree::Pimpl::PushNode(   
-        unsigned parentNodeIndex, unsigned childIndex,
-        const std::vector<WorkingObject>& workingObjects)
+    auto PlacementsQuadTree::Pimpl::Node::GetChildBoundary(unsigned child) const -> BoundingBox
     {
-        Node newNode;
-        newNode._boundary = CalculateBoundary(workingObjects);
-        newNode._children[0] = newNode._children[1] = newNode._children[2] = newNode._children[3] = ~unsigned(0x0);
-
-        Node* parent = nullptr;
-        if (parentNodeIndex < _nodes.size())
-            parent = &_nodes[parentNodeIndex];
-
-        newNode._treeDepth = parent ? (parent->_treeDepth+1) : 0;
-        for (unsigned c=0; c<4; ++c) newNode._children[c] = ~unsigned(0x0);
-        newNode._payloadID = ~unsigned(0x0);
-
-            //  if the quantity of objects in this node is less than a threshold 
-            //  amount, then we can consider it a leaf node
-        const unsigned leafThreshold = 12;
-        if (workingObjects.size() <= leafThreshold) {
-            Payload payload;
-            InitPayload(payload, workingObjects);
-            _payloads.push_back(std::move(payload));
-            newNode._payloadID = unsigned(_payloads.size()-1);
-
-            if (parent) {
-                parent->_children[childIndex] = unsigned(_nodes.size());
-            }
-            _nodes.push_back(newNode);
-            return;
-        }
-
-            //  if it's not a leaf, then we must divide the boundary into sub nodes
-            //  Let's try to do this in a way that will adapt to the placements of
-            //  objects, and create a balanced tree. However, there is always a
-            //  chance that objects will not be able to fit into the division 
-            //  perfectly... These "straddling" objects need to be placed into the 
-            //  smallest node that contains them completely. Ideally we want to find
-            //  dividing lines that separate the objects into 2 roughly even groups, 
-            //  but minimize the number of straddling objects. We can just do a brute
-            //  force test of various potential dividing lines near the median points
+        return BoundingBox(
+            Float3( _origin[0] + float(_childMins[child][0]) * _scale[0],
+                    _origin[1] + float(_childMins[child][1]) * _scale[1],
+                    _origin[2] + float(_childMins[child][2]) * _scale[2]),
+            Float3( _origin[0] + float(_childMaxs[child][0]) * _scale[0],
+                    _origin[1] + float(_childMaxs[child][1]) * _scale[1],
+                    _origin[2] + float(_childMaxs[child][2]) * _scale[2]));
+    }
 
-        float bestDividingLineX = LinearInterpolate(newNode._boundary.first[0], newNode._boundary.second[0], 0.5f);
-        float bestDividingLineY = LinearInterpolate(newNode._boundary.first[1], newNode._boundary.second[1], 0.5f);
+    unsigned PlacementsQuadTree::Pimpl::SplitSAH(
+        std::vector<WorkingObject>& workingObjects, unsigned begin, unsigned end)
+    {
+            //  Binned surface area heuristic. We bin the object centroids along each axis,
+            //  and choose the split (between bins) that minimizes:
+            //      area(left) * count(left) + area(right) * count(right)
+            //  Returns the partition point (objects in [begin, result) go to the left)
+        auto* objs = &workingObjects[begin];
+        auto count = end - begin;
+
+        Float3 centroidMin(FLT_MAX, FLT_MAX, FLT_MAX), centroidMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (unsigned c=0; c<count; ++c)
+            for (unsigned a=0; a<3; ++a) {
+                centroidMin[a] = std::min(centroidMin[a], objs[c]._centroid[a]);
+                centroidMax[a] = std::max(centroidMax[a], objs[c]._centroid[a]);
+            }
 
-        {
-            std::vector<WorkingObject> sortedObjects = workingObjects;
-            std::sort(
-                sortedObjects.begin(), sortedObjects.end(),
-                [](const WorkingObject& lhs, const WorkingObject&rhs)
-                { return (lhs._boundary.first[0] + lhs._boundary.second[0]) < (rhs._boundary.first[0] + rhs._boundary.second[0]); });
-
-            bestDividingLineX = .5f * (sortedObjects[sortedObjects.size()/2]._boundary.first[0] + sortedObjects[sortedObjects.size()/2]._boundary.second[0]);
-
-            std::sort(
-                sortedObjects.begin(), sortedObjects.end(),
-                [](const WorkingObject& lhs, const WorkingObject&rhs)
-                { return (lhs._boundary.first[1] + lhs._boundary.second[1]) < (rhs._boundary.first[1] + rhs._boundary.second[1]); });
-
-            bestDividingLineY = .5f * (sortedObjects[sortedObjects.size()/2]._boundary.first[1] + sortedObjects[sortedObjects.size()/2]._boundary.second[1]);
-
-                //  Attempt to improve the subdivision by looking for dividing lines
-                //  that minimize the number of objects straddling this line. This will
-                //  help try to avoid overlap between child nodes.
-            const bool useAdaptiveDivision = true;
-            if (constant_expression<useAdaptiveDivision>::result()) {
-
-                auto objCount =  unsigned(sortedObjects.size());
-                auto testCount = std::max(size_t(1), objCount/size_t(4));
-
-                    //  Attempt to optimise X dividing line
-                    //  Our optimised dividing line should always be on one
-                    //  of the edges of the bounding box of one of the objects.
-                std::sort(
-                    sortedObjects.begin(), sortedObjects.end(),
-                    [](const WorkingObject& lhs, const WorkingObject&rhs)
-                    { return (lhs._boundary.first[0] + lhs._boundary.second[0]) < (rhs._boundary.first[0] + rhs._boundary.second[0]); });
-
-                unsigned minStradingCount = std::get<1>(DividingLineMetricsX(bestDividingLineX, sortedObjects));
-                float minDivLineX = LinearInterpolate(newNode._boundary.first[0], newNode._boundary.second[0], 0.25f);
-                float maxDivLineX = LinearInterpolate(newNode._boundary.first[0], newNode._boundary.second[0], 0.75f);
-
-                    // todo -- rather than starting at the object that has an equal number
-                    //  of objects on each side, we could consider starting on the object that
-                    //  is closest to the center of the bounding box
-                for (unsigned c=0; c<testCount && minStradingCount; ++c) {
-                    unsigned o;
-                    if (c & 1)  { o = objCount/2 - ((c+1)>>1); }
-                    else        { o = objCount/2 + ((c+1)>>1); }
-
-                        //  We need to test both the left and right edges of the
-                        //  this object's bounding box.
-                    float testLine = sortedObjects[o]._boundary.first[0];
-                    if (testLine >= minDivLineX && testLine <= maxDivLineX) {
-                        unsigned leftCount, straddleCount, rightCount;
-                        std::tie(leftCount, straddleCount, rightCount) = DividingLineMetricsX(testLine, sortedObjects);
-                        if (straddleCount < minStradingCount && leftCount && rightCount) {
-                            bestDividingLineX = testLine;
-                            minStradingCount = straddleCount;
-                        }
-                    }
+        float bestCost = FLT_MAX;
+        unsigned bestAxis = ~0u, bestSplit = 0;
+        for (unsigned a=0; a<3; ++a) {
+            auto extent = centroidMax[a] - centroidMin[a];
+            if (!(extent > 0.f)) continue;
+            auto binScale = float(SAHBinCount) / extent;
+
+            BoundingBox binBoundaries[SAHBinCount];
+            unsigned binCounts[SAHBinCount];
+            for (unsigned b=0; b<SAHBinCount; ++b) {
+                binBoundaries[b] = BoundingBox(Float3(FLT_MAX, FLT_MAX, FLT_MAX), Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+                binCounts[b] = 0;
+            }
 
-                    testLine = sortedObjects[o]._boundary.second[0];
-                    if (testLine >= minDivLineX && testLine <= maxDivLineX) {
-                        unsigned leftCount, straddleCount, rightCount;
-                        std::tie(leftCount, straddleCount, rightCount) = DividingLineMetricsX(testLine, sortedObjects);
-                        if (straddleCount < minStradingCount && leftCount && rightCount) {
-                            bestDividingLineX = testLine;
-                            minStradingCount = straddleCount;
-                        }
-                    }
+            for (unsigned c=0; c<count; ++c) {
+                auto bin = std::min(unsigned((objs[c]._centroid[a] - centroidMin[a]) * binScale), SAHBinCount-1);
+                ++binCounts[bin];
+                for (unsigned q=0; q<3; ++q) {
+                    binBoundaries[bin].first[q] = std::min(binBoundaries[bin].first[q], objs[c]._boundary.first[q]);
+                    binBoundaries[bin].second[q] = std::max(binBoundaries[bin].second[q], objs[c]._boundary.second[q]);
                 }
+            }
 
-                    //  Attempt to optimise Y dividing line
-                std::sort(
-                    sortedObjects.begin(), sortedObjects.end(),
-                    [](const WorkingObject& lhs, const WorkingObject&rhs)
-                    { return (lhs._boundary.first[1] + lhs._boundary.second[1]) < (rhs._boundary.first[1] + rhs._boundary.second[1]); });
-
-                minStradingCount = std::get<1>(DividingLineMetricsY(bestDividingLineY, sortedObjects));
-                float minDivLineY = LinearInterpolate(newNode._boundary.first[1], newNode._boundary.second[1], 0.25f);
-                float maxDivLineY = LinearInterpolate(newNode._boundary.first[1], newNode._boundary.second[1], 0.75f);
-
-                for (unsigned c=0; c<testCount && minStradingCount; ++c) {
-                    unsigned o;
-                    if (c & 1)  { o = objCount/2 - ((c+1)>>1); }
-                    else        { o = objCount/2 + ((c+1)>>1); }
-
-                    float testLine = sortedObjects[o]._boundary.first[1];
-                    if (testLine >= minDivLineY && testLine <= maxDivLineY) {
-                        unsigned leftCount, straddleCount, rightCount;
-                        std::tie(leftCount, straddleCount, rightCount) = DividingLineMetricsY(testLine, sortedObjects);
-                        if (straddleCount < minStradingCount && leftCount && rightCount) {
-                            bestDividingLineY = testLine;
-                            minStradingCount = straddleCount;
-                        }
-                    }
-
-                    testLine = sortedObjects[o]._boundary.second[1];
-                    if (testLine >= minDivLineY && testLine <= maxDivLineY) {
-                        unsigned leftCount, straddleCount, rightCount;
-                        std::tie(leftCount, straddleCount, rightCount) = DividingLineMetricsY(testLine, sortedObjects);
-                        if (straddleCount < minStradingCount && leftCount && rightCount) {
-                            bestDividingLineY = testLine;
-                            minStradingCount = straddleCount;
-                        }
+                // sweep from the right to find the area & count to the right of each split
+            float rightAreas[SAHBinCount];
+            unsigned rightCounts[SAHBinCount];
+            {
+                BoundingBox accumulated(Float3(FLT_MAX, FLT_MAX, FLT_MAX), Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+                unsigned accumulatedCount = 0;
+                for (unsigned b=SAHBinCount-1; b>0; --b) {
+                    for (unsigned q=0; q<3; ++q) {
+                        accumulated.first[q] = std::min(accumulated.first[q], binBoundaries[b].first[q]);
+                        accumulated.second[q] = std::max(accumulated.second[q], binBoundaries[b].second[q]);
                     }
+                    accumulatedCount += binCounts[b];
+                    rightAreas[b] = accumulatedCount ? HalfSurfaceArea(accumulated) : 0.f;
+                    rightCounts[b] = accumulatedCount;
                 }
-
             }
-        }
 
-            //  ok, now we have our dividing line. We an divide our objects up into 5 parts:
-            //  4 children nodes, and the straddling nodes
-
-        std::vector<WorkingObject> dividedObjects[5];
-        for (auto i=workingObjects.cbegin(); i!=workingObjects.cend(); ++i) {
-
-                /// \todo - if an object is large compared to the size of this
-                ///         node's bounding box, then we should put it into
-                ///         a forth "straddling" payload (rather than expanding one
-                ///         of our children to almost the size of the parent node)
-
-            unsigned index = 0;
-            if (i->_boundary.first[0] > bestDividingLineX)          { index |= 0x1; } 
-            else if (i->_boundary.second[0] < bestDividingLineX)    { index |= 0x0; } 
-            else { 
-                    //  try to put this object on the left or the right (based on where
-                    //  the larger volume of this object is)
-                if ((bestDividingLineX - i->_boundary.first[0]) > (i->_boundary.second[0] - bestDividingLineX)) {
-                    index |= 0x0;
-                } else {
-                    index |= 0x1;
+            BoundingBox left(Float3(FLT_MAX, FLT_MAX, FLT_MAX), Float3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+            unsigned leftCount = 0;
+            for (unsigned b=0; b<SAHBinCount-1; ++b) {
+                for (unsigned q=0; q<3; ++q) {
+                    left.first[q] = std::min(left.first[q], binBoundaries[b].first[q]);
+                    left.second[q] = std::max(left.second[q], binBoundaries[b].second[q]);
                 }
-            }
-
-            if (i->_boundary.first[1] > bestDividingLineY)          { index |= 0x2; } 
-            else if (i->_boundary.second[1] < bestDividingLineY)    { index |= 0x0; } 
-            else { 
-                if ((bestDividingLineY - i->_boundary.first[1]) > (i->_boundary.second[1] - bestDividingLineY)) {
-                    index |= 0x0;
-                } else {
-                    index |= 0x2;
+                leftCount += binCounts[b];
+                if (!leftCount || !rightCounts[b+1]) continue;
+
+                auto cost = HalfSurfaceArea(left) * float(leftCount) + rightAreas[b+1] * float(rightCounts[b+1]);
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = a;
+                    bestSplit = b+1;
                 }
             }
-
-            dividedObjects[std::min(index, 4u)].push_back(*i);
         }
 
-        // When there is a lot of overlap (or too few objects), we can choose to
-        // merge children together.
-        //   2+0 -> merged into 0
-        //   3+1 -> merged into 1
-        //   1+0 -> merged into 0
-        //   3+2 -> merged into 2
-        if ((dividedObjects[2].size() + dividedObjects[0].size()) <= leafThreshold) {
-            if ((dividedObjects[1].size() + dividedObjects[0].size()) <= leafThreshold) {
-                //  we can merge 2+0 or 1+0. Let's just do whichever ends up with a bounding
-                //  box that has a smaller volume.
-                auto merge20 = dividedObjects[2]; merge20.insert(merge20.begin(), dividedObjects[0].begin(), dividedObjects[0].end());
-                auto merge10 = dividedObjects[1]; merge10.insert(merge10.begin(), dividedObjects[0].begin(), dividedObjects[0].end());
-                if (Volume(CalculateBoundary(merge20)) < Volume(CalculateBoundary(merge10))) {
-                    dividedObjects[0] = merge20;
-                    dividedObjects[2].clear();
-                } else {
-                    dividedObjects[0] = merge10;
-                    dividedObjects[1].clear();
-                }
-            } else {
-                dividedObjects[0].insert(dividedObjects[0].begin(), dividedObjects[2].begin(), dividedObjects[2].end());
-                dividedObjects[2].clear();
-            }
+        if (bestAxis == ~0u) {
+                // all centroids are in the same place; just split in half
+            return begin + count/2;
         }
 
-        if ((dividedObjects[3].size() + dividedObjects[1].size()) <= leafThreshold) {
-            dividedObjects[1].insert(dividedObjects[1].begin(), dividedObjects[3].begin(), dividedObjects[3].end());
-            dividedObjects[3].clear();
-        }
+        auto binScale = float(SAHBinCount) / (centroidMax[bestAxis] - centroidMin[bestAxis]);
+        auto minCentroid = centroidMin[bestAxis];
+        auto middle = std::partition(
+            workingObjects.begin() + begin, workingObjects.begin() + end,
+            [bestAxis, binScale, minCentroid, bestSplit](const WorkingObject& o)
+            { return std::min(unsigned((o._centroid[bestAxis] - minCentroid) * binScale), SAHBinCount-1) < bestSplit; });
+        auto result = unsigned(std::distance(workingObjects.begin(), middle));
+        assert(result > begin && result < end);
+        return result;
+    }
 
-        if ((dividedObjects[1].size() + dividedObjects[0].size()) <= leafThreshold) {
-            dividedObjects[0].insert(dividedObjects[0].begin(), dividedObjects[1].begin(), dividedObjects[1].end());
-            dividedObjects[1].clear();
+    unsigned PlacementsQuadTree::Pimpl::Build(
+        std::vector<BuildNode>& buildNodes, 
+        std::vector<WorkingObject>& workingObjects, 
+        unsigned begin, unsigned end)
+    {
+        BuildNode node;
+        node._boundary = CalculateBoundary(&workingObjects[begin], &workingObjects[begin] + (end-begin));
+        node._begin = begin; node._end = end;
+        node._childCount = 0;
+        for (unsigned c=0; c<4; ++c) node._children[c] = ~0u;
+
+        auto nodeIndex = unsigned(buildNodes.size());
+        buildNodes.push_back(node);
+        if ((end - begin) <= LeafThreshold)
+            return nodeIndex;
+
+            //  Build a 4-wide node by splitting the largest range with SAH until we 
+            //  have 4 ranges (or the ranges are small enough to become leaves)
+        std::pair<unsigned, unsigned> ranges[4];
+        unsigned rangeCount = 1;
+        ranges[0] = std::make_pair(begin, end);
+        while (rangeCount < 4) {
+            unsigned largest = 0;
+            for (unsigned c=1; c<rangeCount; ++c)
+                if ((ranges[c].second - ranges[c].first) > (ranges[largest].second - ranges[largest].first))
+                    largest = c;
+            if ((ranges[largest].second - ranges[largest].first) <= LeafThreshold) break;
+
+            auto split = SplitSAH(workingObjects, ranges[largest].first, ranges[largest].second);
+            ranges[rangeCount++] = std::make_pair(split, ranges[largest].second);
+            ranges[largest].second = split;
         }
 
-        if ((dividedObjects[3].size() + dividedObjects[2].size()) <= leafThreshold) {
-            dividedObjects[2].insert(dividedObjects[2].begin(), dividedObjects[3].begin(), dividedObjects[3].end());
-            dividedObjects[3].clear();
+            //  keep the children in object order, so each child's objects follow on from the last
+        std::sort(ranges, &ranges[rangeCount]);
+        for (unsigned c=0; c<rangeCount; ++c) {
+            auto child = Build(buildNodes, workingObjects, ranges[c].first, ranges[c].second);
+            buildNodes[nodeIndex]._children[c] = child;
         }
+        buildNodes[nodeIndex]._childCount = rangeCount;
+        return nodeIndex;
+    }
 
-        if (!dividedObjects[4].empty()) {
-            Payload payload;
-            InitPayload(payload, dividedObjects[4]);
-            _payloads.push_back(std::move(payload));
-            newNode._payloadID = unsigned(_payloads.size()-1);
-        }
+    void PlacementsQuadTree::Pimpl::Flatten(const std::vector<BuildNode>& buildNodes, unsigned root)
+    {
+            //  Write out the nodes in breadth first order. Build nodes without children
+            //  become leaves in their parent (except for the root, which always gets a node)
+        std::vector<std::pair<unsigned, uint8>> queue;     // (build node, tree depth)
+        queue.push_back(std::make_pair(root, uint8(0)));
+        for (size_t q=0; q<queue.size(); ++q) {
+            const auto& src = buildNodes[queue[q].first];
+
+            unsigned children[4];
+            unsigned childCount;
+            if (src._childCount) {
+                childCount = src._childCount;
+                std::copy(src._children, &src._children[childCount], children);
+            } else {
+                childCount = 1;
+                children[0] = queue[q].first;   // (root is a leaf; it becomes the only child of itself)
+            }
 
-        assert(dividedObjects[0].size() + dividedObjects[1].size() + dividedObjects[2].size() + dividedObjects[3].size() + dividedObjects[4].size() == workingObjects.size());
+            Node node;
+            XlZeroMemory(node);
+            node._origin = src._boundary.first;
+            node._scale = (src._boundary.second - src._boundary.first) / 255.f;
+            node._childCount = uint8(childCount);
+            node._treeDepth = queue[q].second;
 
-        auto newNodeId = unsigned(_nodes.size());
-        if (parent) {
-            parent->_children[childIndex] = newNodeId;
+            for (unsigned c=0; c<4; ++c) {
+                if (c >= childCount) {
+                    node._children[c] = ~0u;
+                    continue;
+                }
+
+                const auto& child = buildNodes[children[c]];
+                node._objectsBegin[c] = child._begin;
+                node._objectsEnd[c] = child._end;
+                if (child._childCount) {
+                    node._children[c] = unsigned(queue.size());
+                    queue.push_back(std::make_pair(children[c], uint8(std::min(queue[q].second+1, 255))));
+                } else {
+                    node._children[c] = ~0u;
+                }
+
+                    //  Quantize conservatively (the dequantized box must contain the original)
+                for (unsigned a=0; a<3; ++a) {
+                    if (!(node._scale[a] > 0.f)) {
+                        node._childMins[c][a] = 0; node._childMaxs[c][a] = 255;
+                        continue;
+                    }
+                    auto qmin = (int)std::floor((child._boundary.first[a] - node._origin[a]) / node._scale[a]);
+                    auto qmax = (int)std::ceil((child._boundary.second[a] - node._origin[a]) / node._scale[a]);
+                    qmin = std::max(0, std::min(255, qmin));
+                    qmax = std::max(0, std::min(255, qmax));
+                    while (qmin > 0 && (node._origin[a] + float(qmin) * node._scale[a]) > child._boundary.first[a]) --qmin;
+                    while (qmax < 255 && (node._origin[a] + float(qmax) * node._scale[a]) < child._boundary.second[a]) ++qmax;
+                    node._childMins[c][a] = uint8(qmin);
+                    node._childMaxs[c][a] = uint8(qmax);
+                }
+            }
+
+            _nodeStorage.push_back(node);
         }
-        _nodes.push_back(newNode);
+    }
 
-            // now just push in the children
-        for (unsigned c=0; c<4; ++c) {
-            if (!dividedObjects[c].empty()) {
-                PushNode(newNodeId, c, dividedObjects[c]);
+    void PlacementsQuadTree::Pimpl::BuildBoundingBoxes(
+        const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride)
+    {
+        auto count = _objectStorage.size();
+        _boundingBoxStorage.resize(count * 6);
+        for (size_t c=0; c<count; ++c) {
+            const auto& boundary = *PtrAdd(objCellSpaceBoundingBoxes, _objectStorage[c] * objStride);
+            for (unsigned a=0; a<3; ++a) {
+                _boundingBoxStorage[a*count + c] = boundary.first[a];
+                _boundingBoxStorage[(3+a)*count + c] = boundary.second[a];
+            }
+        }
+    }
+
+    bool PlacementsQuadTree::Pimpl::ValidateNodes() const
+    {
+            //  Check that every index in the nodes and objects arrays is in range. Since
+            //  nodes are stored breadth first, child nodes must always come after their 
+            //  parent (which also means there can't be any cycles)
+        for (unsigned n=0; n<_nodeCount; ++n) {
+            const auto& node = _nodes[n];
+            if (node._childCount > 4) return false;
+            for (unsigned c=0; c<node._childCount; ++c) {
+                if (node._children[c] != ~0u && (node._children[c] <= n || node._children[c] >= _nodeCount))
+                    return false;
+                if (node._objectsBegin[c] > node._objectsEnd[c] || node._objectsEnd[c] > _objectCount)
+                    return false;
             }
         }
+
+        for (unsigned c=0; c<_objectCount; ++c)
+            if (_objects[c] >= _objectCount) return false;
+        return true;
     }
 
     bool PlacementsQuadTree::CalculateVisibleObjects(
         const float cellToClipAligned[], 
-        const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
         unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount) const
     {
         visObjsCount = 0;
         assert((size_t(cellToClipAligned) & 0xf) == 0);
+        auto& pimpl = *_pimpl;
+        if (!pimpl._nodeCount) return true;
 
         unsigned nodeAabbTestCount = 0, payloadAabbTestCount = 0;
 
-            //  Traverse through the quad tree, and find do bounding box level 
-            //  culling on each object
-        static std::stack<unsigned> workingStack;
-        static std::stack<unsigned> entirelyVisibleStack;
-        workingStack.push(0);
-        while (!workingStack.empty()) {
-            auto nodeIndex = workingStack.top();
-            workingStack.pop();
-            
-            auto& node = _pimpl->_nodes[nodeIndex];
-            auto test = TestAABB_Aligned(cellToClipAligned, node._boundary.first, node._boundary.second);
-            ++nodeAabbTestCount;
-            if (test == AABBIntersection::Culled) {
-                continue;
-            }
-
-            if (test == AABBIntersection::Within) {
-
-                    //  this node and all children are "visible" without any further
-                    //  culling tests
-                entirelyVisibleStack.push(nodeIndex);
-
-            } else {
-
-                for (unsigned c=0; c<4; ++c) {
-                    if (node._children[c] < _pimpl->_nodes.size()) {
-                        workingStack.push(node._children[c]);
-                    }
-                }
-
-                if (node._payloadID < _pimpl->_payloads.size()) {
-                    auto& payload = _pimpl->_payloads[node._payloadID];
-                    for (auto i=payload._objects.cbegin(); i!=payload._objects.cend(); ++i) {
-
-                            //  Test the "cell" space bounding box of the object itself
-                            //  This must be done inside of this function, we can't
-                            //  drop the responsibility to the caller. Because:
-                            //      * sometimes we can skip it entirely, when quad tree
-                            //          node bounding boxes are considered entirely within the frustum
-                            //      * it's best to reduce the result arrays to as small as
-                            //          possible (because the caller may need to sort them)
-
-                        const auto& boundary = *PtrAdd(objCellSpaceBoundingBoxes, (*i) * objStride);
-                        ++payloadAabbTestCount;
-                        if (!CullAABB_Aligned(cellToClipAligned, boundary.first, boundary.second)) {
-                            if ((visObjsCount+1) > visObjMaxCount) {
-                                return false;
-                            }
-                            visObjs[visObjsCount++] = *i; 
-                        }
-                    }
-                }
+        auto addRange = [&](unsigned begin, unsigned end) -> bool
+        {
+            if ((visObjsCount + (end - begin)) > visObjMaxCount) return false;
+            for (auto c=begin; c<end; ++c)
+                visObjs[visObjsCount++] = pimpl._objects[c];
+            return true;
+        };
 
+            //  Test the "cell" space bounding box of each object in the range.
+            //  This must be done inside of this function, we can't drop the 
+            //  responsibility to the caller. Because:
+            //      * sometimes we can skip it entirely, when tree nodes are 
+            //          considered entirely within the frustum
+            //      * it's best to reduce the result arrays to as small as
+            //          possible (because the caller may need to sort them)
+        auto cullRange = [&](unsigned begin, unsigned end) -> bool
+        {
+            const unsigned batchSize = 64;
+            unsigned visible[batchSize];
+            for (auto b=begin; b<end; b+=batchSize) {
+                auto batchEnd = std::min(b + batchSize, end);
+                auto visibleCount = CullAABBs_Aligned(cellToClipAligned, pimpl.AsAABBArray(b, batchEnd), visible);
+                payloadAabbTestCount += batchEnd - b;
+                if ((visObjsCount + visibleCount) > visObjMaxCount) return false;
+                for (size_t c=0; c<visibleCount; ++c)
+                    visObjs[visObjsCount++] = pimpl._objects[b + visible[c]];
             }
-        }
-
-            //  some nodes might be "entirely visible" -- ie, the bounding box is completely
-            //  within the culling frustum. In these cases, we can skip the rest of the culling
-            //  checks and just add these objects as visible
-        while (!entirelyVisibleStack.empty()) {
-            auto nodeIndex = entirelyVisibleStack.top();
-            entirelyVisibleStack.pop();
+            return true;
+        };
 
-            auto& node = _pimpl->_nodes[nodeIndex];
-            for (unsigned c=0; c<4; ++c) {
-                if (node._children[c] < _pimpl->_nodes.size()) {
-                    entirelyVisibleStack.push(node._children[c]);
+        auto rootTest = TestAABB_Aligned(cellToClipAligned, pimpl._boundary.first, pimpl._boundary.second);
+        if (rootTest == AABBIntersection::Culled) return true;
+        if (rootTest == AABBIntersection::Within) return addRange(0, pimpl._objectCount);
+
+            //  Traverse the tree, testing the 4 children of each node together
+        const unsigned maxStackDepth = 128;
+        unsigned stack[maxStackDepth];
+        unsigned stackSize = 0;
+        stack[stackSize++] = 0;
+        while (stackSize) {
+            const auto& node = pimpl._nodes[stack[--stackSize]];
+
+            float childBoxes[6][4];
+            for (unsigned c=0; c<node._childCount; ++c) {
+                auto boundary = node.GetChildBoundary(c);
+                for (unsigned a=0; a<3; ++a) {
+                    childBoxes[a][c] = boundary.first[a];
+                    childBoxes[3+a][c] = boundary.second[a];
                 }
             }
 
-            if (node._payloadID < _pimpl->_payloads.size()) {
-                auto& payload = _pimpl->_payloads[node._payloadID];
-
-                if ((visObjsCount + payload._objects.size()) > visObjMaxCount) {
-                    return false;
+            AABBArraySoA childArray = 
+            {
+                { childBoxes[0], childBoxes[1], childBoxes[2] },
+                { childBoxes[3], childBoxes[4], childBoxes[5] },
+                node._childCount
+            };
+            AABBIntersection::Enum childTests[4];
+            TestAABBs_Aligned(cellToClipAligned, childArray, childTests);
+            nodeAabbTestCount += node._childCount;
+
+            for (unsigned c=0; c<node._childCount; ++c) {
+                if (childTests[c] == AABBIntersection::Culled) continue;
+
+                bool success;
+                if (childTests[c] == AABBIntersection::Within) {
+                        //  this child and everything below it is "visible" without 
+                        //  any further culling tests
+                    success = addRange(node._objectsBegin[c], node._objectsEnd[c]);
+                } else if (node._children[c] != ~0u && stackSize < maxStackDepth) {
+                    stack[stackSize++] = node._children[c];
+                    success = true;
+                } else {
+                        // leaf (or the stack is full; in which case we just test every object)
+                    success = cullRange(node._objectsBegin[c], node._objectsEnd[c]);
                 }
 
-                for (auto i=payload._objects.cbegin(); i!=payload._objects.cend(); ++i) {
-                    visObjs[visObjsCount++] = *i; 
-                }
+                if (!success) return false;
             }
         }
 
@@ -457,43 +502,104 @@ namespace SceneEngine
         return true;
     }
 
+    std::vector<uint8> PlacementsQuadTree::Serialize() const
+    {
+        const auto& pimpl = *_pimpl;
+        Pimpl::SerializedHeader hdr;
+        XlZeroMemory(hdr);
+        hdr._version = Pimpl::SerializedVersion;
+        hdr._objectCount = pimpl._objectCount;
+        hdr._nodeCount = pimpl._nodeCount;
+        hdr._boundary = pimpl._boundary;
+
+        auto nodesSize = sizeof(Pimpl::Node) * hdr._nodeCount;
+        auto objectsSize = sizeof(unsigned) * hdr._objectCount;
+        auto boxesOffset = Pimpl::BoundingBoxesOffset(hdr._nodeCount, hdr._objectCount);
+        auto boxesSize = sizeof(float) * 6 * hdr._objectCount;
+        std::vector<uint8> result(boxesOffset + boxesSize, 0);
+        XlCopyMemory(AsPointer(result.begin()), &hdr, sizeof(hdr));
+        if (nodesSize) XlCopyMemory(&result[sizeof(hdr)], pimpl._nodes, nodesSize);
+        if (objectsSize) XlCopyMemory(&result[sizeof(hdr) + nodesSize], pimpl._objects, objectsSize);
+        if (boxesSize) XlCopyMemory(&result[boxesOffset], pimpl._boundingBoxes, boxesSize);
+        return std::move(result);
+    }
+
     PlacementsQuadTree::PlacementsQuadTree(
         const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
         size_t objCount)
     {
-            //  Find the minimum and maximum XY of the placements in "placements", and
-            //  divide this space up into a quad tree (ignoring height)
+            //  Build a bounding volume hierarchy for the objects. We use the
+            //  binned surface area heuristic to split the objects into up to
+            //  4 children at each node; then flatten the result into a breadth
+            //  first array of nodes.
             //
-            //  Perhaps there are some cases where we might need to use an oct tree
-            //  instead of a quad tree? What about buildings with multiple floors?
-            //  can we intelligently detect where an oct-tree is required, and where it 
-            //  should just be a quad tree?
-            //
-            //  Ideally we want to support input data that can have either a world space
-            //  bounding box or a local space bounding box (or perhaps even other bounding
-            //  primitives?)
-
-        std::vector<Pimpl::WorkingObject> workingObjects;
-        workingObjects.reserve(objCount);
-
-        for (unsigned c=0; c<objCount; ++c) {
-            auto& objBoundary = *PtrAdd(objCellSpaceBoundingBoxes, c * objStride);
-            Pimpl::WorkingObject o;
-            o._boundary = objBoundary;
-            o._id = c;
-            workingObjects.push_back(o);
+            //  Normally this is done offline (see Placements::Write) and the result
+            //  is loaded with the other constructor. 
+
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_boundary = BoundingBox(Float3(0.f, 0.f, 0.f), Float3(0.f, 0.f, 0.f));
+        if (objCount) {
+            std::vector<Pimpl::WorkingObject> workingObjects;
+            workingObjects.reserve(objCount);
+            for (unsigned c=0; c<objCount; ++c) {
+                auto& objBoundary = *PtrAdd(objCellSpaceBoundingBoxes, c * objStride);
+                Pimpl::WorkingObject o;
+                o._boundary = objBoundary;
+                o._centroid = .5f * (objBoundary.first + objBoundary.second);
+                o._id = c;
+                workingObjects.push_back(o);
+            }
+
+            std::vector<Pimpl::BuildNode> buildNodes;
+            auto root = Pimpl::Build(buildNodes, workingObjects, 0, unsigned(objCount));
+            pimpl->_boundary = buildNodes[root]._boundary;
+            pimpl->Flatten(buildNodes, root);
+
+            pimpl->_objectStorage.reserve(objCount);
+            for (const auto& o:workingObjects) pimpl->_objectStorage.push_back(o._id);
         }
 
-            //  we need to filter each object into nodes as we iterate through the tree
-            //  once we have a fixed number of objects a given node, we can make that node
-            //  a leaf. Objects should be placed into the smallest node that contains them
-            //  completely. We want to avoid cases where objects end up in the dividing line
-            //  between nodes. So we'll use a system that adjusts the bounding box of each
-            //  node based on the objects assigned to it.
+        pimpl->BuildBoundingBoxes(objCellSpaceBoundingBoxes, objStride);
+        pimpl->_nodes = AsPointer(pimpl->_nodeStorage.cbegin());
+        pimpl->_nodeCount = unsigned(pimpl->_nodeStorage.size());
+        pimpl->_objects = AsPointer(pimpl->_objectStorage.cbegin());
+        pimpl->_objectCount = unsigned(pimpl->_objectStorage.size());
+        pimpl->_boundingBoxes = AsPointer(pimpl->_boundingBoxStorage.cbegin());
+        _pimpl = std::move(pimpl);
+    }
 
-        auto pimpl = std::make_unique<Pimpl>();
-        pimpl->PushNode(~unsigned(0x0), 0, workingObjects);
+    PlacementsQuadTree::PlacementsQuadTree(
+        const void* serializedData, size_t serializedSize,
+        size_t objCount)
+    {
+            //  Use the serialized data in-place. Nothing is copied, and nothing needs
+            //  to be parsed -- we just need to validate the sizes and indices (the file
+            //  may be stale or corrupt, and the culling code trusts the indices).
+        if (serializedSize < sizeof(Pimpl::SerializedHeader))
+            Throw(::Exceptions::BasicLabel("Serialized placements tree is too small"));
+        if (size_t(serializedData) & 0xf)
+            Throw(::Exceptions::BasicLabel("Serialized placements tree is misaligned"));
+
+        const auto& hdr = *(const Pimpl::SerializedHeader*)serializedData;
+        if (hdr._version != Pimpl::SerializedVersion || hdr._objectCount != objCount)
+            Throw(::Exceptions::BasicLabel("Serialized placements tree doesn't match the placements"));
+        if (    hdr._nodeCount > (serializedSize - sizeof(hdr)) / sizeof(Pimpl::Node)
+            ||  hdr._objectCount > (serializedSize - sizeof(hdr)) / (sizeof(unsigned) + 6 * sizeof(float)))
+            Throw(::Exceptions::BasicLabel("Serialized placements tree doesn't match the placements"));
+
+        auto boxesOffset = Pimpl::BoundingBoxesOffset(hdr._nodeCount, hdr._objectCount);
+        if (serializedSize != boxesOffset + sizeof(float) * 6 * size_t(hdr._objectCount))
+            Throw(::Exceptions::BasicLabel("Serialized placements tree doesn't match the placements"));
 
+        auto pimpl = std::make_unique<Pimpl>();
+        pimpl->_boundary = hdr._boundary;
+        pimpl->_nodes = (const Pimpl::Node*)PtrAdd(serializedData, sizeof(hdr));
+        pimpl->_nodeCount = hdr._nodeCount;
+        pimpl->_objects = (const unsigned*)PtrAdd(serializedData, sizeof(hdr) + sizeof(Pimpl::Node) * hdr._nodeCount);
+        pimpl->_objectCount = hdr._objectCount;
+        pimpl->_boundingBoxes = (const float*)PtrAdd(serializedData, boxesOffset);
+        if (!pimpl->ValidateNodes())
+            Throw(::Exceptions::BasicLabel("Serialized placements tree is corrupt"));
         _pimpl = std::move(pimpl);
     }
 
@@ -533,19 +639,16 @@ namespace SceneEngine
                 auto quadTree = i->second;
                 if (!quadTree) continue;
 
-                auto& nodes = quadTree->_pimpl->_nodes;
-                for (auto n=nodes.cbegin(); n!=nodes.cend(); ++n) {
-                    if (treeDepthFilter < 0 || signed(n->_treeDepth) == treeDepthFilter) {
-                        DrawBoundingBox(
-                            context, n->_boundary, cellToWorld,
-                            cols[std::min((unsigned)dimof(cols), n->_treeDepth)], 0x1);
-                    }
-                }
-                for (auto n=nodes.cbegin(); n!=nodes.cend(); ++n) {
-                    if (treeDepthFilter < 0 || signed(n->_treeDepth) == treeDepthFilter) {
-                        DrawBoundingBox(
-                            context, n->_boundary, cellToWorld,
-                            cols[std::min((unsigned)dimof(cols), n->_treeDepth)], 0x2);
+                    // draw the (dequantized) bounding box of each child in the tree
+                auto* nodes = quadTree->_pimpl->_nodes;
+                auto nodeCount = quadTree->_pimpl->_nodeCount;
+                for (unsigned pass=0; pass<2; ++pass) {
+                    for (auto n=nodes; n!=&nodes[nodeCount]; ++n) {
+                        if (treeDepthFilter >= 0 && signed(n->_treeDepth) != treeDepthFilter) continue;
+                        for (unsigned c=0; c<n->_childCount; ++c)
+                            DrawBoundingBox(
+                                context, n->GetChildBoundary(c), cellToWorld,
+                                cols[std::min((unsigned)dimof(cols)-1, unsigned(n->_treeDepth))], 0x1 << pass);
                     }
                 }
             }
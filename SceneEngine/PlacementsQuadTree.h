@@ -8,17 +8,25 @@
 
 #include "../Math/Vector.h"
 #include "../Math/Matrix.h"
+#include "../Core/Types.h"
 #include <utility>
 #include <memory>
+#include <vector>
 
 
 namespace SceneEngine
 {
-    /// <summary>Quad tree arrangement for static placements</summary>
+    /// <summary>Bounding volume hierarchy for static placements</summary>
     /// Given a set of objects (identified by cell-space bounding boxes)
-    /// calculate a balanced quad tree. This can be used to optimise camera
+    /// calculate a 4-wide bounding volume hierarchy (built with the binned
+    /// surface area heuristic). This can be used to optimise camera
     /// frustum.
     ///
+    /// The hierarchy is flattened into a single array of nodes, with child
+    /// bounding boxes quantized to 8 bits per component. It can be built 
+    /// offline and stored with the placements (see Serialize()), so the
+    /// build cost doesn't need to be paid at load time.
+    ///
     /// Use "CalculateVisibleObjects" to perform camera frustum tests
     /// using the quad tree information.
     ///
@@ -28,6 +36,10 @@ namespace SceneEngine
     /// multiply. If the world space bounding box straddles the edge of the
     /// frustum, the caller may wish to perform a local space bounding
     /// box test to further improve the result.
+    ///
+    /// The quad tree keeps its own copy of the object bounding boxes (in
+    /// "structure of arrays" form), so objects in each leaf can be culled
+    /// in batches (see XLEMath::CullAABBs_Aligned).
     class PlacementsQuadTree
     {
     public:
@@ -35,14 +47,23 @@ namespace SceneEngine
 
         bool CalculateVisibleObjects(
             const float cellToClipAligned[],
-            const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
             unsigned visObjs[], unsigned& visObjsCount, unsigned visObjMaxCount) const;
 
         PlacementsQuadTree(
             const BoundingBox objCellSpaceBoundingBoxes[], size_t objStride,
             size_t objCount);
+
+        /// <summary>Use a tree previously written with Serialize() in-place</summary>
+        /// The serialized data isn't copied, so it must be 16 byte aligned, and 
+        /// must outlive the tree (for example, it can point into a memory mapped
+        /// file). Throws an exception if the serialized data doesn't match.
+        PlacementsQuadTree(
+            const void* serializedData, size_t serializedSize,
+            size_t objCount);
         ~PlacementsQuadTree();
 
+        std::vector<uint8> Serialize() const;
+
     protected:
         class Pimpl;
         std::unique_ptr<Pimpl> _pimpl;
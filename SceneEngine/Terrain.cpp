@@ -7,6 +7,7 @@
 #include "Terrain.h"
 #include "TerrainScaffold.h"
 #include "TerrainUberSurface.h"
+#include "TerrainCompression.h"
 
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/PtrUtils.h"
@@ -71,10 +72,7 @@ namespace SceneEngine
         for (unsigned n=0; n<dimof(sourceNodes); ++n) {
             const Node& node = *_nodes[sourceNodes[n]];
             if (node._heightMapFileSize > 0) {
-                if (node._heightMapFileSize == expectingSize) {
-                    sourceFile.Seek(node._heightMapFileOffset, SEEK_SET);
-                    sourceFile.Read(sourceData.get(), 2, nodeDim*nodeDim);
-                } else {
+                if (!node.LoadHeightMap(sourceFile, (uint16*)sourceData.get())) {
                         //  some nodes have holes... These aren't fully supported.
                         //  just use the lowest valid height
                     XlSetMemory(sourceData.get(), 0, expectingSize);
@@ -138,15 +136,44 @@ namespace SceneEngine
     TerrainCell::Node::Node(const Float4x4& localToCell, size_t heightMapFileOffset, size_t heightMapFileSize, unsigned widthInElements)
     : _localToCell(localToCell), _heightMapFileOffset(heightMapFileOffset), _heightMapFileSize(heightMapFileSize)
     , _secondaryCacheOffset(0x0), _secondaryCacheSize(0x0)
-    , _widthInElements(widthInElements)
+    , _widthInElements(widthInElements), _heightMapCompressed(false)
     {
     }
 
+    size_t TerrainCell::Node::GetHeightMapDataSize() const
+    {
+        if (_heightMapCompressed)
+            return _heightMapFileSize ? (_widthInElements*_widthInElements*sizeof(uint16)) : 0;
+        return _heightMapFileSize;
+    }
+
+    bool TerrainCell::Node::LoadHeightMap(Utility::BasicFile& file, uint16 dst[]) const
+    {
+            //  Read the height map data from the source file into "dst" (which must have
+            //  room for _widthInElements*_widthInElements values). Returns false
+            //  for nodes with holes, or if the compressed data is invalid
+        const size_t expectedSize = _widthInElements*_widthInElements*sizeof(uint16);
+        if (!_heightMapCompressed) {
+            if (_heightMapFileSize != expectedSize) return false;
+            file.Seek(_heightMapFileOffset, SEEK_SET);
+            return file.Read(dst, 1, expectedSize) == expectedSize;
+        }
+
+        if (!_heightMapFileSize) return false;
+        auto compressedData = std::make_unique<uint8[]>(_heightMapFileSize);
+        file.Seek(_heightMapFileOffset, SEEK_SET);
+        if (file.Read(compressedData.get(), 1, _heightMapFileSize) != _heightMapFileSize) return false;
+        return DecompressHeightMap(
+            dst, _widthInElements, _widthInElements, 
+            compressedData.get(), _heightMapFileSize);
+    }
+
     //////////////////////////////////////////////////////////////////////////////////////////
 
     TerrainCellTexture::TerrainCellTexture() 
     {
         _nodeTextureByteCount = 0;
+        _nodeWidthInElements = 0;
         _fieldCount = 0;
     }
 
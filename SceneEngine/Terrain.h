@@ -137,6 +137,18 @@ namespace SceneEngine
         ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
         const TerrainCoordinateSystem& coords, Float2 queryPosition);
 
+    /// <summary>Gets the height and normal of the terrain at many positions at once</summary>
+    /// Equivalent to calling GetTerrainHeight for each position, but the queries are sorted
+    /// by terrain node first, so each node is only looked up once. Decoded nodes are kept in
+    /// a cache that is shared between threads, so this can be called from any thread.
+    /// "normals" can be null. Positions outside of the terrain (or in nodes that
+    /// can't be loaded) get a height of 0 and an up normal.
+    void GetTerrainHeights(
+        float heights[], Float3 normals[],
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, 
+        const TerrainCoordinateSystem& coords, 
+        const Float2 queryPositions[], size_t queryCount);
+
     class TerrainCell;
     class TerrainCellTexture;
     class TerrainUberSurfaceGeneric;
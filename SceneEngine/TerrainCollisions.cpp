@@ -12,14 +12,16 @@
 #include "../ConsoleRig/Log.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/HeapUtils.h"
+#include "../Utility/MemoryUtils.h"
 #include <memory>
+#include <algorithm>
 
 namespace SceneEngine
 {
     class TerrainNodeHeightCollision
     {
     public:
-        float GetHeight(Float2 cellBasedCoord) const;
+        float GetHeight(Float2 cellBasedCoord, Float2* cellBasedGradient = nullptr) const;
 
         const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const   { return _validationCallback; }
 
@@ -42,18 +44,20 @@ namespace SceneEngine
         return float(rawSample) * _scaffoldData._localToCell(2, 2) + _scaffoldData._localToCell(2, 3);
     }
 
-    float TerrainNodeHeightCollision::GetHeight(Float2 cellBasedCoord) const
+    float TerrainNodeHeightCollision::GetHeight(Float2 cellBasedCoord, Float2* cellBasedGradient) const
     {
+        const float nodeScale = float(_scaffoldData._widthInElements - _scaffoldData.GetOverlapWidth());
         Float2 nodeCoord(
             (cellBasedCoord[0] - _scaffoldData._localToCell(0,3)) / _scaffoldData._localToCell(0,0),
             (cellBasedCoord[1] - _scaffoldData._localToCell(1,3)) / _scaffoldData._localToCell(1,1));
-        nodeCoord *= float(_scaffoldData._widthInElements - _scaffoldData.GetOverlapWidth());
+        nodeCoord *= nodeScale;
         Float2 A(XlFloor(nodeCoord[0]), XlFloor(nodeCoord[1]));
         Int2 baseIndex((int)A[0], (int)A[1]);
         if (   baseIndex[0] < 0 || baseIndex[1] < 0
             || (baseIndex[0]+1) >= int(_scaffoldData._widthInElements) 
             || (baseIndex[1]+1) >= int(_scaffoldData._widthInElements)) {
             assert(0);      // probably testing the wrong node. The coordinates given don't match the node transform
+            if (cellBasedGradient) *cellBasedGradient = Float2(0.f, 0.f);
             return 0.f;
         }
         Float2 B = nodeCoord - A;
@@ -72,6 +76,16 @@ namespace SceneEngine
         float w1 = B[0] * (1.f - B[1]);
         float w2 = (1.0f - B[0]) * B[1];
         float w3 = B[0] * B[1];
+
+        if (cellBasedGradient) {
+                //  derivatives of the bilinear filter, scaled back into cell based coordinates
+            float dhdx = (h1 - h0) * (1.f - B[1]) + (h3 - h2) * B[1];
+            float dhdy = (h2 - h0) * (1.f - B[0]) + (h3 - h1) * B[0];
+            *cellBasedGradient = Float2(
+                dhdx * nodeScale / _scaffoldData._localToCell(0,0),
+                dhdy * nodeScale / _scaffoldData._localToCell(1,1));
+        }
+
         return h0 * w0 + h1 * w1 + h2 * w2 + h3 * w3;
     }
 
@@ -90,11 +104,11 @@ namespace SceneEngine
             //  a coordinate space defined by a single precision floating 
             //  point transform.
         auto& node = *cell._nodes[nodeIndex];
-        auto heightData = std::make_unique<uint16[]>(node._heightMapFileSize/2);
+        auto heightData = std::make_unique<uint16[]>(node._widthInElements*node._widthInElements);
         {
             BasicFile file(cellFilename, "rb");
-            file.Seek(node._heightMapFileOffset, SEEK_SET);
-            file.Read(heightData.get(), 1, node._heightMapFileSize);
+            if (!node.LoadHeightMap(file, heightData.get()))
+                XlSetMemory(heightData.get(), 0, node._widthInElements*node._widthInElements*sizeof(uint16));
         }
 
         auto validCallback = std::make_shared<Assets::DependencyValidation>();
@@ -112,62 +126,130 @@ namespace SceneEngine
 
     extern Int2 TerrainOffset;
 
+        //  Decoded nodes, shared by all threads. Queries are normally clustered, so a
+        //  modest number of nodes covers most cases (each node is only a few KB).
+    static ConcurrentLRUCache<TerrainNodeHeightCollision> CollisionCache(256);
+
+    static std::shared_ptr<TerrainNodeHeightCollision> GetCollisionObject(
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, UInt2 cellIndex, unsigned nodeIndex)
+    {
+        char cellFilename[MaxPath];
+        cfg.GetCellFilename(cellFilename, dimof(cellFilename), cellIndex, CoverageId_Heights);
+
+            //  Key by the filename, so that different terrains don't collide in the cache.
+            //  Another thread might be loading the same node at the same time; in that case,
+            //  we just end up with 2 copies, and the last one wins the cache slot.
+            //  The cache picks a shard from the high bits of the key, so the node index
+            //  must be mixed into the whole key (not just added to the low bits).
+        uint64 hash = HashCombine(Hash64(cellFilename), nodeIndex);
+        auto collisionObject = CollisionCache.Get(hash);
+        if (!collisionObject || collisionObject->GetDependencyValidation()->GetValidationIndex() != 0) {
+            collisionObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, nodeIndex);
+            CollisionCache.Insert(hash, collisionObject);
+        }
+        return collisionObject;
+    }
+
     float GetTerrainHeight(ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, Float2 queryPosition)
     {
-        TRY
+        float result = 0.f;
+        GetTerrainHeights(&result, nullptr, ioFormat, cfg, coords, &queryPosition, 1);
+        return result;
+    }
+
+    void GetTerrainHeights(
+        float heights[], Float3 normals[],
+        ITerrainFormat& ioFormat, const TerrainConfig& cfg, const TerrainCoordinateSystem& coords, 
+        const Float2 queryPositions[], size_t queryCount)
+    {
+            //
+            //  Find the cell and node that contains each position.
+            //  Once we've found it, we need to find a cached TerrainNodeHeightCollision
+            //  for the given node, and get the height data from that.
+            //
+            //  We're going to make some assumptions to make this faster. 
+            //      * We'll assume that the cells are arranged in a grid, so we can find the cell quickly
+            //      * we'll also make similar assumptions about the arrangement of nodes within
+            //          the cell, so we can find the node index directly (within loading the cell node)
+            //
+            //  The queries are sorted by node, so we only need to look up each node once.
+            //
+
+        class Query
         {
-                //
-                //  Find the cell and node that contains this position.
-                //  Once we've found it, we need to find a cached TerrainNodeHeightCollision
-                //  for the given node, and get the height data from that.
-                //
-                //  We're going to make some assumptions to make this faster. 
-                //      * We'll assume that the cells are arranged in a grid, so we can find the cell quickly
-                //      * we'll also make similar assumptions about the arrangement of nodes within
-                //          the cell, so we can find the node index directly (within loading the cell node)
-                //  
-
-            auto worldToCell = coords.WorldToCellBased();
+        public:
+            uint64 _nodeKey;
+            Float2 _cellFrac;
+            unsigned _index;
+        };
+
+        auto worldToCell = coords.WorldToCellBased();
+        auto cellDimsInNodes = cfg.CellDimensionsInNodes();
+        const float terrainOffsetZ = coords.TerrainOffset()[2];
+
+        std::vector<Query> queries;
+        queries.reserve(queryCount);
+        for (size_t q=0; q<queryCount; ++q) {
+            heights[q] = 0.f;
+            if (normals) normals[q] = Float3(0.f, 0.f, 1.f);
+
             auto cellBasedCoord = Truncate(
-                TransformPoint(worldToCell, Expand(queryPosition, 0.f)));
+                TransformPoint(worldToCell, Expand(queryPositions[q], 0.f)));
 
             Float2 cellIndex(XlFloor(cellBasedCoord[0]), XlFloor(cellBasedCoord[1]));
-
             if (    cellIndex[0] < 0.f || cellIndex[0] >= float(cfg._cellCount[0])
                 ||  cellIndex[1] < 0.f || cellIndex[1] >= float(cfg._cellCount[1])) {
-                return 0.f;
+                continue;
             }
 
             Float2 cellFrac(cellBasedCoord[0] - cellIndex[0], cellBasedCoord[1] - cellIndex[1]);
-        
-            auto cellDimsInNodes = cfg.CellDimensionsInNodes();
             float nodeX = XlFloor(cellFrac[0] * float(cellDimsInNodes[0]));
             float nodeY = XlFloor(cellFrac[1] * float(cellDimsInNodes[1]));
             unsigned nodeIndex = 85 + unsigned(nodeY) * cellDimsInNodes[0] + unsigned(nodeX);
 
-            uint64 cellHash = (uint64(nodeIndex) << 32ull) | (uint64(cellIndex[1]) << 6ull) | uint64(cellIndex[0]);
-
-                // (simple cache for recently used terrain files -- so we don't have to continually re-load every frame)
-                //      -- \todo -- this cache should be in a manager object! todo many statics in functions!
-            static LRUCache<TerrainNodeHeightCollision> CollisionCache(8);
-            auto collisionObject = CollisionCache.Get(cellHash);
-            if (!collisionObject) {
-                char cellFilename[MaxPath];
-                cfg.GetCellFilename(cellFilename, dimof(cellFilename), UInt2(unsigned(cellIndex[0]), unsigned(cellIndex[1])), CoverageId_Heights);
-                collisionObject = std::make_shared<TerrainNodeHeightCollision>(cellFilename, ioFormat, nodeIndex);
-                CollisionCache.Insert(cellHash, collisionObject);
-            }
-
-            assert(collisionObject);
-            return collisionObject->GetHeight(cellFrac) + coords.TerrainOffset()[2];
-
-        } CATCH(const ::Assets::Exceptions::PendingAsset&) {
-        } CATCH(const std::exception&) {
-            // we can sometimes get missing files. Just return a default height
-            LogWarning << "Error when querying terrain height at " << queryPosition[0] << ", " << queryPosition[1];
-        } CATCH_END
+            Query query;
+            query._nodeKey = (uint64(nodeIndex) << 32ull) | (uint64(cellIndex[1]) << 16ull) | uint64(cellIndex[0]);
+            query._cellFrac = cellFrac;
+            query._index = unsigned(q);
+            queries.push_back(query);
+        }
 
-        return 0.f;
+        std::sort(queries.begin(), queries.end(), 
+            [](const Query& lhs, const Query& rhs) { return lhs._nodeKey < rhs._nodeKey; });
+
+        for (auto i=queries.cbegin(); i!=queries.cend();) {
+            auto groupEnd = i + 1;
+            while (groupEnd != queries.cend() && groupEnd->_nodeKey == i->_nodeKey) ++groupEnd;
+
+            TRY
+            {
+                UInt2 cellIndex(unsigned(i->_nodeKey & 0xffff), unsigned((i->_nodeKey >> 16ull) & 0xffff));
+                auto collisionObject = GetCollisionObject(ioFormat, cfg, cellIndex, unsigned(i->_nodeKey >> 32ull));
+                assert(collisionObject);
+
+                for (auto q=i; q!=groupEnd; ++q) {
+                    if (normals) {
+                            //  the gradient is in cell based coordinates. Convert it back
+                            //  into world space with the (transposed) xy part of worldToCell
+                        Float2 cellGrad;
+                        heights[q->_index] = collisionObject->GetHeight(q->_cellFrac, &cellGrad) + terrainOffsetZ;
+                        Float2 worldGrad(
+                            cellGrad[0] * worldToCell(0,0) + cellGrad[1] * worldToCell(1,0),
+                            cellGrad[0] * worldToCell(0,1) + cellGrad[1] * worldToCell(1,1));
+                        normals[q->_index] = Normalize(Float3(-worldGrad[0], -worldGrad[1], 1.f));
+                    } else {
+                        heights[q->_index] = collisionObject->GetHeight(q->_cellFrac) + terrainOffsetZ;
+                    }
+                }
+
+            } CATCH(const ::Assets::Exceptions::PendingAsset&) {
+            } CATCH(const std::exception&) {
+                // we can sometimes get missing files. Just return a default height
+                LogWarning << "Error when querying terrain height at " << queryPositions[i->_index][0] << ", " << queryPositions[i->_index][1];
+            } CATCH_END
+
+            i = groupEnd;
+        }
     }
 
 }
\ No newline at end of file
@@ -0,0 +1,291 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "TerrainCompression.h"
+#include "../Utility/ArithmeticUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <algorithm>
+#include <assert.h>
+
+namespace SceneEngine
+{
+    class CompressedHeightMapHeader
+    {
+    public:
+        uint16  _width, _height;
+        uint8   _heightBits;
+        uint8   _version;
+        uint16  _dummy;
+    };
+
+    static const unsigned RiceEscapeQuotient = 24;     // quotients this large are written as raw values
+    static const unsigned RiceEscapeBits = 20;          // (enough for any zig-zagged height residual)
+    static const unsigned RunEscapeBits = 32;           // gradient flag runs can be as long as the whole map
+    static const uint8 HeightMapVersion = 1;
+    static const unsigned RiceParameterBits = 5;
+
+        //  Bits are packed LSB first. So a unary code (q zeroes followed by a one)
+        //  can be read back with a single "count trailing zeroes"
+    class HeightMapBitWriter
+    {
+    public:
+        void Write(uint32 value, unsigned bitCount)
+        {
+            assert(bitCount <= 32);
+            _accumulator |= uint64(value) << _count;
+            _count += bitCount;
+            while (_count >= 8) {
+                _dst->push_back(uint8(_accumulator));
+                _accumulator >>= 8;
+                _count -= 8;
+            }
+        }
+
+        void WriteRice(uint32 value, unsigned k, unsigned escapeBits = RiceEscapeBits)
+        {
+            auto q = value >> k;
+            if (q < RiceEscapeQuotient) {
+                Write(1u<<q, q+1);
+                if (k) Write(value & ((1u<<k)-1), k);
+            } else {
+                assert(escapeBits >= 32 || value < (1u<<escapeBits));
+                Write(1u<<RiceEscapeQuotient, RiceEscapeQuotient+1);
+                Write(value, escapeBits);
+            }
+        }
+
+        void Flush()
+        {
+            if (_count) _dst->push_back(uint8(_accumulator));
+            _accumulator = 0;
+            _count = 0;
+        }
+
+        HeightMapBitWriter(std::vector<uint8>& dst) : _dst(&dst), _accumulator(0), _count(0) {}
+    private:
+        std::vector<uint8>* _dst;
+        uint64 _accumulator;
+        unsigned _count;
+    };
+
+    class HeightMapBitReader
+    {
+    public:
+        void Refill()
+        {
+            if ((_end - _ptr) >= 8) {
+                uint64 v;
+                XlCopyMemory(&v, _ptr, sizeof(v));
+                _bits |= v << _count;
+                _ptr += (63 - _count) >> 3;
+                _count |= 56;
+            } else {
+                    // near the end of the stream, we pad with zeroes
+                while (_count <= 56) {
+                    uint64 b = 0;
+                    if (_ptr < _end) { b = *_ptr++; } else { ++_paddingBytes; }
+                    _bits |= b << _count;
+                    _count += 8;
+                }
+            }
+        }
+
+        uint32 Read(unsigned bitCount)
+        {
+            assert(_count >= bitCount);
+            auto result = uint32(_bits & ((uint64(1)<<bitCount)-1));
+            _bits >>= bitCount;
+            _count -= bitCount;
+            return result;
+        }
+
+        bool ReadRice(uint32& result, unsigned k, unsigned escapeBits = RiceEscapeBits)
+        {
+            Refill();
+            auto q = xl_ctz8(_bits);
+            if (q > RiceEscapeQuotient) return false;
+            _bits >>= (q+1);
+            _count -= q+1;
+            if (q == RiceEscapeQuotient) {
+                if (_count < escapeBits) Refill();
+                result = Read(escapeBits);
+            } else { result = (q << k) | Read(k); }
+            return true;
+        }
+
+        bool IsValid() const { return (_paddingBytes*8) <= _count; }    // (false if we've read into the padding)
+
+        HeightMapBitReader(const void* begin, const void* end)
+        : _ptr((const uint8*)begin), _end((const uint8*)end), _bits(0), _count(0), _paddingBytes(0) {}
+    private:
+        const uint8* _ptr;
+        const uint8* _end;
+        uint64 _bits;
+        unsigned _count;
+        unsigned _paddingBytes;
+    };
+
+    static inline uint32 ZigZag(int value)          { return uint32((unsigned(value) << 1) ^ unsigned(value >> 31)); }
+    static inline int UnZigZag(uint32 value)        { return int(value >> 1) ^ -int(value & 1); }
+
+    static inline int MedianEdgePredictor(int a, int b, int c)
+    {
+            //  LOCO-I "median edge detector." Picks the left or upper neighbour when
+            //  there seems to be an edge, otherwise uses the planar prediction.
+        int mx = std::max(a, b), mn = std::min(a, b);
+        if (c >= mx) return mn;
+        if (c <= mn) return mx;
+        return a + b - c;
+    }
+
+    static inline int PredictHeight(const uint16* row, const uint16* prevRow, unsigned x, unsigned heightMask)
+    {
+        if (!prevRow) return x ? int(row[x-1] & heightMask) : 0;
+        if (!x) return int(prevRow[0] & heightMask);
+        return MedianEdgePredictor(row[x-1] & heightMask, prevRow[x] & heightMask, prevRow[x-1] & heightMask);
+    }
+
+    static unsigned ChooseRiceParameter(const uint32 values[], size_t count, unsigned escapeBits = RiceEscapeBits)
+    {
+        unsigned bestK = 0;
+        uint64 bestCost = ~uint64(0);
+        for (unsigned k=0; k<=16; ++k) {
+            uint64 cost = 0;
+            for (size_t c=0; c<count; ++c) {
+                auto q = values[c] >> k;
+                cost += (q < RiceEscapeQuotient) ? (q + 1 + k) : (RiceEscapeQuotient + 1 + escapeBits);
+            }
+            if (cost < bestCost) { bestCost = cost; bestK = k; }
+        }
+        return bestK;
+    }
+
+    std::vector<uint8> CompressHeightMap(
+        const uint16 heights[], unsigned width, unsigned height, unsigned heightBits)
+    {
+        assert(heightBits == 14 || heightBits == 16);
+        assert(width <= 0xffff && height <= 0xffff);
+        const unsigned heightMask = (1u<<heightBits)-1;
+
+        std::vector<uint8> result;
+        result.resize(sizeof(CompressedHeightMapHeader));
+        auto& hdr = *(CompressedHeightMapHeader*)AsPointer(result.begin());
+        hdr._width = uint16(width);
+        hdr._height = uint16(height);
+        hdr._heightBits = uint8(heightBits);
+        hdr._version = HeightMapVersion;
+        hdr._dummy = 0;
+
+        HeightMapBitWriter writer(result);
+        const unsigned count = width*height;
+
+            //  Gradient flags (in the upper bits) are written as runs of the same value.
+            //  Each run after the first starts with the change in value
+        if (heightBits < 16 && count) {
+            std::vector<uint32> runs;
+            std::vector<uint8> values;
+            unsigned runStart = 0;
+            for (unsigned c=1; c<=count; ++c) {
+                if (c == count || (heights[c] >> heightBits) != (heights[runStart] >> heightBits)) {
+                    runs.push_back(c - runStart - 1);
+                    values.push_back(uint8(heights[runStart] >> heightBits));
+                    runStart = c;
+                }
+            }
+
+            auto k = ChooseRiceParameter(AsPointer(runs.begin()), runs.size(), RunEscapeBits);
+            writer.Write(values[0], 16-heightBits);
+            writer.Write(k, RiceParameterBits);
+            for (size_t r=0; r<runs.size(); ++r) {
+                writer.WriteRice(runs[r], k, RunEscapeBits);
+                if ((r+1) < runs.size())
+                    writer.Write((values[r+1] - values[r] - 1) & ((1u<<(16-heightBits))-1), 16-heightBits);
+            }
+        }
+
+            //  Height residuals, with a Rice parameter per row
+        std::vector<uint32> residuals(width);
+        for (unsigned y=0; y<height; ++y) {
+            auto* row = &heights[y*width];
+            auto* prevRow = y ? &heights[(y-1)*width] : nullptr;
+            for (unsigned x=0; x<width; ++x)
+                residuals[x] = ZigZag(int(row[x] & heightMask) - PredictHeight(row, prevRow, x, heightMask));
+
+            auto k = ChooseRiceParameter(AsPointer(residuals.begin()), width);
+            writer.Write(k, RiceParameterBits);
+            for (unsigned x=0; x<width; ++x)
+                writer.WriteRice(residuals[x], k);
+        }
+
+        writer.Flush();
+        return std::move(result);
+    }
+
+    bool DecompressHeightMap(
+        uint16 dst[], unsigned width, unsigned height,
+        const void* compressedData, size_t compressedDataSize)
+    {
+        if (compressedDataSize < sizeof(CompressedHeightMapHeader)) return false;
+        const auto& hdr = *(const CompressedHeightMapHeader*)compressedData;
+        if (hdr._version != HeightMapVersion || hdr._width != width || hdr._height != height
+            || (hdr._heightBits != 14 && hdr._heightBits != 16))
+            return false;
+
+        const unsigned heightBits = hdr._heightBits;
+        const unsigned heightMask = (1u<<heightBits)-1;
+        const unsigned count = width*height;
+        HeightMapBitReader reader(
+            PtrAdd(compressedData, sizeof(CompressedHeightMapHeader)),
+            PtrAdd(compressedData, compressedDataSize));
+
+        if (heightBits < 16 && count) {
+            const unsigned flagBits = 16-heightBits;
+            reader.Refill();
+            auto value = reader.Read(flagBits);
+            auto k = reader.Read(RiceParameterBits);
+            unsigned c = 0;
+            for (;;) {
+                uint32 run;
+                if (!reader.ReadRice(run, k, RunEscapeBits)) return false;
+                if (run >= (count - c)) return false;
+                auto v = uint16(value << heightBits);
+                for (unsigned e=c+run+1; c<e; ++c) dst[c] = v;
+                if (c == count) break;
+
+                reader.Refill();
+                value = (value + reader.Read(flagBits) + 1) & ((1u<<flagBits)-1);
+            }
+        } else {
+            XlSetMemory(dst, 0, count * sizeof(uint16));
+        }
+
+        for (unsigned y=0; y<height; ++y) {
+            auto* row = &dst[y*width];
+            auto* prevRow = y ? &dst[(y-1)*width] : nullptr;
+            reader.Refill();
+            auto k = reader.Read(RiceParameterBits);
+            int left = 0;
+            for (unsigned x=0; x<width; ++x) {
+                uint32 residual;
+                if (!reader.ReadRice(residual, k)) return false;
+                int prediction;
+                if (prevRow) {
+                    int up = prevRow[x] & heightMask;
+                    prediction = x ? MedianEdgePredictor(left, up, prevRow[x-1] & heightMask) : up;
+                } else 
+                    prediction = left;
+                int h = prediction + UnZigZag(residual);
+                if (h < 0 || unsigned(h) > heightMask) return false;
+                row[x] = uint16(row[x] | h);
+                left = h;
+            }
+        }
+
+        return reader.IsValid();
+    }
+}
+
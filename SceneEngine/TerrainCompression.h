@@ -0,0 +1,35 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Core/Types.h"
+#include <vector>
+
+namespace SceneEngine
+{
+    /// <summary>Lossless compression for quantized terrain height maps</summary>
+    /// Compresses the 16 bit values written for "QuantRange" terrain nodes.
+    /// Each height is predicted from its left, upper and upper-left neighbours
+    /// (using the LOCO-I "median edge detector" predictor), and the residuals are
+    /// Rice coded, with a Rice parameter chosen per row.
+    ///
+    /// When "heightBits" is 14, the top 2 bits of each value are treated as gradient
+    /// flags. They are coded separately, as run lengths.
+    ///
+    /// Decompression is a single pass over the data, and is intended to be fast enough
+    /// to use on the streaming path.
+    std::vector<uint8> CompressHeightMap(
+        const uint16 heights[], unsigned width, unsigned height, unsigned heightBits);
+
+    /// <summary>Decompress data written with CompressHeightMap</summary>
+    /// Returns false if the compressed data is corrupt, or doesn't match the
+    /// given dimensions.
+    bool DecompressHeightMap(
+        uint16 dst[], unsigned width, unsigned height,
+        const void* compressedData, size_t compressedDataSize);
+}
+
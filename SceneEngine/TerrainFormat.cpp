@@ -7,16 +7,20 @@
 #include "TerrainFormat.h"
 #include "TerrainUberSurface.h"
 #include "TerrainScaffold.h"
+#include "TerrainCompression.h"
 #include "../RenderCore/Resource.h"
 #include "../RenderCore/Metal/Format.h"
 #include "../Assets/ChunkFile.h"
 #include "../Assets/Assets.h"
 #include "../Utility/Streams/FileUtils.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Threading/CompletionThreadPool.h"
 #include "../Utility/PtrUtils.h"
 #include "../Core/Types.h"
 
 #include <stack>
 #include <assert.h>
+#include <intrin.h>
 
 #include "../Core/WinAPI/IncludeWindows.h"
 
@@ -49,7 +53,8 @@ namespace SceneEngine
             enum Enum 
             {
                 None,
-                QuantRange      ///< high precision min-max range, with low precision values in between
+                QuantRange,             ///< high precision min-max range, with low precision values in between
+                QuantRangePredicted     ///< as QuantRange, but the values are then compressed with CompressHeightMap
             };
             typedef unsigned Type;
         }
@@ -183,7 +188,10 @@ namespace SceneEngine
 
                             float compressionData[2] = { 0.f, 1.f };
                             if (loadInfo._hdr._compressionDataSize) {
-                                if (loadInfo._hdr._compressionType == Compression::QuantRange && loadInfo._hdr._compressionDataSize >= (sizeof(float)*2)) {
+                                bool quantRange = 
+                                        loadInfo._hdr._compressionType == Compression::QuantRange
+                                    ||  loadInfo._hdr._compressionType == Compression::QuantRangePredicted;
+                                if (quantRange && loadInfo._hdr._compressionDataSize >= (sizeof(float)*2)) {
                                     file.Read(compressionData, sizeof(float), 2);
                                     file.Seek(loadInfo._hdr._compressionDataSize - sizeof(float)*2, SEEK_CUR);
                                 } else {
@@ -200,6 +208,7 @@ namespace SceneEngine
                             auto node = std::make_unique<Node>(
                                 localToCell, loadInfo._hdr._dataOffset + heightDataChunk._fileOffset, 
                                 loadInfo._hdr._dataSize, loadInfo._hdr._dimensionsInElements);
+                            node->_heightMapCompressed = loadInfo._hdr._compressionType == Compression::QuantRangePredicted;
 
                             nodes.push_back(std::move(node));
                         }
@@ -228,6 +237,7 @@ namespace SceneEngine
         TerrainCellTexture::TerrainCellTexture(const char filename[])
         {
             _nodeTextureByteCount = 0;
+            _nodeWidthInElements = 0;
             _fieldCount = 0;
             auto validationCallback = std::make_shared<::Assets::DependencyValidation>();
 
@@ -255,6 +265,7 @@ namespace SceneEngine
                 file.Read(&cellDesc._hdr, sizeof(cellDesc._hdr), 1);
 
                 std::vector<unsigned> fileOffsetsBreadthFirst;
+                std::vector<unsigned> compressedSizes;
         
                 {
                     //  nodes are stored as a breadth-first quad tree, starting with
@@ -269,11 +280,23 @@ namespace SceneEngine
                             for (unsigned x=0; x<(1u<<l); ++x) {
                                 auto loadInfo = LoadNodeStructure(file);
                                 fileOffsetsBreadthFirst.push_back(loadInfo._hdr._dataOffset + coverageDataChunk._fileOffset);
+
+                                    //  compressed nodes have variable size data; but they will 
+                                    //  all be the same size after decompression
+                                unsigned byteCount = loadInfo._hdr._dataSize;
+                                if (loadInfo._hdr._compressionType == Compression::QuantRangePredicted) {
+                                    if (compressedSizes.size() != (fileOffsetsBreadthFirst.size()-1))
+                                        throw ::Assets::Exceptions::FormatError("Mixed compression types in terrain texture file: %s", filename);
+                                    compressedSizes.push_back(loadInfo._hdr._dataSize);
+                                    byteCount = loadInfo._hdr._dimensionsInElements * loadInfo._hdr._dimensionsInElements * sizeof(uint16);
+                                }
+
                                 if (!_nodeTextureByteCount) {
-                                    _nodeTextureByteCount = loadInfo._hdr._dataSize;
+                                    _nodeTextureByteCount = byteCount;
+                                    _nodeWidthInElements = loadInfo._hdr._dimensionsInElements;
                                 } else {
                                         // assert all nodes have the same size data
-                                    assert(loadInfo._hdr._dataSize == _nodeTextureByteCount);
+                                    assert(byteCount == _nodeTextureByteCount);
                                 }
                             }
                         }
@@ -285,6 +308,9 @@ namespace SceneEngine
                 _fieldCount = (unsigned)cellDesc._hdr._treeDepth;
                 _sourceFileName = filename;
                 _nodeFileOffsets = std::move(fileOffsetsBreadthFirst);
+                if (!compressedSizes.empty() && compressedSizes.size() != _nodeFileOffsets.size())
+                    throw ::Assets::Exceptions::FormatError("Mixed compression types in terrain texture file: %s", filename);
+                _nodeCompressedSizes = std::move(compressedSizes);
                 _validationCallback = std::move(validationCallback);
             } 
             CATCH (const Utility::Exceptions::IOException&) { Throw(::Assets::Exceptions::InvalidAsset(filename, "Missing terrain texture")); }
@@ -317,15 +343,20 @@ namespace SceneEngine
         class CoverageDataResult
         {
         public:
+            std::vector<uint8> _rawData;
             std::vector<uint8> _compressionData;
             Metal::NativeFormat::Enum _nativeFormat;
-            unsigned _rawDataSize;
 
             CoverageDataResult(
-                std::vector<uint8>&& compressionData, Metal::NativeFormat::Enum nativeFormat, unsigned rawDataSize)
-            : _compressionData(std::forward<std::vector<uint8>>(compressionData))
-            , _nativeFormat(nativeFormat)
-            , _rawDataSize(rawDataSize) {}
+                std::vector<uint8>&& rawData, std::vector<uint8>&& compressionData, Metal::NativeFormat::Enum nativeFormat)
+            : _rawData(std::forward<std::vector<uint8>>(rawData))
+            , _compressionData(std::forward<std::vector<uint8>>(compressionData))
+            , _nativeFormat(nativeFormat) {}
+
+            CoverageDataResult(CoverageDataResult&& moveFrom)
+            : _rawData(std::move(moveFrom._rawData))
+            , _compressionData(std::move(moveFrom._compressionData))
+            , _nativeFormat(moveFrom._nativeFormat) {}
         };
 
         template<typename Element>
@@ -426,112 +457,330 @@ namespace SceneEngine
                 return 3;
             }
 
+        static unsigned ClassifySlope(float slope, const GradientFlagsSettings& settings)
+        {
+            if (slope < settings._slopeThresholds[0]) return 0;
+            if (slope < settings._slopeThresholds[1]) return 1;
+            if (slope < settings._slopeThresholds[2]) return 2;
+            return 3;
+        }
+
+            //  Calculate the gradient flags for "count" elements of row "y", starting
+            //  at "xStart". Equivalent to calling CalculateGradientFlag for each element
+        template<typename Element>
+            static void CalculateGradientFlagsRow(
+                uint8 dst[], TerrainUberSurfaceGeneric&, unsigned, unsigned, unsigned count,
+                const GradientFlagsSettings&)
+            {
+                XlSetMemory(dst, 0, count);
+            }
+
+        template<>
+            static void CalculateGradientFlagsRow<float>(
+                uint8 dst[], TerrainUberSurfaceGeneric& surface, unsigned y, unsigned xStart, unsigned count,
+                const GradientFlagsSettings& settings)
+            {
+                const unsigned width = surface.GetWidth(), height = surface.GetHeight();
+                const unsigned xEnd = xStart + count;
+
+                    //  Elements with all of their neighbours within the surface can use the SSE
+                    //  path. The sums are evaluated in the same order as CalculateDHDXY, so the 
+                    //  results match the scalar path exactly. Edges use the scalar path.
+                unsigned sseStart = xEnd, sseEnd = xEnd;
+                if (y >= 1 && (y+1) < height && width > 2) {
+                    sseStart = std::min(std::max(xStart, 1u), xEnd);
+                    sseEnd = std::max(sseStart, std::min(xEnd, width-1));
+                    sseEnd = sseStart + ((sseEnd - sseStart) & ~3u);
+                }
+
+                for (unsigned x=xStart; x<sseStart; ++x)
+                    dst[x-xStart] = (uint8)CalculateGradientFlag<float>(surface, UInt2(x, y), settings);
+
+                if (sseStart < sseEnd) {
+                    const auto* r0 = (const float*)surface.GetDataFast(UInt2(0, y-1));
+                    const auto* r1 = (const float*)surface.GetDataFast(UInt2(0, y));
+                    const auto* r2 = (const float*)surface.GetDataFast(UInt2(0, y+1));
+
+                    using namespace Internal;
+                    const auto h00 = _mm_set1_ps(SharrHoriz3x3[0][0]), h10 = _mm_set1_ps(SharrHoriz3x3[1][0]), h20 = _mm_set1_ps(SharrHoriz3x3[2][0]);
+                    const auto h02 = _mm_set1_ps(SharrHoriz3x3[0][2]), h12 = _mm_set1_ps(SharrHoriz3x3[1][2]), h22 = _mm_set1_ps(SharrHoriz3x3[2][2]);
+                    const auto v00 = _mm_set1_ps(SharrVert3x3[0][0]), v20 = _mm_set1_ps(SharrVert3x3[2][0]);
+                    const auto v01 = _mm_set1_ps(SharrVert3x3[0][1]), v21 = _mm_set1_ps(SharrVert3x3[2][1]);
+                    const auto v02 = _mm_set1_ps(SharrVert3x3[0][2]), v22 = _mm_set1_ps(SharrVert3x3[2][2]);
+                    const auto absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+                    const auto spacing = _mm_set1_ps(settings._elementSpacing);
+
+                    __declspec(align(16)) float slopes[4];
+                    for (unsigned x=sseStart; x<sseEnd; x+=4) {
+                        auto center = _mm_loadu_ps(r1+x);
+                        auto d00 = _mm_sub_ps(_mm_loadu_ps(r0+x-1), center);
+                        auto d01 = _mm_sub_ps(_mm_loadu_ps(r0+x  ), center);
+                        auto d02 = _mm_sub_ps(_mm_loadu_ps(r0+x+1), center);
+                        auto d10 = _mm_sub_ps(_mm_loadu_ps(r1+x-1), center);
+                        auto d12 = _mm_sub_ps(_mm_loadu_ps(r1+x+1), center);
+                        auto d20 = _mm_sub_ps(_mm_loadu_ps(r2+x-1), center);
+                        auto d21 = _mm_sub_ps(_mm_loadu_ps(r2+x  ), center);
+                        auto d22 = _mm_sub_ps(_mm_loadu_ps(r2+x+1), center);
+
+                            // (the kernels are indexed [x][y], as in CalculateDHDXY)
+                        auto dhdx = _mm_mul_ps(h00, d00);
+                        dhdx = _mm_add_ps(dhdx, _mm_mul_ps(h10, d01));
+                        dhdx = _mm_add_ps(dhdx, _mm_mul_ps(h20, d02));
+                        dhdx = _mm_add_ps(dhdx, _mm_mul_ps(h02, d20));
+                        dhdx = _mm_add_ps(dhdx, _mm_mul_ps(h12, d21));
+                        dhdx = _mm_add_ps(dhdx, _mm_mul_ps(h22, d22));
+
+                        auto dhdy = _mm_mul_ps(v00, d00);
+                        dhdy = _mm_add_ps(dhdy, _mm_mul_ps(v20, d02));
+                        dhdy = _mm_add_ps(dhdy, _mm_mul_ps(v01, d10));
+                        dhdy = _mm_add_ps(dhdy, _mm_mul_ps(v21, d12));
+                        dhdy = _mm_add_ps(dhdy, _mm_mul_ps(v02, d20));
+                        dhdy = _mm_add_ps(dhdy, _mm_mul_ps(v22, d22));
+
+                        dhdx = _mm_and_ps(_mm_div_ps(dhdx, spacing), absMask);
+                        dhdy = _mm_and_ps(_mm_div_ps(dhdy, spacing), absMask);
+                        _mm_store_ps(slopes, _mm_max_ps(dhdy, dhdx));   // (same as std::max(dhdx, dhdy), including NaNs)
+
+                        dst[x-xStart+0] = (uint8)ClassifySlope(slopes[0], settings);
+                        dst[x-xStart+1] = (uint8)ClassifySlope(slopes[1], settings);
+                        dst[x-xStart+2] = (uint8)ClassifySlope(slopes[2], settings);
+                        dst[x-xStart+3] = (uint8)ClassifySlope(slopes[3], settings);
+                    }
+                }
+
+                for (unsigned x=sseEnd; x<xEnd; ++x)
+                    dst[x-xStart] = (uint8)CalculateGradientFlag<float>(surface, UInt2(x, y), settings);
+            }
+
+            //  Full resolution gradient flags for the area covered by a cell. These are
+            //  calculated once, and shared by every node in the cell (rather than 
+            //  recalculated for every LOD)
+        class GradientFlagsImage
+        {
+        public:
+            UInt2 _origin;
+            unsigned _width, _height;
+            std::vector<uint8> _flags;
+        };
+
+        template<typename Element>
+            static void CalculateGradientFlags(
+                GradientFlagsImage& result, TerrainUberSurfaceGeneric& surface,
+                UInt2 origin, unsigned width, unsigned height,
+                const GradientFlagsSettings& settings)
+        {
+            result._origin = origin;
+            result._width = width;
+            result._height = height;
+            result._flags.resize(width*height);
+
+            auto& pool = ConsoleRig::GlobalServices::GetLongTaskThreadPool();
+            const unsigned bandCount = std::min((pool.GetWorkerThreadCount()+1) * 4, height);
+            auto* dst = AsPointer(result._flags.begin());
+            CompletionThreadPool::TaskGroup group(pool);
+            for (unsigned b=0; b<bandCount; ++b) {
+                unsigned begin = b * height / bandCount, end = (b+1) * height / bandCount;
+                group.Run(
+                    [dst, &surface, origin, width, begin, end, &settings]()
+                    {
+                        for (unsigned y=begin; y<end; ++y)
+                            CalculateGradientFlagsRow<Element>(
+                                &dst[y*width], surface, origin[1]+y, origin[0], width, settings);
+                    });
+            }
+            group.Wait();
+        }
+
+            //  Sample a row of the uber surface, with "Corner" downsampling 
+            //  (ie, every "skip"th element)
+        template<typename Element>
+            static void SampleRow(
+                Element dst[], TerrainUberSurfaceGeneric& surface, 
+                unsigned startx, unsigned y, unsigned skip, unsigned count)
+            {
+                unsigned inBoundsCount = 0;
+                if (y < surface.GetHeight() && startx < surface.GetWidth()) {
+                    inBoundsCount = std::min(count, (surface.GetWidth() - startx + skip - 1) / skip);
+                    const auto* src = (const Element*)surface.GetDataFast(UInt2(startx, y));
+                    for (unsigned x=0; x<inBoundsCount; ++x)
+                        dst[x] = src[x*skip];
+                }
+                for (unsigned x=inBoundsCount; x<count; ++x)
+                    dst[x] = SceneEngine::Internal::DummyValue<Element>();
+            }
+
         template<typename Element>
-            static CoverageDataResult WriteCoverageData(
-                BasicFile& destinationFile, TerrainUberSurfaceGeneric& surface,
+            static void RowMinMax(float& minValue, float& maxValue, const Element src[], unsigned count)
+            {
+                for (unsigned x=0; x<count; ++x) {
+                    minValue = std::min(minValue, AsScalar(src[x]));
+                    maxValue = std::max(maxValue, AsScalar(src[x]));
+                }
+            }
+
+        static void RowMinMax(float& minValue, float& maxValue, const float src[], unsigned count)
+        {
+            unsigned x=0;
+            if (count >= 4) {
+                auto mins = _mm_set1_ps(minValue), maxs = _mm_set1_ps(maxValue);
+                for (; (x+4)<=count; x+=4) {
+                    auto v = _mm_loadu_ps(src+x);
+                    mins = _mm_min_ps(mins, v);
+                    maxs = _mm_max_ps(maxs, v);
+                }
+                __declspec(align(16)) float m[2][4];
+                _mm_store_ps(m[0], mins);
+                _mm_store_ps(m[1], maxs);
+                minValue = std::min(std::min(m[0][0], m[0][1]), std::min(m[0][2], m[0][3]));
+                maxValue = std::max(std::max(m[1][0], m[1][1]), std::max(m[1][2], m[1][3]));
+            }
+            for (; x<count; ++x) {
+                minValue = std::min(minValue, src[x]);
+                maxValue = std::max(maxValue, src[x]);
+            }
+        }
+
+        template<typename Element>
+            static void QuantizeRow(
+                uint16 dst[], const Element src[], const uint16 flags[], unsigned count,
+                float minValue, float maxValue, unsigned compressedHeightMask)
+            {
+                for (unsigned x=0; x<count; ++x) {
+                    float ch = (AsScalar(src[x]) - minValue) * float(compressedHeightMask) / (maxValue - minValue);
+                    dst[x] = uint16((uint16)std::min(float(compressedHeightMask), std::max(0.f, ch)) | flags[x]);
+                }
+            }
+
+        static void QuantizeRow(
+            uint16 dst[], const float src[], const uint16 flags[], unsigned count,
+            float minValue, float maxValue, unsigned compressedHeightMask)
+        {
+            const auto minv = _mm_set1_ps(minValue);
+            const auto range = _mm_set1_ps(maxValue - minValue);
+            const auto mask = _mm_set1_ps(float(compressedHeightMask));
+            const auto zero = _mm_setzero_ps();
+            unsigned x=0;
+            for (; (x+4)<=count; x+=4) {
+                auto ch = _mm_div_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(src+x), minv), mask), range);
+                ch = _mm_min_ps(_mm_max_ps(ch, zero), mask);        // (NaNs become zero, as with std::max(0.f, ch))
+                auto q = _mm_cvttps_epi32(ch);
+                q = _mm_packus_epi32(q, q);
+                q = _mm_or_si128(q, _mm_loadl_epi64((const __m128i*)&flags[x]));
+                _mm_storel_epi64((__m128i*)&dst[x], q);
+            }
+            for (; x<count; ++x) {
+                float ch = (src[x] - minValue) * float(compressedHeightMask) / (maxValue - minValue);
+                dst[x] = uint16((uint16)std::min(float(compressedHeightMask), std::max(0.f, ch)) | flags[x]);
+            }
+        }
+
+        template<typename Element>
+            static CoverageDataResult BuildCoverageData(
+                TerrainUberSurfaceGeneric& surface,
                 unsigned startx, unsigned starty, signed downsample, unsigned dimensionsInElements,
-                const GradientFlagsSettings& gradFlagsSettings, Compression::Enum compression)
+                const GradientFlagsImage* gradientFlags, Compression::Enum compression)
         {
             float minValue =  FLT_MAX;
             float maxValue = -FLT_MAX;
             auto sampledValues = std::make_unique<Element[]>(dimensionsInElements*dimensionsInElements);
-            XlSetMemory(sampledValues.get(), 0, dimensionsInElements*dimensionsInElements*sizeof(Element));
+
+                //  "Corner" method is required for the LOD to work correctly on node
+                //  boundaries. We need adjacent tiles to match,
+                //  even if they are at different LOD levels. When a high-LOD tile needs
+                //  to match a low-LOD neighbour, we just skip every second sample.
+                //  So, we have to do the same here, when we downsample.
+            const DownsampleMethod::Enum downsampleMethod = DownsampleMethod::Corner;
 
             unsigned kw = 1<<downsample;
-            for (unsigned y=0; y<dimensionsInElements; ++y)
-                for (unsigned x=0; x<dimensionsInElements; ++x) {
-
-                        //  "Corner" method is required for the LOD to work correctly on node
-                        //  boundaries. We need adjacent tiles to match,
-                        //  even if they are at different LOD levels. When a high-LOD tile needs
-                        //  to match a low-LOD neighbour, we just skip every second sample.
-                        //  So, we have to do the same here, when we downsample.
-                    const DownsampleMethod::Enum downsampleMethod = DownsampleMethod::Corner;
-
-                        //  first, we need to downsample the source data to get the 
-                        //  correct values. Simple box filter currently. I'm not sure
-                        //  what the best filter for height data is -- but maybe we
-                        //  want to try something that will preserve large details in the 
-                        //  distance 
-                        //      (ie, so that mountains, etc, don't collapse into nothing)
-                    Element k; 
-                    Zero(k);
-                    if (constant_expression<downsampleMethod == DownsampleMethod::Average>::result()) {
+            for (unsigned y=0; y<dimensionsInElements; ++y) {
+                auto* row = &sampledValues[y*dimensionsInElements];
+
+                    //  first, we need to downsample the source data to get the 
+                    //  correct values. Simple box filter currently. I'm not sure
+                    //  what the best filter for height data is -- but maybe we
+                    //  want to try something that will preserve large details in the 
+                    //  distance 
+                    //      (ie, so that mountains, etc, don't collapse into nothing)
+                if (constant_expression<downsampleMethod == DownsampleMethod::Average>::result()) {
+                    for (unsigned x=0; x<dimensionsInElements; ++x) {
+                        Element k; 
+                        Zero(k);
                         for (unsigned ky=0; ky<kw; ++ky)
                             for (unsigned kx=0; kx<kw; ++kx)
                                 k = Add(k, GetValue<Element>(surface, UInt2(startx + kw*x + kx, starty + kw*y + ky)));
-                        k = Divide(k, kw*kw);
-                    } else if (constant_expression<downsampleMethod == DownsampleMethod::Corner>::result()) {
-                        k = GetValue<Element>(surface, UInt2(startx + kw*x, starty + kw*y));
+                        row[x] = Divide(k, kw*kw);
                     }
-
-                    minValue = std::min(minValue, AsScalar(k));
-                    maxValue = std::max(maxValue, AsScalar(k));
-                    sampledValues[y*dimensionsInElements+x] = k;
-
+                } else if (constant_expression<downsampleMethod == DownsampleMethod::Corner>::result()) {
+                    SampleRow(row, surface, startx, starty + kw*y, kw, dimensionsInElements);
                 }
 
-            if (compression == Compression::QuantRange) {
+                RowMinMax(minValue, maxValue, row, dimensionsInElements);
+            }
+
+            if (compression == Compression::QuantRange || compression == Compression::QuantRangePredicted) {
 
-                const bool encodedGradientFlags = gradFlagsSettings._enable;
+                const bool encodedGradientFlags = gradientFlags != nullptr;
                 const auto compressedHeightMask = encodedGradientFlags ? 0x3fffu : 0xffffu;
                 auto sampledGradientFlags = std::make_unique<uint16[]>(dimensionsInElements*dimensionsInElements);
 
                 if (encodedGradientFlags) {
 
-                    const unsigned kw = 1<<downsample;
-                    for (unsigned y=0; y<dimensionsInElements; ++y)
-                        for (unsigned x=0; x<dimensionsInElements; ++x) {
-                            unsigned counts[4] = { 0u, 0u, 0u, 0u };
-                            
-                            for (unsigned ky=0; ky<kw; ++ky)
-                                for (unsigned kx=0; kx<kw; ++kx) {
-                                    unsigned flag = CalculateGradientFlag<Element>(surface, UInt2(startx + kw*x + kx, starty + kw*y + ky), gradFlagsSettings);
-                                    if (flag < dimof(counts)) ++counts[flag];
-                                }
+                    auto counts = std::make_unique<unsigned[][4]>(dimensionsInElements);
+                    for (unsigned y=0; y<dimensionsInElements; ++y) {
+                        XlSetMemory(counts.get(), 0, sizeof(unsigned)*4*dimensionsInElements);
+                        for (unsigned ky=0; ky<kw; ++ky) {
+                            auto* flagsRow = &gradientFlags->_flags[
+                                (starty + kw*y + ky - gradientFlags->_origin[1]) * gradientFlags->_width 
+                                + startx - gradientFlags->_origin[0]];
+                            for (unsigned x=0; x<dimensionsInElements; ++x)
+                                for (unsigned kx=0; kx<kw; ++kx)
+                                    ++counts[x][flagsRow[kw*x + kx]];
+                        }
                             
-                                // We choose the value that is most common
-                                // average isn't actually right, because it runs
-                                // the risk of producing a result that doesn't exist
-                                // in the top-LOD data at all!
+                            // We choose the value that is most common
+                            // average isn't actually right, because it runs
+                            // the risk of producing a result that doesn't exist
+                            // in the top-LOD data at all!
+                        for (unsigned x=0; x<dimensionsInElements; ++x) {
                             unsigned result = 0;
                             for (unsigned c=1; c<4; ++c)
-                                if (counts[c] > counts[result]) result = c;
+                                if (counts[x][c] > counts[x][result]) result = c;
                             sampledGradientFlags[y*dimensionsInElements+x] = (uint16)(result<<14);
                         }
+                    }
 
                 } else {
                     XlSetMemory(sampledGradientFlags.get(), 0, sizeof(uint16)*dimensionsInElements*dimensionsInElements);
                 }
 
-                auto compressedHeightData = std::make_unique<uint16[]>(dimensionsInElements*dimensionsInElements);
-                for (unsigned y=0; y<dimensionsInElements; ++y)
-                    for (unsigned x=0; x<dimensionsInElements; ++x) {
-                        auto s = AsScalar(sampledValues[y*dimensionsInElements+x]);
-                        float ch = (s - minValue) * float(compressedHeightMask) / (maxValue - minValue);
-
-                        uint16 compressedValue = (uint16)std::min(float(compressedHeightMask), std::max(0.f, ch));
-                        compressedValue |= sampledGradientFlags[y*dimensionsInElements+x];
-                        compressedHeightData[y*dimensionsInElements+x] = compressedValue;
-                    }
-
-                    // write all these results to the file...
                 auto rawDataSize = sizeof(uint16)*dimensionsInElements*dimensionsInElements;
-                destinationFile.Write(compressedHeightData.get(), rawDataSize, 1);
+                std::vector<uint8> compressedHeightData(rawDataSize);
+                for (unsigned y=0; y<dimensionsInElements; ++y)
+                    QuantizeRow(
+                        &((uint16*)AsPointer(compressedHeightData.begin()))[y*dimensionsInElements],
+                        &sampledValues[y*dimensionsInElements], &sampledGradientFlags[y*dimensionsInElements],
+                        dimensionsInElements, minValue, maxValue, compressedHeightMask);
+
+                    //  The predicted format is lossless relative to QuantRange; it just 
+                    //  adds an entropy coding step on top of the quantized values
+                if (compression == Compression::QuantRangePredicted)
+                    compressedHeightData = CompressHeightMap(
+                        (const uint16*)AsPointer(compressedHeightData.begin()), 
+                        dimensionsInElements, dimensionsInElements, encodedGradientFlags ? 14 : 16);
 
                 std::vector<uint8> compressionData;
                 compressionData.resize(sizeof(float)*2);
                 *(std::pair<float, float>*)AsPointer(compressionData.begin()) = std::make_pair(minValue, (maxValue - minValue) / float(compressedHeightMask));
-                return CoverageDataResult(std::move(compressionData), Metal::NativeFormat::R16_UINT, (unsigned)rawDataSize);
+                return CoverageDataResult(std::move(compressedHeightData), std::move(compressionData), Metal::NativeFormat::R16_UINT);
 
             } else if (compression == Compression::None) {
 
                 auto rawDataSize = sizeof(Element)*dimensionsInElements*dimensionsInElements;
-                destinationFile.Write(sampledValues.get(), rawDataSize, 1);
-                return CoverageDataResult(std::vector<uint8>(), AsFormat<Element>(), (unsigned)rawDataSize);
+                std::vector<uint8> rawData((const uint8*)sampledValues.get(), (const uint8*)sampledValues.get() + rawDataSize);
+                return CoverageDataResult(std::move(rawData), std::vector<uint8>(), AsFormat<Element>());
 
             } else {
-                return CoverageDataResult(std::vector<uint8>(), Metal::NativeFormat::Unknown, 0);
+                return CoverageDataResult(std::vector<uint8>(), std::vector<uint8>(), Metal::NativeFormat::Unknown);
             }
         }
 
@@ -552,13 +801,79 @@ namespace SceneEngine
                 //  write an area of the uber surface to our native terrain format
             auto nodeCount = NodeCountFromTreeDepth(treeDepth);
             unsigned compressionDataPerNode = 0;
-            if (compression == Compression::QuantRange)
+            const bool quantRange = compression == Compression::QuantRange || compression == Compression::QuantRangePredicted;
+            if (quantRange)
                 compressionDataPerNode = sizeof(float)*2;
             std::vector<uint8> nodeHeaders;
             nodeHeaders.resize(nodeCount*(sizeof(NodeDesc::Header) + compressionDataPerNode), 0);
 
             unsigned uniqueElementsDimension = 
                 std::min(cellMaxs[0] - cellMins[0], cellMaxs[1] - cellMins[1]) / (1u<<(treeDepth-1));
+            const unsigned nodeDimensions = uniqueElementsDimension + overlapElements;
+
+                //  The gradient flags are calculated at full resolution, over the area 
+                //  covered by the top node (which includes the overlap for every LOD)
+            std::unique_ptr<GradientFlagsImage> gradientFlags;
+            if (quantRange && gradFlagsSettings._enable) {
+                gradientFlags = std::make_unique<GradientFlagsImage>();
+                auto fullResDims = nodeDimensions << (treeDepth-1);
+                CalculateGradientFlags<Element>(
+                    *gradientFlags, surface, cellMins, fullResDims, fullResDims, gradFlagsSettings);
+            }
+
+                //  Build the data for every node in parallel. The nodes are
+                //  independent, and we write them out in order afterwards, so the
+                //  output is the same as building them one by one.
+            class NodeWork
+            {
+            public:
+                UInt2 _rawCoord;
+                signed _downsample;
+                std::unique_ptr<CoverageDataResult> _result;
+
+                NodeWork() {}
+                NodeWork(NodeWork&& moveFrom) : _rawCoord(moveFrom._rawCoord), _downsample(moveFrom._downsample), _result(std::move(moveFrom._result)) {}
+                NodeWork& operator=(NodeWork&& moveFrom) { _rawCoord = moveFrom._rawCoord; _downsample = moveFrom._downsample; _result = std::move(moveFrom._result); return *this; }
+            };
+            std::vector<NodeWork> nodes(nodeCount);
+            {
+                unsigned nodeIndex = 0;
+                for (unsigned l=0; l<treeDepth; ++l) {
+                    for (unsigned y=0; y<(1u<<l); ++y) {
+                        for (unsigned x=0; x<(1u<<l); ++x, ++nodeIndex) {
+                            signed downsample = treeDepth-1-l;
+                            unsigned skip = 1 << downsample;
+                            nodes[nodeIndex]._rawCoord = UInt2(
+                                cellMins[0] + x * uniqueElementsDimension * skip,
+                                cellMins[1] + y * uniqueElementsDimension * skip);
+                            nodes[nodeIndex]._downsample = downsample;
+                        }
+                    }
+                }
+                assert(nodeIndex == nodeCount);
+            }
+
+            {
+                auto& pool = ConsoleRig::GlobalServices::GetLongTaskThreadPool();
+                const unsigned rangeCount = std::min((pool.GetWorkerThreadCount()+1) * 4, unsigned(nodeCount));
+                auto* nodesPtr = AsPointer(nodes.begin());
+                auto* gradientFlagsPtr = gradientFlags.get();
+                CompletionThreadPool::TaskGroup group(pool);
+                for (unsigned r=0; r<rangeCount; ++r) {
+                        // (interleave, because the nodes in the first few levels are more expensive)
+                    group.Run(
+                        [nodesPtr, r, rangeCount, nodeCount, &surface, nodeDimensions, gradientFlagsPtr, compression]()
+                        {
+                            for (unsigned n=r; n<unsigned(nodeCount); n+=rangeCount)
+                                nodesPtr[n]._result = std::make_unique<CoverageDataResult>(
+                                    BuildCoverageData<Element>(
+                                        surface, nodesPtr[n]._rawCoord[0], nodesPtr[n]._rawCoord[1],
+                                        nodesPtr[n]._downsample, nodeDimensions, 
+                                        gradientFlagsPtr, compression));
+                        });
+                }
+                group.Wait();
+            }
 
             outputFile.BeginChunk(ChunkType_CoverageScaffold, 0, "Scaffold");
 
@@ -581,41 +896,28 @@ namespace SceneEngine
             outputFile.BeginChunk(ChunkType_CoverageData, 0, "Data");
 
             unsigned heightDataOffsetIterator = 0;
-            unsigned nodeIndex = 0;
-            for (unsigned l=0; l<treeDepth; ++l) {
-                for (unsigned y=0; y<(1u<<l); ++y) {
-                    for (unsigned x=0; x<(1u<<l); ++x, ++nodeIndex) {
-                        NodeDesc::Header nodeHdr;
-                        nodeHdr._nodeHeaderVersion = 0;
-                        nodeHdr._dimensionsInElements = uniqueElementsDimension + overlapElements;
-                        std::fill(nodeHdr._dummy, &nodeHdr._dummy[dimof(nodeHdr._dummy)], 0);
-
-                        signed downsample = treeDepth-1-l;
-                        unsigned skip = 1 << downsample;
-                        unsigned rawCoordX = cellMins[0] + x * uniqueElementsDimension * skip;
-                        unsigned rawCoordY = cellMins[1] + y * uniqueElementsDimension * skip;
-
-                        auto p = WriteCoverageData<Element>(
-                            outputFile, surface, rawCoordX, rawCoordY,
-                            downsample, uniqueElementsDimension + overlapElements, 
-                            gradFlagsSettings, compression);
-                        assert(p._compressionData.size() == compressionDataPerNode);
-
-                        nodeHdr._dataOffset = heightDataOffsetIterator;
-                        nodeHdr._dataSize = p._rawDataSize;
-                        heightDataOffsetIterator += nodeHdr._dataSize;
-
-                        nodeHdr._compressionType = compression;
-                        nodeHdr._compressionDataSize = compressionDataPerNode;
-                        nodeHdr._format = p._nativeFormat;
-
-                        auto* hdr = (NodeDesc::Header*)PtrAdd(AsPointer(nodeHeaders.begin()), nodeIndex * (sizeof(NodeDesc::Header) + compressionDataPerNode));
-                        *hdr = nodeHdr;
-                        XlCopyMemory(PtrAdd(hdr, sizeof(NodeDesc::Header)), AsPointer(p._compressionData.begin()), p._compressionData.size());
-                    }
-                }
+            for (unsigned nodeIndex=0; nodeIndex<unsigned(nodeCount); ++nodeIndex) {
+                NodeDesc::Header nodeHdr;
+                nodeHdr._nodeHeaderVersion = 0;
+                nodeHdr._dimensionsInElements = nodeDimensions;
+                std::fill(nodeHdr._dummy, &nodeHdr._dummy[dimof(nodeHdr._dummy)], 0);
+
+                auto& p = *nodes[nodeIndex]._result;
+                assert(p._compressionData.size() == compressionDataPerNode);
+                outputFile.Write(AsPointer(p._rawData.begin()), p._rawData.size(), 1);
+
+                nodeHdr._dataOffset = heightDataOffsetIterator;
+                nodeHdr._dataSize = (unsigned)p._rawData.size();
+                heightDataOffsetIterator += nodeHdr._dataSize;
+
+                nodeHdr._compressionType = compression;
+                nodeHdr._compressionDataSize = compressionDataPerNode;
+                nodeHdr._format = p._nativeFormat;
+
+                auto* hdr = (NodeDesc::Header*)PtrAdd(AsPointer(nodeHeaders.begin()), nodeIndex * (sizeof(NodeDesc::Header) + compressionDataPerNode));
+                *hdr = nodeHdr;
+                XlCopyMemory(PtrAdd(hdr, sizeof(NodeDesc::Header)), AsPointer(p._compressionData.begin()), p._compressionData.size());
             }
-            assert(nodeIndex == nodeCount);
             outputFile.FinishCurrentChunk();
 
                 // go back and write the node headers in the node header chunk
@@ -643,11 +945,15 @@ namespace SceneEngine
         const char destinationFile[], TerrainUberSurfaceGeneric& surface, 
         UInt2 cellMins, UInt2 cellMaxs, unsigned treeDepth, unsigned overlapElements) const
     {
+            // (we read whole rows of the surface at a time)
+        if (!surface.IsRowMajor())
+            Throw(::Exceptions::BasicLabel("Can't write cells from a tiled uber surface (%s)", destinationFile));
+
         if (surface.Format() == ImpliedTyping::TypeOf<float>()) {
             MainTerrainFormat::WriteCellFromUberSurface<float>(
                 destinationFile, surface, 
                 cellMins, cellMaxs, treeDepth, overlapElements, _gradFlagsSettings,
-                MainTerrainFormat::Compression::QuantRange, 
+                _compressedHeights ? MainTerrainFormat::Compression::QuantRangePredicted : MainTerrainFormat::Compression::QuantRange, 
                 std::make_pair(VersionString, BuildDateString));
         } else if (surface.Format() == ImpliedTyping::TypeOf<ShadowSample>()) {
             MainTerrainFormat::WriteCellFromUberSurface<ShadowSample>(
@@ -682,8 +988,8 @@ namespace SceneEngine
         }
     }
 
-    TerrainFormat::TerrainFormat(const GradientFlagsSettings& gradFlagsSettings)
-    : _gradFlagsSettings(gradFlagsSettings) {}
+    TerrainFormat::TerrainFormat(const GradientFlagsSettings& gradFlagsSettings, bool compressedHeights)
+    : _gradFlagsSettings(gradFlagsSettings), _compressedHeights(compressedHeights) {}
 
     TerrainFormat::~TerrainFormat() {}
 
@@ -41,11 +41,17 @@ namespace SceneEngine
             const char destinationFile[], TerrainUberSurfaceGeneric& surface, 
             UInt2 cellMins, UInt2 cellMaxs, unsigned treeDepth, unsigned overlapElements) const;
 
-        TerrainFormat(const GradientFlagsSettings& gradFlagsSettings = GradientFlagsSettings());
+            //  When "compressedHeights" is set, height nodes are written with lossless
+            //  compression (see CompressHeightMap). Otherwise they are written as raw
+            //  16 bit values
+        TerrainFormat(
+            const GradientFlagsSettings& gradFlagsSettings = GradientFlagsSettings(),
+            bool compressedHeights = true);
         ~TerrainFormat();
 
     protected:
         GradientFlagsSettings _gradFlagsSettings;
+        bool _compressedHeights;
     };
 }
 
@@ -9,6 +9,7 @@
 #include "TextureTileSet.h"
 #include "TerrainMaterialTextures.h"
 #include "TerrainScaffold.h"
+#include "TerrainCompression.h"
 
 #include "SimplePatchBox.h"
 #include "Noise.h"
@@ -498,10 +499,23 @@ namespace SceneEngine
                 auto& sourceCell = *cellRenderInfo._sourceCell;
                 auto& sourceNode = sourceCell._nodes[n];
 
+                    //  Compressed nodes are decoded in a background thread, after they
+                    //  are read from disk
+                BufferUploads::FileDataDecoder decoder;
+                if (sourceNode->_heightMapCompressed) {
+                    auto width = sourceNode->_widthInElements;
+                    decoder = [width](void* dst, size_t dstSize, const void* src, size_t srcSize) -> bool
+                        {
+                            if (dstSize != width*width*sizeof(uint16)) return false;
+                            return DecompressHeightMap((uint16*)dst, width, width, src, srcSize);
+                        };
+                }
+
                 auto& heightTile = cellRenderInfo._heightTiles[n];
                 heightTile.Queue(
                     *_heightMapTileSet, cellRenderInfo._heightMapStreamingFilePtr,
-                    unsigned(sourceNode->_heightMapFileOffset), unsigned(sourceNode->_heightMapFileSize));
+                    unsigned(sourceNode->_heightMapFileOffset), unsigned(sourceNode->_heightMapFileSize),
+                    std::move(decoder));
                 ++uploadsThisFrame;
 
                 _pendingUploads.push_back(UploadPair(&cellRenderInfo, n));
@@ -514,9 +528,21 @@ namespace SceneEngine
 
                     if (i->_flags & (Flags::NeedsCoverageUpload0<<covIndex)) {
                         auto& c = cellRenderInfo._coverage[covIndex];
+                        auto fileSize = c._source->_nodeTextureByteCount;
+                        BufferUploads::FileDataDecoder decoder;
+                        if (!c._source->_nodeCompressedSizes.empty()) {
+                            fileSize = c._source->_nodeCompressedSizes[n];
+                            auto width = c._source->_nodeWidthInElements;
+                            decoder = [width](void* dst, size_t dstSize, const void* src, size_t srcSize) -> bool
+                                {
+                                    if (dstSize != width*width*sizeof(uint16)) return false;
+                                    return DecompressHeightMap((uint16*)dst, width, width, src, srcSize);
+                                };
+                        }
+
                         c._tiles[n].Queue(
                             *_coverageTileSet[covIndex], c._streamingFilePtr, 
-                            c._source->_nodeFileOffsets[n], c._source->_nodeTextureByteCount);
+                            c._source->_nodeFileOffsets[n], fileSize, std::move(decoder));
 
                         ++uploadsThisFrame;
                         anyCoverageUploads = true;
@@ -854,7 +880,7 @@ namespace SceneEngine
             auto& sourceNode = sourceCell._nodes[n];
 
             const unsigned expectedDataSize = sourceNode->_widthInElements*sourceNode->_widthInElements*2;
-            if (std::max(sourceNode->_heightMapFileSize, sourceNode->_secondaryCacheSize) < expectedDataSize) {
+            if (std::max(sourceNode->GetHeightMapDataSize(), sourceNode->_secondaryCacheSize) < expectedDataSize) {
                     // some nodes have "holes". We have to ignore them.
                 cullResults[n - field._nodeBegin] = AABBIntersection::Culled;
             } else {
@@ -976,7 +1002,7 @@ namespace SceneEngine
             }
             
             const unsigned expectedDataSize = sourceNode->_widthInElements*sourceNode->_widthInElements*2;
-            if (std::max(sourceNode->_heightMapFileSize, sourceNode->_secondaryCacheSize) < expectedDataSize)
+            if (std::max(sourceNode->GetHeightMapDataSize(), sourceNode->_secondaryCacheSize) < expectedDataSize)
                 continue;   // some nodes have "holes". We have to ignore them.
 
                 //  we should check for valid data & required uploads. Mark the flags now, and we'll 
@@ -1285,13 +1311,14 @@ namespace SceneEngine
 
     void TerrainCellRenderer::NodeCoverageInfo::Queue(
         TextureTileSet& coverageTileSet,
-        const void* filePtr, unsigned fileOffset, unsigned fileSize)
+        const void* filePtr, unsigned fileOffset, unsigned fileSize,
+        BufferUploads::FileDataDecoder&& decoder)
     {
             // the caller should check to see if we need an upload before calling this
         assert(!coverageTileSet.IsValid(_tile));
         assert(!coverageTileSet.IsValid(_pendingTile));
         coverageTileSet.Transaction_Begin(
-            _pendingTile, filePtr, fileOffset, fileSize);
+            _pendingTile, filePtr, fileOffset, fileSize, std::move(decoder));
     }
 
     void TerrainCellRenderer::NodeCoverageInfo::EndTransactions(BufferUploads::IManager& bufferUploads)
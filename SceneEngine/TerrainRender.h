@@ -112,7 +112,9 @@ namespace SceneEngine
             TextureTile _tile;
             TextureTile _pendingTile;
 
-            void Queue(TextureTileSet& coverageTileSet, const void* filePtr, unsigned fileOffset, unsigned fileSize);
+            void Queue(
+                TextureTileSet& coverageTileSet, const void* filePtr, unsigned fileOffset, unsigned fileSize,
+                BufferUploads::FileDataDecoder&& decoder = BufferUploads::FileDataDecoder());
             bool CompleteUpload(BufferUploads::IManager& bufferUploads);
             void EndTransactions(BufferUploads::IManager& bufferUploads);
 
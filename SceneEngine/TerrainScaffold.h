@@ -39,8 +39,14 @@ namespace SceneEngine
             size_t      _secondaryCacheOffset;
             size_t      _secondaryCacheSize;
             unsigned    _widthInElements;
+            bool        _heightMapCompressed;       // (height map data in the source file is written with CompressHeightMap)
             Node(const Float4x4& localToCell, size_t heightMapFileOffset, size_t heightMapFileSize, unsigned widthInElements);
 
+                //  Size of the height map data after it has been decompressed. Nodes with
+                //  holes have less data than _widthInElements*_widthInElements
+            size_t      GetHeightMapDataSize() const;
+            bool        LoadHeightMap(Utility::BasicFile& file, uint16 dst[]) const;
+
                 //  Note -- hack here for 32x32 tiles!
             unsigned    GetOverlapWidth() const { return (_widthInElements==33)?1:2; }
         };
@@ -88,7 +94,9 @@ namespace SceneEngine
 
     protected:
         std::vector<unsigned>   _nodeFileOffsets;
-        unsigned                _nodeTextureByteCount;
+        std::vector<unsigned>   _nodeCompressedSizes;   // (empty unless the nodes were written with CompressHeightMap)
+        unsigned                _nodeTextureByteCount;  // (size after decompression)
+        unsigned                _nodeWidthInElements;
         unsigned                _fieldCount;
         std::string             _sourceFileName;
 
@@ -57,12 +57,12 @@ namespace SceneEngine
     {
         assert(_mappedFile && _dataStart);
         if (coord[0] >= _width || coord[1] >= _height) return nullptr;
-        auto stride = _width * _sampleBytes;
-        return PtrAdd(_dataStart, coord[1] * stride + coord[0] * _sampleBytes);
+        return PtrAdd(_dataStart, GetElementIndex(coord[0], coord[1]) * _sampleBytes);
     }
 
     unsigned TerrainUberSurfaceGeneric::GetStride() const 
     { 
+        assert(!_tiled);
         return _width * _sampleBytes;
     }
 
@@ -73,6 +73,8 @@ namespace SceneEngine
         _width = _height = 0;
         _dataStart = nullptr;
         _sampleBytes = 0;
+        _tiled = false;
+        _tileCountX = 0;
 
             //  Load the file as a Win32 "mapped file"
             //  the format is very simple.. it's just a basic header, and then
@@ -87,15 +89,21 @@ namespace SceneEngine
             Throw(::Assets::Exceptions::InvalidAsset(
                 filename, "Uber surface file appears to be corrupt"));
 
+        if (hdr._layout != TerrainUberHeader::Layout_RowMajor && hdr._layout != TerrainUberHeader::Layout_Tiled)
+            Throw(::Assets::Exceptions::InvalidAsset(
+                filename, "Uber surface file has an unknown layout"));
+
         _width = hdr._width;
         _height = hdr._height;
-        _dataStart = PtrAdd(mappedFile->GetData(), sizeof(TerrainUberHeader));
+        _dataStart = PtrAdd(mappedFile->GetData(), hdr.GetDataOffset());
         _format = ImpliedTyping::TypeDesc(
             ImpliedTyping::TypeCat(hdr._typeCat), 
             (uint16)hdr._typeArrayCount);
         _sampleBytes = _format.GetSize();
+        _tiled = hdr._layout == TerrainUberHeader::Layout_Tiled;
+        _tileCountX = (hdr._width + TerrainUberHeader::TileDims - 1) / TerrainUberHeader::TileDims;
 
-        if (mappedFile->GetSize() < (sizeof(TerrainUberHeader) + hdr._width * hdr._height * _sampleBytes))
+        if (mappedFile->GetSize() < (hdr.GetDataOffset() + hdr.GetDataSize()))
             Throw(::Assets::Exceptions::InvalidAsset(
                 filename, "Uber surface file appears to be corrupt (it is smaller than it should be)"));
 
@@ -106,6 +114,9 @@ namespace SceneEngine
     {
         _width = _height = 0;
         _dataStart = nullptr;
+        _sampleBytes = 0;
+        _tiled = false;
+        _tileCountX = 0;
     }
 
     TerrainUberSurfaceGeneric::~TerrainUberSurfaceGeneric()
@@ -116,6 +127,10 @@ namespace SceneEngine
     , _dataStart(moveFrom._dataStart)
     , _width(moveFrom._width)
     , _height(moveFrom._height)
+    , _format(moveFrom._format)
+    , _sampleBytes(moveFrom._sampleBytes)
+    , _tiled(moveFrom._tiled)
+    , _tileCountX(moveFrom._tileCountX)
     {
         moveFrom._dataStart = nullptr;
         moveFrom._width = moveFrom._height = 0;
@@ -127,6 +142,10 @@ namespace SceneEngine
         _width = moveFrom._width;
         _height = moveFrom._height;
         _dataStart = moveFrom._dataStart;
+        _format = moveFrom._format;
+        _sampleBytes = moveFrom._sampleBytes;
+        _tiled = moveFrom._tiled;
+        _tileCountX = moveFrom._tileCountX;
         moveFrom._dataStart = nullptr;
         moveFrom._width = moveFrom._height = 0;
         return *this;
@@ -539,7 +558,8 @@ namespace SceneEngine
         hdr._height = height;
         hdr._typeCat = (unsigned)type._type;
         hdr._typeArrayCount = type._arrayCount;
-        hdr._dummy[0] = hdr._dummy[1] = hdr._dummy[2] = 0;
+        hdr._layout = TerrainUberHeader::Layout_RowMajor;
+        hdr._dummy[0] = hdr._dummy[1] = 0;
         outputFile.Write(&hdr, sizeof(hdr), 1);
 
         unsigned lineSize = width*type.GetSize();
@@ -593,6 +613,10 @@ namespace SceneEngine
 
     GenericUberSurfaceInterface::GenericUberSurfaceInterface(TerrainUberSurfaceGeneric& uberSurface, std::shared_ptr<ITerrainFormat> ioFormat)
     {
+            //  the editing tools copy whole rows in and out of the surface
+        if (!uberSurface.IsRowMajor())
+            Throw(::Exceptions::BasicLabel("Tiled uber surfaces can't be edited. Convert to row-major layout first"));
+
         auto pimpl = std::make_unique<Pimpl>();
         pimpl->_uberSurface = &uberSurface;     // no protection on this pointer (assuming it's coming from a resource)
         pimpl->_ioFormat = std::move(ioFormat);
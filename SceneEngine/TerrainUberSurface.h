@@ -42,6 +42,10 @@ namespace SceneEngine
         unsigned GetWidth() const { return _width; }
         unsigned GetHeight() const { return _height; }
 
+            //  Rows are only contiguous in memory for row-major surfaces. GetStride() and
+            //  any code that walks along a row with a pointer requires IsRowMajor()
+        bool IsRowMajor() const { return !_tiled; }
+
         TerrainUberSurfaceGeneric(const ::Assets::ResChar filename[]);
         ~TerrainUberSurfaceGeneric();
         
@@ -55,6 +59,10 @@ namespace SceneEngine
         void* _dataStart;
         ImpliedTyping::TypeDesc _format;
         unsigned _sampleBytes; // sample size in bytes
+        bool _tiled;
+        unsigned _tileCountX;
+
+        size_t GetElementIndex(unsigned x, unsigned y) const;
     };
 
     /// <summary>Represents a single "uber" field of terrain data</summary>
@@ -74,6 +82,9 @@ namespace SceneEngine
     /// be able to manipulate it in full precision, whatever true format it is.
     /// That means we can't just cast all data to a Float4... we probably need
     /// something a little nicer than that.
+    ///
+    /// The file can be either row-major, or tiled (see TerrainUberHeader::Layout).
+    /// GetValue(), GetValueFast() and SetValue() work with both layouts.
     template <typename Type> class TerrainUberSurface : public TerrainUberSurfaceGeneric
     {
     public:
@@ -199,14 +210,64 @@ namespace SceneEngine
         void CancelActiveOperations();
     };
 
+    class TerrainUberHeader
+    {
+    public:
+        unsigned _magic;
+        unsigned _width, _height;
+        unsigned _typeCat;
+        unsigned _typeArrayCount;
+        unsigned _layout;
+        unsigned _dummy[2];
+
+        static const unsigned Magic = 0xa4d3e4c3;
+
+            //  In the "Tiled" layout, the surface is split into TileDims x TileDims blocks,
+            //  and each block is stored contiguously (blocks and the elements within them
+            //  are in row-major order). Blocks on the right and bottom edges are padded to
+            //  full size. The data is aligned to TiledDataOffset, so that blocks of 32 bit
+            //  elements fall on page boundaries. Nearby elements are nearby in the file, so
+            //  walking through the surface in any direction touches few pages.
+        enum Layout { Layout_RowMajor = 0, Layout_Tiled = 1 };
+        static const unsigned TileDims = 64;
+        static const unsigned TiledDataOffset = 4096;
+
+        size_t GetDataOffset() const;
+        size_t GetDataSize() const;
+    };
+
         ///////////////   I N L I N E   I M P L E M E N T A T I O N S   ///////////////
 
+    inline size_t TerrainUberHeader::GetDataOffset() const
+    {
+        return (_layout == Layout_Tiled) ? TiledDataOffset : sizeof(TerrainUberHeader);
+    }
+
+    inline size_t TerrainUberHeader::GetDataSize() const
+    {
+        auto sampleBytes = ImpliedTyping::TypeDesc(ImpliedTyping::TypeCat(_typeCat), (uint16)_typeArrayCount).GetSize();
+        if (_layout == Layout_Tiled) {
+            size_t tileCountX = (_width + TileDims - 1) / TileDims, tileCountY = (_height + TileDims - 1) / TileDims;
+            return tileCountX * tileCountY * TileDims * TileDims * sampleBytes;
+        }
+        return size_t(_width) * size_t(_height) * sampleBytes;
+    }
+
+    inline size_t TerrainUberSurfaceGeneric::GetElementIndex(unsigned x, unsigned y) const
+    {
+        if (_tiled) {
+            const unsigned tileDims = TerrainUberHeader::TileDims;
+            auto tile = (y / tileDims) * _tileCountX + (x / tileDims);
+            return size_t(tile) * (tileDims * tileDims) + (y % tileDims) * tileDims + (x % tileDims);
+        }
+        return size_t(y) * _width + x;
+    }
+
     inline void* TerrainUberSurfaceGeneric::GetDataFast(UInt2 coord)
     {
         assert(_mappedFile && _dataStart);
         assert(coord[0] < _width && coord[1] < _height);
-        auto stride = _width * _sampleBytes;
-        return PtrAdd(_dataStart, coord[1] * stride + coord[0] * _sampleBytes);
+        return PtrAdd(_dataStart, GetElementIndex(coord[0], coord[1]) * _sampleBytes);
     }
 
     namespace Internal
@@ -221,7 +282,7 @@ namespace SceneEngine
         assert(_mappedFile && _dataStart);
         if (y >= _height || x >= _width)
             return Internal::DummyValue<Type>();
-        return ((Type*)_dataStart)[y*_width+x];
+        return ((Type*)_dataStart)[GetElementIndex(x, y)];
     }
 
     template <typename Type>
@@ -229,7 +290,7 @@ namespace SceneEngine
     {
         assert(_mappedFile && _dataStart);
         if (y < _height && x < _width) {
-            ((Type*)_dataStart)[y*_width+x] = newValue;
+            ((Type*)_dataStart)[GetElementIndex(x, y)] = newValue;
         }
     }
 
@@ -238,19 +299,7 @@ namespace SceneEngine
     {
         assert(_mappedFile && _dataStart);
         assert(y < _height && x < _width);
-        return ((Type*)_dataStart)[y*_width+x];
+        return ((Type*)_dataStart)[GetElementIndex(x, y)];
     }
 
-    class TerrainUberHeader
-    {
-    public:
-        unsigned _magic;
-        unsigned _width, _height;
-        unsigned _typeCat;
-        unsigned _typeArrayCount;
-        unsigned _dummy[3];
-
-        static const unsigned Magic = 0xa4d3e4c3;
-    };
-
 }
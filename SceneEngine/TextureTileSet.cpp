@@ -83,7 +83,8 @@ namespace SceneEngine
 
     void    TextureTileSet::Transaction_Begin(
                 TextureTile& tile,
-                const void* fileHandle, size_t offset, size_t dataSize)
+                const void* fileHandle, size_t offset, size_t dataSize,
+                BufferUploads::FileDataDecoder&& decoder)
     {
         CompleteCreation();
         if (!_resource || _resource->IsEmpty()) {
@@ -164,8 +165,14 @@ namespace SceneEngine
         const unsigned rowPitch = Metal::BitsPerPixel(_format) * _elementSize[0] / 8;
         const unsigned slicePitch = rowPitch * _elementSize[1];
 
-        auto dataPacket = BufferUploads::CreateFileDataSource(
-            fileHandle, offset, dataSize, BufferUploads::TexturePitches(rowPitch, slicePitch));
+            //  When there's a decoder, the data in the file is compressed, and is 
+            //  decoded into a full tile
+        auto dataPacket = decoder 
+            ? BufferUploads::CreateFileDataSource(
+                fileHandle, offset, dataSize, BufferUploads::TexturePitches(rowPitch, slicePitch),
+                std::move(decoder), slicePitch)
+            : BufferUploads::CreateFileDataSource(
+                fileHandle, offset, dataSize, BufferUploads::TexturePitches(rowPitch, slicePitch));
         _bufferUploads->UpdateData(
             tile._transaction, dataPacket.get(),
             BufferUploads::PartialResource(destinationBox, 0, 0, address[2]));
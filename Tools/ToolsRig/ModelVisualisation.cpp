@@ -207,7 +207,7 @@ namespace ToolsRig
         ModelSceneParser sceneParser(
             *_pimpl->_settings, *_pimpl->_envSettings,
             *model._renderer, model._boundingBox, *model._sharedStateSet,
-            model._model);
+            model._model.get());
         sceneParser.Prepare();
         LightingParser_ExecuteScene(
             *context, parserContext, sceneParser,
@@ -318,7 +318,7 @@ namespace ToolsRig
 
                 RenderWithEmbeddedSkeleton(
                     RenderCore::Assets::ModelRendererContext(metalContext.get(), parserContext, techniqueIndex),
-                    *model._renderer, *model._sharedStateSet, model._model);
+                    *model._renderer, *model._sharedStateSet, model._model.get());
 
                 if (model._sharedStateSet) {
                     model._sharedStateSet->ReleaseState(metalContext.get());
@@ -348,7 +348,7 @@ namespace ToolsRig
 
                 RenderWithEmbeddedSkeleton(
                     RenderCore::Assets::ModelRendererContext(metalContext.get(), parserContext, techniqueIndex),
-                    *model._renderer, *model._sharedStateSet, model._model);
+                    *model._renderer, *model._sharedStateSet, model._model.get());
 
                 if (model._sharedStateSet) {
                     model._sharedStateSet->ReleaseState(metalContext.get());
@@ -428,7 +428,7 @@ namespace ToolsRig
         model._sharedStateSet->CaptureState(metalContext.get());
         RenderWithEmbeddedSkeleton(
             RenderCore::Assets::ModelRendererContext(metalContext.get(), parserContext, 6),
-            *model._renderer, *model._sharedStateSet, model._model);
+            *model._renderer, *model._sharedStateSet, model._model.get());
         model._sharedStateSet->ReleaseState(metalContext.get());
 
         auto results = stateContext.GetResults();
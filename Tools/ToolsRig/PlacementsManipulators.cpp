@@ -1120,17 +1120,22 @@ namespace ToolsRig
             //  Now add new placements for all of these pts.
             //  We need to clamp them to the terrain surface as we do this
 
-        for (auto p=noisyPts.begin(); p!=noisyPts.end(); ++p) {
-            Float2 pt = *p + Truncate(centre);
-            float height = 0.f;
-            auto terrain = hitTestScene.GetTerrain().get();
-            if (terrain) {
-                height = SceneEngine::GetTerrainHeight(
-                    *terrain->GetFormat().get(), terrain->GetConfig(), terrain->GetCoords(), pt);
-            }
-
-            _spawnPositions.push_back(Expand(pt, height));
+        std::vector<Float2> pts;
+        pts.reserve(noisyPts.size());
+        for (auto p=noisyPts.begin(); p!=noisyPts.end(); ++p)
+            pts.push_back(*p + Truncate(centre));
+
+        std::vector<float> heights(pts.size(), 0.f);
+        auto terrain = hitTestScene.GetTerrain().get();
+        if (terrain && !pts.empty()) {
+            SceneEngine::GetTerrainHeights(
+                AsPointer(heights.begin()), nullptr,
+                *terrain->GetFormat().get(), terrain->GetConfig(), terrain->GetCoords(), 
+                AsPointer(pts.cbegin()), pts.size());
         }
+
+        for (size_t c=0; c<pts.size(); ++c)
+            _spawnPositions.push_back(Expand(pts[c], heights[c]));
     }
 
     void ScatterPlacements::PerformScatter(
@@ -22,6 +22,8 @@
 #include "../../Utility/StringFormat.h"
 #include "../../Utility/Streams/FileUtils.h"
 #include "../../Utility/Streams/PathUtils.h"
+#include "../../Utility/SystemUtils.h"
+#include "../../Utility/MemoryUtils.h"
 #include "../../Utility/Conversion.h"
 #include "../../Utility/Threading/ThreadingUtils.h"
 #include <vector>
@@ -183,6 +185,66 @@ namespace ToolsRig
         }
     }
     
+    void ConvertUberSurfaceLayout(
+        const ::Assets::ResChar dstFile[], const ::Assets::ResChar srcFile[],
+        bool tiledLayout, ConsoleRig::IProgress* progress)
+    {
+        TerrainUberSurfaceGeneric src(srcFile);
+
+        TerrainUberHeader hdr;
+        hdr._magic = TerrainUberHeader::Magic;
+        hdr._width = src.GetWidth();
+        hdr._height = src.GetHeight();
+        hdr._typeCat = unsigned(src.Format()._type);
+        hdr._typeArrayCount = src.Format()._arrayCount;
+        hdr._layout = tiledLayout ? TerrainUberHeader::Layout_Tiled : TerrainUberHeader::Layout_RowMajor;
+        hdr._dummy[0] = hdr._dummy[1] = 0;
+
+        {
+            MemoryMappedFile dstFileData(dstFile, hdr.GetDataOffset() + hdr.GetDataSize(), MemoryMappedFile::Access::Write);
+            if (!dstFileData.IsValid())
+                Throw(::Exceptions::BasicLabel("Couldn't open output file (%s)", dstFile));
+            *(TerrainUberHeader*)dstFileData.GetData() = hdr;
+        }
+
+            //  Reopen the output as an uber surface, so the addressing is the same
+            //  as everywhere else. In both layouts, each row within a tile is contiguous.
+            //  So we can walk through one band of tiles at a time, and copy whole tile rows.
+        TerrainUberSurfaceGeneric dst(dstFile);
+        const unsigned tileDims = TerrainUberHeader::TileDims;
+        const auto sampleBytes = src.Format().GetSize();
+        const unsigned bandCount = (hdr._height + tileDims - 1) / tileDims;
+
+        auto step = progress ? progress->BeginStep("Convert uber surface layout", bandCount, false) : nullptr;
+        for (unsigned band=0; band<bandCount; ++band) {
+            auto yEnd = std::min((band+1)*tileDims, hdr._height);
+            for (unsigned x=0; x<hdr._width; x+=tileDims) {
+                auto run = std::min(tileDims, hdr._width - x);
+                for (unsigned y=band*tileDims; y<yEnd; ++y)
+                    XlCopyMemory(dst.GetDataFast(UInt2(x, y)), src.GetDataFast(UInt2(x, y)), run * sampleBytes);
+            }
+            if (step) step->Advance();
+        }
+    }
+
+        //  Deletes a file when it goes out of scope (including during exception unwinding)
+    class TemporaryFile
+    {
+    public:
+        const ::Assets::ResChar* Get() const { return _filename; }
+
+        TemporaryFile(const ::Assets::ResChar filename[]) { XlCopyString(_filename, filename); }
+        ~TemporaryFile() { XlDeleteFile((const utf8*)_filename); }
+    private:
+        ::Assets::ResChar _filename[MaxPath];
+
+        TemporaryFile(const TemporaryFile&);
+        TemporaryFile& operator=(const TemporaryFile&);
+    };
+
+        //  Row-major heights smaller than this are used directly by the terrain operators
+    static const size_t TiledCopyMinimumSize = 512 * 1024 * 1024;
+
     static void GenerateSurface(
         ITerrainOp& op, TerrainCoverageId coverageId,
         const TerrainConfig& cfg, 
@@ -202,8 +264,27 @@ namespace ToolsRig
                 // this is the shadows layer... We need to build the shadows procedurally
             ::Assets::ResChar uberHeightsFile[MaxPath];
             TerrainConfig::GetUberSurfaceFilename(uberHeightsFile, dimof(uberHeightsFile), uberSurfaceDir, CoverageId_Heights);
-            TerrainUberHeightsSurface heightsData(uberHeightsFile);
-            HeightsUberSurfaceInterface uberSurfaceInterface(heightsData);
+
+                //  The operators walk through the heights along long lines and around
+                //  large areas. In a row-major file, every step in y is a different page.
+                //  For large surfaces, we calculate from a temporary tiled copy of the heights
+                //  (which is much kinder to the page cache when the surface is larger than memory).
+                //  Tiled and small surfaces are used directly.
+            bool needsTiledCopy;
+            {
+                TerrainUberSurfaceGeneric heights(uberHeightsFile);
+                needsTiledCopy = heights.IsRowMajor()
+                    && (size_t(heights.GetWidth()) * size_t(heights.GetHeight()) * heights.Format().GetSize()) >= TiledCopyMinimumSize;
+            }
+
+            std::unique_ptr<TemporaryFile> tiledHeightsFile;
+            if (needsTiledCopy) {
+                ::Assets::ResChar tiledFilename[MaxPath];
+                XlCopyString(tiledFilename, uberHeightsFile);
+                XlCatString(tiledFilename, dimof(tiledFilename), ".tiled");
+                tiledHeightsFile = std::make_unique<TemporaryFile>(tiledFilename);
+                ConvertUberSurfaceLayout(tiledFilename, uberHeightsFile, true, progress);
+            }
 
             //////////////////////////////////////////////////////////////////////////////////////
                 // build the uber shadowing file, and then write out the shadowing textures for each node
@@ -219,13 +300,15 @@ namespace ToolsRig
 
             //////////////////////////////////////////////////////////////////////////////////////
                 
-            BuildUberSurface(
-                shadowUberFn, op, 
-                *uberSurfaceInterface.GetUberSurface(), interestingMins, interestingMaxs, 
-                cfg.ElementSpacing(), shadowToHeightsScale, 
-                TerrainOpConfig(),
-                progress);
-
+            {
+                TerrainUberHeightsSurface heightsData(tiledHeightsFile ? tiledHeightsFile->Get() : uberHeightsFile);
+                BuildUberSurface(
+                    shadowUberFn, op, 
+                    heightsData, interestingMins, interestingMaxs, 
+                    cfg.ElementSpacing(), shadowToHeightsScale, 
+                    TerrainOpConfig(),
+                    progress);
+            }
         }
 
         //////////////////////////////////////////////////////////////////////////////////////
@@ -242,8 +325,9 @@ namespace ToolsRig
         ConsoleRig::IProgress* progress)
     {
         Float2 sunAxisOfMovement(XlCos(cfg.SunPathAngle()), XlSin(cfg.SunPathAngle()));
+            //  It seems that around 1000 is needed for very long shadows. At 200, shadows get clipped off too soon.
         const float shadowSearchDistance = 1000.f;
-        AngleBasedShadowsOperator op(sunAxisOfMovement, shadowSearchDistance);
+        HorizonSweepShadowsOperator op(sunAxisOfMovement, shadowSearchDistance);
         
         GenerateSurface(
             op, CoverageId_AngleBasedShadows,
@@ -567,7 +651,8 @@ namespace ToolsRig
         hdr._height = finalDims[1];
         hdr._typeCat = (unsigned)dstType;
         hdr._typeArrayCount = 1;
-        hdr._dummy[0] = hdr._dummy[1] = hdr._dummy[2]  = 0;
+        hdr._layout = TerrainUberHeader::Layout_RowMajor;
+        hdr._dummy[0] = hdr._dummy[1]  = 0;
 
         void* outputArray = PtrAdd(outputUberFile.GetData(), sizeof(TerrainUberHeader));
 
@@ -749,6 +834,9 @@ namespace ToolsRig
             Throw(::Exceptions::BasicLabel("Could not find input file (%s)", srcFN));
 
         TerrainUberSurfaceGeneric uberSurface(srcFN);
+        if (!uberSurface.IsRowMajor())
+            Throw(::Exceptions::BasicLabel("Tiled uber surfaces can't be exported. Convert to row-major layout first (%s)", srcFN));
+
         auto step = 
               progress 
             ? progress->BeginStep("Create uber surface data", uberSurface.GetHeight(), true)
@@ -837,7 +925,8 @@ namespace ToolsRig
         hdr._height = finalDims[1];
         hdr._typeCat = (unsigned)ImpliedTyping::TypeCat::Float;
         hdr._typeArrayCount = 1;
-        hdr._dummy[0] = hdr._dummy[1] = hdr._dummy[2]  = 0;
+        hdr._layout = TerrainUberHeader::Layout_RowMajor;
+        hdr._dummy[0] = hdr._dummy[1]  = 0;
 
         float* outputArray = (float*)PtrAdd(outputUberFile.GetData(), sizeof(TerrainUberHeader));
         std::fill(
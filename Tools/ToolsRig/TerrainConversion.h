@@ -80,6 +80,12 @@ namespace ToolsRig
         unsigned destNodeDims, unsigned destCellTreeDepth,
         ConsoleRig::IProgress* progress = nullptr);
 
+    /// <summary>Generates the shadows uber surface from the heights</summary>
+    /// (GenerateAmbientOcclusionSurface works in the same way.)
+    /// When the heights uber surface is large and row-major, a temporary tiled copy of it
+    /// is written next to it (with a ".tiled" extension) while the surface is calculated. So
+    /// there must be enough disk space for a second copy of the heights. The copy is always
+    /// deleted afterwards, even on errors.
     void GenerateShadowsSurface(
         const SceneEngine::TerrainConfig& cfg, 
         const ::Assets::ResChar uberSurfaceDir[],
@@ -92,6 +98,15 @@ namespace ToolsRig
         bool overwriteExisting,
         ConsoleRig::IProgress* progress = nullptr);
 
+    /// <summary>Rewrites an uber surface file in either the row-major or tiled layout</summary>
+    /// See SceneEngine::TerrainUberHeader for a description of the layouts. Tiled surfaces
+    /// can be used as inputs for the terrain operators, but not for editing or exporting.
+    void ConvertUberSurfaceLayout(
+        const ::Assets::ResChar dstFile[],
+        const ::Assets::ResChar srcFile[],
+        bool tiledLayout,
+        ConsoleRig::IProgress* progress = nullptr);
+
     UInt2 GetCellCountFromUberSurface(
         const ::Assets::ResChar inputUberSurfaceDirectory[],
         UInt2 destNodeDims, unsigned destCellTreeDepth);
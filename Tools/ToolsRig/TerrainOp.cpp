@@ -18,24 +18,6 @@ namespace ToolsRig
 {
     using namespace SceneEngine;
 
-    class UberSurfaceWriter
-    {
-    public:
-        void* GetData();
-        const void* GetData() const;
-
-        UberSurfaceWriter(
-            const ::Assets::ResChar outFile[],
-            UInt2 dims,
-            ImpliedTyping::TypeDesc format);
-        ~UberSurfaceWriter();
-
-        UberSurfaceWriter& operator=(const UberSurfaceWriter&) = delete;
-        UberSurfaceWriter(const UberSurfaceWriter&) = delete;
-    protected:
-        MemoryMappedFile _file;
-    };
-
     void* UberSurfaceWriter::GetData()              { return PtrAdd(_file.GetData(), sizeof(TerrainUberHeader)); }
     const void* UberSurfaceWriter::GetData() const  { return PtrAdd(_file.GetData(), sizeof(TerrainUberHeader)); }
 
@@ -55,13 +37,22 @@ namespace ToolsRig
         hdr._height = dims[1];
         hdr._typeCat = unsigned(format._type);
         hdr._typeArrayCount = format._arrayCount;
-        hdr._dummy[0] = hdr._dummy[1] = hdr._dummy[2] = 0;
+        hdr._layout = TerrainUberHeader::Layout_RowMajor;
+        hdr._dummy[0] = hdr._dummy[1] = 0;
 
         *(TerrainUberHeader*)_file.GetData() = hdr;
     }
 
     UberSurfaceWriter::~UberSurfaceWriter() {}
 
+    bool ITerrainOp::CalculateSurface(
+        void* dst, size_t dstRowPitch, Int2 mins, Int2 maxs,
+        SceneEngine::TerrainUberHeightsSurface& heightsSurface, float xyScale, float relativeResolution,
+        const TerrainOpConfig& cfg, ConsoleRig::IProgress* progress) const
+    {
+        return false;
+    }
+
     void BuildUberSurface(
         const ::Assets::ResChar destinationFile[],
         ITerrainOp& op,
@@ -82,66 +73,94 @@ namespace ToolsRig
         {
             UberSurfaceWriter writer(tempFile.get(), outDims, outFormat);
 
-            auto step = progress ? progress->BeginStep(op.GetName(), outDims[1], true) : nullptr;
-
             const int border = int(2.f / relativeResolution);
             void* linesDest = writer.GetData();
             auto lineSize = outDims[0]*bpp/8;
-            
-            auto lineCount = int(outDims[1])-border;
-            Interlocked::Value queueLoc = border;
-
-            auto threadFunction = 
-                [   &queueLoc, &interestingMins, &interestingMaxs, 
-                    border, &outDims, relativeResolution,
-                    bpp, &heightsSurface, xyScale, &op, 
-                    linesDest, lineSize, lineCount, &step]()
-                {
-                    auto lineOfSamples = std::make_unique<char[]>(lineSize);
-                    op.FillDefault(lineOfSamples.get(), outDims[0]);
 
-                    for (;;) {
-                        auto y = Interlocked::Increment(&queueLoc);
-                        if (y >= lineCount) return;
-
-                        if (y >= interestingMins[1] && y < interestingMaxs[1]) {
-                            for (   int x=std::max(interestingMins[0], border); 
-                                    x<std::min(interestingMaxs[0], int(outDims[0])-border); 
-                                    ++x) {
-
-                                    Float2 coord = Float2(float(x), float(y)) * relativeResolution;
-                                    op.Calculate(PtrAdd(lineOfSamples.get(), x*bpp/8), coord, heightsSurface, xyScale);
-                                }
-                        } else {
-                            op.FillDefault(
-                                PtrAdd(lineOfSamples.get(), interestingMins[0]*bpp/8), 
-                                std::min(interestingMaxs[0]+1, int(outDims[0])) - interestingMins[0]);
-                        }
+                //  Some operations calculate the whole surface at once. They only write
+                //  to the calculated area, so we need to fill in the rest afterwards
+            Int2 calculateMins(std::max(interestingMins[0], border), std::max(interestingMins[1], border));
+            Int2 calculateMaxs(
+                std::min(interestingMaxs[0], int(outDims[0])-border), 
+                std::min(interestingMaxs[1], int(outDims[1])-border));
+            bool calculatedSurface = 
+                    calculateMins[0] < calculateMaxs[0] && calculateMins[1] < calculateMaxs[1]
+                &&  op.CalculateSurface(
+                        linesDest, lineSize, calculateMins, calculateMaxs, 
+                        heightsSurface, xyScale, relativeResolution, cfg, progress);
+
+            if (calculatedSurface) {
+                auto lineOfSamples = std::make_unique<char[]>(lineSize);
+                op.FillDefault(lineOfSamples.get(), outDims[0]);
 
+                for (int y=0; y<int(outDims[1]); ++y) {
+                    if (y >= calculateMins[1] && y < calculateMaxs[1]) {
+                        XlCopyMemory(PtrAdd(linesDest, y*lineSize), lineOfSamples.get(), calculateMins[0]*bpp/8);
+                        XlCopyMemory(
+                            PtrAdd(linesDest, y*lineSize + calculateMaxs[0]*bpp/8), lineOfSamples.get(), 
+                            (outDims[0]-calculateMaxs[0])*bpp/8);
+                    } else {
                         XlCopyMemory(PtrAdd(linesDest, y*lineSize), lineOfSamples.get(), lineSize);
-                        if (step) {
-                            step->Advance();
-                            if (step->IsCancelled()) return;
-                        }
                     }
-                };
+                }
+            } else {
+                auto step = progress ? progress->BeginStep(op.GetName(), outDims[1], true) : nullptr;
+
+                auto lineCount = int(outDims[1])-border;
+                Interlocked::Value queueLoc = border;
+
+                auto threadFunction = 
+                    [   &queueLoc, &interestingMins, &interestingMaxs, 
+                        border, &outDims, relativeResolution,
+                        bpp, &heightsSurface, xyScale, &op, 
+                        linesDest, lineSize, lineCount, &step]()
+                    {
+                        auto lineOfSamples = std::make_unique<char[]>(lineSize);
+                        op.FillDefault(lineOfSamples.get(), outDims[0]);
+
+                        for (;;) {
+                            auto y = Interlocked::Increment(&queueLoc);
+                            if (y >= lineCount) return;
+
+                            if (y >= interestingMins[1] && y < interestingMaxs[1]) {
+                                for (   int x=std::max(interestingMins[0], border); 
+                                        x<std::min(interestingMaxs[0], int(outDims[0])-border); 
+                                        ++x) {
+
+                                        Float2 coord = Float2(float(x), float(y)) * relativeResolution;
+                                        op.Calculate(PtrAdd(lineOfSamples.get(), x*bpp/8), coord, heightsSurface, xyScale);
+                                    }
+                            } else {
+                                op.FillDefault(
+                                    PtrAdd(lineOfSamples.get(), interestingMins[0]*bpp/8), 
+                                    std::min(interestingMaxs[0]+1, int(outDims[0])) - interestingMins[0]);
+                            }
+
+                            XlCopyMemory(PtrAdd(linesDest, y*lineSize), lineOfSamples.get(), lineSize);
+                            if (step) {
+                                step->Advance();
+                                if (step->IsCancelled()) return;
+                            }
+                        }
+                    };
 
-            std::vector<std::thread> threads;
-            for (unsigned c=0; c<std::max(1u, cfg._maxThreadCount); ++c)
-                threads.emplace_back(std::thread(threadFunction));
+                std::vector<std::thread> threads;
+                for (unsigned c=0; c<std::max(1u, cfg._maxThreadCount); ++c)
+                    threads.emplace_back(std::thread(threadFunction));
 
-            for (auto&t : threads) t.join();
+                for (auto&t : threads) t.join();
 
-            // fill in the border and any other space untouched...
-            {
-                auto lineOfSamples = std::make_unique<char[]>(lineSize);
-                op.FillDefault(lineOfSamples.get(), outDims[0]);
+                // fill in the border and any other space untouched...
+                {
+                    auto lineOfSamples = std::make_unique<char[]>(lineSize);
+                    op.FillDefault(lineOfSamples.get(), outDims[0]);
 
-                for (int y=0;y<border;++y)
-                    XlCopyMemory(PtrAdd(linesDest, y*lineSize), lineOfSamples.get(), lineSize);
+                    for (int y=0;y<border;++y)
+                        XlCopyMemory(PtrAdd(linesDest, y*lineSize), lineOfSamples.get(), lineSize);
 
-                for (; queueLoc<int(outDims[1]); ++queueLoc)
-                    XlCopyMemory(PtrAdd(linesDest, queueLoc*lineSize), lineOfSamples.get(), lineSize);
+                    for (; queueLoc<int(outDims[1]); ++queueLoc)
+                        XlCopyMemory(PtrAdd(linesDest, queueLoc*lineSize), lineOfSamples.get(), lineSize);
+                }
             }
         }
 
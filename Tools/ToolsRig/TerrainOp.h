@@ -8,6 +8,7 @@
 
 #include "../../Assets/AssetsCore.h"
 #include "../../Math/Vector.h"
+#include "../../Utility/Streams/FileUtils.h"
 
 namespace SceneEngine 
 { 
@@ -19,6 +20,8 @@ namespace Utility { namespace ImpliedTyping { class TypeDesc; }}
 
 namespace ToolsRig
 {
+    class TerrainOpConfig;
+
     /// <summary>Terrain operation that executes on heights</summary>
     /// This is an interface class for simple terrain operations
     /// (like shadows and ambient occlusion).
@@ -34,9 +37,16 @@ namespace ToolsRig
         virtual ImpliedTyping::TypeDesc GetOutputFormat() const = 0;
         virtual void FillDefault(void* dst, unsigned count) const = 0;
         virtual const char* GetName() const = 0;
-    };
 
-    class TerrainOpConfig;
+            //  Some operations can share work between neighbouring samples. They can
+            //  override this to calculate every sample in [mins, maxs) in a single call
+            //  (writing into "dst", which has the same layout as the output surface).
+            //  Returns false if the operation only supports Calculate().
+        virtual bool CalculateSurface(
+            void* dst, size_t dstRowPitch, Int2 mins, Int2 maxs,
+            SceneEngine::TerrainUberHeightsSurface& heightsSurface, float xyScale, float relativeResolution,
+            const TerrainOpConfig& cfg, ConsoleRig::IProgress* progress) const;
+    };
 
     void BuildUberSurface(
         const ::Assets::ResChar destinationFile[],
@@ -55,5 +65,26 @@ namespace ToolsRig
         TerrainOpConfig();
     };
 
+    /// <summary>Creates a new row-major uber surface file</summary>
+    /// The file is memory mapped; write the samples to GetData() before
+    /// the writer is destroyed.
+    class UberSurfaceWriter
+    {
+    public:
+        void* GetData();
+        const void* GetData() const;
+
+        UberSurfaceWriter(
+            const ::Assets::ResChar outFile[],
+            UInt2 dims,
+            ImpliedTyping::TypeDesc format);
+        ~UberSurfaceWriter();
+
+        UberSurfaceWriter& operator=(const UberSurfaceWriter&) = delete;
+        UberSurfaceWriter(const UberSurfaceWriter&) = delete;
+    protected:
+        MemoryMappedFile _file;
+    };
+
 }
 
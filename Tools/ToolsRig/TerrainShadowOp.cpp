@@ -8,6 +8,11 @@
 #include "../../SceneEngine/TerrainUberSurface.h"
 #include "../../Math/Geometry.h"
 #include "../../Utility/ParameterBox.h"
+#include "../../Utility/PtrUtils.h"
+#include "../../Utility/Threading/ThreadingUtils.h"
+#include "../../ConsoleRig/IProgress.h"
+#include <thread>
+#include <algorithm>
 
 namespace ToolsRig
 {
@@ -125,6 +130,27 @@ namespace ToolsRig
         return XlATan2(1.f, grad);
     }
 
+    static ShadowSample MakeShadowSample(float a0, float a1)
+    {
+            // Both a0 and a1 should be positive. But we'll negate a0 before we use it for a comparison
+        assert(a0 > 0.f && a1 > 0.f);
+
+            //
+            //      The "expansion constant" helps prevent shadows creaping up on peaks.
+            //      Peaks (especially sharp peaks) shouldn't receive shadows until the sun is >90 degrees, or <-90 degrees.
+            //      But if we clamp the direction at +-90, shadow will start to the creep
+            //      up on the peak when the sun gets near 90 degrees. We want to prevent the
+            //      shadow from behaving like this -- which we can do by clamping the angle
+            //      beyond 90.
+            //
+        const float expansionConstant = 1.5f;
+        const float conversionConstant = float(0xffff) / (.5f * expansionConstant * float(M_PI));
+
+        return ShadowSample(
+            (int16)Clamp(a0 * conversionConstant, 0.f, float(0xffff)),
+            (int16)Clamp(a1 * conversionConstant, 0.f, float(0xffff)));
+    }
+
     void AngleBasedShadowsOperator::Calculate(
         void* dst, Float2 coord, 
         SceneEngine::TerrainUberHeightsSurface& heightsSurface, float xyScale) const
@@ -163,33 +189,17 @@ namespace ToolsRig
             //      We want to write to a real big file... So here's what we'll do.
             //          Lets do 1 line at a time, and write each line to the file in one write operation
             //
-            //      If we wanted to improve this, we could twiddle the data in the texture. This would
-            //      mean that samples that are close to each other in physical space are more likely to
-            //      be close in the file.
+            //      Samples that are close to each other in physical space are only close in the file
+            //      when the heights surface uses the tiled layout (see TerrainUberHeader). GenerateSurface
+            //      makes a tiled copy of large row-major heights (see TiledCopyMinimumSize) before
+            //      running operators like this one. Smaller surfaces are used in whatever layout they have.
             //
 
         float a0 = CalculateShadowingAngleForSun(
             heightsSurface, coord, -_sunDirectionOfMovement, _searchDistance, xyScale);
         float a1 = CalculateShadowingAngleForSun(
             heightsSurface, coord,  _sunDirectionOfMovement, _searchDistance, xyScale);
-
-            // Both a0 and a1 should be positive. But we'll negate a0 before we use it for a comparison
-        assert(a0 > 0.f && a1 > 0.f);
-
-            //
-            //      The "expansion constant" helps prevent shadows creaping up on peaks.
-            //      Peaks (especially sharp peaks) shouldn't receive shadows until the sun is >90 degrees, or <-90 degrees.
-            //      But if we clamp the direction at +-90, shadow will start to the creep
-            //      up on the peak when the sun gets near 90 degrees. We want to prevent the
-            //      shadow from behaving like this -- which we can do by clamping the angle
-            //      beyond 90.
-            //
-        const float expansionConstant = 1.5f;
-        const float conversionConstant = float(0xffff) / (.5f * expansionConstant * float(M_PI));
-
-        *(ShadowSample*)dst = ShadowSample(
-            (int16)Clamp(a0 * conversionConstant, 0.f, float(0xffff)),
-            (int16)Clamp(a1 * conversionConstant, 0.f, float(0xffff)));
+        *(ShadowSample*)dst = MakeShadowSample(a0, a1);
     }
 
     ImpliedTyping::TypeDesc AngleBasedShadowsOperator::GetOutputFormat() const
@@ -218,6 +228,395 @@ namespace ToolsRig
 
     AngleBasedShadowsOperator::~AngleBasedShadowsOperator() {}
 
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    namespace HorizonSweep
+    {
+        class ProfilePoint
+        {
+        public:
+            float _t, _height;      // "_t" is the distance along the line
+        };
+
+        class QuerySample
+        {
+        public:
+            ProfilePoint _pt;
+            float _forwardLimit, _backwardLimit;
+            Int2 _sample;
+        };
+
+            //  Finds every point where the line crosses a grid edge (in order of increasing t),
+            //  and interpolates the height along that edge. These are the same points that
+            //  ShadowingAngleOperator uses. We can't use GridEdgeIterator2 here, because it's
+            //  only accurate when the start point is on a grid vertex.
+        static void CollectProfile(
+            std::vector<ProfilePoint>& points, TerrainUberHeightsSurface& surface,
+            Float2 origin, Float2 direction, float tMin, float tMax)
+        {
+            points.clear();
+
+            int gridLine[2], gridStep[2];
+            float tNext[2];
+            for (unsigned a=0; a<2; ++a) {
+                if (XlAbs(direction[a]) < 1e-6f) { tNext[a] = FLT_MAX; gridLine[a] = gridStep[a] = 0; continue; }
+                    // (small epsilon to make sure we get a crossing that is exactly on tMin)
+                float start = origin[a] + tMin * direction[a];
+                gridStep[a] = (direction[a] > 0.f) ? 1 : -1;
+                gridLine[a] = (direction[a] > 0.f) ? int(XlCeil(start - 1e-4f)) : int(XlFloor(start + 1e-4f));
+                tNext[a] = (float(gridLine[a]) - origin[a]) / direction[a];
+            }
+
+            for (;;) {
+                unsigned a = (tNext[0] <= tNext[1]) ? 0 : 1, b = 1-a;
+                float t = tNext[a];
+                if (t > tMax) break;
+
+                float v = origin[b] + t * direction[b];
+                int j = int(XlFloor(v));
+                float alpha = v - float(j);
+
+                UInt2 s0, s1;
+                s0[a] = s1[a] = unsigned(gridLine[a]);
+                s0[b] = unsigned(j); s1[b] = unsigned(j+1);
+                float h0 = surface.GetValueFast(s0[0], s0[1]);
+                float h1 = surface.GetValueFast(s1[0], s1[1]);
+
+                ProfilePoint pt;
+                pt._t = t;
+                pt._height = LinearInterpolate(h0, h1, alpha);
+                points.push_back(pt);
+
+                gridLine[a] += gridStep[a];
+                tNext[a] = (float(gridLine[a]) - origin[a]) / direction[a];
+            }
+        }
+
+        static float Slope(const ProfilePoint& from, const ProfilePoint& to)
+        {
+            return (to._height - from._height) / (to._t - from._t);
+        }
+
+            //  Largest slope from "query" to the points of an upper convex hull that is
+            //  entirely in front of it. "hullPt(0)" must be the closest hull point. The
+            //  slopes to the hull points increase up to the tangent point, and decrease
+            //  after it, so we can find it with a binary search.
+        template<typename HullAccessor>
+            static float TangentSlope(const ProfilePoint& query, size_t hullSize, HullAccessor hullPt)
+        {
+            size_t lo = 0, hi = hullSize-1;
+            while (lo < hi) {
+                auto mid = (lo + hi) / 2;
+                if (Slope(query, hullPt(mid+1)) <= Slope(query, hullPt(mid))) hi = mid;
+                else lo = mid + 1;
+            }
+            return Slope(query, hullPt(lo));
+        }
+
+            //  "points" and "queries" must be sorted by increasing _t. For each query, we want
+            //  the largest slope to any point in the range ("limits[q]", query._t + searchDistance].
+            //  The limits should be in front of the queries, and shouldn't decrease from one
+            //  query to the next.
+            //
+            //  Without a search distance limit, we sweep backwards along the line, adding points
+            //  to the upper convex hull of the profile in front of us (so each point is pushed
+            //  and popped at most once). The largest slope from a query is the tangent to that hull.
+            //
+            //  With a limit, points also leave the range at the far end, and a simple hull can't
+            //  handle that. So we split the line into blocks of "searchDistance" length. The range
+            //  for a query covers the rest of its own block (a suffix, found with the same backwards
+            //  sweep, restarted at every block) and the start of the next block (a prefix, found
+            //  with a forwards sweep, also restarted at every block).
+        static void Sweep(
+            float results[],
+            const ProfilePoint points[], size_t pointCount,
+            const ProfilePoint queries[], const float limits[], size_t queryCount,
+            float searchDistance,
+            std::vector<const ProfilePoint*>& hull)
+        {
+            if (!queryCount) return;
+            const bool limited = pointCount && (points[pointCount-1]._t - queries[0]._t) > searchDistance;
+
+            const float blockOrigin = queries[0]._t;
+            auto blockEnd = [blockOrigin, searchDistance](float t) 
+                { return blockOrigin + (XlFloor((t - blockOrigin) / searchDistance) + 1.f) * searchDistance; };
+            auto pointsBefore = [points, pointCount](float t)
+                { return size_t(std::upper_bound(points, points+pointCount, t, [](float lhs, const ProfilePoint& rhs) { return lhs < rhs._t; }) - points); };
+
+                //  suffix of each block (or the whole line, if there's no limit)
+            hull.clear();
+            auto p = pointCount;
+            float currentBlockEnd = FLT_MAX;
+            for (auto q=queryCount; q>0; --q) {
+                const auto& query = queries[q-1];
+                if (limited) {
+                    auto e = blockEnd(query._t);
+                    if (e != currentBlockEnd) {
+                        hull.clear();
+                        p = pointsBefore(e);
+                        currentBlockEnd = e;
+                    }
+                }
+
+                while (p > 0 && points[p-1]._t > limits[q-1]) {
+                    const auto& pt = points[--p];
+                    while (hull.size() >= 2 && Slope(pt, *hull[hull.size()-1]) <= Slope(pt, *hull[hull.size()-2]))
+                        hull.pop_back();
+                    hull.push_back(&pt);
+                }
+
+                    // hull.back() is the closest point
+                auto n = hull.size();
+                results[q-1] = n 
+                    ? TangentSlope(query, n, [&hull, n](size_t i) -> const ProfilePoint& { return *hull[n-1-i]; })
+                    : -FLT_MAX;
+            }
+
+            if (!limited) return;
+
+                //  prefix of the next block
+            hull.clear();
+            currentBlockEnd = FLT_MAX;
+            for (size_t q=0; q<queryCount; ++q) {
+                const auto& query = queries[q];
+                auto e = blockEnd(query._t);
+                if (e != currentBlockEnd) {
+                    hull.clear();
+                    p = pointsBefore(e);
+                    currentBlockEnd = e;
+                }
+
+                float rangeEnd = query._t + searchDistance;
+                while (p < pointCount && points[p]._t <= rangeEnd) {
+                    const auto& pt = points[p++];
+                    while (hull.size() >= 2 && Slope(*hull[hull.size()-2], *hull[hull.size()-1]) <= Slope(*hull[hull.size()-2], pt))
+                        hull.pop_back();
+                    hull.push_back(&pt);
+                }
+
+                if (limits[q] > e) {
+                        //  Rare case -- the limit is past the block end, so some points
+                        //  in the hull aren't in range. Just check the points directly.
+                    for (auto i=pointsBefore(limits[q]); i<p; ++i)
+                        results[q] = std::max(results[q], Slope(query, points[i]));
+                } else if (!hull.empty()) {
+                        // hull[0] is the closest point
+                    results[q] = std::max(results[q], 
+                        TangentSlope(query, hull.size(), [&hull](size_t i) -> const ProfilePoint& { return *hull[i]; }));
+                }
+            }
+        }
+
+        static void Reverse(std::vector<ProfilePoint>& dst, const std::vector<ProfilePoint>& src)
+        {
+            dst.resize(src.size());
+            for (size_t c=0; c<src.size(); ++c) {
+                dst[c]._t = -src[src.size()-1-c]._t;
+                dst[c]._height = src[src.size()-1-c]._height;
+            }
+        }
+
+        static bool ClipLine(float& tMin, float& tMax, Float2 origin, Float2 direction, Float2 mins, Float2 maxs)
+        {
+            tMin = -FLT_MAX; tMax = FLT_MAX;
+            for (unsigned c=0; c<2; ++c) {
+                if (XlAbs(direction[c]) < 1e-6f) {
+                    if (origin[c] < mins[c] || origin[c] > maxs[c]) return false;
+                    continue;
+                }
+                float t0 = (mins[c] - origin[c]) / direction[c];
+                float t1 = (maxs[c] - origin[c]) / direction[c];
+                if (t0 > t1) std::swap(t0, t1);
+                tMin = std::max(tMin, t0);
+                tMax = std::min(tMax, t1);
+            }
+            return tMin < tMax;
+        }
+    }
+
+    bool HorizonSweepShadowsOperator::CalculateSurface(
+        void* dst, size_t dstRowPitch, Int2 mins, Int2 maxs,
+        SceneEngine::TerrainUberHeightsSurface& heightsSurface, float xyScale, float relativeResolution,
+        const TerrainOpConfig& cfg, ConsoleRig::IProgress* progress) const
+    {
+        using namespace HorizonSweep;
+
+            //  We calculate the shadows along lines parallel to the sun's direction of movement.
+            //  Every sample belongs to the closest line. When the direction is aligned to the grid,
+            //  there is one line per row (or column) of samples, and every sample sits exactly
+            //  on its line. Otherwise the lines are closer together, to reduce the error
+            //  from moving the sample onto the line.
+        const Float2 direction = Normalize(_sunDirectionOfMovement);
+        const Float2 normal(-direction[1], direction[0]);
+        const bool gridAligned = std::min(XlAbs(direction[0]), XlAbs(direction[1])) < 1e-5f;
+        const float lineSpacing = gridAligned ? relativeResolution : (.25f * relativeResolution);
+
+            //  the lines are clamped to the same area as CalculateShadowingGrad uses
+        const float border = 1.f;
+        const Float2 validMins(border, border);
+        const Float2 validMaxs(float(heightsSurface.GetWidth()-1)-border, float(heightsSurface.GetHeight()-1)-border);
+
+        float offsetMin = FLT_MAX, offsetMax = -FLT_MAX;
+        for (unsigned c=0; c<4; ++c) {
+            Float2 corner(float((c&1)?(maxs[0]-1):mins[0]), float((c&2)?(maxs[1]-1):mins[1]));
+            float offset = Dot(corner * relativeResolution, normal);
+            offsetMin = std::min(offsetMin, offset);
+            offsetMax = std::max(offsetMax, offset);
+        }
+
+        auto lineIndex = [offsetMin, lineSpacing, normal, relativeResolution](Int2 sample) -> int
+            {
+                float offset = Dot(Float2(float(sample[0]), float(sample[1])) * relativeResolution, normal);
+                return int(XlFloor((offset - offsetMin) / lineSpacing + .5f));
+            };
+        const int lineCount = int(XlFloor((offsetMax - offsetMin) / lineSpacing + .5f)) + 1;
+
+            //  (GridEdgeIterator2 never returns the crossing at the sample point itself)
+        const float minDistance = 1e-3f;
+
+            //  We find the samples for each line by walking along the axis that is closest
+            //  to the direction of movement. There are only ever a few samples near the line
+            //  on the other axis.
+        const unsigned majorAxis = (XlAbs(direction[0]) >= XlAbs(direction[1])) ? 0 : 1;
+        const unsigned minorAxis = 1 - majorAxis;
+
+        auto step = progress ? progress->BeginStep(GetName(), unsigned(lineCount), true) : nullptr;
+        Interlocked::Value queueLoc = 0;
+
+        auto threadFunction = 
+            [&]()
+            {
+                std::vector<ProfilePoint> points, reversePoints;
+                std::vector<QuerySample> samples;
+                std::vector<ProfilePoint> queries, reverseQueries;
+                std::vector<float> forwardLimits, backwardLimits;
+                std::vector<float> forwardGrads, backwardGrads;
+                std::vector<const ProfilePoint*> hull;
+
+                for (;;) {
+                    int line = Interlocked::Increment(&queueLoc);
+                    if (line >= lineCount) return;
+
+                    if (step) {
+                        step->Advance();
+                        if (step->IsCancelled()) return;
+                    }
+
+                    float lineOffset = offsetMin + float(line) * lineSpacing;
+                    Float2 lineOrigin = lineOffset * normal;
+
+                        //  find the samples that belong to this line
+                    samples.clear();
+                    for (int m=mins[majorAxis]; m<maxs[majorAxis]; ++m) {
+                            //  solve for the minor coordinate where the line passes through this
+                            //  major coordinate
+                        float minorCoord = 
+                            (lineOffset / relativeResolution - normal[majorAxis] * float(m)) 
+                            / normal[minorAxis];
+                        int minorStart = std::max(int(XlFloor(minorCoord)) - 1, mins[minorAxis]);
+                        int minorEnd = std::min(int(XlFloor(minorCoord)) + 3, maxs[minorAxis]);
+                        for (int n=minorStart; n<minorEnd; ++n) {
+                            Int2 sample;
+                            sample[majorAxis] = m;
+                            sample[minorAxis] = n;
+                            if (lineIndex(sample) != line) continue;
+
+                            Float2 original = Float2(float(sample[0]), float(sample[1])) * relativeResolution;
+                            Float2 coord = original + (lineOffset - Dot(original, normal)) * normal;
+
+                            QuerySample q;
+                            q._pt._t = Dot(coord, direction);
+                            q._pt._height = GetInterpolatedValue(heightsSurface, coord);
+                            q._sample = sample;
+
+                                //  CalculateShadowingGrad ignores the grid edges that pass through the
+                                //  sample point itself. Moving the sample onto the line shifts those
+                                //  crossings a little bit away from it, and we must ignore them,
+                                //  also. Otherwise the local slope of the terrain dominates.
+                            q._forwardLimit = q._backwardLimit = q._pt._t;
+                            for (unsigned a=0; a<2; ++a) {
+                                if (XlAbs(direction[a]) < 1e-6f) continue;
+                                int kStart = int(XlCeil(std::min(original[a], coord[a]) - 1e-4f));
+                                int kEnd = int(XlFloor(std::max(original[a], coord[a]) + 1e-4f));
+                                for (int k=kStart; k<=kEnd; ++k) {
+                                    float t = q._pt._t + (float(k) - coord[a]) / direction[a];
+                                    q._forwardLimit = std::max(q._forwardLimit, t);
+                                    q._backwardLimit = std::min(q._backwardLimit, t);
+                                }
+                            }
+                            q._forwardLimit += minDistance;
+                            q._backwardLimit -= minDistance;
+                            samples.push_back(q);
+                        }
+                    }
+                    if (samples.empty()) continue;
+
+                    std::sort(samples.begin(), samples.end(), 
+                        [](const QuerySample& lhs, const QuerySample& rhs) { return lhs._pt._t < rhs._pt._t; });
+
+                        //  Sweep() needs the limits in the same order as the queries. They can only
+                        //  be out of order when 2 samples are very close, so just clamp them.
+                    auto queryCount = samples.size();
+                    queries.resize(queryCount); reverseQueries.resize(queryCount);
+                    forwardLimits.resize(queryCount); backwardLimits.resize(queryCount);
+                    for (size_t c=0; c<queryCount; ++c) {
+                        queries[c] = samples[c]._pt;
+                        forwardLimits[c] = samples[c]._forwardLimit;
+                        reverseQueries[c]._t = -samples[queryCount-1-c]._pt._t;
+                        reverseQueries[c]._height = samples[queryCount-1-c]._pt._height;
+                        backwardLimits[c] = -samples[queryCount-1-c]._backwardLimit;
+                    }
+                    for (size_t c=queryCount-1; c>0; --c) {
+                        forwardLimits[c-1] = std::min(forwardLimits[c-1], forwardLimits[c]);
+                        backwardLimits[c-1] = std::min(backwardLimits[c-1], backwardLimits[c]);
+                    }
+
+                        //  collect the terrain profile along the line
+                    points.clear();
+                    float tMin, tMax;
+                    if (ClipLine(tMin, tMax, lineOrigin, direction, validMins, validMaxs))
+                        CollectProfile(points, heightsSurface, lineOrigin, direction, tMin, tMax);
+
+                        //  sweep in both directions. For the backwards direction, we just
+                        //  reverse the line
+                    forwardGrads.resize(queryCount);
+                    backwardGrads.resize(queryCount);
+                    Sweep(
+                        AsPointer(forwardGrads.begin()), 
+                        AsPointer(points.cbegin()), points.size(),
+                        AsPointer(queries.cbegin()), AsPointer(forwardLimits.cbegin()), queryCount, 
+                        _searchDistance, hull);
+
+                    Reverse(reversePoints, points);
+                    Sweep(
+                        AsPointer(backwardGrads.begin()), 
+                        AsPointer(reversePoints.cbegin()), reversePoints.size(),
+                        AsPointer(reverseQueries.cbegin()), AsPointer(backwardLimits.cbegin()), queryCount, 
+                        _searchDistance, hull);
+
+                    for (size_t c=0; c<queryCount; ++c) {
+                        float a0 = XlATan2(1.f, backwardGrads[queryCount-1-c] / xyScale);
+                        float a1 = XlATan2(1.f, forwardGrads[c] / xyScale);
+                        auto* d = (ShadowSample*)PtrAdd(dst, samples[c]._sample[1] * dstRowPitch + samples[c]._sample[0] * sizeof(ShadowSample));
+                        *d = MakeShadowSample(a0, a1);
+                    }
+                }
+            };
+
+        std::vector<std::thread> threads;
+        for (unsigned c=0; c<std::max(1u, cfg._maxThreadCount); ++c)
+            threads.emplace_back(std::thread(threadFunction));
+        for (auto&t : threads) t.join();
+
+        return true;
+    }
+
+    HorizonSweepShadowsOperator::HorizonSweepShadowsOperator(Float2 sunDirectionOfMovement, float searchDistance)
+    : AngleBasedShadowsOperator(sunDirectionOfMovement, searchDistance)
+    {}
+
+    HorizonSweepShadowsOperator::~HorizonSweepShadowsOperator() {}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
     ImpliedTyping::TypeDesc AOOperator::GetOutputFormat() const 
@@ -52,4 +52,29 @@ namespace ToolsRig
         Float2 _sunDirectionOfMovement;
         float _searchDistance;
     };
+
+    /// <summary>Generates the same shadows as AngleBasedShadowsOperator, using a horizon sweep</summary>
+    /// AngleBasedShadowsOperator searches along the sun's direction of movement separately
+    /// for every sample. This operator instead walks whole lines of the height map that are
+    /// parallel to the sun's direction of movement. As we sweep along the line, we maintain the
+    /// convex hull of the terrain profile in front of the current point, and the shadowing
+    /// angle is just the tangent to that hull. So the cost for each line is close to linear in
+    /// its length (rather than proportional to length * search distance).
+    ///
+    /// The search distance limit is the same as AngleBasedShadowsOperator (so the same shadow
+    /// casters are considered). When the direction of movement is aligned with the grid, the results should match
+    /// AngleBasedShadowsOperator exactly. Otherwise each sample is moved onto the nearest line
+    /// (lines are a quarter of a sample apart), so there are some small differences.
+    class HorizonSweepShadowsOperator : public AngleBasedShadowsOperator
+    {
+    public:
+        bool CalculateSurface(
+            void* dst, size_t dstRowPitch, Int2 mins, Int2 maxs,
+            SceneEngine::TerrainUberHeightsSurface& heightsSurface, float xyScale, float relativeResolution,
+            const TerrainOpConfig& cfg, ConsoleRig::IProgress* progress) const;
+
+            // note: searchDistance is in number of grid elements (ie, not world space units)
+        HorizonSweepShadowsOperator(Float2 sunDirectionOfMovement, float searchDistance);
+        ~HorizonSweepShadowsOperator();
+    };
 }
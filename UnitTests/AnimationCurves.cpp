@@ -0,0 +1,297 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/RawAnimationCurve.h"
+#include "../Math/Interpolation.h"
+#include "../Math/Transformations.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using RenderCore::Assets::RawAnimationCurve;
+    namespace NativeFormat = RenderCore::Metal::NativeFormat;
+
+    class SyntheticCurve
+    {
+    public:
+        std::vector<float>  _times;
+        std::vector<Float3> _elements;  // position, in tangent, out tangent (for bezier)
+        bool                _bezier;
+
+        RawAnimationCurve   BuildCurve() const
+        {
+            auto keyCount = _times.size();
+            std::unique_ptr<float[], BlockSerializerDeleter<float[]>> timeMarkers(new float[keyCount]);
+            std::copy(_times.begin(), _times.end(), timeMarkers.get());
+
+            auto dataSize = _elements.size() * sizeof(Float3);
+            std::unique_ptr<uint8[], BlockSerializerDeleter<uint8[]>> data(new uint8[dataSize]);
+            XlCopyMemory(data.get(), AsPointer(_elements.begin()), dataSize);
+
+            auto elementsPerKey = _bezier ? 3 : 1;
+            return RawAnimationCurve(
+                keyCount, std::move(timeMarkers),
+                DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>(std::move(data), dataSize),
+                elementsPerKey * sizeof(Float3),
+                _bezier ? RawAnimationCurve::Bezier : RawAnimationCurve::Linear,
+                NativeFormat::R32G32B32_FLOAT,
+                _bezier ? NativeFormat::R32G32B32_FLOAT : NativeFormat::Unknown,
+                _bezier ? NativeFormat::R32G32B32_FLOAT : NativeFormat::Unknown);
+        }
+
+        Float3 Reference(float time) const
+        {
+                //  This is the original linear scan implementation
+            auto elementsPerKey = _bezier ? 3 : 1;
+            if (time < _times[0]) return _elements[0];
+            for (size_t c=0; c<_times.size()-1; ++c)
+                if (time < _times[c+1]) {
+                    float alpha = (time - _times[c]) / (_times[c+1] - _times[c]);
+                    const auto& P0 = _elements[c*elementsPerKey];
+                    const auto& P1 = _elements[(c+1)*elementsPerKey];
+                    if (!_bezier) return SphericalInterpolate(P0, P1, alpha);
+                    return SphericalBezierInterpolate(
+                        P0, _elements[c*elementsPerKey+2], _elements[(c+1)*elementsPerKey+1], P1, alpha);
+                }
+            return _elements[(_times.size()-1)*elementsPerKey];
+        }
+
+        SyntheticCurve(size_t keyCount, bool bezier, unsigned seed) : _bezier(bezier)
+        {
+                //  Something like a long motion capture clip. Mocap data is usually
+                //  sampled at a fixed rate, but after key reduction the spacing
+                //  becomes irregular.
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> spacing(1.f/120.f, 1.f/15.f);
+            std::uniform_real_distribution<float> value(-1.f, 1.f);
+            float time = 0.f;
+            for (size_t c=0; c<keyCount; ++c) {
+                _times.push_back(time);
+                time += spacing(rng);
+                Float3 position(value(rng), value(rng), value(rng));
+                _elements.push_back(position);
+                if (bezier) {
+                    _elements.push_back(position + Float3(value(rng), value(rng), value(rng)) * .1f);
+                    _elements.push_back(position + Float3(value(rng), value(rng), value(rng)) * .1f);
+                }
+            }
+        }
+    };
+
+    static bool BitwiseEqual(const Float3& lhs, const Float3& rhs)
+    {
+        return lhs[0] == rhs[0] && lhs[1] == rhs[1] && lhs[2] == rhs[2];
+    }
+
+    static RawAnimationCurve BuildJointCurve(size_t keyCount, Float3 scale = Float3(1.f, 1.f, 1.f))
+    {
+            //  Smooth joint motion, sampled at 30fps, as we would get from
+            //  motion capture. Stored as full matrices, as the Collada exporters do
+        std::unique_ptr<float[], BlockSerializerDeleter<float[]>> timeMarkers(new float[keyCount]);
+        std::unique_ptr<uint8[], BlockSerializerDeleter<uint8[]>> data(new uint8[keyCount * sizeof(Float4x4)]);
+        auto* matrices = (Float4x4*)data.get();
+        for (size_t c=0; c<keyCount; ++c) {
+            float t = c / 30.f;
+            timeMarkers[c] = t;
+            auto rotation = MakeRotationQuaternion(
+                Normalize(Float3(std::sin(t * .3f), .5f, std::cos(t * .2f))), 
+                1.5f * std::sin(t * 1.7f));
+            matrices[c] = AsFloat4x4(RotationScaleTranslation(
+                rotation, scale,
+                Float3(.2f * std::sin(t * 2.3f), .1f * t, 1.f + .05f * std::cos(t * 4.1f))));
+        }
+
+        return RawAnimationCurve(
+            keyCount, std::move(timeMarkers),
+            DynamicArray<uint8, BlockSerializerDeleter<uint8[]>>(std::move(data), keyCount * sizeof(Float4x4)),
+            sizeof(Float4x4), RawAnimationCurve::Linear,
+            NativeFormat::Matrix4x4, NativeFormat::Unknown, NativeFormat::Unknown);
+    }
+
+    static float MaxDifference(const Float4x4& lhs, const Float4x4& rhs)
+    {
+        float result = 0.f;
+        for (unsigned i=0; i<4; ++i)
+            for (unsigned j=0; j<4; ++j)
+                result = std::max(result, std::abs(lhs(i,j) - rhs(i,j)));
+        return result;
+    }
+
+    static float MaxDifference(const Float3& lhs, const Float3& rhs)
+    {
+        return std::max(std::max(std::abs(lhs[0] - rhs[0]), std::abs(lhs[1] - rhs[1])), std::abs(lhs[2] - rhs[2]));
+    }
+
+    TEST_CLASS(AnimationCurves)
+	{
+	public:
+		TEST_METHOD(KeySearchMatchesLinearScan)
+		{
+            const unsigned keyCounts[] = { 1, 2, 3, 17, 1000 };
+            for (unsigned k=0; k<dimof(keyCounts); ++k)
+                for (unsigned b=0; b<2; ++b) {
+                    SyntheticCurve source(keyCounts[k], b!=0, k*2+b);
+                    auto curve = source.BuildCurve();
+
+                        //  forwards playback, random jumps (including backwards) and
+                        //  times outside of the curve. The cursor is only a hint, so
+                        //  it must never change the result
+                    std::mt19937 rng(k);
+                    std::uniform_real_distribution<float> jump(curve.StartTime() - 1.f, curve.EndTime() + 1.f);
+                    unsigned cursor = 0;
+                    for (unsigned c=0; c<4096; ++c) {
+                        float time = ((c%256) < 200) ? (curve.StartTime() - .5f + c * (1.f/60.f)) : jump(rng);
+                        auto expected = source.Reference(time);
+                        Assert::IsTrue(BitwiseEqual(expected, curve.Calculate<Float3>(time)));
+                        Assert::IsTrue(BitwiseEqual(expected, curve.Calculate<Float3>(time, &cursor)));
+                        Assert::IsTrue(cursor < std::max(keyCounts[k], 1u));
+                    }
+
+                        //  garbage cursor values are just ignored
+                    cursor = ~0u;
+                    float time = .5f * (curve.StartTime() + curve.EndTime());
+                    Assert::IsTrue(BitwiseEqual(source.Reference(time), curve.Calculate<Float3>(time, &cursor)));
+
+                        //  NaN times clamp to the first key
+                    const float nan = std::numeric_limits<float>::quiet_NaN();
+                    auto firstKey = curve.Calculate<Float3>(curve.StartTime());
+                    Assert::IsTrue(BitwiseEqual(firstKey, curve.Calculate<Float3>(nan)));
+                    Assert::IsTrue(BitwiseEqual(firstKey, curve.Calculate<Float3>(nan, &cursor)));
+                }
+        }
+
+        TEST_METHOD(CompressedCurves)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Every original sample is checked against the compressed curve, so
+                //  the error there is within the tolerance. We sample between the keys
+                //  as well, where interpolating the rotations can add a tiny bit more.
+            const float tolerance = 1e-3f, allowedError = 1.25f * tolerance;
+            {
+                auto original = BuildJointCurve(9000);
+                auto compressed = original.Compress(tolerance);
+                Assert::IsTrue(compressed.GetKeyEncoding() == RawAnimationCurve::QuantizedTRS);
+
+                float maxError = 0.f;
+                unsigned cursor = 0;
+                for (float t=-1.f; t<original.EndTime()+1.f; t+=1.f/97.f)
+                    maxError = std::max(maxError, MaxDifference(original.Calculate<Float4x4>(t), compressed.Calculate<Float4x4>(t, &cursor)));
+                Assert::IsTrue(maxError < allowedError);
+
+                const float nan = std::numeric_limits<float>::quiet_NaN();
+                Assert::IsTrue(MaxDifference(original.Calculate<Float4x4>(original.StartTime()), compressed.Calculate<Float4x4>(nan, &cursor)) < allowedError);
+
+                LogAlwaysWarning
+                    << "Float4x4 curve: " << original.KeyCount() << " keys, " << original.DataSize() << " bytes -> "
+                    << compressed.KeyCount() << " keys, " << compressed.DataSize() << " bytes (max error " << maxError << ")";
+            }
+
+            {
+                SyntheticCurve source(2000, false, 7);
+                auto original = source.BuildCurve();
+                auto compressed = original.Compress(tolerance);
+                Assert::IsTrue(compressed.GetKeyEncoding() == RawAnimationCurve::Quantized);
+
+                float maxError = 0.f;
+                for (float t=-1.f; t<original.EndTime()+1.f; t+=1.f/97.f)
+                    maxError = std::max(maxError, MaxDifference(original.Calculate<Float3>(t), compressed.Calculate<Float3>(t)));
+                Assert::IsTrue(maxError < allowedError);
+
+                LogAlwaysWarning
+                    << "Float3 curve (noise): " << original.KeyCount() << " keys, " << original.DataSize() << " bytes -> "
+                    << compressed.KeyCount() << " keys, " << compressed.DataSize() << " bytes (max error " << maxError << ")";
+            }
+
+            {
+                    //  Mirroring transforms can't be represented by the decomposed keys,
+                    //  and a very large range can't be quantized within the tolerance. 
+                    //  Both of these curves must be left uncompressed.
+                auto mirrored = BuildJointCurve(300, Float3(-1.f, 1.f, 1.f));
+                Assert::IsTrue(mirrored.Compress(tolerance).GetKeyEncoding() == RawAnimationCurve::Uncompressed);
+
+                SyntheticCurve source(2000, false, 7);
+                for (auto& e:source._elements) e *= 1e5f;
+                auto largeRange = source.BuildCurve();
+                Assert::IsTrue(largeRange.Compress(tolerance).GetKeyEncoding() == RawAnimationCurve::Uncompressed);
+            }
+        }
+
+        TEST_METHOD(KeySearchBenchmark)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  Roughly a 10 minute mocap clip on a 64 bone skeleton. We play
+                //  it forwards at 60fps, evaluating every curve each frame.
+            const unsigned curveCount = 64, keyCount = 20000;
+            std::vector<SyntheticCurve> sources;
+            std::vector<RawAnimationCurve> curves;
+            for (unsigned c=0; c<curveCount; ++c) {
+                sources.push_back(SyntheticCurve(keyCount, (c%4)==0, c));
+                curves.push_back(sources[c].BuildCurve());
+            }
+
+            std::vector<const RawAnimationCurve*> curvePtrs;
+            float endTime = 0.f;
+            for (auto& c:curves) {
+                curvePtrs.push_back(&c);
+                endTime = std::max(endTime, c.EndTime());
+            }
+
+            const unsigned frameCount = unsigned(endTime * 60.f);
+            const unsigned referenceStride = 64;   // the linear scan is too slow to do every frame
+            std::vector<Float3> binaryResults(curveCount * frameCount);
+            std::vector<Float3> cursorResults(curveCount * frameCount);
+            std::vector<unsigned> cursors(curveCount, 0);
+
+            auto start = GetPerformanceCounter();
+            for (unsigned f=0; f<frameCount; f+=referenceStride)
+                for (unsigned c=0; c<curveCount; ++c)
+                    binaryResults[f*curveCount+c] = sources[c].Reference(f / 60.f);
+            auto t0 = GetPerformanceCounter();
+            for (unsigned f=0; f<frameCount; ++f)
+                for (unsigned c=0; c<curveCount; ++c)
+                    binaryResults[f*curveCount+c] = curves[c].Calculate<Float3>(f / 60.f);
+            auto t1 = GetPerformanceCounter();
+            for (unsigned f=0; f<frameCount; ++f)
+                RawAnimationCurve::Calculate(
+                    &cursorResults[f*curveCount], f / 60.f,
+                    AsPointer(curvePtrs.begin()), curveCount, AsPointer(cursors.begin()));
+            auto t2 = GetPerformanceCounter();
+
+            for (unsigned f=0; f<frameCount; ++f)
+                for (unsigned c=0; c<curveCount; ++c) {
+                    Assert::IsTrue(BitwiseEqual(binaryResults[f*curveCount+c], cursorResults[f*curveCount+c]));
+                    if ((f%referenceStride)==0)
+                        Assert::IsTrue(BitwiseEqual(sources[c].Reference(f / 60.f), binaryResults[f*curveCount+c]));
+                }
+
+            auto freq = double(GetPerformanceCounterFrequency());
+            auto referenceEvaluations = double(((frameCount+referenceStride-1)/referenceStride) * curveCount);
+            auto evaluations = double(frameCount * curveCount);
+            LogAlwaysWarning
+                << "Sampling " << curveCount << " curves of " << keyCount << " keys for " << frameCount << " frames: "
+                << "linear scan " << 1e9 * double(t0-start) / freq / referenceEvaluations << "ns/eval, "
+                << "binary search " << 1e9 * double(t1-t0) / freq / evaluations << "ns/eval, "
+                << "cursor batch " << 1e9 * double(t2-t1) / freq / evaluations << "ns/eval";
+        }
+	};
+}
+
@@ -0,0 +1,210 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Assets/ArchiveCache.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/Streams/FileUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/SystemUtils.h"
+#include <CppUnitTest.h>
+#include <vector>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static const char TestArchiveName[] = "int/unittest/archive";
+
+    static void DeleteTestArchive()
+    {
+        const char* suffixes[] = { "", ".dir", ".log", ".debug", ".compact", ".dir.new", ".dir.tmp" };
+        for (auto s:suffixes)
+            XlDeleteFile((const utf8*)(std::string(TestArchiveName) + s).c_str());
+    }
+
+    static ::Assets::ArchiveCache::BlockAndSize MakeBlock(uint64 id, unsigned version, unsigned size)
+    {
+        auto result = std::make_shared<std::vector<uint8>>(size);
+        for (unsigned c=0; c<size; ++c)
+            (*result)[c] = uint8(id * 31 + version * 7 + c);
+        return result;
+    }
+
+    static bool BlockMatches(const ::Assets::ArchiveCache::BlockView& view, uint64 id, unsigned version, unsigned size)
+    {
+        if (view.size() != size) return false;
+        for (unsigned c=0; c<size; ++c)
+            if (view.data()[c] != uint8(id * 31 + version * 7 + c)) return false;
+        return true;
+    }
+
+    static void Commit(::Assets::ArchiveCache& archive, uint64 id, unsigned version, unsigned size)
+    {
+        archive.Commit(id, MakeBlock(id, version, size), std::string(), [](){});
+    }
+
+    TEST_CLASS(ArchiveCache)
+	{
+	public:
+		TEST_METHOD(DirectoryLogReplay)
+		{
+                //  Write a few batches in FlushMode::AppendLog (including a replaced block),
+                //  and then check that reopening the archive replays the log correctly
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            DeleteTestArchive();
+
+            {
+                ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                archive.SetFlushMode(::Assets::ArchiveCache::FlushMode::AppendLog, 1.f);
+                Commit(archive, 1, 0, 100);
+                Commit(archive, 2, 0, 200);
+                Commit(archive, 3, 0, 300);
+                archive.FlushToDisk();
+
+                Commit(archive, 2, 1, 250);
+                Commit(archive, 4, 0, 400);
+                archive.FlushToDisk();
+                Assert::AreEqual(5u, archive.GetMetrics()._directoryLogEntries);
+            }
+
+            {
+                ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(1), 1, 0, 100));
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(2), 2, 1, 250));
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(3), 3, 0, 300));
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(4), 4, 0, 400));
+                Assert::IsFalse(archive.HasItem(5));
+
+                auto metrics = archive.GetMetrics();
+                Assert::AreEqual(5u, metrics._directoryLogEntries);
+                Assert::AreEqual(size_t(4), metrics._blocks.size());
+                Assert::AreEqual(100u + 250u + 300u + 400u, metrics._usedSpace);
+            }
+
+            DeleteTestArchive();
+		}
+
+        TEST_METHOD(Compaction)
+        {
+                //  Compact an archive with wasted space, in both flush modes. BlockViews
+                //  from before the compaction must remain valid, and the compacted
+                //  archive must survive being reopened.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned blockCount = 16, blockSize = 1024, versions = 4;
+            ::Assets::ArchiveCache::FlushMode modes[] = { ::Assets::ArchiveCache::FlushMode::AppendLog, ::Assets::ArchiveCache::FlushMode::Rewrite };
+            for (auto mode:modes) {
+                DeleteTestArchive();
+
+                {
+                    ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                    archive.SetFlushMode(mode, 1.f);
+
+                        //  Keep a view alive across every flush. In FlushMode::Rewrite, this
+                        //  forces the flushes to append, and leave old versions behind
+                    ::Assets::ArchiveCache::BlockView firstVersion;
+                    for (unsigned v=0; v<versions; ++v) {
+                        for (unsigned c=0; c<blockCount; ++c)
+                            Commit(archive, c, v, blockSize);
+                        archive.FlushToDisk();
+                        if (v == 0) firstVersion = archive.OpenFromCache(0);
+                    }
+                    Assert::IsTrue(BlockMatches(firstVersion, 0, 0, blockSize));
+
+                    auto before = archive.GetMetrics();
+                    Assert::IsTrue(before._fragmentation > .5f);
+                    Assert::AreEqual(blockCount * blockSize, before._usedSpace);
+
+                    Assert::IsTrue(archive.Compact());
+
+                    auto after = archive.GetMetrics();
+                    Assert::AreEqual(0u, after._directoryLogEntries);
+                    Assert::AreEqual(blockCount * blockSize, after._usedSpace);
+                    Assert::IsTrue(after._allocatedFileSize < before._allocatedFileSize);
+                    Assert::IsTrue(after._fragmentation < .01f);
+
+                    for (unsigned c=0; c<blockCount; ++c)
+                        Assert::IsTrue(BlockMatches(archive.OpenFromCache(c), c, versions-1, blockSize));
+
+                        // the old view still points into the retired archive
+                    Assert::IsTrue(BlockMatches(firstVersion, 0, 0, blockSize));
+                }
+
+                {
+                    ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                    for (unsigned c=0; c<blockCount; ++c)
+                        Assert::IsTrue(BlockMatches(archive.OpenFromCache(c), c, versions-1, blockSize));
+                    Assert::AreEqual(0u, archive.GetMetrics()._directoryLogEntries);
+                }
+            }
+
+            DeleteTestArchive();
+        }
+
+        TEST_METHOD(TruncatedLogRecovery)
+        {
+                //  Simulate a crash part way through writing a directory log batch, by
+                //  truncating the log. The archive should fall back to the last complete
+                //  batch, and then continue appending after it.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            DeleteTestArchive();
+
+            {
+                ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                archive.SetFlushMode(::Assets::ArchiveCache::FlushMode::AppendLog, 1.f);
+                Commit(archive, 1, 0, 100);
+                Commit(archive, 2, 0, 200);
+                archive.FlushToDisk();
+                Commit(archive, 2, 1, 250);
+                Commit(archive, 3, 0, 300);
+                archive.FlushToDisk();
+            }
+
+            auto logFileName = std::string(TestArchiveName) + ".log";
+            {
+                std::vector<uint8> logData;
+                {
+                    BasicFile logFile(logFileName.c_str(), "rb");
+                    logData.resize((size_t)logFile.GetSize());
+                    logFile.Read(AsPointer(logData.begin()), 1, logData.size());
+                }
+                    // cut off the end of the last entry in the second batch
+                Assert::IsTrue(logData.size() > 8);
+                BasicFile logFile(logFileName.c_str(), "wb");
+                logFile.Write(AsPointer(logData.cbegin()), 1, logData.size() - 8);
+            }
+
+            {
+                ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                archive.SetFlushMode(::Assets::ArchiveCache::FlushMode::AppendLog, 1.f);
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(1), 1, 0, 100));
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(2), 2, 0, 200));
+                Assert::IsFalse(archive.HasItem(3));
+                Assert::AreEqual(2u, archive.GetMetrics()._directoryLogEntries);
+
+                    // this batch should overwrite the partial batch in the log
+                Commit(archive, 4, 0, 400);
+                archive.FlushToDisk();
+            }
+
+            {
+                ::Assets::ArchiveCache archive(TestArchiveName, "unittest", "unittest");
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(1), 1, 0, 100));
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(2), 2, 0, 200));
+                Assert::IsFalse(archive.HasItem(3));
+                Assert::IsTrue(BlockMatches(archive.OpenFromCache(4), 4, 0, 400));
+                Assert::AreEqual(3u, archive.GetMetrics()._directoryLogEntries);
+            }
+
+            DeleteTestArchive();
+        }
+	};
+}
@@ -0,0 +1,208 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../Assets/Assets.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/AssetSetManager.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include <CppUnitTest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <string>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static std::atomic<unsigned> s_testAssetsAlive(0);
+    static std::atomic<unsigned> s_testAssetsConstructed(0);
+    static const unsigned TestAssetAliveMagic = 0x7e57a55e;
+
+    class TestAsset
+    {
+    public:
+        std::string _name;
+        unsigned _magic;
+
+        const std::shared_ptr<::Assets::DependencyValidation>& GetDependencyValidation() const { return _validation; }
+
+        TestAsset(const char name[])
+        : _name(name), _magic(TestAssetAliveMagic)
+        {
+            _validation = std::make_shared<::Assets::DependencyValidation>();
+            ++s_testAssetsAlive;
+            ++s_testAssetsConstructed;
+                // give other threads a chance to run into this asset while it's under construction
+            std::this_thread::yield();
+        }
+
+        ~TestAsset() { _magic = 0; --s_testAssetsAlive; }
+
+    private:
+        std::shared_ptr<::Assets::DependencyValidation> _validation;
+    };
+
+    static bool IsAlive(const TestAsset& asset, const char name[])
+    {
+        return asset._magic == TestAssetAliveMagic && asset._name == name;
+    }
+
+        //  CyclicAssetA and CyclicAssetB request each other from their constructors. The first
+        //  time, each waits until the other thread has started constructing, so that the cycle
+        //  spans two threads.
+    static std::atomic<unsigned> s_cyclicArrivals(0);
+
+    static void CyclicRendezvous()
+    {
+        ++s_cyclicArrivals;
+        while (s_cyclicArrivals.load() < 2)
+            std::this_thread::yield();
+    }
+
+    class CyclicAssetB;
+
+    class CyclicAssetA
+    {
+    public:
+        CyclicAssetA(const char name[]);
+    };
+
+    class CyclicAssetB
+    {
+    public:
+        CyclicAssetB(const char name[])
+        {
+            CyclicRendezvous();
+            ::Assets::GetAsset<CyclicAssetA>(name);
+        }
+    };
+
+    CyclicAssetA::CyclicAssetA(const char name[])
+    {
+        CyclicRendezvous();
+        ::Assets::GetAsset<CyclicAssetB>(name);
+    }
+
+    TEST_CLASS(AssetSets)
+	{
+	public:
+		TEST_METHOD(ConcurrentGetAndRefresh)
+		{
+                //  Worker threads repeatedly get a small set of assets while this thread
+                //  invalidates them. Every asset a worker holds must stay alive and intact,
+                //  and each version should only be constructed once.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto assetServices = std::make_shared<::Assets::Services>(0);
+
+            {
+                const char* names[] = { "asset0", "asset1", "asset2", "asset3", "asset4", "asset5", "asset6", "asset7" };
+                const unsigned threadCount = 4;
+                const unsigned invalidations = 500;
+
+                auto constructedBefore = s_testAssetsConstructed.load();
+                std::atomic<unsigned> failures(0);
+                std::atomic<bool> finished(false);
+                std::vector<std::thread> threads;
+                for (unsigned t=0; t<threadCount; ++t) {
+                    threads.emplace_back(
+                        [&names, &failures, &finished, t]()
+                        {
+                            std::shared_ptr<const TestAsset> held[dimof(names)];
+                            for (unsigned c=0; !finished.load(); ++c) {
+                                auto n = (c + t) % dimof(names);
+                                auto asset = ::Assets::GetAssetDepPtr<TestAsset>(names[n]);
+                                if (!asset || !IsAlive(*asset, names[n])) ++failures;
+
+                                    // check the version we got last time this name came around,
+                                    // (it may have been superseded since then)
+                                if (held[n] && !IsAlive(*held[n], names[n])) ++failures;
+                                held[n] = std::move(asset);
+                            }
+                        });
+                }
+
+                for (unsigned c=0; c<invalidations; ++c) {
+                    auto asset = ::Assets::GetAssetDepPtr<TestAsset>(names[c % dimof(names)]);
+                    asset->GetDependencyValidation()->OnChange();
+                    if ((c % 16) == 15)
+                        ::Assets::Services::GetAssetSets().OnFrameBarrier();
+                    std::this_thread::yield();
+                }
+
+                finished = true;
+                for (auto& t:threads) t.join();
+
+                Assert::AreEqual(0u, failures.load());
+                auto constructed = s_testAssetsConstructed.load() - constructedBefore;
+                Assert::IsTrue(constructed >= unsigned(dimof(names)));
+                Assert::IsTrue(constructed <= unsigned(dimof(names)) + invalidations);
+
+                    // after the frame barrier, only the current version of each asset should remain
+                ::Assets::Services::GetAssetSets().OnFrameBarrier();
+                Assert::AreEqual(unsigned(dimof(names)), s_testAssetsAlive.load());
+            }
+
+            {
+                    //  References returned by GetAssetDep<> must remain valid after the asset is
+                    //  rebuilt, until the next frame barrier
+                auto aliveBefore = s_testAssetsAlive.load();
+                const auto& original = ::Assets::GetAssetDep<TestAsset>("refreshed");
+                original.GetDependencyValidation()->OnChange();
+
+                const TestAsset* rebuilt = nullptr;
+                std::thread([&rebuilt]() { rebuilt = &::Assets::GetAssetDep<TestAsset>("refreshed"); }).join();
+                Assert::IsTrue(rebuilt != &original);
+                Assert::IsTrue(IsAlive(original, "refreshed"));
+                Assert::AreEqual(aliveBefore + 2, s_testAssetsAlive.load());
+
+                ::Assets::Services::GetAssetSets().OnFrameBarrier();
+                Assert::AreEqual(aliveBefore + 1, s_testAssetsAlive.load());
+                Assert::IsTrue(IsAlive(*rebuilt, "refreshed"));
+            }
+
+            ::Assets::Services::GetAssetSets().Clear();
+            Assert::AreEqual(0u, s_testAssetsAlive.load());
+            assetServices.reset();
+		}
+
+        TEST_METHOD(CyclicConstructionAcrossThreads)
+        {
+                //  Thread 0 constructs A, which requests B. Thread 1 constructs B, which requests A.
+                //  Without cycle detection, both threads would wait on each other forever.
+                //  Instead both requests should end with an exception.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto assetServices = std::make_shared<::Assets::Services>(0);
+
+            {
+                std::atomic<unsigned> exceptions(0);
+                std::thread t0(
+                    [&exceptions]()
+                    {
+                        TRY { ::Assets::GetAsset<CyclicAssetA>("cycle"); }
+                        CATCH (...) { ++exceptions; }
+                        CATCH_END
+                    });
+                std::thread t1(
+                    [&exceptions]()
+                    {
+                        TRY { ::Assets::GetAsset<CyclicAssetB>("cycle"); }
+                        CATCH (...) { ++exceptions; }
+                        CATCH_END
+                    });
+                t0.join();
+                t1.join();
+                Assert::AreEqual(2u, exceptions.load());
+            }
+
+            ::Assets::Services::GetAssetSets().Clear();
+            assetServices.reset();
+        }
+	};
+}
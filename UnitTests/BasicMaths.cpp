@@ -4,8 +4,14 @@
 // accompanying file "LICENSE" or the website
 // http://www.opensource.org/licenses/mit-license.php)
 
+#include "UnitTestHelper.h"
 #include "../Math/Transformations.h"
+#include "../Math/ProjectionMath.h"
+#include "../ConsoleRig/Log.h"
 #include <CppUnitTest.h>
+#include <random>
+#include <vector>
+#include <intrin.h>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -79,5 +85,83 @@ namespace UnitTests
 
 		}
 
+		TEST_METHOD(BatchAABBCulling)
+		{
+			UnitTest_SetWorkingDirectory();
+			ConsoleRig::GlobalServices services(GetStartupConfig());
+
+				// Compare the batched (SoA) culling path against the scalar
+				// reference, and measure the cost per box for each
+			const unsigned boxCount = 64*1024 + 3;		// (not a multiple of 4, so we exercise the remainder path)
+			std::vector<float> components[6];
+			for (auto& c:components) c.resize(boxCount);
+
+			std::mt19937 rng(6432);
+			std::uniform_real_distribution<float> position(-200.f, 200.f), size(.1f, 20.f);
+			for (unsigned c=0; c<boxCount; ++c)
+				for (unsigned q=0; q<3; ++q) {
+					components[q][c] = position(rng);
+					components[3+q][c] = components[q][c] + size(rng);
+				}
+
+			XLEMath::AABBArraySoA boxes = 
+			{
+				{ components[0].data(), components[1].data(), components[2].data() },
+				{ components[3].data(), components[4].data(), components[5].data() },
+				boxCount
+			};
+
+				// simple perspective projection (looking down +Z; near 1, far 1000)
+			const float nearClip = 1.f, farClip = 1000.f;
+			Float4x4 projection(
+				1.f, 0.f, 0.f, 0.f,
+				0.f, 1.f, 0.f, 0.f,
+				0.f, 0.f, farClip / (farClip - nearClip), -nearClip * farClip / (farClip - nearClip),
+				0.f, 0.f, 1.f, 0.f);
+			Float4x4 rotation = Identity<Float4x4>();
+			Combine_InPlace(RotationY(.15f * gPI), rotation);
+			__declspec(align(16)) auto localToProjection = Combine(rotation, projection);
+
+			std::vector<XLEMath::AABBIntersection::Enum> referenceResults(boxCount), batchResults(boxCount);
+			std::vector<unsigned> visibleIndices(boxCount);
+
+			XLEMath::TestAABBs_Reference(AsFloatArray(localToProjection), boxes, referenceResults.data());
+			XLEMath::TestAABBs_Aligned(AsFloatArray(localToProjection), boxes, batchResults.data());
+			auto visibleCount = XLEMath::CullAABBs_Aligned(AsFloatArray(localToProjection), boxes, visibleIndices.data());
+
+			unsigned referenceVisible = 0, boundaryCount = 0;
+			for (unsigned c=0; c<boxCount; ++c) {
+				Assert::IsTrue(referenceResults[c] == batchResults[c]);
+				referenceVisible += referenceResults[c] != XLEMath::AABBIntersection::Culled;
+				boundaryCount += referenceResults[c] == XLEMath::AABBIntersection::Boundary;
+			}
+			Assert::AreEqual(size_t(referenceVisible), visibleCount);
+			for (size_t c=0; c<visibleCount; ++c)
+				Assert::IsTrue(referenceResults[visibleIndices[c]] != XLEMath::AABBIntersection::Culled);
+			Assert::IsTrue(referenceVisible != 0 && referenceVisible != boxCount && boundaryCount != 0);
+
+				// performance comparison (scalar reference, one-at-a-time SSE, and batched SSE)
+			const unsigned iterationCount = 100;
+			auto start = __rdtsc();
+			for (unsigned i=0; i<iterationCount; ++i)
+				XLEMath::TestAABBs_Reference(AsFloatArray(localToProjection), boxes, referenceResults.data());
+			auto middle0 = __rdtsc();
+			for (unsigned i=0; i<iterationCount; ++i)
+				for (unsigned c=0; c<boxCount; ++c)
+					batchResults[c] = XLEMath::TestAABB_Aligned(
+						AsFloatArray(localToProjection), 
+						Float3(components[0][c], components[1][c], components[2][c]),
+						Float3(components[3][c], components[4][c], components[5][c]));
+			auto middle1 = __rdtsc();
+			for (unsigned i=0; i<iterationCount; ++i)
+				XLEMath::CullAABBs_Aligned(AsFloatArray(localToProjection), boxes, visibleIndices.data());
+			auto end = __rdtsc();
+
+			auto totalBoxes = float(uint64(boxCount) * iterationCount);
+			LogAlwaysWarning << "Scalar reference: " << float(middle0 - start) / totalBoxes << " cycles per box";
+			LogAlwaysWarning << "Single box SSE: " << float(middle1 - middle0) / totalBoxes << " cycles per box";
+			LogAlwaysWarning << "Batched SoA SSE: " << float(end - middle1) / totalBoxes << " cycles per box";
+		}
+
 	};
-}
\ No newline at end of file
+}
@@ -0,0 +1,332 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/CPUSkinning.h"
+#include "../RenderCore/Assets/ModelRunTime.h"
+#include "../RenderCore/Assets/ModelRunTimeInternal.h"
+#include "../RenderCore/Assets/Services.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/CompileAndAsyncManager.h"
+#include "../Assets/IntermediateAssets.h"
+#include "../Assets/Assets.h"
+#include "../Math/Transformations.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets;
+
+    class SyntheticSkinnedMesh
+    {
+    public:
+        std::vector<Float3>     _positions, _normals;
+        std::vector<Float4>     _weights;
+        std::vector<UInt4>      _jointIndices;
+        std::vector<unsigned>   _triangles;
+
+        SyntheticSkinnedMesh(unsigned vertexCount, unsigned jointCount, unsigned seed)
+        {
+                //  Random vertices with normalized weights. Triangles are just
+                //  consecutive vertices (we only need them for ray tests)
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> value(-1.f, 1.f);
+            for (unsigned v=0; v<vertexCount; ++v) {
+                _positions.push_back(Float3(value(rng), value(rng), value(rng)) * 3.f);
+                _normals.push_back(Normalize(Float3(value(rng), value(rng), value(rng))));
+                Float4 w(std::abs(value(rng)) + .1f, std::abs(value(rng)), std::abs(value(rng)), std::abs(value(rng)));
+                _weights.push_back(w / (w[0] + w[1] + w[2] + w[3]));
+                _jointIndices.push_back(UInt4(rng()%jointCount, rng()%jointCount, rng()%jointCount, rng()%jointCount));
+            }
+            for (unsigned t=0; (t+3)<=vertexCount; t+=3) {
+                _triangles.push_back(t); _triangles.push_back(t+1); _triangles.push_back(t+2);
+            }
+        }
+
+        CPUSkinningMesh Build(const CPUSkinningMesh::Section sections[], unsigned sectionCount) const
+        {
+            return CPUSkinningMesh(
+                AsPointer(_positions.cbegin()), AsPointer(_normals.cbegin()),
+                AsPointer(_weights.cbegin()), AsPointer(_jointIndices.cbegin()),
+                unsigned(_positions.size()), sections, sectionCount,
+                AsPointer(_triangles.cbegin()), unsigned(_triangles.size()));
+        }
+    };
+
+    static std::vector<Float3x4> RandomRigidPalette(unsigned jointCount, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> value(-1.f, 1.f);
+        std::vector<Float3x4> result;
+        for (unsigned j=0; j<jointCount; ++j) {
+            auto rotation = MakeRotationMatrix(Normalize(Float3(value(rng), value(rng), value(rng))), value(rng) * 3.f);
+            Float3x4 m;
+            for (unsigned r=0; r<3; ++r) {
+                for (unsigned c=0; c<3; ++c) m(r,c) = rotation(r,c);
+                m(r,3) = value(rng) * 5.f;
+            }
+            result.push_back(m);
+        }
+        return result;
+    }
+
+    static Float3 TransformByRow(const Float3x4& m, Float3 v, float w)
+    {
+        return Float3(
+            m(0,0)*v[0] + m(0,1)*v[1] + m(0,2)*v[2] + m(0,3)*w,
+            m(1,0)*v[0] + m(1,1)*v[1] + m(1,2)*v[2] + m(1,3)*w,
+            m(2,0)*v[0] + m(2,1)*v[1] + m(2,2)*v[2] + m(2,3)*w);
+    }
+
+    static unsigned InfluenceCount(const CPUSkinningMesh::Section sections[], unsigned sectionCount, unsigned vertex)
+    {
+        for (unsigned s=0; s<sectionCount; ++s)
+            if (vertex >= sections[s]._firstVertex && vertex < (sections[s]._firstVertex + sections[s]._vertexCount))
+                return sections[s]._influenceCount;
+        return 0;
+    }
+
+    TEST_CLASS(CPUSkinning)
+	{
+	public:
+		TEST_METHOD(LinearBlendMatchesReference)
+		{
+                //  Compare against a simple scalar version of the skinning shader.
+                //  The sections have gaps and lengths that aren't multiples of 4
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned vertexCount = 1003, jointCount = 40;
+            SyntheticSkinnedMesh source(vertexCount, jointCount, 5);
+            const CPUSkinningMesh::Section sections[] = { {0, 301, 4}, {301, 200, 2}, {520, 301, 1}, {850, 100, 3} };
+            auto mesh = source.Build(sections, dimof(sections));
+            auto palette = RandomRigidPalette(jointCount, 6);
+            Assert::AreEqual(vertexCount, mesh.GetVertexCount());
+            Assert::IsTrue(mesh.GetPaletteSize() <= jointCount);
+
+            CPUSkinnedVertices result;
+            mesh.Skin(result, AsPointer(palette.cbegin()), jointCount);
+
+            for (unsigned v=0; v<vertexCount; ++v) {
+                auto influenceCount = InfluenceCount(sections, dimof(sections), v);
+                Float3 position = source._positions[v], normal = source._normals[v];
+                if (influenceCount) {
+                    position = normal = Float3(0.f, 0.f, 0.f);
+                    for (unsigned c=0; c<influenceCount; ++c) {
+                        const auto& joint = palette[source._jointIndices[v][c]];
+                        position += source._weights[v][c] * TransformByRow(joint, source._positions[v], 1.f);
+                        normal += source._weights[v][c] * TransformByRow(joint, source._normals[v], 0.f);
+                    }
+                }
+                Assert::IsTrue(Magnitude(result.GetPosition(v) - position) < 1e-4f);
+                Assert::IsTrue(Magnitude(result.GetNormal(v) - normal) < 1e-4f);
+            }
+        }
+
+        TEST_METHOD(DualQuaternion)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned vertexCount = 1003, jointCount = 40;
+            SyntheticSkinnedMesh source(vertexCount, jointCount, 7);
+            auto palette = RandomRigidPalette(jointCount, 8);
+
+                //  With a single influence, the dual quaternion result should match
+                //  linear blend (both are just the rigid joint transform)
+            {
+                const CPUSkinningMesh::Section sections[] = { {0, vertexCount, 1} };
+                auto singleWeights = source;
+                std::fill(singleWeights._weights.begin(), singleWeights._weights.end(), Float4(1.f, 0.f, 0.f, 0.f));
+                auto mesh = singleWeights.Build(sections, dimof(sections));
+                CPUSkinnedVertices linearBlend, dualQuaternion;
+                mesh.Skin(linearBlend, AsPointer(palette.cbegin()), jointCount, CPUSkinningMethod::LinearBlend);
+                mesh.Skin(dualQuaternion, AsPointer(palette.cbegin()), jointCount, CPUSkinningMethod::DualQuaternion);
+                for (unsigned v=0; v<vertexCount; ++v) {
+                    Assert::IsTrue(Magnitude(linearBlend.GetPosition(v) - dualQuaternion.GetPosition(v)) < 1e-4f);
+                    Assert::IsTrue(Magnitude(linearBlend.GetNormal(v) - dualQuaternion.GetNormal(v)) < 1e-4f);
+                }
+            }
+
+                //  With blended influences, the result is always a rigid transform. So
+                //  unit length normals stay unit length (unlike linear blend)
+            {
+                const CPUSkinningMesh::Section sections[] = { {0, vertexCount, 4} };
+                auto mesh = source.Build(sections, dimof(sections));
+                CPUSkinnedVertices dualQuaternion;
+                mesh.Skin(dualQuaternion, AsPointer(palette.cbegin()), jointCount, CPUSkinningMethod::DualQuaternion);
+                for (unsigned v=0; v<vertexCount; ++v)
+                    Assert::IsTrue(std::abs(Magnitude(dualQuaternion.GetNormal(v)) - 1.f) < 1e-4f);
+            }
+        }
+
+        TEST_METHOD(RayTest)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned vertexCount = 300, jointCount = 16;
+            SyntheticSkinnedMesh source(vertexCount, jointCount, 9);
+            const CPUSkinningMesh::Section sections[] = { {0, vertexCount, 4} };
+            auto mesh = source.Build(sections, dimof(sections));
+            auto palette = RandomRigidPalette(jointCount, 10);
+            CPUSkinnedVertices skinned;
+            mesh.Skin(skinned, AsPointer(palette.cbegin()), jointCount);
+
+                //  Short ray through the middle of each triangle (in its skinned position).
+                //  The triangles are random, so sometimes another one gets in the way
+                //  first. But we should never find anything further away.
+            unsigned directHits = 0;
+            for (unsigned t=0; t<mesh.GetTriangleCount(); ++t) {
+                auto a = skinned.GetPosition(t*3), b = skinned.GetPosition(t*3+1), c = skinned.GetPosition(t*3+2);
+                auto centre = (a + b + c) / 3.f;
+                auto normal = Normalize(Cross(b - a, c - a));
+                unsigned hitTriangle = ~0u;
+                auto distance = mesh.RayTest(skinned, std::make_pair(centre + normal * 1e-2f, centre - normal * 1e-2f), &hitTriangle);
+                Assert::IsTrue(hitTriangle < mesh.GetTriangleCount());
+                Assert::IsTrue(distance < (1e-2f + 1e-4f));
+                if (hitTriangle == t) {
+                    Assert::IsTrue(std::abs(distance - 1e-2f) < 1e-4f);
+                    ++directHits;
+                }
+            }
+            Assert::IsTrue(directHits > mesh.GetTriangleCount() / 2);
+
+            unsigned hitTriangle = 0;
+            auto miss = mesh.RayTest(skinned, std::make_pair(Float3(100.f, 100.f, 100.f), Float3(101.f, 100.f, 100.f)), &hitTriangle);
+            Assert::AreEqual(FLT_MAX, miss);
+            Assert::AreEqual(~0u, hitTriangle);
+        }
+
+        TEST_METHOD(SkinnedModel)
+        {
+                //  Skin the sample character with CPUSkinnedModel, and compare each mesh
+                //  to skinning it directly on this thread, with the joint palette from
+                //  WriteJointTransforms. This checks the palette layout and the batching
+                //  in CPUSkinnedModel::Skin. Some of the vertices are also compared to a
+                //  scalar version of the skinning shader (as in LinearBlendMatchesReference),
+                //  so a bad palette can't match itself.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            {
+                auto assetServices = std::make_shared<::Assets::Services>(0);
+                auto renderAssetServices = std::make_shared<RenderCore::Assets::Services>(nullptr);
+                renderAssetServices->InitColladaCompilers();
+
+                auto& model = LoadCompiledScaffold<ModelScaffold>("game/chr/nu_f/skin/dragon003");
+                auto& skeleton = LoadCompiledScaffold<SkeletonScaffold>("game/chr/nu_f/skeleton/all_co_sk_whirlwind_launch_mub");
+                auto& animSet = LoadCompiledScaffold<AnimationSetScaffold>("game/chr/nu_f/animation");
+                SkinPrepareMachine prepareMachine(model, animSet, skeleton);
+
+                ModelRenderer::PreparedAnimation preparedAnim;
+                preparedAnim._animState = AnimationState(.5f, Hash64("onehand_mo_combat_run_f"));
+                prepareMachine.PrepareAnimation(nullptr, preparedAnim);
+                const auto& skeletonBinding = prepareMachine.GetSkeletonBinding();
+
+                CPUSkinnedModel skinnedModel(model);
+                auto& data = model.ImmutableData();
+                Assert::AreEqual(unsigned(data._boundSkinnedControllerCount), skinnedModel.GetMeshCount());
+                Assert::IsTrue(skinnedModel.GetMeshCount() > 0);
+
+                std::vector<CPUSkinnedVertices> result;
+                skinnedModel.Skin(result, preparedAnim._finalMatrices.get(), skeletonBinding);
+                Assert::AreEqual(size_t(skinnedModel.GetMeshCount()), result.size());
+
+                for (unsigned m=0; m<skinnedModel.GetMeshCount(); ++m) {
+                    const auto& mesh = skinnedModel.GetMesh(m);
+                    auto paletteSize = std::max(unsigned(data._boundSkinnedControllers[m]._jointMatrixCount), mesh.GetPaletteSize());
+                    std::vector<Float3x4> palette(paletteSize, Identity<Float3x4>());
+                    WriteJointTransforms(
+                        AsPointer(palette.begin()), paletteSize, data._boundSkinnedControllers[m],
+                        preparedAnim._finalMatrices.get(), skeletonBinding);
+
+                    CPUSkinnedVertices expected;
+                    mesh.Skin(expected, AsPointer(palette.cbegin()), paletteSize);
+
+                    Assert::AreEqual(mesh.GetVertexCount(), result[m]._vertexCount);
+                    Assert::IsTrue(expected._streams == result[m]._streams);
+
+                    unsigned skinnedVertices = 0;
+                    for (unsigned v=0; v<mesh.GetVertexCount(); v+=37) {
+                        auto src = mesh.GetSourceVertex(v);
+                        Float3 position = src._position;
+                        if (src._influenceCount) {
+                            position = Float3(0.f, 0.f, 0.f);
+                            for (unsigned c=0; c<src._influenceCount; ++c) {
+                                Assert::IsTrue(src._jointIndices[c] < paletteSize);
+                                position += src._weights[c] * TransformByRow(palette[src._jointIndices[c]], src._position, 1.f);
+                            }
+                            ++skinnedVertices;
+                        }
+                            //  (relative to the distance from the origin)
+                        auto tolerance = 1e-4f * std::max(1.f, Magnitude(position));
+                        Assert::IsTrue(Magnitude(result[m].GetPosition(v) - position) < tolerance);
+                    }
+                    Assert::IsTrue(skinnedVertices > 0);
+                }
+            }
+        }
+
+        TEST_METHOD(HeadlessBenchmark)
+        {
+                //  Skin a crowd worth of meshes without any device. Compare a
+                //  single thread to CPUSkinMeshes (split across the thread pool),
+                //  for both methods.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned meshCount = 64, vertexCount = 8192, jointCount = 64;
+            SyntheticSkinnedMesh source(vertexCount, jointCount, 11);
+            const CPUSkinningMesh::Section sections[] = { {0, vertexCount/2, 4}, {vertexCount/2, vertexCount/4, 2}, {vertexCount*3/4, vertexCount/4, 1} };
+            std::vector<CPUSkinningMesh> meshes;
+            std::vector<std::vector<Float3x4>> palettes;
+            for (unsigned m=0; m<meshCount; ++m) {
+                meshes.push_back(source.Build(sections, dimof(sections)));
+                palettes.push_back(RandomRigidPalette(jointCount, m));
+            }
+
+            std::vector<CPUSkinnedVertices> serial(meshCount), parallel(meshCount), dualQuaternion(meshCount);
+            std::vector<CPUSkinningJob> parallelJobs, dualQuaternionJobs;
+            for (unsigned m=0; m<meshCount; ++m) {
+                CPUSkinningJob job = { &meshes[m], AsPointer(palettes[m].cbegin()), jointCount, &parallel[m] };
+                parallelJobs.push_back(job);
+                job._output = &dualQuaternion[m];
+                dualQuaternionJobs.push_back(job);
+            }
+
+            auto start = GetPerformanceCounter();
+            for (unsigned m=0; m<meshCount; ++m)
+                meshes[m].Skin(serial[m], AsPointer(palettes[m].cbegin()), jointCount);
+            auto middle0 = GetPerformanceCounter();
+            CPUSkinMeshes(AsPointer(parallelJobs.cbegin()), parallelJobs.size(), CPUSkinningMethod::LinearBlend);
+            auto middle1 = GetPerformanceCounter();
+            CPUSkinMeshes(AsPointer(dualQuaternionJobs.cbegin()), dualQuaternionJobs.size(), CPUSkinningMethod::DualQuaternion);
+            auto end = GetPerformanceCounter();
+
+            for (unsigned m=0; m<meshCount; ++m)
+                Assert::IsTrue(serial[m]._streams == parallel[m]._streams);
+
+            auto freq = float(GetPerformanceCounterFrequency());
+            LogAlwaysWarning
+                << meshCount << " meshes with " << vertexCount << " vertices: linear blend "
+                << 1000.f * (middle0-start) / freq << "ms, linear blend parallel "
+                << 1000.f * (middle1-middle0) / freq << "ms, dual quaternion parallel "
+                << 1000.f * (end-middle1) / freq << "ms";
+        }
+	};
+}
+
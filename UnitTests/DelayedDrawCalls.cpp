@@ -0,0 +1,114 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/DelayedDrawCall.h"
+#include "../Math/Transformations.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include <CppUnitTest.h>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using RenderCore::Assets::DelayedDrawCall;
+    using RenderCore::Assets::DelayedDrawCallSet;
+
+    class FakeRenderer
+    {
+    public:
+        unsigned _drawCallCount;
+        unsigned _step;
+    };
+
+    static void FakePrepare(DelayedDrawCallSet& dest, const FakeRenderer& renderer, const Float4x4& modelToWorld)
+    {
+            // mimics ModelRenderer::Prepare -- one transform, and one entry per draw call
+        auto transformIndex = (unsigned)dest._transforms.size();
+        dest._transforms.push_back(modelToWorld);
+        for (unsigned c=0; c<renderer._drawCallCount; ++c) {
+            DelayedDrawCall entry;
+            XlZeroMemory(entry);
+            entry._renderer = &renderer;
+            entry._subMesh = &renderer;
+            entry._drawCallIndex = c;
+            entry._meshToWorld = transformIndex;
+            entry._instanceCount = 1;
+            entry._indexCount = 36;
+            dest._entries[renderer._step].push_back(entry);
+        }
+    }
+
+    TEST_CLASS(DelayedDrawCalls)
+	{
+	public:
+		TEST_METHOD(PlacementsInstancing)
+		{
+                //  Simulate a "forest" of placements (a few different models, repeated many
+                //  times, spread over a few threads), and count the draw records before and
+                //  after DelayedDrawCallSet::BuildInstances
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            FakeRenderer renderers[] = { {2, 0}, {3, 0}, {1, 0}, {4, 1}, {2, 2} };
+            const unsigned objectCount = 5000;
+            const unsigned threadCount = 4;
+
+            std::mt19937 rng(4512);
+            std::vector<unsigned> objectRenderers;
+            for (unsigned c=0; c<objectCount; ++c)
+                objectRenderers.push_back(rng() % dimof(renderers));
+
+            std::vector<std::unique_ptr<DelayedDrawCallSet>> threadSets;
+            for (unsigned t=0; t<threadCount; ++t)
+                threadSets.push_back(std::make_unique<DelayedDrawCallSet>(0));
+
+            size_t originalRecordCount = 0;
+            for (unsigned c=0; c<objectCount; ++c) {
+                auto& renderer = renderers[objectRenderers[c]];
+                FakePrepare(*threadSets[c * threadCount / objectCount], renderer, AsFloat4x4(Float3(float(c), 0.f, 0.f)));
+                originalRecordCount += renderer._drawCallCount;
+            }
+
+            DelayedDrawCallSet merged(0);
+            for (unsigned t=0; t<threadCount; ++t) {
+                threadSets[t]->BuildInstances();
+                merged.Append(*threadSets[t]);
+            }
+            merged.BuildInstances();
+
+            size_t expectedRecordCount = 0;
+            for (unsigned c=0; c<dimof(renderers); ++c)
+                expectedRecordCount += renderers[c]._drawCallCount;
+
+            size_t recordCount = 0;
+            for (unsigned step=0; step<dimof(merged._entries); ++step) {
+                for (auto i=merged._entries[step].cbegin(); i!=merged._entries[step].cend(); ++i) {
+                    auto& renderer = *(const FakeRenderer*)i->_renderer;
+                    Assert::AreEqual(renderer._step, step);
+
+                        //  every object using this renderer must be an instance, in the
+                        //  original order
+                    unsigned instance = 0;
+                    for (unsigned c=0; c<objectCount; ++c) {
+                        if (&renderers[objectRenderers[c]] != &renderer) continue;
+                        Assert::IsTrue(instance < i->_instanceCount);
+                        Assert::AreEqual(float(c), ExtractTranslation(merged._transforms[i->_meshToWorld + instance])[0]);
+                        ++instance;
+                    }
+                    Assert::AreEqual(instance, i->_instanceCount);
+                }
+                recordCount += merged._entries[step].size();
+            }
+
+            Assert::AreEqual(expectedRecordCount, recordCount);
+            LogAlwaysWarning << "Placements instancing: (" << originalRecordCount << ") draw records collapsed to (" << recordCount << ")";
+        }
+	};
+}
+
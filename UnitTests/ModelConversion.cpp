@@ -11,6 +11,11 @@
 #include "../RenderCore/Assets/Services.h"
 #include "../ColladaConversion/DLLInterface.h"
 #include "../ColladaConversion/NascentModel.h"
+#include "../ColladaConversion/ScaffoldParsingUtil.h"
+#include "../ColladaConversion/GeometryAlgorithm.h"
+#include "../ColladaConversion/MeshDatabaseAdapter.h"
+#include "../ColladaConversion/NascentCommandStream.h"
+#include "../RenderCore/Metal/Format.h"
 #include "../Assets/IntermediateAssets.h"
 #include "../Assets/Assets.h"
 #include "../ConsoleRig/Console.h"
@@ -22,10 +27,19 @@
 #include "../Utility/TimeUtils.h"
 #include "../Utility/Threading/ThreadingUtils.h"
 #include "../Utility/Conversion.h"
+#include "../Utility/PtrUtils.h"
 #include "../Utility/Streams/StreamDOM.h"
 #include "../Utility/Streams/XmlStreamFormatter.h"
+#include "../Utility/Streams/FileUtils.h"
 #include "../Core/SelectConfiguration.h"
 #include <CppUnitTest.h>
+#include <sstream>
+#include <iomanip>
+#include <random>
+#include <array>
+#include <algorithm>
+#include <limits>
+#include <set>
 
 #include "../Core/WinAPI/IncludeWindows.h"
 
@@ -58,6 +72,163 @@ namespace UnitTests
         }
     }
 
+    static void WriteSyntheticDAE(const char filename[], unsigned gridDims)
+    {
+            // Write a simple collada file with a single large grid mesh. This is 
+            // intended to look like the very large exports we get from some tools
+            // (ie, long <float_array> and <p> elements dominate the file).
+        std::stringstream str;
+        str << std::fixed << std::setprecision(6);
+        str << "<?xml version=\"1.0\" encoding=\"utf-8\"?>\n";
+        str << "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n";
+        str << "<asset><unit name=\"meter\" meter=\"1\"/><up_axis>Z_UP</up_axis></asset>\n";
+        str << "<library_geometries><geometry id=\"grid-mesh\" name=\"grid\"><mesh>\n";
+
+        auto vertexCount = gridDims * gridDims;
+        str << "<source id=\"grid-positions\"><float_array id=\"grid-positions-array\" count=\"" << vertexCount*3 << "\">";
+        for (unsigned y=0; y<gridDims; ++y)
+            for (unsigned x=0; x<gridDims; ++x) {
+                float height = std::sin(float(x) * 0.137f) * std::cos(float(y) * 0.071f) * 12.5f;
+                str << float(x) * 0.25f << " " << float(y) * 0.25f << " " << height << " ";
+            }
+        str << "</float_array>\n";
+        str << "<technique_common><accessor source=\"#grid-positions-array\" count=\"" << vertexCount << "\" stride=\"3\">";
+        str << "<param name=\"X\" type=\"float\"/><param name=\"Y\" type=\"float\"/><param name=\"Z\" type=\"float\"/>";
+        str << "</accessor></technique_common></source>\n";
+        str << "<vertices id=\"grid-vertices\"><input semantic=\"POSITION\" source=\"#grid-positions\"/></vertices>\n";
+
+        auto triangleCount = (gridDims-1) * (gridDims-1) * 2;
+        str << "<triangles count=\"" << triangleCount << "\"><input semantic=\"VERTEX\" source=\"#grid-vertices\" offset=\"0\"/><p>";
+        for (unsigned y=0; y<gridDims-1; ++y)
+            for (unsigned x=0; x<gridDims-1; ++x) {
+                auto i0 = y*gridDims+x, i1 = i0+1, i2 = i0+gridDims, i3 = i2+1;
+                str << i0 << " " << i1 << " " << i2 << " " << i2 << " " << i1 << " " << i3 << " ";
+            }
+        str << "</p></triangles>\n";
+        str << "</mesh></geometry></library_geometries>\n";
+
+        str << "<library_visual_scenes><visual_scene id=\"scene\">";
+        str << "<node id=\"grid-node\" name=\"grid\"><instance_geometry url=\"#grid-mesh\"/></node>";
+        str << "</visual_scene></library_visual_scenes>\n";
+        str << "<scene><instance_visual_scene url=\"#scene\"/></scene>\n";
+        str << "</COLLADA>\n";
+
+        auto data = str.str();
+        BasicFile file(filename, "wb");
+        file.Write(data.c_str(), 1, data.size());
+    }
+
+    static std::string WriteSyntheticList(bool floats, unsigned elementCount, unsigned seed)
+    {
+            // Build a whitespace separated list like the contents of a <float_array> or <p>.
+            // Separators, exponents and signs are mixed up so that chunk boundaries in the 
+            // parallel parser fall on a variety of different cases.
+        const char* separators[] = { " ", "  ", "\t", "\n", "\r\n", " \t \n" };
+        std::mt19937 rng(seed);
+        std::uniform_int_distribution<unsigned> sep(0, dimof(separators)-1);
+        std::uniform_int_distribution<unsigned> form(0, 5);
+        std::uniform_int_distribution<int> exponent(-12, 12);
+        std::uniform_real_distribution<float> value(-1000.f, 1000.f);
+        std::uniform_int_distribution<uint32> integer(0, 0xffffffffu);
+
+        std::stringstream str;
+        str << " \t\n  ";      // leading whitespace
+        for (unsigned c=0; c<elementCount; ++c) {
+            if (c) str << separators[sep(rng)];
+            if (floats) {
+                switch (form(rng)) {
+                case 0: str << std::setprecision(9) << value(rng); break;
+                case 1: str << std::scientific << std::setprecision(7) << value(rng); str.unsetf(std::ios::floatfield); break;
+                case 2: str << int(value(rng)); break;
+                case 3: str << std::setprecision(5) << value(rng) << "e" << exponent(rng); break;
+                case 4: str << "-0." << (rng() % 100000) << "E+" << (rng() % 4); break;
+                default: str << std::fixed << std::setprecision(3) << value(rng) / 1000.f; str.unsetf(std::ios::floatfield); break;
+                }
+            } else {
+                switch (form(rng)) {
+                case 0: str << integer(rng); break;
+                case 1: str << (rng() % 10); break;
+                default: str << (rng() % 65536); break;
+                }
+            }
+        }
+        str << " \r\n\t ";     // trailing whitespace
+        return str.str();
+    }
+
+    template<typename Type>
+        static void CheckParallelListParse(const std::string& list, unsigned destCount)
+    {
+        using namespace ColladaConversion;
+        XmlInputStreamFormatter<utf8>::InteriorSection section(
+            (const utf8*)list.data(), (const utf8*)(list.data() + list.size()));
+
+        std::vector<Type> sequential(destCount, Type(0)), parallel(destCount, Type(0));
+        unsigned sequentialCount = ~0u, parallelCount = ~0u;
+        auto* sequentialEnd = ParseXMLListSequential(AsPointer(sequential.begin()), destCount, section, &sequentialCount);
+        const utf8* parallelEnd = nullptr;
+        Assert::IsTrue(ParallelParseXMLList(AsPointer(parallel.begin()), destCount, section, &parallelCount, parallelEnd));
+
+        Assert::AreEqual(sequentialCount, parallelCount);
+        Assert::IsTrue(sequentialEnd == parallelEnd);
+        Assert::IsTrue(std::memcmp(AsPointer(sequential.begin()), AsPointer(parallel.begin()), destCount * sizeof(Type)) == 0);
+    }
+
+    static std::vector<unsigned> BuildGridTriangles(unsigned gridDims)
+    {
+        std::vector<unsigned> result;
+        result.reserve((gridDims-1)*(gridDims-1)*6);
+        for (unsigned y=0; y<gridDims-1; ++y)
+            for (unsigned x=0; x<gridDims-1; ++x) {
+                auto i0 = y*gridDims+x, i1 = i0+1, i2 = i0+gridDims, i3 = i2+1;
+                unsigned tris[] = { i0, i1, i2, i2, i1, i3 };
+                result.insert(result.end(), tris, &tris[dimof(tris)]);
+            }
+        return std::move(result);
+    }
+
+    static std::set<std::pair<unsigned, unsigned>> FindBorderEdges(
+        const std::vector<std::vector<unsigned>>& drawOperations, const unsigned positionIndices[])
+    {
+            // Directed edges (in terms of position indices) without a matching edge in the opposite direction
+        std::set<std::pair<unsigned, unsigned>> edges;
+        for (const auto& d:drawOperations)
+            for (size_t t=0; t+2<d.size(); t+=3)
+                for (unsigned e=0; e<3; ++e)
+                    edges.insert(std::make_pair(positionIndices[d[t+e]], positionIndices[d[t+(e+1)%3]]));
+
+        std::set<std::pair<unsigned, unsigned>> result;
+        for (const auto& e:edges)
+            if (edges.find(std::make_pair(e.second, e.first)) == edges.end())
+                result.insert(e);
+        return std::move(result);
+    }
+
+    static std::vector<std::array<unsigned, 3>> SortedTriangles(const std::vector<unsigned>& indices)
+    {
+        std::vector<std::array<unsigned, 3>> result;
+        for (size_t c=0; c+2<indices.size(); c+=3) {
+            std::array<unsigned, 3> t = { indices[c], indices[c+1], indices[c+2] };
+            result.push_back(t);
+        }
+        std::sort(result.begin(), result.end());
+        return std::move(result);
+    }
+
+    static void CheckVertexCacheOptimisation(const std::vector<unsigned>& input, size_t vertexCount, unsigned cacheSize)
+    {
+        using namespace RenderCore::ColladaConversion;
+        auto optimized = input;
+        OptimizeVertexCache(AsPointer(optimized.begin()), optimized.size(), vertexCount, cacheSize);
+
+            // the output must contain exactly the same triangles (with the same winding), just reordered
+        Assert::IsTrue(SortedTriangles(input) == SortedTriangles(optimized));
+
+        auto before = CalculateVertexCacheMetrics(AsPointer(input.cbegin()), input.size(), vertexCount, cacheSize);
+        auto after = CalculateVertexCacheMetrics(AsPointer(optimized.cbegin()), optimized.size(), vertexCount, cacheSize);
+        Assert::IsTrue(after._acmr <= before._acmr);
+    }
+
 	TEST_CLASS(ModelConversion)
 	{
 	public:
@@ -156,6 +327,270 @@ namespace UnitTests
             }
         }
 
+        TEST_METHOD(ColladaLargeArrayParsePerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                // Measure parsing performance for very large <float_array> and <p> lists.
+                // These lists are large enough to be split between threads, so
+                // this profiles both the SIMD number scanning and the parallel split.
+            {
+                #if defined(_DEBUG)
+                    ConsoleRig::AttachableLibrary lib("../Finals_Debug32/ColladaConversion.dll");
+                #else
+                    ConsoleRig::AttachableLibrary lib("../Finals_Profile32/ColladaConversion.dll");
+                #endif
+                lib.TryAttach();
+
+                #if !TARGET_64BIT
+                    auto createScaffold = lib.GetFunction<RenderCore::ColladaConversion::CreateColladaScaffoldFn*>(
+                        "?CreateColladaScaffold@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@VColladaScaffold@ColladaConversion@RenderCore@@@std@@QBD@Z");
+                    auto serializeSkin = lib.GetFunction<RenderCore::ColladaConversion::ModelSerializeFn*>(
+                        "?SerializeSkin@ColladaConversion@RenderCore@@YA?AV?$shared_ptr@V?$vector@VNascentChunk@ColladaConversion@RenderCore@@V?$allocator@VNascentChunk@ColladaConversion@RenderCore@@@std@@@std@@@std@@ABVColladaScaffold@12@@Z");
+
+                    const unsigned gridSizes[] = { 64, 512, 1536 };
+                    for (unsigned g=0; g<dimof(gridSizes); ++g) {
+                        StringMeld<256> testFile;
+                        testFile << "synthetic_grid_" << gridSizes[g] << ".dae";
+                        WriteSyntheticDAE(testFile, gridSizes[g]);
+                        auto bytes = GetFileSize(testFile);
+
+                        const unsigned iterations = (unsigned)std::max(uint64(4), uint64(1024*1024*1024) / uint64(bytes));
+                        auto startCycles = __rdtsc();
+                        auto start = GetPerformanceCounter();
+                        for (unsigned c=0; c<iterations; ++c) {
+                            auto scaffold = (*createScaffold)(testFile);
+                            auto chunks = (*serializeSkin)(*scaffold);
+                        }
+                        auto end = GetPerformanceCounter();
+                        auto endCycles = __rdtsc();
+
+                        auto seconds = (end-start) / float(GetPerformanceCounterFrequency());
+                        LogAlwaysWarning 
+                            << "Synthetic grid (" << gridSizes[g] << "x" << gridSizes[g] << ", " << bytes/1024 << "KB): "
+                            << (endCycles-startCycles) / (uint64(bytes)*iterations) << " cycles per byte, "
+                            << (float(bytes)*iterations) / (1024.f*1024.f*seconds) << " MB/s";
+
+                        XlDeleteFile((const utf8*)testFile.get());
+                    }
+                #endif
+            }
+        }
+
+        TEST_METHOD(ColladaParallelListParse)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                // The parallel list parser must give exactly the same results as the 
+                // sequential parser. The element counts here are chosen so that they 
+                // aren't a multiple of the SIMD width, and the lists are large enough 
+                // to be split between threads.
+            const unsigned elementCount = 400003;
+            auto floats = WriteSyntheticList(true, elementCount, 5381);
+            auto ints = WriteSyntheticList(false, elementCount, 6151);
+
+            CheckParallelListParse<float>(floats, elementCount);
+            CheckParallelListParse<uint32>(ints, elementCount);
+
+                // destination arrays that are smaller than the list stop part way through
+            CheckParallelListParse<float>(floats, elementCount - 12345);
+            CheckParallelListParse<uint32>(ints, elementCount - 12345);
+
+                // reading just a few elements from the front of a large list (as we do for each
+                // polygon in a <polylist>) should never be split between threads
+            {
+                XmlInputStreamFormatter<utf8>::InteriorSection section(
+                    (const utf8*)floats.data(), (const utf8*)(floats.data() + floats.size()));
+                float dest[8];
+                const utf8* end = nullptr;
+                Assert::IsFalse(ColladaConversion::ParallelParseXMLList(dest, dimof(dest), section, nullptr, end));
+            }
+        }
+
+        TEST_METHOD(VertexCacheOptimisation)
+        {
+            const unsigned cacheSizes[] = { 8, 16, 32 };
+            for (unsigned c=0; c<dimof(cacheSizes); ++c) {
+                    // a regular grid (which is already in a reasonable order)
+                const unsigned gridDims = 65;
+                auto grid = BuildGridTriangles(gridDims);
+                CheckVertexCacheOptimisation(grid, gridDims*gridDims, cacheSizes[c]);
+
+                    // the same grid with the triangles shuffled
+                std::vector<std::array<unsigned, 3>> triangles = SortedTriangles(grid);
+                std::mt19937 rng(5987);
+                std::shuffle(triangles.begin(), triangles.end(), rng);
+                std::vector<unsigned> shuffled;
+                for (const auto& t:triangles) shuffled.insert(shuffled.end(), t.begin(), t.end());
+                CheckVertexCacheOptimisation(shuffled, gridDims*gridDims, cacheSizes[c]);
+
+                    // random triangles, with some unreferenced vertices and a few repeated triangles
+                std::uniform_int_distribution<unsigned> vertex(0, 499);
+                std::vector<unsigned> random;
+                for (unsigned t=0; t<1500; ++t) {
+                    random.push_back(vertex(rng)); random.push_back(vertex(rng)); random.push_back(vertex(rng));
+                }
+                random.insert(random.end(), random.begin(), random.begin() + 30);
+                CheckVertexCacheOptimisation(random, 600, cacheSizes[c]);
+            }
+        }
+
+        TEST_METHOD(VertexWelding)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const auto nan = std::numeric_limits<float>::quiet_NaN();
+            const auto inf = std::numeric_limits<float>::infinity();
+            const float positions[][3] = 
+            {
+                { 0.f, 0.f, 0.f },
+                { 0.f, 0.f, 0.f },          // exact duplicate of 0
+                { 1e-4f, 0.f, 0.f },        // within epsilon of 0
+                { 1.f, 0.f, 0.f },
+                { nan, 0.f, 0.f },
+                { nan, 0.f, 0.f },          // same bit pattern as 4
+                { inf, 0.f, 0.f },
+                { 1e30f, 0.f, 0.f },        // too large to quantize, but not the same as 6
+                { -inf, 0.f, 0.f },
+                { 1.f, 0.f, 0.f },          // duplicate of 3
+            };
+            const unsigned expectedRemap[] = { 0, 0, 0, 1, 2, 2, 3, 4, 5, 1 };
+
+            bool parallel[] = { false, true };
+            for (auto p:parallel) {
+                RenderCore::ColladaConversion::MeshDatabaseAdapter mesh;
+                mesh.AddStream(
+                    RenderCore::ColladaConversion::CreateRawDataSource(positions, PtrAdd(positions, sizeof(positions)), RenderCore::Metal::NativeFormat::R32G32B32_FLOAT),
+                    std::vector<unsigned>(), "POSITION", 0);
+
+                RenderCore::ColladaConversion::VertexWeldingConfig cfg;
+                cfg._defaultEpsilon = 1e-2f;
+                cfg._parallel = p;
+                auto remap = mesh.WeldVertices(cfg);
+
+                Assert::AreEqual(size_t(dimof(expectedRemap)), remap.size());
+                for (unsigned c=0; c<dimof(expectedRemap); ++c)
+                    Assert::AreEqual(expectedRemap[c], remap[c]);
+                Assert::AreEqual(size_t(6), mesh._unifiedVertexCount);
+
+                    // the remaining vertices should reference the first of each group of duplicates
+                const unsigned expectedVertexMap[] = { 0, 3, 4, 6, 7, 8 };
+                Assert::AreEqual(size_t(dimof(expectedVertexMap)), mesh._streams[0]._vertexMap.size());
+                for (unsigned c=0; c<dimof(expectedVertexMap); ++c)
+                    Assert::AreEqual(expectedVertexMap[c], mesh._streams[0]._vertexMap[c]);
+            }
+
+                //  Two position indices with the same value. These only weld when
+                //  "_matchPositionIndices" is off
+            const float sharedPositions[][3] = { { 2.f, 3.f, 4.f }, { 2.f, 3.f, 4.f } };
+            bool matchIndices[] = { false, true };
+            for (auto m:matchIndices) {
+                RenderCore::ColladaConversion::MeshDatabaseAdapter mesh;
+                mesh.AddStream(
+                    RenderCore::ColladaConversion::CreateRawDataSource(sharedPositions, PtrAdd(sharedPositions, sizeof(sharedPositions)), RenderCore::Metal::NativeFormat::R32G32B32_FLOAT),
+                    std::vector<unsigned>{ 0, 1, 0, 1 }, "POSITION", 0);
+
+                RenderCore::ColladaConversion::VertexWeldingConfig cfg;
+                cfg._matchPositionIndices = m;
+                auto remap = mesh.WeldVertices(cfg);
+
+                Assert::AreEqual(size_t(4), remap.size());
+                Assert::AreEqual(size_t(m ? 2 : 1), mesh._unifiedVertexCount);
+                Assert::AreEqual(0u, remap[0]);
+                Assert::AreEqual(0u, remap[2]);
+                Assert::AreEqual(m ? 1u : 0u, remap[1]);
+                Assert::AreEqual(m ? 1u : 0u, remap[3]);
+            }
+        }
+
+        TEST_METHOD(LODSimplificationSeams)
+        {
+                //  A bumpy grid split into two draw operations (like a material boundary), with
+                //  a texture seam through the first one (the vertices along the seam are duplicated).
+                //  Each draw operation is simplified separately; the result must not have any cracks
+            const unsigned gridDims = 33, seamColumn = 8, splitColumn = 16;
+            std::vector<Float3> positions;
+            std::vector<unsigned> positionIndices;
+            for (unsigned y=0; y<gridDims; ++y)
+                for (unsigned x=0; x<gridDims; ++x) {
+                    positions.push_back(Float3(float(x), float(y), .25f * std::sin(.7f * float(x)) * std::cos(.5f * float(y))));
+                    positionIndices.push_back(y*gridDims+x);
+                }
+            for (unsigned y=0; y<gridDims; ++y) {
+                positions.push_back(positions[y*gridDims+seamColumn]);
+                positionIndices.push_back(y*gridDims+seamColumn);
+            }
+
+            auto grid = BuildGridTriangles(gridDims);
+            std::vector<std::vector<unsigned>> drawOperations(2);
+            for (size_t t=0; t<grid.size(); t+=3) {
+                unsigned minX = std::min(std::min(grid[t]%gridDims, grid[t+1]%gridDims), grid[t+2]%gridDims);
+                for (unsigned c=0; c<3; ++c) {
+                    auto i = grid[t+c];
+                    if (minX >= seamColumn && (i%gridDims) == seamColumn)
+                        i = gridDims*gridDims + i/gridDims;
+                    drawOperations[(minX < splitColumn) ? 0 : 1].push_back(i);
+                }
+            }
+
+            auto originalBorder = FindBorderEdges(drawOperations, AsPointer(positionIndices.cbegin()));
+            auto originalIndexCount = drawOperations[0].size() + drawOperations[1].size();
+
+            for (auto& d:drawOperations) {
+                auto error = RenderCore::ColladaConversion::SimplifyTriangleList(
+                    d, AsPointer(positions.cbegin()), positions.size(),
+                    nullptr, 0, 0.f, d.size()/4, 1.f);
+                Assert::IsTrue(error <= 1.f);
+            }
+
+            Assert::IsTrue((drawOperations[0].size() + drawOperations[1].size()) * 2 < originalIndexCount);
+            auto simplifiedBorder = FindBorderEdges(drawOperations, AsPointer(positionIndices.cbegin()));
+            Assert::IsTrue(originalBorder == simplifiedBorder);
+        }
+
+        TEST_METHOD(LODChainPadding)
+        {
+                //  Every geometry instance should get an entry for each LOD up to the
+                //  model's max LOD, reusing the last level of shorter chains
+            using RenderCore::ColladaConversion::NascentModelCommandStream;
+            NascentModelCommandStream cmdStream;
+            auto add = [&cmdStream](unsigned id, unsigned localToWorld, unsigned lod)
+            {
+                std::vector<NascentModelCommandStream::MaterialGuid> materials(1, 100+localToWorld);
+                cmdStream.Add(NascentModelCommandStream::GeometryInstance(id, localToWorld, std::move(materials), lod));
+            };
+            add(0, 0, 0); add(1, 0, 1); add(2, 0, 2);       // full chain
+            add(3, 1, 0);                                   // no generated LODs
+            add(4, 2, 0); add(5, 2, 1);                     // stopped early
+            cmdStream.PadLODChains();
+
+            const unsigned expected[][3] = 
+            {
+                // id, localToWorld, lod
+                { 0, 0, 0 }, { 1, 0, 1 }, { 2, 0, 2 },
+                { 3, 1, 0 }, { 3, 1, 1 }, { 3, 1, 2 },
+                { 4, 2, 0 }, { 5, 2, 1 }, { 5, 2, 2 }
+            };
+            Assert::AreEqual(size_t(dimof(expected)), cmdStream._geometryInstances.size());
+            for (unsigned c=0; c<dimof(expected); ++c) {
+                const auto& i = cmdStream._geometryInstances[c];
+                Assert::AreEqual(expected[c][0], i._id);
+                Assert::AreEqual(expected[c][1], i._localToWorldId);
+                Assert::AreEqual(expected[c][2], i._levelOfDetail);
+                Assert::IsTrue(i._materials.size() == 1 && i._materials[0] == 100+expected[c][1]);
+            }
+
+                // models without LODs are unchanged
+            NascentModelCommandStream noLODs;
+            noLODs.Add(NascentModelCommandStream::GeometryInstance(0, 0, std::vector<NascentModelCommandStream::MaterialGuid>(), 0));
+            noLODs.Add(NascentModelCommandStream::GeometryInstance(1, 1, std::vector<NascentModelCommandStream::MaterialGuid>(), 0));
+            noLODs.PadLODChains();
+            Assert::AreEqual(size_t(2), noLODs._geometryInstances.size());
+        }
+
         TEST_METHOD(StreamDOMParsePerformance)
         {
             UnitTest_SetWorkingDirectory();
@@ -0,0 +1,194 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../SceneEngine/PlacementsQuadTree.h"
+#include "../Math/Transformations.h"
+#include "../Math/ProjectionMath.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+        //  Similar to Placements::ObjectReference; the tree reads the bounding
+        //  boxes with a stride
+    class TestObject
+    {
+    public:
+        SceneEngine::PlacementsQuadTree::BoundingBox _cellSpaceBoundary;
+        unsigned _dummy[3];
+    };
+
+    static std::vector<TestObject> BuildRandomObjects(unsigned objectCount, unsigned seed)
+    {
+            //  Mostly small objects in clusters (like vegetation), with some larger
+            //  objects scattered over the whole cell
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> cellPosition(0.f, 512.f), clusterOffset(-16.f, 16.f);
+        std::uniform_real_distribution<float> smallSize(.25f, 4.f), largeSize(8.f, 64.f);
+
+        std::vector<TestObject> result;
+        result.reserve(objectCount);
+        Float3 clusterCentre(0.f, 0.f, 0.f);
+        for (unsigned c=0; c<objectCount; ++c) {
+            if ((c % 64) == 0)
+                clusterCentre = Float3(cellPosition(rng), cellPosition(rng), cellPosition(rng));
+
+            TestObject obj;
+            Float3 mins, size;
+            if ((c % 16) == 0) {
+                mins = Float3(cellPosition(rng), cellPosition(rng), cellPosition(rng));
+                size = Float3(largeSize(rng), largeSize(rng), largeSize(rng));
+            } else {
+                mins = clusterCentre + Float3(clusterOffset(rng), clusterOffset(rng), clusterOffset(rng));
+                size = Float3(smallSize(rng), smallSize(rng), smallSize(rng));
+            }
+            obj._cellSpaceBoundary = std::make_pair(mins, mins + size);
+            obj._dummy[0] = obj._dummy[1] = obj._dummy[2] = c;
+            result.push_back(obj);
+        }
+        return std::move(result);
+    }
+
+    static Float4x4 BuildCellToProjection(float yaw, const Float3& cameraPosition)
+    {
+            // simple perspective projection (looking down +Z; near 1, far 2000)
+        const float nearClip = 1.f, farClip = 2000.f;
+        Float4x4 projection(
+            1.f, 0.f, 0.f, 0.f,
+            0.f, 1.f, 0.f, 0.f,
+            0.f, 0.f, farClip / (farClip - nearClip), -nearClip * farClip / (farClip - nearClip),
+            0.f, 0.f, 1.f, 0.f);
+        Float4x4 cellToCamera = Identity<Float4x4>();
+        Combine_InPlace(RotationY(yaw), cellToCamera);
+        Combine_InPlace(-cameraPosition, cellToCamera);     // (applied before the rotation)
+        return Combine(cellToCamera, projection);
+    }
+
+    static std::vector<unsigned> CullTree(
+        const SceneEngine::PlacementsQuadTree& tree, const float cellToProjection[], unsigned objectCount)
+    {
+        std::vector<unsigned> result(objectCount);
+        unsigned visibleCount = 0;
+        Assert::IsTrue(tree.CalculateVisibleObjects(cellToProjection, AsPointer(result.begin()), visibleCount, objectCount));
+        result.resize(visibleCount);
+        std::sort(result.begin(), result.end());
+        return std::move(result);
+    }
+
+    TEST_CLASS(PlacementsCulling)
+    {
+    public:
+        TEST_METHOD(BVHMatchesQuadTree)
+        {
+                //  The old quad tree returned every object whose cell space bounding box
+                //  isn't culled (objects under entirely visible nodes were added without a
+                //  test, but must pass it anyway). So we can compare the BVH against a test
+                //  of every object, for cameras that see all, some and none of the objects.
+                //  We also check that serialized trees give the same results when used in-place.
+            const unsigned objectCount = 20000;
+            auto objects = BuildRandomObjects(objectCount, 7841);
+
+            SceneEngine::PlacementsQuadTree tree(&objects[0]._cellSpaceBoundary, sizeof(TestObject), objectCount);
+
+            auto serialized = tree.Serialize();
+            std::unique_ptr<uint8, PODAlignedDeletor> alignedCopy((uint8*)XlMemAlign(serialized.size(), 16));
+            XlCopyMemory(alignedCopy.get(), AsPointer(serialized.cbegin()), serialized.size());
+            SceneEngine::PlacementsQuadTree inPlaceTree(alignedCopy.get(), serialized.size(), objectCount);
+            Assert::IsTrue(inPlaceTree.Serialize() == serialized);
+
+            const Float3 cameraPositions[] =
+            {
+                Float3(256.f, 256.f, -600.f),   // far back, sees the whole cell
+                Float3(256.f, 256.f, 256.f),    // in the middle of the cell
+                Float3(40.f, 400.f, 100.f),
+                Float3(256.f, 256.f, 1200.f),   // behind the cell (looking away from it, except for the last yaw)
+            };
+            const float yaws[] = { 0.f, .2f * gPI, -.35f * gPI, gPI };
+
+            unsigned totalVisible = 0, partialViews = 0;
+            for (auto pos:cameraPositions)
+                for (auto yaw:yaws) {
+                    __declspec(align(16)) auto cellToProjection = BuildCellToProjection(yaw, pos);
+
+                    std::vector<unsigned> reference;
+                    for (unsigned c=0; c<objectCount; ++c) {
+                        const auto& b = objects[c]._cellSpaceBoundary;
+                        if (!XLEMath::CullAABB_Aligned(AsFloatArray(cellToProjection), b.first, b.second))
+                            reference.push_back(c);
+                    }
+
+                    auto visible = CullTree(tree, AsFloatArray(cellToProjection), objectCount);
+                    Assert::IsTrue(visible == reference);
+                    Assert::IsTrue(std::adjacent_find(visible.begin(), visible.end()) == visible.end());
+                    Assert::IsTrue(CullTree(inPlaceTree, AsFloatArray(cellToProjection), objectCount) == reference);
+
+                    totalVisible += unsigned(reference.size());
+                    partialViews += !reference.empty() && reference.size() != objectCount;
+
+                        //  When the output array is too small, the query should fail (rather
+                        //  than overrunning the array)
+                    if (reference.size() > 1) {
+                        std::vector<unsigned> small(reference.size()-1);
+                        unsigned visibleCount = 0;
+                        Assert::IsFalse(tree.CalculateVisibleObjects(
+                            AsFloatArray(cellToProjection), AsPointer(small.begin()),
+                            visibleCount, unsigned(small.size())));
+                        Assert::IsTrue(visibleCount <= small.size());
+                    }
+                }
+            Assert::IsTrue(totalVisible != 0 && partialViews != 0);
+        }
+
+        TEST_METHOD(BVHSerializationErrors)
+        {
+            const unsigned objectCount = 1000;
+            auto objects = BuildRandomObjects(objectCount, 2209);
+            auto serialized = SceneEngine::PlacementsQuadTree(
+                &objects[0]._cellSpaceBoundary, sizeof(TestObject), objectCount).Serialize();
+
+            std::unique_ptr<uint8, PODAlignedDeletor> alignedCopy((uint8*)XlMemAlign(serialized.size() + 16, 16));
+            XlCopyMemory(alignedCopy.get(), AsPointer(serialized.cbegin()), serialized.size());
+
+            auto expectException = [](const void* data, size_t size, size_t objCount)
+            {
+                bool gotException = false;
+                TRY { SceneEngine::PlacementsQuadTree tree(data, size, objCount); (void)tree; }
+                CATCH (...) { gotException = true; }
+                CATCH_END
+                Assert::IsTrue(gotException);
+            };
+
+                // wrong object count, truncated, and too short for the header
+            expectException(alignedCopy.get(), serialized.size(), objectCount+1);
+            expectException(alignedCopy.get(), serialized.size()-4, objectCount);
+            expectException(alignedCopy.get(), 8, objectCount);
+
+                // misaligned
+            XlMoveMemory(PtrAdd(alignedCopy.get(), 4), alignedCopy.get(), serialized.size());
+            expectException(PtrAdd(alignedCopy.get(), 4), serialized.size(), objectCount);
+
+                //  corrupt object indices. The object array ends less than 16 bytes before the
+                //  bounding boxes (which are 16 byte aligned); so the 16 bytes before the bounding
+                //  boxes contain at least the last object index (and maybe some padding)
+            XlCopyMemory(alignedCopy.get(), AsPointer(serialized.cbegin()), serialized.size());
+            {
+                SceneEngine::PlacementsQuadTree validTree(alignedCopy.get(), serialized.size(), objectCount);
+                (void)validTree;
+            }
+            auto* boxes = (unsigned*)PtrAdd(alignedCopy.get(), serialized.size() - objectCount * 6 * sizeof(float));
+            for (unsigned c=1; c<=4; ++c)
+                boxes[-int(c)] = objectCount + 100;
+            expectException(alignedCopy.get(), serialized.size(), objectCount);
+        }
+    };
+}
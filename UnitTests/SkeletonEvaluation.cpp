@@ -0,0 +1,302 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "../RenderCore/Assets/FlatTransformationMachine.h"
+#include "../RenderCore/Assets/TransformationCommands.h"
+#include "../RenderCore/Assets/ModelRunTime.h"
+#include "../RenderCore/Assets/ModelRunTimeInternal.h"
+#include "../RenderCore/Assets/AnimationRunTime.h"
+#include "../RenderCore/Assets/Services.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/CompileAndAsyncManager.h"
+#include "../Assets/IntermediateAssets.h"
+#include "../Assets/Assets.h"
+#include "../Math/Transformations.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+#include <algorithm>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    using namespace RenderCore::Assets;
+
+    class SyntheticSkeleton
+    {
+    public:
+        std::vector<uint32> _commandStream;
+        unsigned            _outputMatrixCount;
+        unsigned            _float1Count, _float3Count, _float4Count, _float4x4Count;
+
+        SyntheticSkeleton(unsigned jointCount, unsigned seed)
+        : _outputMatrixCount(0), _float1Count(0), _float3Count(0), _float4Count(0), _float4x4Count(0)
+        {
+                //  A root transform, followed by a tree of joints. The shape is
+                //  similar to a character (a few long chains with short branches)
+                //  and it covers every command type, multiple pops at once, and
+                //  transforms applied after an output has been written.
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> value(-1.f, 1.f);
+
+            PushCommand(TransformStackCommand::WriteOutputMatrix); PushCommand(_outputMatrixCount++);
+            PushCommand(TransformStackCommand::PushLocalToWorld);
+            PushCommand(TransformStackCommand::TransformFloat4x4_Static);
+            auto root = MakeRotationMatrix(Normalize(Float3(.2f, 1.f, .3f)), .5f);
+            for (unsigned r=0; r<4; ++r)
+                for (unsigned c=0; c<4; ++c)
+                    PushFloat(r<3&&c<3 ? root(r,c) : (r==c ? 1.f : (c==3 ? value(rng) : 0.f)));
+            PushCommand(TransformStackCommand::WriteOutputMatrix); PushCommand(_outputMatrixCount++);
+
+            unsigned depth = 0;
+            for (unsigned j=0; j<jointCount; ++j) {
+                PushCommand(TransformStackCommand::PushLocalToWorld); ++depth;
+                PushCommand(TransformStackCommand::Translate_Static); PushFloat(value(rng)); PushFloat(value(rng)); PushFloat(value(rng));
+                switch (j%4) {
+                case 0: PushCommand(TransformStackCommand::RotateX_Static); PushFloat(value(rng) * 90.f); break;
+                case 1: PushCommand(TransformStackCommand::RotateY_Static); PushFloat(value(rng) * 90.f); break;
+                case 2: PushCommand(TransformStackCommand::Rotate_Static); PushFloat(.3f); PushFloat(.9f); PushFloat(.3f); PushFloat(value(rng) * 90.f); break;
+                case 3: PushCommand(TransformStackCommand::ArbitraryScale_Static); PushFloat(1.f); PushFloat(1.1f); PushFloat(.9f); break;
+                }
+
+                switch (j%5) {
+                case 0: PushCommand(TransformStackCommand::Translate_Parameter); PushCommand(_float3Count++);
+                        PushCommand(TransformStackCommand::Rotate_Parameter); PushCommand(_float4Count++); break;
+                case 1: PushCommand(TransformStackCommand::RotateX_Parameter); PushCommand(_float1Count++);
+                        PushCommand(TransformStackCommand::RotateY_Parameter); PushCommand(_float1Count++);
+                        PushCommand(TransformStackCommand::RotateZ_Parameter); PushCommand(_float1Count++); break;
+                case 2: PushCommand(TransformStackCommand::TransformFloat4x4_Parameter); PushCommand(_float4x4Count++); break;
+                case 3: PushCommand(TransformStackCommand::UniformScale_Parameter); PushCommand(_float1Count++);
+                        PushCommand(TransformStackCommand::ArbitraryScale_Parameter); PushCommand(_float3Count++); break;
+                case 4: PushCommand(TransformStackCommand::UniformScale_Static); PushFloat(1.05f); break;     // (static only joint)
+                }
+
+                PushCommand(TransformStackCommand::WriteOutputMatrix); PushCommand(_outputMatrixCount++);
+
+                    //  sometimes, keep transforming after writing the output
+                if ((j%7) == 3) {
+                    PushCommand(TransformStackCommand::RotateZ_Static); PushFloat(value(rng) * 45.f);
+                    PushCommand(TransformStackCommand::Translate_Parameter); PushCommand(_float3Count++);
+                    PushCommand(TransformStackCommand::WriteOutputMatrix); PushCommand(_outputMatrixCount++);
+                }
+
+                    //  end chains every now and again, sometimes popping multiple levels
+                unsigned popCount = 0;
+                if ((j%6) == 5) popCount = 1 + (j%3);
+                if (depth >= 12) popCount = depth - 2;
+                popCount = std::min(popCount, depth-1);
+                if (popCount) {
+                    PushCommand(TransformStackCommand::PopLocalToWorld); PushCommand(popCount);
+                    depth -= popCount;
+                }
+            }
+            PushCommand(TransformStackCommand::PopLocalToWorld); PushCommand(depth+1);
+        }
+
+        void BuildParameterSet(TransformationParameterSet& result, float time) const
+        {
+            auto& float1s = result.GetFloat1ParametersVector();
+            auto& float3s = result.GetFloat3ParametersVector();
+            auto& float4s = result.GetFloat4ParametersVector();
+            auto& float4x4s = result.GetFloat4x4ParametersVector();
+            float1s.resize(_float1Count); float3s.resize(_float3Count);
+            float4s.resize(_float4Count); float4x4s.resize(_float4x4Count);
+
+            for (unsigned c=0; c<_float1Count; ++c)
+                float1s[c] = (c%2) ? 30.f * std::sin(time + float(c)) : (1.f + .1f * std::sin(time * 2.f + float(c)));
+            for (unsigned c=0; c<_float3Count; ++c)
+                float3s[c] = Float3(std::sin(time + c), 1.f + .1f * std::cos(time + c), .5f * std::sin(time * 1.3f + c));
+            for (unsigned c=0; c<_float4Count; ++c)
+                float4s[c] = Float4(0.f, std::cos(time + c), std::sin(time + c), 45.f * std::sin(time * .7f + c));
+            for (unsigned c=0; c<_float4x4Count; ++c)
+                float4x4s[c] = Combine(
+                    Expand(MakeRotationMatrix(Normalize(Float3(1.f, std::sin(time + c), .5f)), time), Float3(.1f, .2f, .3f)),
+                    AsFloat4x4(UniformScale(.9f)));
+        }
+
+    private:
+        void PushCommand(uint32 value) { _commandStream.push_back(value); }
+        void PushFloat(float value) { _commandStream.push_back(*(uint32*)&value); }
+    };
+
+    static void NullTransformIterator(const Float4x4&, const Float4x4&, const void*) {}
+
+    static float MaxDifference(const Float4x4 lhs[], const Float4x4 rhs[], unsigned count)
+    {
+            //  (relative to the largest element in each matrix)
+        float result = 0.f;
+        for (unsigned c=0; c<count; ++c) {
+            float magnitude = 1.f, difference = 0.f;
+            for (unsigned r=0; r<4; ++r)
+                for (unsigned q=0; q<4; ++q) {
+                    magnitude = std::max(magnitude, std::abs(lhs[c](r,q)));
+                    difference = std::max(difference, std::abs(lhs[c](r,q) - rhs[c](r,q)));
+                }
+            result = std::max(result, difference / magnitude);
+        }
+        return result;
+    }
+
+    TEST_CLASS(SkeletonEvaluation)
+	{
+	public:
+		TEST_METHOD(FlatMachineMatchesInterpreter)
+		{
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned jointCounts[] = { 1, 7, 64, 150 };
+            for (unsigned j=0; j<dimof(jointCounts); ++j) {
+                SyntheticSkeleton skeleton(jointCounts[j], j);
+                auto cmdBegin = AsPointer(skeleton._commandStream.cbegin());
+                auto cmdEnd = AsPointer(skeleton._commandStream.cend());
+                FlatTransformationMachine flat(cmdBegin, cmdEnd, skeleton._outputMatrixCount);
+                Assert::AreEqual(skeleton._outputMatrixCount, flat.GetOutputMatrixCount());
+
+                std::vector<Float4x4> expected(skeleton._outputMatrixCount), result(skeleton._outputMatrixCount);
+                std::vector<Float4x4> workingSpace(flat.GetWorkingSpaceCount());
+                TransformationParameterSet params;
+                for (float time=0.f; time<2.f; time+=.25f) {
+                    skeleton.BuildParameterSet(params, time);
+                    GenerateOutputTransformsFree(
+                        AsPointer(expected.begin()), expected.size(), &params,
+                        cmdBegin, cmdEnd, NullTransformIterator, nullptr);
+                    flat.GenerateOutputTransforms(
+                        AsPointer(result.begin()), unsigned(result.size()), &params,
+                        AsPointer(workingSpace.begin()));
+
+                        //  the static transforms are folded together in a different
+                        //  order, so there is a small amount of rounding difference
+                    Assert::IsTrue(MaxDifference(AsPointer(expected.begin()), AsPointer(result.begin()), skeleton._outputMatrixCount) < 1e-5f);
+                }
+
+                    //  without a parameter set, animated transforms are skipped (in both implementations)
+                GenerateOutputTransformsFree(
+                    AsPointer(expected.begin()), expected.size(), nullptr,
+                    cmdBegin, cmdEnd, NullTransformIterator, nullptr);
+                flat.GenerateOutputTransforms(
+                    AsPointer(result.begin()), unsigned(result.size()), nullptr,
+                    AsPointer(workingSpace.begin()));
+                Assert::IsTrue(MaxDifference(AsPointer(expected.begin()), AsPointer(result.begin()), skeleton._outputMatrixCount) < 1e-5f);
+            }
+        }
+
+        TEST_METHOD(CrowdBenchmark)
+        {
+                //  Evaluate a crowd of characters with the same skeleton. Compare the
+                //  command stream interpreter to the flat machine
+                //  (see BatchPrepareAnimation for the multithreaded version)
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned characterCount = 512, jointCount = 64;
+            SyntheticSkeleton skeleton(jointCount, 17);
+            auto cmdBegin = AsPointer(skeleton._commandStream.cbegin());
+            auto cmdEnd = AsPointer(skeleton._commandStream.cend());
+            FlatTransformationMachine flat(cmdBegin, cmdEnd, skeleton._outputMatrixCount);
+
+            const auto outputCount = skeleton._outputMatrixCount;
+            std::vector<TransformationParameterSet> params(characterCount);
+            for (unsigned c=0; c<characterCount; ++c)
+                skeleton.BuildParameterSet(params[c], float(c) * .01f);
+
+            std::vector<Float4x4> interpreted(characterCount * outputCount);
+            std::vector<Float4x4> flatResults(characterCount * outputCount);
+
+            auto start = GetPerformanceCounter();
+            for (unsigned c=0; c<characterCount; ++c)
+                GenerateOutputTransformsFree(
+                    &interpreted[c*outputCount], outputCount, &params[c],
+                    cmdBegin, cmdEnd, NullTransformIterator, nullptr);
+            auto middle = GetPerformanceCounter();
+            {
+                std::vector<Float4x4> workingSpace(flat.GetWorkingSpaceCount());
+                for (unsigned c=0; c<characterCount; ++c)
+                    flat.GenerateOutputTransforms(
+                        &flatResults[c*outputCount], outputCount, &params[c],
+                        AsPointer(workingSpace.begin()));
+            }
+            auto end = GetPerformanceCounter();
+
+            Assert::IsTrue(MaxDifference(AsPointer(interpreted.begin()), AsPointer(flatResults.begin()), characterCount * outputCount) < 1e-5f);
+
+            auto freq = float(GetPerformanceCounterFrequency());
+            LogAlwaysWarning
+                << characterCount << " characters with " << jointCount << " joints: interpreter "
+                << 1000.f * (middle-start) / freq << "ms, flat "
+                << 1000.f * (end-middle) / freq << "ms";
+        }
+
+        TEST_METHOD(BatchPrepareAnimation)
+        {
+                //  Prepare a crowd of characters with the batch version of 
+                //  SkinPrepareMachine::PrepareAnimation (which splits the work across
+                //  the thread pool), and compare every character to the command
+                //  stream interpreter.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            {
+                auto assetServices = std::make_shared<::Assets::Services>(0);
+                auto renderAssetServices = std::make_shared<RenderCore::Assets::Services>(nullptr);
+                renderAssetServices->InitColladaCompilers();
+
+                auto& model = LoadCompiledScaffold<ModelScaffold>("game/chr/nu_f/skin/dragon003");
+                auto& skeletonScaffold = LoadCompiledScaffold<SkeletonScaffold>("game/chr/nu_f/skeleton/all_co_sk_whirlwind_launch_mub");
+                auto& animSetScaffold = LoadCompiledScaffold<AnimationSetScaffold>("game/chr/nu_f/animation");
+                SkinPrepareMachine prepareMachine(model, animSetScaffold, skeletonScaffold);
+
+                auto& skeleton = skeletonScaffold.GetTransformationMachine();
+                auto& animSet = animSetScaffold.ImmutableData();
+                AnimationSetBinding binding(animSet._animationSet.GetOutputInterface(), skeleton.GetInputInterface());
+
+                const uint64 animation = Hash64("onehand_mo_combat_run_f");
+                auto anim = animSet._animationSet.FindAnimation(animation);
+                Assert::IsTrue(anim._endTime > anim._beginTime);
+
+                const unsigned characterCount = 512;
+                std::vector<ModelRenderer::PreparedAnimation> states(characterCount);
+                std::vector<ModelRenderer::PreparedAnimation*> statePtrs;
+                for (unsigned c=0; c<characterCount; ++c) {
+                    states[c]._animState = AnimationState(
+                        (anim._endTime - anim._beginTime) * float(c) / float(characterCount), animation);
+                    statePtrs.push_back(&states[c]);
+                }
+
+                auto start = GetPerformanceCounter();
+                prepareMachine.PrepareAnimation(nullptr, AsPointer(statePtrs.cbegin()), statePtrs.size());
+                auto end = GetPerformanceCounter();
+
+                const auto outputCount = skeleton.GetOutputMatrixCount();
+                Assert::AreEqual(outputCount, prepareMachine.GetSkeletonOutputCount());
+                std::vector<Float4x4> expected(outputCount);
+                for (unsigned c=0; c<characterCount; ++c) {
+                    auto params = animSet._animationSet.BuildTransformationParameterSet(
+                        states[c]._animState, skeleton, binding, animSet._curves, animSet._curvesCount);
+                    GenerateOutputTransformsFree(
+                        AsPointer(expected.begin()), outputCount, &params,
+                        skeleton.GetCommandStream(), skeleton.GetCommandStream() + skeleton.GetCommandStreamSize(),
+                        NullTransformIterator, nullptr);
+
+                    Assert::IsTrue(states[c]._finalMatrices != nullptr);
+                    Assert::IsTrue(MaxDifference(AsPointer(expected.begin()), states[c]._finalMatrices.get(), outputCount) < 1e-4f);
+                }
+
+                LogAlwaysWarning
+                    << "Batch PrepareAnimation for " << characterCount << " characters with " << outputCount << " outputs: "
+                    << 1000.f * float(end-start) / float(GetPerformanceCounterFrequency()) << "ms";
+            }
+        }
+	};
+}
+
@@ -0,0 +1,154 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "TerrainTestHelper.h"
+#include "../Tools/ToolsRig/TerrainConversion.h"
+#include "../Tools/ToolsRig/TerrainOp.h"
+#include "../SceneEngine/Terrain.h"
+#include "../SceneEngine/TerrainConfig.h"
+#include "../SceneEngine/TerrainFormat.h"
+#include "../Assets/AssetServices.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Math/Vector.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/Streams/FileUtils.h"
+#include <CppUnitTest.h>
+#include <random>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    TEST_CLASS(TerrainCollisions)
+	{
+	public:
+		TEST_METHOD(HeightsAndNormals)
+		{
+                //  Write a small terrain (2x2 cells, each with 16x16 leaf nodes), and
+                //  then query it with GetTerrainHeights.
+                //  At the sample points, the heights should match the source surface
+                //  (other than quantization). Between the sample points, the normals
+                //  should match finite differences of the bilinear filtered heights.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+            auto assetServices = std::make_shared<::Assets::Services>(0);
+
+            const char terrainDir[] = "synthetic_terrain";
+            const UInt2 cellCount(2, 2);
+            const unsigned nodeDims = 8, cellTreeDepth = 5;
+            const float elementSpacing = 2.f;
+            const Float3 terrainOffset(-100.f, 50.f, 25.f);
+            CreateDirectoryRecursive(terrainDir);
+
+            SceneEngine::TerrainConfig cfg(terrainDir, cellCount, nodeDims, cellTreeDepth);
+            const unsigned cellElements = nodeDims * cfg.CellDimensionsInNodes()[0];
+            const unsigned width = cellCount[0] * cellElements, height = cellCount[1] * cellElements;
+
+            ::Assets::ResChar uberSurfaceFile[MaxPath];
+            SceneEngine::TerrainConfig::GetUberSurfaceFilename(
+                uberSurfaceFile, dimof(uberSurfaceFile), terrainDir, SceneEngine::CoverageId_Heights);
+                //  smooth hills, so that the normals vary over the surface
+            auto heights = BuildSyntheticHeights(width, height, SyntheticHeightsDesc(40.f, 128.f, 3, 0.f, 7));
+            WriteUberSurface(uberSurfaceFile, AsPointer(heights.cbegin()), width, height);
+            ToolsRig::GenerateCellFiles(cfg, terrainDir, true, SceneEngine::GradientFlagsSettings());
+
+            SceneEngine::TerrainFormat ioFormat;
+            SceneEngine::TerrainCoordinateSystem coords(terrainOffset, float(cellElements) * elementSpacing);
+            auto toWorld = [&](float x, float y)
+                { return Float2(x * elementSpacing + terrainOffset[0], y * elementSpacing + terrainOffset[1]); };
+
+                //  (the last row & column of the surface isn't covered by the node overlap)
+            const unsigned maxX = width-2, maxY = height-2;
+
+            {
+                    //  point sampled heights, at every sample position
+                std::vector<Float2> positions;
+                std::vector<float> expected;
+                for (unsigned y=0; y<=maxY; ++y)
+                    for (unsigned x=0; x<=maxX; ++x) {
+                        positions.push_back(toWorld(float(x), float(y)));
+                        expected.push_back(heights[y*width+x] + terrainOffset[2]);
+                    }
+
+                std::vector<float> results(positions.size());
+                std::vector<Float3> normals(positions.size());
+                SceneEngine::GetTerrainHeights(
+                    AsPointer(results.begin()), AsPointer(normals.begin()),
+                    ioFormat, cfg, coords, AsPointer(positions.cbegin()), positions.size());
+
+                for (size_t c=0; c<positions.size(); ++c)
+                    Assert::AreEqual(expected[c], results[c], .01f);
+
+                Assert::AreEqual(
+                    expected[0],
+                    SceneEngine::GetTerrainHeight(ioFormat, cfg, coords, positions[0]), .01f);
+            }
+
+            {
+                    //  random positions between the samples. We compare the normals to
+                    //  central differences of GetTerrainHeights. The offsets stay within
+                    //  the same quad, where the bilinear filter is smooth.
+                std::mt19937 rng(7);
+                std::uniform_int_distribution<unsigned> sampleX(0, maxX-1), sampleY(0, maxY-1);
+                std::uniform_real_distribution<float> frac(.1f, .9f);
+                const float e = .05f;
+
+                const unsigned queryCount = 4096;
+                std::vector<Float2> positions;
+                std::vector<float> expected;
+                positions.reserve(queryCount*5);
+                for (unsigned q=0; q<queryCount; ++q) {
+                    unsigned x = sampleX(rng), y = sampleY(rng);
+                    float fx = frac(rng), fy = frac(rng);
+                    float h0 = heights[y*width+x], h1 = heights[y*width+x+1];
+                    float h2 = heights[(y+1)*width+x], h3 = heights[(y+1)*width+x+1];
+                    expected.push_back(
+                          h0 * (1.f-fx) * (1.f-fy) + h1 * fx * (1.f-fy)
+                        + h2 * (1.f-fx) * fy + h3 * fx * fy
+                        + terrainOffset[2]);
+
+                    positions.push_back(toWorld(x + fx, y + fy));
+                    positions.push_back(toWorld(x + fx - e, y + fy));
+                    positions.push_back(toWorld(x + fx + e, y + fy));
+                    positions.push_back(toWorld(x + fx, y + fy - e));
+                    positions.push_back(toWorld(x + fx, y + fy + e));
+                }
+
+                std::vector<float> results(positions.size());
+                std::vector<Float3> normals(positions.size());
+                SceneEngine::GetTerrainHeights(
+                    AsPointer(results.begin()), AsPointer(normals.begin()),
+                    ioFormat, cfg, coords, AsPointer(positions.cbegin()), positions.size());
+
+                unsigned tiltedCount = 0;
+                for (unsigned q=0; q<queryCount; ++q) {
+                    const float* h = &results[q*5];
+                    Assert::AreEqual(expected[q], h[0], .01f);
+
+                    float dhdx = (h[2] - h[1]) / (2.f * e * elementSpacing);
+                    float dhdy = (h[4] - h[3]) / (2.f * e * elementSpacing);
+                    auto fdNormal = Normalize(Float3(-dhdx, -dhdy, 1.f));
+                    const auto& normal = normals[q*5];
+                    Assert::AreEqual(fdNormal[0], normal[0], 2e-3f);
+                    Assert::AreEqual(fdNormal[1], normal[1], 2e-3f);
+                    Assert::AreEqual(fdNormal[2], normal[2], 2e-3f);
+                    if (normal[2] < .95f) ++tiltedCount;
+                }
+                Assert::IsTrue(tiltedCount > queryCount / 4);
+            }
+
+            for (unsigned y=0; y<cellCount[1]; ++y)
+                for (unsigned x=0; x<cellCount[0]; ++x) {
+                    ::Assets::ResChar cellFile[MaxPath];
+                    cfg.GetCellFilename(cellFile, dimof(cellFile), UInt2(x, y), SceneEngine::CoverageId_Heights);
+                    XlDeleteFile((const utf8*)cellFile);
+                }
+            XlDeleteFile((const utf8*)uberSurfaceFile);
+        }
+    };
+}
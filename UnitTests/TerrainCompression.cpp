@@ -0,0 +1,148 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "TerrainTestHelper.h"
+#include "../SceneEngine/TerrainCompression.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include <CppUnitTest.h>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static std::vector<uint16> BuildQuantizedHeights(unsigned dims, unsigned heightBits, unsigned seed)
+    {
+            //  Synthetic heights quantized to "heightBits", with a few quantization
+            //  steps of noise. This is smoother than a real height map, but it has
+            //  similar statistics after quantization. When there are spare bits, we
+            //  add some blobs of gradient flags, as TerrainFormat would.
+        const unsigned heightMask = (1u<<heightBits)-1;
+        auto heights = BuildSyntheticHeights(
+            dims, dims, SyntheticHeightsDesc(.5f, float(dims), 4, 16.f / float(heightMask), seed));
+
+        std::vector<uint16> result(dims*dims);
+        for (unsigned y=0; y<dims; ++y)
+            for (unsigned x=0; x<dims; ++x) {
+                float fx = x / float(dims), fy = y / float(dims);
+                auto q = unsigned(std::max(0.f, std::min(float(heightMask), (heights[y*dims+x] * .5f + .5f) * float(heightMask))));
+                unsigned flags = 0;
+                if (heightBits < 16)
+                    flags = unsigned(std::abs(std::sin(fx * 5.f + float(seed)) + std::cos(fy * 3.f)) * 1.5f) & 3;
+                result[y*dims+x] = uint16(q | (flags << heightBits));
+            }
+        return result;
+    }
+
+    TEST_CLASS(TerrainCompression)
+	{
+	public:
+		TEST_METHOD(HeightMapRoundTrip)
+		{
+            const unsigned nodeDims[] = { 1, 33, 65, 257 };
+            const unsigned heightBits[] = { 14, 16 };
+            for (unsigned d=0; d<dimof(nodeDims); ++d)
+                for (unsigned b=0; b<dimof(heightBits); ++b) {
+                    auto dims = nodeDims[d];
+                    auto heights = BuildQuantizedHeights(dims, heightBits[b], d*16+b);
+                    auto compressed = SceneEngine::CompressHeightMap(AsPointer(heights.begin()), dims, dims, heightBits[b]);
+
+                    std::vector<uint16> decompressed(dims*dims, 0xcdcd);
+                    Assert::IsTrue(SceneEngine::DecompressHeightMap(
+                        AsPointer(decompressed.begin()), dims, dims,
+                        AsPointer(compressed.begin()), compressed.size()));
+                    Assert::IsTrue(heights == decompressed);
+
+                        //  truncated data and mismatched dimensions must be rejected
+                    Assert::IsFalse(SceneEngine::DecompressHeightMap(
+                        AsPointer(decompressed.begin()), dims, dims,
+                        AsPointer(compressed.begin()), compressed.size()/2));
+                    if (dims > 1)
+                        Assert::IsFalse(SceneEngine::DecompressHeightMap(
+                            AsPointer(decompressed.begin()), dims-1, dims-1,
+                            AsPointer(compressed.begin()), compressed.size()));
+                }
+        }
+
+        TEST_METHOD(HeightMapLongRuns)
+        {
+                //  A single gradient flag run longer than the raw height residuals
+                //  can escape to. Also try a few long runs with a short one between.
+            const unsigned dims = 2048;
+            auto heights = BuildQuantizedHeights(dims, 14, 7);
+            for (auto& h:heights) h = uint16(h & 0x3fff);
+
+            for (unsigned pass=0; pass<2; ++pass) {
+                if (pass == 1)
+                    for (unsigned c=dims*dims/2; c<dims*dims/2+5; ++c)
+                        heights[c] = uint16(heights[c] | (2u<<14));
+
+                auto compressed = SceneEngine::CompressHeightMap(AsPointer(heights.begin()), dims, dims, 14);
+                std::vector<uint16> decompressed(dims*dims, 0xcdcd);
+                Assert::IsTrue(SceneEngine::DecompressHeightMap(
+                    AsPointer(decompressed.begin()), dims, dims,
+                    AsPointer(compressed.begin()), compressed.size()));
+                Assert::IsTrue(heights == decompressed);
+            }
+        }
+
+        TEST_METHOD(HeightMapCompressionBenchmark)
+        {
+                //  Compare the predicted format against the raw "QuantRange" data
+                //  for a typical cell worth of 65x65 nodes. For QuantRange, "decoding"
+                //  is just a copy.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned dims = 65, nodeCount = 341;
+            std::vector<std::vector<uint16>> nodes;
+            std::vector<std::vector<uint8>> compressedNodes;
+            size_t rawSize = 0, compressedSize = 0;
+            for (unsigned n=0; n<nodeCount; ++n) {
+                nodes.push_back(BuildQuantizedHeights(dims, 14, n));
+                compressedNodes.push_back(SceneEngine::CompressHeightMap(AsPointer(nodes[n].begin()), dims, dims, 14));
+                rawSize += nodes[n].size() * sizeof(uint16);
+                compressedSize += compressedNodes[n].size();
+            }
+
+            const unsigned iterations = 32;
+            std::vector<uint16> dst(dims*dims);
+
+            auto copyTime = MeasureMilliseconds(
+                [&]()
+                {
+                    for (unsigned i=0; i<iterations; ++i)
+                        for (unsigned n=0; n<nodeCount; ++n)
+                            XlCopyMemory(AsPointer(dst.begin()), AsPointer(nodes[n].begin()), dims*dims*sizeof(uint16));
+                });
+            auto decodeTime = MeasureMilliseconds(
+                [&]()
+                {
+                    for (unsigned i=0; i<iterations; ++i)
+                        for (unsigned n=0; n<nodeCount; ++n) {
+                            bool result = SceneEngine::DecompressHeightMap(
+                                AsPointer(dst.begin()), dims, dims,
+                                AsPointer(compressedNodes[n].begin()), compressedNodes[n].size());
+                            Assert::IsTrue(result);
+                        }
+                });
+
+            auto decodedMB = float(rawSize) * iterations / (1024.f*1024.f);
+            LogAlwaysWarning
+                << "QuantRange: " << rawSize/1024 << "KB, "
+                << decodedMB / std::max(1e-6f, copyTime / 1000.f) << " MB/s (copy)";
+            LogAlwaysWarning
+                << "QuantRangePredicted: " << compressedSize/1024 << "KB ("
+                << 100.f * float(compressedSize) / float(rawSize) << "% of QuantRange), "
+                << decodedMB / std::max(1e-6f, decodeTime / 1000.f) << " MB/s decoded";
+        }
+	};
+}
+
@@ -0,0 +1,153 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "TerrainTestHelper.h"
+#include "../Tools/ToolsRig/TerrainShadowOp.h"
+#include "../Tools/ToolsRig/TerrainOp.h"
+#include "../SceneEngine/TerrainUberSurface.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/PtrUtils.h"
+#include "../Math/Math.h"
+#include <CppUnitTest.h>
+#include <algorithm>
+#include <cmath>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static const unsigned RidgeOffset = 16;     // distance of the ridge from the right edge
+
+    static void WriteSyntheticHeights(const char filename[], unsigned width, unsigned height)
+    {
+            //  Rolling hills, with a little bit of noise. We want lots of
+            //  small bumps to make sure that the near shadow casters are
+            //  handled correctly, not just the big features.
+            //  There's also a tall ridge near one edge, that should only
+            //  shadow samples within the search distance
+        auto heights = BuildSyntheticHeights(width, height, SyntheticHeightsDesc(60.f, 300.f, 5, 1.f, 3));
+        for (unsigned y=0; y<height; ++y)
+            heights[y*width+width-RidgeOffset] += 4000.f;
+        WriteUberSurface(filename, AsPointer(heights.cbegin()), width, height);
+    }
+
+        //  When the sun path isn't aligned with the grid, the sweep moves samples a
+        //  little bit. Right next to the ridge, that makes a big difference to the
+        //  result. It's also just luck whether the ridge is seen by a ray that leaves
+        //  the surface (or reaches the search distance) right next to it.
+    static bool IsNearRidge(Int2 sample, Float2 direction, unsigned width, unsigned height, float searchDistance)
+    {
+        const float ridgeX = float(width-RidgeOffset);
+        if (XlAbs(float(sample[0]) - ridgeX) <= 2.f) return true;
+
+            // (the ray is clamped to the same limits as CalculateShadowingGrad uses)
+        float tExit = searchDistance;
+        if (direction[0] >  1e-3f) tExit = std::min(tExit, (float(width-2) - sample[0]) / direction[0]);
+        if (direction[0] < -1e-3f) tExit = std::min(tExit, (1.f - sample[0]) / direction[0]);
+        if (direction[1] >  1e-3f) tExit = std::min(tExit, (float(height-2) - sample[1]) / direction[1]);
+        if (direction[1] < -1e-3f) tExit = std::min(tExit, (1.f - sample[1]) / direction[1]);
+        return XlAbs(float(sample[0]) + tExit * direction[0] - ridgeX) < 1.5f;
+    }
+
+    TEST_CLASS(TerrainShadows)
+	{
+	public:
+		TEST_METHOD(HorizonSweepMatchesSearch)
+		{
+                //  Compare HorizonSweepShadowsOperator to the original per-sample
+                //  search. When the sun path is aligned with the grid, they should
+                //  agree exactly (other than rounding). Otherwise the sweep moves
+                //  samples a little bit, so we allow some error for every sample (away
+                //  from the ridge, see IsNearRidge), and a smaller average error.
+                //  The surface is wider than the search distance, so that the
+                //  distance limit is tested as well.
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned width = 1153, height = 49;
+            const float searchDistance = 1000.f;
+            const char filename[] = "synthetic_heights.uber";
+            WriteSyntheticHeights(filename, width, height);
+
+            {
+                SceneEngine::TerrainUberHeightsSurface surface(filename);
+                const float xyScale = 2.f;
+                const Int2 mins(2, 2), maxs(width-2, height-2);
+
+                struct TestCase { float _angle; bool _gridAligned; };
+                const TestCase testCases[] =
+                {
+                    { 0.f, true }, { .5f * gPI, true }, { gPI, true },
+                    { .3f, false }, { .25f * gPI, false }, { -1.f, false }
+                };
+
+                for (unsigned c=0; c<dimof(testCases); ++c) {
+                    Float2 sunDirection(XlCos(testCases[c]._angle), XlSin(testCases[c]._angle));
+                    ToolsRig::AngleBasedShadowsOperator search(sunDirection, searchDistance);
+                    ToolsRig::HorizonSweepShadowsOperator sweep(sunDirection, searchDistance);
+
+                    std::vector<uint16> searchResults(width*height*2, 0), sweepResults(width*height*2, 0);
+
+                    auto searchTime = MeasureMilliseconds(
+                        [&]()
+                        {
+                            for (int y=mins[1]; y<maxs[1]; ++y)
+                                for (int x=mins[0]; x<maxs[0]; ++x)
+                                    search.Calculate(
+                                        &searchResults[(y*width+x)*2], Float2(float(x), float(y)),
+                                        surface, xyScale);
+                        });
+                    bool result = false;
+                    auto sweepTime = MeasureMilliseconds(
+                        [&]()
+                        {
+                            result = sweep.CalculateSurface(
+                                AsPointer(sweepResults.begin()), width*2*sizeof(uint16), mins, maxs,
+                                surface, xyScale, 1.f, ToolsRig::TerrainOpConfig(1), nullptr);
+                        });
+                    Assert::IsTrue(result);
+
+                    int maxError = 0;
+                    double totalError = 0.;
+                    for (int y=mins[1]; y<maxs[1]; ++y)
+                        for (int x=mins[0]; x<maxs[0]; ++x)
+                            for (unsigned e=0; e<2; ++e) {
+                                auto i = (y*width+x)*2+e;
+                                int error = std::abs(int(searchResults[i]) - int(sweepResults[i]));
+                                totalError += double(error);
+
+                                    // (e==0 is the shadowing from behind, ie. searching backwards)
+                                Float2 searchDirection = e ? sunDirection : -sunDirection;
+                                if (    testCases[c]._gridAligned 
+                                    || !IsNearRidge(Int2(x, y), searchDirection, width, height, searchDistance))
+                                    maxError = std::max(maxError, error);
+                            }
+                    auto meanError = totalError / double((maxs[0]-mins[0]) * (maxs[1]-mins[1]) * 2);
+
+                    LogAlwaysWarning
+                        << "Sun path angle " << testCases[c]._angle
+                        << ": search " << searchTime << "ms, sweep "
+                        << sweepTime << "ms, mean error " << meanError
+                        << ", max error " << maxError;
+
+                    if (testCases[c]._gridAligned) {
+                        Assert::IsTrue(maxError <= 8);      // (just rounding)
+                    } else {
+                        Assert::IsTrue(maxError < int(.1f * float(0xffff)));
+                        Assert::IsTrue(meanError < .01 * double(0xffff));
+                    }
+                }
+            }
+
+            XlDeleteFile((const utf8*)filename);
+        }
+    };
+}
+
@@ -0,0 +1,76 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#pragma once
+
+#include "../Tools/ToolsRig/TerrainOp.h"
+#include "../Math/Vector.h"
+#include "../Math/Math.h"
+#include "../Utility/TimeUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/ParameterBox.h"
+#include <vector>
+#include <random>
+#include <cmath>
+
+namespace UnitTests
+{
+        //  Synthetic height fields for the terrain tests. A few octaves of sine
+        //  waves (each with half the amplitude and half the wavelength of the
+        //  previous one), plus a little bit of uniform noise. The phase of each
+        //  octave comes from the seed.
+    class SyntheticHeightsDesc
+    {
+    public:
+        float       _amplitude;     // of the first octave
+        float       _wavelength;    // of the first octave, in samples
+        unsigned    _octaves;
+        float       _noise;         // size of the range of noise values (centered on zero)
+        unsigned    _seed;
+
+        SyntheticHeightsDesc(float amplitude, float wavelength, unsigned octaves, float noise, unsigned seed)
+        : _amplitude(amplitude), _wavelength(wavelength), _octaves(octaves), _noise(noise), _seed(seed) {}
+    };
+
+    static std::vector<float> BuildSyntheticHeights(unsigned width, unsigned height, const SyntheticHeightsDesc& desc)
+    {
+        std::mt19937 rng(desc._seed);
+        std::uniform_real_distribution<float> phase(0.f, 2.f * gPI);
+        std::uniform_real_distribution<float> noise(-.5f * desc._noise, .5f * desc._noise);
+        std::vector<float> phases(desc._octaves*2);
+        for (auto& p:phases) p = phase(rng);
+
+        std::vector<float> result(width*height);
+        for (unsigned y=0; y<height; ++y)
+            for (unsigned x=0; x<width; ++x) {
+                float h = 0.f, amplitude = desc._amplitude, frequency = 2.f * gPI / desc._wavelength;
+                for (unsigned o=0; o<desc._octaves; ++o) {
+                    h += amplitude * std::sin(x * frequency + phases[o*2+0]) * std::cos(y * frequency + phases[o*2+1]);
+                    amplitude *= .5f; frequency *= 2.f;
+                }
+                result[y*width+x] = h + ((desc._noise > 0.f) ? noise(rng) : 0.f);
+            }
+        return result;
+    }
+
+    static void WriteUberSurface(const char filename[], const float heights[], unsigned width, unsigned height)
+    {
+        ToolsRig::UberSurfaceWriter writer(
+            filename, UInt2(width, height),
+            ImpliedTyping::TypeDesc(ImpliedTyping::TypeCat::Float));
+        XlCopyMemory(writer.GetData(), heights, width*height*sizeof(float));
+    }
+
+        //  Runs the given function, and returns the time it took in milliseconds
+    template<typename Fn>
+        float MeasureMilliseconds(Fn&& fn)
+        {
+            auto start = GetPerformanceCounter();
+            fn();
+            auto end = GetPerformanceCounter();
+            return 1000.f * float(end - start) / float(GetPerformanceCounterFrequency());
+        }
+}
@@ -0,0 +1,120 @@
+// Copyright 2015 XLGAMES Inc.
+//
+// Distributed under the MIT License (See
+// accompanying file "LICENSE" or the website
+// http://www.opensource.org/licenses/mit-license.php)
+
+#include "UnitTestHelper.h"
+#include "TerrainTestHelper.h"
+#include "../Tools/ToolsRig/TerrainConversion.h"
+#include "../Tools/ToolsRig/TerrainOp.h"
+#include "../SceneEngine/TerrainUberSurface.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
+#include "../Utility/SystemUtils.h"
+#include "../Utility/TimeUtils.h"
+#include <CppUnitTest.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+
+namespace UnitTests
+{
+    static void WriteSequentialSurface(const char filename[], unsigned width, unsigned height)
+    {
+            //  Every sample has a different value, so we can check that each one ends up
+            //  in the right place
+        std::vector<float> values(width*height);
+        for (unsigned c=0; c<width*height; ++c)
+            values[c] = float(c);
+        WriteUberSurface(filename, AsPointer(values.cbegin()), width, height);
+    }
+
+    static float DiagonalWalk(SceneEngine::TerrainUberHeightsSurface& surface)
+    {
+            //  Walk diagonal lines across the surface (similar to the shadows
+            //  operator with a diagonal sun path)
+        float result = 0.f;
+        auto width = surface.GetWidth(), height = surface.GetHeight();
+        for (unsigned start=0; start<width; start+=3)
+            for (unsigned c=0; (start+c)<width && c<height; ++c)
+                result += surface.GetValueFast(start+c, c);
+        return result;
+    }
+
+    TEST_CLASS(TerrainUberSurface)
+	{
+	public:
+		TEST_METHOD(TiledLayoutRoundTrip)
+		{
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                //  dimensions that aren't multiples of the tile size, to test the padding
+            const unsigned width = 300, height = 130;
+            const char rowMajorFile[] = "synthetic_surface.uber";
+            const char tiledFile[] = "synthetic_surface_tiled.uber";
+            const char roundTripFile[] = "synthetic_surface_roundtrip.uber";
+            WriteSequentialSurface(rowMajorFile, width, height);
+
+            ToolsRig::ConvertUberSurfaceLayout(tiledFile, rowMajorFile, true);
+            ToolsRig::ConvertUberSurfaceLayout(roundTripFile, tiledFile, false);
+
+            {
+                SceneEngine::TerrainUberHeightsSurface rowMajor(rowMajorFile);
+                SceneEngine::TerrainUberHeightsSurface tiled(tiledFile);
+                SceneEngine::TerrainUberHeightsSurface roundTrip(roundTripFile);
+                Assert::IsTrue(rowMajor.IsRowMajor());
+                Assert::IsFalse(tiled.IsRowMajor());
+                Assert::IsTrue(roundTrip.IsRowMajor());
+                Assert::AreEqual(width, tiled.GetWidth());
+                Assert::AreEqual(height, tiled.GetHeight());
+
+                for (unsigned y=0; y<height; ++y)
+                    for (unsigned x=0; x<width; ++x) {
+                        float expected = float(y*width+x);
+                        Assert::AreEqual(expected, tiled.GetValue(x, y));
+                        Assert::AreEqual(expected, tiled.GetValueFast(x, y));
+                        Assert::AreEqual(expected, roundTrip.GetValue(x, y));
+                    }
+
+                    //  out of range reads return the dummy value in both layouts
+                Assert::AreEqual(0.f, tiled.GetValue(width, 0));
+                Assert::AreEqual(0.f, tiled.GetValue(0, height));
+            }
+
+            XlDeleteFile((const utf8*)rowMajorFile);
+            XlDeleteFile((const utf8*)tiledFile);
+            XlDeleteFile((const utf8*)roundTripFile);
+        }
+
+        TEST_METHOD(TiledLayoutWalkPerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+            const unsigned dims = 4096;
+            const char rowMajorFile[] = "synthetic_surface.uber";
+            const char tiledFile[] = "synthetic_surface_tiled.uber";
+            WriteSequentialSurface(rowMajorFile, dims, dims);
+            ToolsRig::ConvertUberSurfaceLayout(tiledFile, rowMajorFile, true);
+
+            {
+                SceneEngine::TerrainUberHeightsSurface rowMajor(rowMajorFile);
+                SceneEngine::TerrainUberHeightsSurface tiled(tiledFile);
+
+                float rowMajorResult = 0.f, tiledResult = 0.f;
+                auto rowMajorTime = MeasureMilliseconds([&]() { rowMajorResult = DiagonalWalk(rowMajor); });
+                auto tiledTime = MeasureMilliseconds([&]() { tiledResult = DiagonalWalk(tiled); });
+                Assert::AreEqual(rowMajorResult, tiledResult);
+
+                LogAlwaysWarning
+                    << "Diagonal walk over " << dims << "x" << dims << " surface: row-major "
+                    << rowMajorTime << "ms, tiled " << tiledTime << "ms";
+            }
+
+            XlDeleteFile((const utf8*)rowMajorFile);
+            XlDeleteFile((const utf8*)tiledFile);
+        }
+	};
+}
+
@@ -7,7 +7,17 @@
 #include "UnitTestHelper.h"
 #include "../Assets/AsyncLoadOperation.h"
 #include "../Utility/Threading/CompletionThreadPool.h"
+#include "../Utility/Threading/LockFree.h"
+#include "../ConsoleRig/Log.h"
+#include "../ConsoleRig/GlobalServices.h"
 #include <CppUnitTest.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <intrin.h>
+
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace UnitTests
 {
@@ -51,6 +61,187 @@ namespace UnitTests
                 }
             }
         }
+
+        TEST_METHOD(CompletionThreadPoolTaskGroup)
+        {
+            UnitTest_SetWorkingDirectory();
+
+            CompletionThreadPool pool(4);
+
+                // nested groups -- tasks that wait on their own sub tasks must
+                // not deadlock, because Wait() executes the group's pending tasks
+            std::atomic<unsigned> counter(0);
+            std::atomic<bool> continuationRan(false);
+            {
+                CompletionThreadPool::TaskGroup group(pool);
+                for (unsigned c=0; c<256; ++c)
+                    group.Run(
+                        [&counter, &pool]()
+                        {
+                            CompletionThreadPool::TaskGroup inner(pool);
+                            for (unsigned q=0; q<8; ++q)
+                                inner.Run([&counter]() { ++counter; });
+                            inner.Wait();
+                        });
+                group.SetContinuation([&continuationRan]() { continuationRan = true; });
+                group.Wait();
+                Assert::IsTrue(group.IsComplete());
+            }
+            Assert::AreEqual(256u*8u, counter.load());
+
+            while (!continuationRan.load()) { Threading::YieldTimeSlice(); }
+        }
+
+        TEST_METHOD(CompletionThreadPoolTaskGroupIsolation)
+        {
+            UnitTest_SetWorkingDirectory();
+
+            CompletionThreadPool pool(1);
+
+                // Block the only worker thread, and then queue an unrelated task ahead
+                // of a group task. Waiting on the group must execute the group task on
+                // this thread, without picking up the unrelated task.
+            std::atomic<bool> workerBlocked(false), releaseWorker(false), unrelatedRan(false), unrelatedRanHere(false);
+            auto thisThread = std::this_thread::get_id();
+            pool.Enqueue(
+                [&workerBlocked, &releaseWorker]()
+                {
+                    workerBlocked = true;
+                    while (!releaseWorker.load()) { Threading::YieldTimeSlice(); }
+                });
+            while (!workerBlocked.load()) { Threading::YieldTimeSlice(); }
+
+            pool.Enqueue(
+                [&unrelatedRan, &unrelatedRanHere, thisThread]()
+                {
+                    unrelatedRanHere = std::this_thread::get_id() == thisThread;
+                    unrelatedRan = true;
+                });
+
+            std::atomic<unsigned> counter(0);
+            {
+                CompletionThreadPool::TaskGroup group(pool);
+                for (unsigned c=0; c<16; ++c)
+                    group.Run([&counter]() { ++counter; });
+                group.Wait();
+            }
+            Assert::AreEqual(16u, counter.load());
+            Assert::IsFalse(unrelatedRan.load());
+
+            releaseWorker = true;
+            while (!unrelatedRan.load()) { Threading::YieldTimeSlice(); }
+            Assert::IsFalse(unrelatedRanHere.load());
+        }
+
+        template<typename PushFn, typename PopFn>
+            static uint64 RunQueueTest(
+                unsigned pushThreadCount, unsigned popThreadCount, unsigned itemsPerPusher, 
+                bool fifo, PushFn&& pushFn, PopFn&& popFn)
+        {
+                //  Each item holds the index of the thread that pushed it (in the top bits)
+                //  and its sequence number for that thread. Each popping thread records what
+                //  it got, so we can check the results after the timing has finished.
+            const unsigned sequenceBits = 20;
+            Assert::IsTrue(itemsPerPusher <= (1u<<sequenceBits) && pushThreadCount <= (1u<<(32-sequenceBits)));
+
+            std::atomic<bool> go(false);
+            std::vector<std::thread> threads;
+            for (unsigned t=0; t<pushThreadCount; ++t)
+                threads.emplace_back(
+                    [&go, &pushFn, itemsPerPusher, t, sequenceBits]()
+                    {
+                        while (!go.load()) {}
+                        for (unsigned c=0; c<itemsPerPusher; ++c) pushFn((t<<sequenceBits) | c);
+                    });
+
+            auto totalItems = pushThreadCount * itemsPerPusher;
+            auto itemsPerPopper = totalItems / popThreadCount;
+            std::vector<std::vector<unsigned>> popped(popThreadCount);
+            for (unsigned t=0; t<popThreadCount; ++t) {
+                auto count = (t == popThreadCount-1) ? (totalItems - itemsPerPopper * (popThreadCount-1)) : itemsPerPopper;
+                auto* dst = &popped[t];
+                dst->reserve(count);
+                threads.emplace_back(
+                    [&go, &popFn, count, dst]()
+                    {
+                        while (!go.load()) {}
+                        for (unsigned c=0; c<count; ++c) dst->push_back(popFn());
+                    });
+            }
+
+            auto start = __rdtsc();
+            go = true;
+            for (auto& t:threads) t.join();
+            auto result = (__rdtsc() - start) / totalItems;
+
+                //  Every item must have been popped exactly once. For a FIFO queue, each
+                //  popping thread must also see the items from any one pusher in order.
+            std::vector<unsigned> popCounts(totalItems, 0);
+            bool validItems = true, inOrder = true;
+            for (const auto& p:popped) {
+                std::vector<unsigned> nextSequence(pushThreadCount, 0);
+                for (auto item:p) {
+                    auto pusher = item >> sequenceBits, sequence = item & ((1u<<sequenceBits)-1);
+                    if (pusher >= pushThreadCount || sequence >= itemsPerPusher) { validItems = false; continue; }
+                    ++popCounts[pusher * itemsPerPusher + sequence];
+                    inOrder &= sequence >= nextSequence[pusher];
+                    nextSequence[pusher] = sequence+1;
+                }
+            }
+            Assert::IsTrue(validItems);
+            Assert::IsTrue(std::all_of(popCounts.begin(), popCounts.end(), [](unsigned c) { return c == 1; }));
+            if (fifo) Assert::IsTrue(inOrder);
+
+            return result;
+        }
+
+        TEST_METHOD(LockFreeQueuePerformance)
+        {
+            UnitTest_SetWorkingDirectory();
+            ConsoleRig::GlobalServices services(GetStartupConfig());
+
+                // Compare FixedSizeQueue (multiple pushers, single popper, with overflow) with
+                // BoundedQueue (multiple pushers and poppers, blocking when full)
+            const unsigned itemsPerPusher = 64 * 1024;
+            const unsigned threadCounts[] = { 1, 2, 4, 8, 16, 32 };
+            for (auto threadCount:threadCounts) {
+                uint64 fixedSizeCycles, boundedCycles, boundedMPMCCycles;
+
+                {
+                    LockFree::FixedSizeQueue<unsigned, 256> queue;
+                        //  (items that go through the overflow path can come out of order)
+                    fixedSizeCycles = RunQueueTest(threadCount, 1, itemsPerPusher, false,
+                        [&queue](unsigned c) { queue.push_overflow(c); },
+                        [&queue]() -> unsigned
+                        {
+                            unsigned* t = nullptr;
+                            while (!queue.try_front(t)) { Threading::Pause(); }
+                            auto result = *t;
+                            queue.pop();
+                            return result;
+                        });
+                }
+
+                {
+                    LockFree::BoundedQueue<unsigned, 256> queue;
+                    boundedCycles = RunQueueTest(threadCount, 1, itemsPerPusher, true,
+                        [&queue](unsigned c) { queue.push_wait(c); },
+                        [&queue]() -> unsigned { unsigned t; queue.pop_wait(t); return t; });
+                }
+
+                {
+                    LockFree::BoundedQueue<unsigned, 256> queue;
+                    boundedMPMCCycles = RunQueueTest(threadCount, threadCount, itemsPerPusher, true,
+                        [&queue](unsigned c) { queue.push_wait(c); },
+                        [&queue]() -> unsigned { unsigned t; queue.pop_wait(t); return t; });
+                    Assert::AreEqual(size_t(0), queue.size());
+                }
+
+                LogAlwaysWarning << threadCount << " pushing threads -- FixedSizeQueue: " << fixedSizeCycles 
+                    << " cycles per item. BoundedQueue: " << boundedCycles 
+                    << " cycles per item. BoundedQueue (" << threadCount << " popping threads): " << boundedMPMCCycles << " cycles per item.";
+            }
+        }
     };
 }
 
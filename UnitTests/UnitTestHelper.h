@@ -10,6 +10,11 @@
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/Streams/FileUtils.h"
 #include "../Utility/SystemUtils.h"
+#include "../Assets/AssetServices.h"
+#include "../Assets/CompileAndAsyncManager.h"
+#include "../Assets/IntermediateAssets.h"
+#include "../Assets/Assets.h"
+#include <CppUnitTest.h>
 
 namespace UnitTests
 {
@@ -46,6 +51,20 @@ namespace UnitTests
     	XlConcatPath(workingDir, dimof(workingDir), appDir, catPath, &catPath[XlStringLen(catPath)]);
     	XlChDir(workingDir);
     }
+
+        //  Compiles the given asset (if necessary) and waits for the result. This
+        //  needs the asset services and the intermediate compilers to be set up.
+    template<typename Type>
+        static const Type& LoadCompiledScaffold(const char initializer[])
+    {
+        auto& compilers = ::Assets::Services::GetAsyncMan().GetIntermediateCompilers();
+        auto& store = ::Assets::Services::GetAsyncMan().GetIntermediateStore();
+        auto marker = compilers.PrepareAsset(Type::CompileProcessType, &initializer, 1, store);
+        marker->StallWhilePending();
+        Microsoft::VisualStudio::CppUnitTestFramework::Assert::IsTrue(
+            marker->GetState() == ::Assets::AssetState::Ready);
+        return ::Assets::GetAsset<Type>(marker->_sourceID0);
+    }
     
 }
 
@@ -12,6 +12,9 @@
 #include "../Utility/Streams/StreamTypes.h"
 #include "../Utility/Streams/PathUtils.h"
 #include "../Utility/FunctionUtils.h"
+#include "../Utility/HeapUtils.h"
+#include "../Utility/MemoryUtils.h"
+#include "../Utility/PtrUtils.h"
 #include "../Math/Vector.h"
 #include <CppUnitTest.h>
 #include <stdexcept>
@@ -246,6 +249,129 @@ namespace UnitTests
 				std::string("source/sourcefile.cpp"),
 				MakeRelativePath(SplitPath<char>("D:\\LM\\Code\\SomeOtherDirectory\\Another\\../.."), SplitPath<char>("D:\\LM\\Code\\SomeDir\\../.\\Source\\./SourceFile.cpp")));
 		}
+
+        TEST_METHOD(LRUCacheTest)
+        {
+            LRUCache<unsigned> cache(4);
+            for (unsigned c=0; c<4; ++c)
+                cache.Insert(c * 0x100000000ull, std::make_shared<unsigned>(c));
+
+                // touch 0, then insert another object -- 1 should be evicted
+            Assert::IsTrue(cache.Get(0) != nullptr);
+            cache.Insert(99, std::make_shared<unsigned>(99));
+            Assert::IsTrue(cache.Get(1 * 0x100000000ull) == nullptr);
+            Assert::AreEqual(0u, *cache.Get(0));
+            Assert::AreEqual(99u, *cache.Get(99));
+            Assert::AreEqual(3u, *cache.Get(3 * 0x100000000ull));
+
+                // replacing an existing object shouldn't evict anything
+            cache.Insert(99, std::make_shared<unsigned>(100));
+            Assert::AreEqual(100u, *cache.Get(99));
+
+            auto metrics = cache.GetMetrics();
+            Assert::AreEqual(uint64(1), metrics._evictions);
+            Assert::AreEqual(uint64(1), metrics._misses);
+            Assert::AreEqual(4u, metrics._size);
+
+            ConcurrentLRUCache<unsigned> concurrentCache(64, 8);
+            for (unsigned c=0; c<1024; ++c)
+                concurrentCache.Insert(Hash64(&c, PtrAdd(&c, sizeof(c))), std::make_shared<unsigned>(c));
+            auto concurrentMetrics = concurrentCache.GetMetrics();
+            Assert::AreEqual(64u, concurrentMetrics._size);
+            Assert::AreEqual(uint64(1024-64), concurrentMetrics._evictions);
+
+                // CompareAndInsert only replaces the object we expect to be there
+            auto first = concurrentCache.CompareAndInsert(5, nullptr, std::make_shared<unsigned>(5));
+            auto second = concurrentCache.CompareAndInsert(5, nullptr, std::make_shared<unsigned>(6));
+            Assert::IsTrue(first == second);
+            auto third = concurrentCache.CompareAndInsert(5, first, std::make_shared<unsigned>(7));
+            Assert::AreEqual(7u, *third);
+            Assert::AreEqual(7u, *concurrentCache.Get(5));
+        }
+
+        TEST_METHOD(FlatHashTableTest)
+        {
+            FlatHashTable<unsigned> table;
+            Assert::IsTrue(table.Find(5) == nullptr);
+
+                // insert enough to force the table to grow a few times (including the key 0,
+                // which is stored separately)
+            for (unsigned c=0; c<1000; ++c)
+                table.Insert(c * 0x100000000ull, c);
+            table.Insert(0, 1234);
+            Assert::AreEqual(1000u, table.GetSize());
+
+            for (unsigned c=1; c<1000; ++c) {
+                auto* v = table.Find(c * 0x100000000ull);
+                Assert::IsTrue(v && *v == c);
+            }
+            Assert::AreEqual(1234u, *table.Find(0));
+            Assert::IsTrue(table.Find(1) == nullptr);
+
+            auto moved = std::move(table);
+            Assert::AreEqual(0u, table.GetSize());
+            Assert::AreEqual(500u, *moved.Find(500 * 0x100000000ull));
+
+            auto metrics = moved.GetMetrics();
+            Assert::AreEqual(uint64(1001), metrics._hits);
+            Assert::AreEqual(uint64(2), metrics._misses);
+            Assert::AreEqual(1000u, metrics._size);
+            Assert::IsTrue(metrics._capacity >= 2000u);
+        }
+
+        TEST_METHOD(ParameterBoxFilteredHash)
+        {
+            ParameterBox filter(
+                {
+                    std::make_pair((const utf8*)"A", "1u"),
+                    std::make_pair((const utf8*)"B", "2u"),
+                    std::make_pair((const utf8*)"C", "3u"),
+                    std::make_pair((const utf8*)"D", ".5f")
+                });
+
+                // "E" isn't in the filter, and "D" will need a cast from int to float
+            ParameterBox source(
+                {
+                    std::make_pair((const utf8*)"A", "5u"),
+                    std::make_pair((const utf8*)"B", "6u"),
+                    std::make_pair((const utf8*)"D", "7i"),
+                    std::make_pair((const utf8*)"E", "8u")
+                });
+
+                // The filtered hash should be the same as the hash of the filter box, 
+                // after the values from the source are copied in
+            ParameterBox expected(
+                {
+                    std::make_pair((const utf8*)"A", "5u"),
+                    std::make_pair((const utf8*)"B", "6u"),
+                    std::make_pair((const utf8*)"C", "3u"),
+                    std::make_pair((const utf8*)"D", "7.f")
+                });
+
+            auto mask = filter.BuildFilterMask(source);
+            Assert::AreEqual(expected.GetHash(), filter.CalculateFilteredHashValue(source, mask));
+            Assert::AreEqual(expected.GetHash(), filter.CalculateFilteredHashValue(source));
+
+                // the mask can be reused with other boxes with the same layout
+            ParameterBox source2(
+                {
+                    std::make_pair((const utf8*)"A", "5u"),
+                    std::make_pair((const utf8*)"B", "9u"),
+                    std::make_pair((const utf8*)"D", "7i"),
+                    std::make_pair((const utf8*)"E", "8u")
+                });
+            Assert::AreEqual(source.CalculateLayoutHash(), source2.CalculateLayoutHash());
+            expected.SetParameter((const utf8*)"B", 9u);
+            Assert::AreEqual(expected.GetHash(), filter.CalculateFilteredHashValue(source2, mask));
+
+                // but changing a type changes the layout
+            source2.SetParameter((const utf8*)"B", 9.f);
+            Assert::AreNotEqual(source.CalculateLayoutHash(), source2.CalculateLayoutHash());
+
+                // with no matching parameters, the filtered hash is just the hash of the filter
+            ParameterBox unrelated({ std::make_pair((const utf8*)"F", "1u") });
+            Assert::AreEqual(filter.GetHash(), filter.CalculateFilteredHashValue(unrelated));
+        }
     };
 }
 
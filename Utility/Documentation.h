@@ -21,7 +21,8 @@
         by the standard library.
             Class | Description
             ----- | -----------
-            CompletionThreadPool | <i>basic thread pool with windows completion ports</i>
+            CompletionThreadPool | <i>work stealing thread pool (with support for windows completion routines)</i>
+            LockFree::BoundedQueue | <i>fixed size multi-producer/multi-consumer queue</i>
             Utility::Interlocked namespace | <i>layer over atomic CPU instructions</i> 
 
     ## Streams
@@ -58,6 +59,7 @@
             Class | Description
             ----- | -----------
             LRUCache | <i>Records a finite subset of the most recently used items of a larger set</i>
+            ConcurrentLRUCache | <i>Thread safe (sharded) version of LRUCache</i>
             MiniHeap | <i>Moderate performance (but highly flexible) heap implementation. Used for small and special case heap implementations</i>
             SpanningHeap | <i>Heap management utility for arbitrarily sized blocks</i>
             BitHeap | <i>Records allocated/deallocated status for a fixed set of equal heap blocks</i>
@@ -33,57 +33,135 @@ namespace Utility
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+    /// <summary>Records a finite subset of the most recently used items of a larger set</summary>
+    /// Objects are identified by a 64 bit hash value. Lookups use an open addressed
+    /// hash table (with linear probing), and the recency order is maintained with an
+    /// intrusive linked list (LRUQueue). So Get(), Insert() and eviction are all
+    /// constant time operations.
+    ///
+    /// LRUCache is not thread safe; see ConcurrentLRUCache for a version that can be
+    /// used from multiple threads.
     template<typename Type> class LRUCache
     {
     public:
         void Insert(uint64 hashName, std::shared_ptr<Type> object);
         std::shared_ptr<Type>& Get(uint64 hashName);
 
+        class Metrics
+        {
+        public:
+            uint64 _hits, _misses, _evictions;
+            unsigned _size, _capacity;
+        };
+        Metrics GetMetrics() const;
+
         LRUCache(unsigned cacheSize);
         ~LRUCache();
     protected:
         std::vector<std::shared_ptr<Type>>   _objects;
+        std::vector<uint64>                  _objectHashes;
         std::vector<std::pair<uint64, unsigned>> _lookupTable;
+        unsigned _lookupMask;
         LRUQueue _queue;
         unsigned _cacheSize;
+
+        uint64 _hits, _misses, _evictions;
+
+        static const unsigned EmptyEntry = ~unsigned(0x0);
+
+        unsigned HomeIndex(uint64 hashName) const;
+        unsigned FindEntry(uint64 hashName) const;
+        void InsertEntry(uint64 hashName, unsigned objectIndex);
+        void EraseEntry(unsigned tableIndex);
     };
 
+    template<typename Type>
+        unsigned LRUCache<Type>::HomeIndex(uint64 hashName) const
+    {
+            // the names are normally already hash values, but mix them again
+            // anyway, so that structured keys don't cluster in the table
+        return unsigned((hashName * 0x9E3779B97F4A7C15ull) >> 32ull) & _lookupMask;
+    }
+
+    template<typename Type>
+        unsigned LRUCache<Type>::FindEntry(uint64 hashName) const
+    {
+        auto i = HomeIndex(hashName);
+        for (;;) {
+            const auto& e = _lookupTable[i];
+            if (e.second == EmptyEntry) return EmptyEntry;
+            if (e.first == hashName) return i;
+            i = (i+1) & _lookupMask;
+        }
+    }
+
+    template<typename Type>
+        void LRUCache<Type>::InsertEntry(uint64 hashName, unsigned objectIndex)
+    {
+            // (the table is always at least twice as large as the cache size,
+            // so there must be a free entry)
+        auto i = HomeIndex(hashName);
+        while (_lookupTable[i].second != EmptyEntry)
+            i = (i+1) & _lookupMask;
+        _lookupTable[i] = std::make_pair(hashName, objectIndex);
+    }
+
+    template<typename Type>
+        void LRUCache<Type>::EraseEntry(unsigned tableIndex)
+    {
+            // Erase with "backward shift" (rather than tombstones). Entries in
+            // the probe sequence after the erased entry are moved back, unless 
+            // their home index falls cyclically in between.
+        auto i = tableIndex;
+        auto j = i;
+        for (;;) {
+            j = (j+1) & _lookupMask;
+            if (_lookupTable[j].second == EmptyEntry) break;
+            auto k = HomeIndex(_lookupTable[j].first);
+            bool stays = (i <= j) ? ((i < k) && (k <= j)) : ((i < k) || (k <= j));
+            if (stays) continue;
+            _lookupTable[i] = _lookupTable[j];
+            i = j;
+        }
+        _lookupTable[i] = std::make_pair(0ull, unsigned(EmptyEntry));
+    }
+
     template<typename Type>
         void LRUCache<Type>::Insert(uint64 hashName, std::shared_ptr<Type> object)
     {
             // try to insert this object into the cache (if it's not already here)
-        auto i = std::lower_bound(_lookupTable.cbegin(), _lookupTable.cend(), hashName, CompareFirst<uint64, unsigned>());
-        if (i != _lookupTable.cend() && i->first == hashName) {
+        auto existing = FindEntry(hashName);
+        if (existing != EmptyEntry) {
                 // already here! But we should replace, this might be an update operation
-            _objects[i->second] = object;
+            auto objectIndex = _lookupTable[existing].second;
+            _objects[objectIndex] = std::move(object);
+            _queue.BringToFront(objectIndex);
             return;
         }
 
         if (_objects.size() < _cacheSize) {
-            _objects.push_back(object);
-            _lookupTable.insert(i, std::make_pair(hashName, unsigned(_objects.size()-1)));
-            _queue.BringToFront(unsigned(_objects.size()-1));
+            _objects.push_back(std::move(object));
+            _objectHashes.push_back(hashName);
+            auto objectIndex = unsigned(_objects.size()-1);
+            InsertEntry(hashName, objectIndex);
+            _queue.BringToFront(objectIndex);
             return;
         }
 
             // we need to evict an existing object.
-        // SelectedModel = nullptr;
-
         unsigned eviction = _queue.GetOldestValue();
         if (eviction == ~unsigned(0x0)) {
             assert(0); return;
         }
 
-        _objects[eviction] = object;
-        auto oldLookup = std::find_if(_lookupTable.cbegin(), _lookupTable.cend(), 
-            [=](const std::pair<uint64, unsigned>& p) { return p.second == eviction; });
-        assert(oldLookup != _lookupTable.cend());
-        _lookupTable.erase(oldLookup);
-
-            // have to search again after the erase above
-        i = std::lower_bound(_lookupTable.cbegin(), _lookupTable.cend(), hashName, CompareFirst<uint64, unsigned>());
-        _lookupTable.insert(i, std::make_pair(hashName, eviction));
+        auto oldLookup = FindEntry(_objectHashes[eviction]);
+        assert(oldLookup != EmptyEntry && _lookupTable[oldLookup].second == eviction);
+        EraseEntry(oldLookup);
+        ++_evictions;
 
+        _objects[eviction] = std::move(object);
+        _objectHashes[eviction] = hashName;
+        InsertEntry(hashName, eviction);
         _queue.BringToFront(eviction);
     }
 
@@ -91,28 +169,365 @@ namespace Utility
         std::shared_ptr<Type>& LRUCache<Type>::Get(uint64 hashName)
     {
             // find the given object, and move it to the front of the queue
-        auto i = std::lower_bound(_lookupTable.cbegin(), _lookupTable.cend(), hashName, CompareFirst<uint64, unsigned>());
-        if (i != _lookupTable.cend() && i->first == hashName) {
-            _queue.BringToFront(i->second);
-            return _objects[i->second];
+        auto i = FindEntry(hashName);
+        if (i != EmptyEntry) {
+            ++_hits;
+            auto objectIndex = _lookupTable[i].second;
+            _queue.BringToFront(objectIndex);
+            return _objects[objectIndex];
         }
+        ++_misses;
         static std::shared_ptr<Type> dummy;
         return dummy;
     }
 
+    template<typename Type>
+        auto LRUCache<Type>::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        result._hits = _hits;
+        result._misses = _misses;
+        result._evictions = _evictions;
+        result._size = unsigned(_objects.size());
+        result._capacity = _cacheSize;
+        return result;
+    }
+
     template<typename Type>
         LRUCache<Type>::LRUCache(unsigned cacheSize)
     : _queue(cacheSize) 
     , _cacheSize(cacheSize)
+    , _hits(0), _misses(0), _evictions(0)
     {
-        _lookupTable.reserve(cacheSize);
         _objects.reserve(cacheSize);
+        _objectHashes.reserve(cacheSize);
+
+            // keep the load factor of the lookup table at or below 0.5
+        unsigned tableSize = 8;
+        while (tableSize < cacheSize*2) tableSize <<= 1;
+        _lookupTable.resize(tableSize, std::make_pair(0ull, unsigned(EmptyEntry)));
+        _lookupMask = tableSize-1;
     }
 
     template<typename Type>
         LRUCache<Type>::~LRUCache()
     {}
 
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    /// <summary>Thread safe version of LRUCache</summary>
+    /// The cache is split into a number of "shards", each with it's own lock and
+    /// it's own LRUCache. The shard is selected from the hash name, so threads
+    /// working with different objects will rarely contend on the same lock.
+    ///
+    /// Note that the recency order is maintained separately for each shard (so the
+    /// eviction order is only an approximation of true LRU order).
+    ///
+    /// Get() returns the object by value (because another thread could replace or 
+    /// evict it as soon as the lock is released).
+    template<typename Type> class ConcurrentLRUCache
+    {
+    public:
+        void Insert(uint64 hashName, std::shared_ptr<Type> object);
+        std::shared_ptr<Type> Get(uint64 hashName);
+
+            /// <summary>Insert only if the cached object is still "expected"</summary>
+            /// Replaces the object for "hashName" with "object" if the object currently in
+            /// the cache is "expected" (which can be null, to mean "not in the cache").
+            /// Returns the object that is in the cache afterwards. So when two threads miss
+            /// on the same name at the same time, they both end up using the same object
+            /// (rather than the second insert destroying the first thread's object).
+        std::shared_ptr<Type> CompareAndInsert(
+            uint64 hashName, 
+            const std::shared_ptr<Type>& expected, std::shared_ptr<Type> object);
+
+        typedef typename LRUCache<Type>::Metrics Metrics;
+        Metrics GetMetrics() const;
+
+        ConcurrentLRUCache(unsigned cacheSize, unsigned shardCount = 16);
+        ~ConcurrentLRUCache();
+    protected:
+        class Shard
+        {
+        public:
+            mutable Threading::Mutex _lock;
+            LRUCache<Type> _cache;
+            Shard(unsigned cacheSize) : _cache(cacheSize) {}
+        };
+        std::vector<std::unique_ptr<Shard>> _shards;
+
+        Shard& GetShard(uint64 hashName);
+    };
+
+    template<typename Type>
+        auto ConcurrentLRUCache<Type>::GetShard(uint64 hashName) -> Shard&
+    {
+            // (LRUCache uses the high bits of the mixed hash for the table index, 
+            // so use the low bits of the upper half here)
+        return *_shards[unsigned(hashName >> 32ull) % unsigned(_shards.size())];
+    }
+
+    template<typename Type>
+        void ConcurrentLRUCache<Type>::Insert(uint64 hashName, std::shared_ptr<Type> object)
+    {
+        auto& shard = GetShard(hashName);
+        ScopedLock(shard._lock);
+        shard._cache.Insert(hashName, std::move(object));
+    }
+
+    template<typename Type>
+        std::shared_ptr<Type> ConcurrentLRUCache<Type>::Get(uint64 hashName)
+    {
+        auto& shard = GetShard(hashName);
+        ScopedLock(shard._lock);
+        return shard._cache.Get(hashName);
+    }
+
+    template<typename Type>
+        std::shared_ptr<Type> ConcurrentLRUCache<Type>::CompareAndInsert(
+            uint64 hashName, 
+            const std::shared_ptr<Type>& expected, std::shared_ptr<Type> object)
+    {
+        auto& shard = GetShard(hashName);
+        ScopedLock(shard._lock);
+        auto current = shard._cache.Get(hashName);
+        if (current != expected)
+            return current;
+        shard._cache.Insert(hashName, object);
+        return object;
+    }
+
+    template<typename Type>
+        auto ConcurrentLRUCache<Type>::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        result._hits = result._misses = result._evictions = 0;
+        result._size = result._capacity = 0;
+        for (const auto& s:_shards) {
+            ScopedLock(s->_lock);
+            auto m = s->_cache.GetMetrics();
+            result._hits += m._hits;
+            result._misses += m._misses;
+            result._evictions += m._evictions;
+            result._size += m._size;
+            result._capacity += m._capacity;
+        }
+        return result;
+    }
+
+    template<typename Type>
+        ConcurrentLRUCache<Type>::ConcurrentLRUCache(unsigned cacheSize, unsigned shardCount)
+    {
+        shardCount = std::max(1u, std::min(shardCount, cacheSize));
+        _shards.reserve(shardCount);
+        for (unsigned c=0; c<shardCount; ++c) {
+                // distribute the total cache size evenly between the shards
+            auto shardSize = cacheSize / shardCount + ((c < (cacheSize % shardCount)) ? 1 : 0);
+            _shards.push_back(std::make_unique<Shard>(shardSize));
+        }
+    }
+
+    template<typename Type>
+        ConcurrentLRUCache<Type>::~ConcurrentLRUCache()
+    {}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+    /// <summary>Unordered map from 64 bit hash values to objects</summary>
+    /// Use this in place of a sorted vector of (hash, object) pairs when there are many
+    /// lookups and inserts happen at unpredictable times. The table is open addressed with
+    /// linear probing (like the lookup table in LRUCache). The keys are kept separately from
+    /// the objects, so probing only touches the keys. Insert() never moves existing
+    /// entries to make room (the table doubles instead). It keeps the load factor at or
+    /// below 0.5.
+    ///
+    /// The key 0 is allowed, but it's stored outside of the main table, because 0 marks
+    /// empty entries. There's no Erase(), because the clients so far are caches that only grow.
+    ///
+    /// Pointers returned by Find() are invalidated by Insert() and Clear().
+    /// FlatHashTable is not thread safe.
+    template<typename Type> class FlatHashTable
+    {
+    public:
+        Type*       Find(uint64 key);
+        Type&       Insert(uint64 key, Type value);
+        void        Clear();
+        unsigned    GetSize() const { return _size; }
+
+        class Metrics
+        {
+        public:
+            uint64 _hits, _misses;
+            unsigned _size, _capacity;
+        };
+        Metrics GetMetrics() const;
+
+        FlatHashTable();
+        FlatHashTable(const FlatHashTable& copyFrom);
+        FlatHashTable& operator=(const FlatHashTable& copyFrom);
+        FlatHashTable(FlatHashTable&& moveFrom);
+        FlatHashTable& operator=(FlatHashTable&& moveFrom);
+        ~FlatHashTable();
+    protected:
+        std::vector<uint64> _keys;      // 0 marks an empty entry
+        std::vector<Type>   _values;    // (one extra entry on the end for the key 0)
+        unsigned _mask, _size;
+        bool _hasZeroKey;
+
+        uint64 _hits, _misses;
+
+        unsigned HomeIndex(uint64 key) const;
+        unsigned FindIndex(uint64 key) const;
+        void Grow();
+    };
+
+    template<typename Type>
+        unsigned FlatHashTable<Type>::HomeIndex(uint64 key) const
+    {
+            // same mixing as LRUCache::HomeIndex
+        return unsigned((key * 0x9E3779B97F4A7C15ull) >> 32ull) & _mask;
+    }
+
+    template<typename Type>
+        unsigned FlatHashTable<Type>::FindIndex(uint64 key) const
+    {
+            // returns either the entry with this key, or the empty entry 
+            // where it should be inserted
+        assert(key != 0 && !_keys.empty());
+        auto i = HomeIndex(key);
+        while (_keys[i] != key && _keys[i] != 0)
+            i = (i+1) & _mask;
+        return i;
+    }
+
+    template<typename Type>
+        Type* FlatHashTable<Type>::Find(uint64 key)
+    {
+        if (key == 0) {
+            if (_hasZeroKey) { ++_hits; return &_values[_keys.size()]; }
+        } else if (!_keys.empty()) {
+            auto i = FindIndex(key);
+            if (_keys[i] == key) { ++_hits; return &_values[i]; }
+        }
+        ++_misses;
+        return nullptr;
+    }
+
+    template<typename Type>
+        Type& FlatHashTable<Type>::Insert(uint64 key, Type value)
+    {
+        if ((_size+1)*2 > unsigned(_keys.size()))
+            Grow();
+
+        if (key == 0) {
+            if (!_hasZeroKey) { _hasZeroKey = true; ++_size; }
+            auto& result = _values[_keys.size()];
+            result = std::move(value);
+            return result;
+        }
+
+        auto i = FindIndex(key);
+        if (_keys[i] == 0) {
+            _keys[i] = key;
+            ++_size;
+        }
+        _values[i] = std::move(value);
+        return _values[i];
+    }
+
+    template<typename Type>
+        void FlatHashTable<Type>::Grow()
+    {
+        auto oldKeys = std::move(_keys);
+        auto oldValues = std::move(_values);
+        auto newTableSize = std::max(16u, unsigned(oldKeys.size())*2);
+        _keys = std::vector<uint64>(newTableSize, 0);
+        _values = std::vector<Type>(newTableSize+1);
+        _mask = newTableSize-1;
+
+        for (size_t c=0; c<oldKeys.size(); ++c) {
+            if (!oldKeys[c]) continue;
+            auto i = FindIndex(oldKeys[c]);
+            _keys[i] = oldKeys[c];
+            _values[i] = std::move(oldValues[c]);
+        }
+        if (_hasZeroKey)
+            _values[newTableSize] = std::move(oldValues[oldKeys.size()]);
+    }
+
+    template<typename Type>
+        void FlatHashTable<Type>::Clear()
+    {
+        _keys.clear();
+        _values.clear();
+        _mask = 0; _size = 0;
+        _hasZeroKey = false;
+    }
+
+    template<typename Type>
+        auto FlatHashTable<Type>::GetMetrics() const -> Metrics
+    {
+        Metrics result;
+        result._hits = _hits;
+        result._misses = _misses;
+        result._size = _size;
+        result._capacity = unsigned(_keys.size());
+        return result;
+    }
+
+    template<typename Type>
+        FlatHashTable<Type>::FlatHashTable()
+    : _mask(0), _size(0), _hasZeroKey(false)
+    , _hits(0), _misses(0)
+    {}
+
+    template<typename Type>
+        FlatHashTable<Type>::FlatHashTable(const FlatHashTable& copyFrom)
+    : _keys(copyFrom._keys), _values(copyFrom._values)
+    , _mask(copyFrom._mask), _size(copyFrom._size), _hasZeroKey(copyFrom._hasZeroKey)
+    , _hits(copyFrom._hits), _misses(copyFrom._misses)
+    {}
+
+    template<typename Type>
+        auto FlatHashTable<Type>::operator=(const FlatHashTable& copyFrom) -> FlatHashTable&
+    {
+        _keys = copyFrom._keys;
+        _values = copyFrom._values;
+        _mask = copyFrom._mask;
+        _size = copyFrom._size;
+        _hasZeroKey = copyFrom._hasZeroKey;
+        _hits = copyFrom._hits;
+        _misses = copyFrom._misses;
+        return *this;
+    }
+
+    template<typename Type>
+        FlatHashTable<Type>::FlatHashTable(FlatHashTable&& moveFrom)
+    : _keys(std::move(moveFrom._keys)), _values(std::move(moveFrom._values))
+    , _mask(moveFrom._mask), _size(moveFrom._size), _hasZeroKey(moveFrom._hasZeroKey)
+    , _hits(moveFrom._hits), _misses(moveFrom._misses)
+    {
+        moveFrom.Clear();
+    }
+
+    template<typename Type>
+        auto FlatHashTable<Type>::operator=(FlatHashTable&& moveFrom) -> FlatHashTable&
+    {
+        _keys = std::move(moveFrom._keys);
+        _values = std::move(moveFrom._values);
+        _mask = moveFrom._mask;
+        _size = moveFrom._size;
+        _hasZeroKey = moveFrom._hasZeroKey;
+        _hits = moveFrom._hits;
+        _misses = moveFrom._misses;
+        moveFrom.Clear();
+        return *this;
+    }
+
+    template<typename Type>
+        FlatHashTable<Type>::~FlatHashTable()
+    {}
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
     template <typename Marker>
@@ -896,15 +896,9 @@ namespace Utility
         return _cachedParameterNameHash;
     }
 
-    uint64      ParameterBox::CalculateFilteredHashValue(const ParameterBox& source) const
+    auto ParameterBox::BuildFilterMask(const ParameterBox& source) const -> FilterMask
     {
-        if (_values.size() > 1024) {
-            assert(0);
-            return 0;
-        }
-
-        uint8 temporaryValues[1024];
-        std::copy(_values.cbegin(), _values.cend(), temporaryValues);
+        FilterMask result;
 
         auto i  = _hashNames.cbegin();
         auto i2 = source._hashNames.cbegin();
@@ -918,20 +912,25 @@ namespace Utility
                 auto offsetSrc  = source._offsets[std::distance(source._hashNames.cbegin(), i2)].second;
                 auto typeSrc    = source._types[std::distance(source._hashNames.cbegin(), i2)];
                 
-                if (typeDest == typeSrc) {
-                    XlCopyMemory(
-                        PtrAdd(temporaryValues, offsetDest), 
-                        PtrAdd(AsPointer(source._values.cbegin()), offsetSrc),
-                        typeDest.GetSize());
+                    // sometimes we get trival casting situations (like "unsigned int" to "int")
+                    //  -- even in those cases, we execute the casting function, which will effect performance
+                bool cast = !(typeDest == typeSrc);
+
+                    // values are stored in the same order as the names, so matching parameters
+                    // are often next to each other in both boxes. In that case, we can just extend
+                    // the previous copy
+                auto* prev = result._copies.empty() ? nullptr : &result._copies.back();
+                if (    !cast && prev && !prev->_cast
+                    &&  (prev->_dstOffset + prev->_size) == offsetDest
+                    &&  (prev->_srcOffset + prev->_size) == offsetSrc) {
+                    prev->_size += typeDest.GetSize();
                 } else {
-                        // sometimes we get trival casting situations (like "unsigned int" to "int")
-                        //  -- even in those cases, we execute the casting function, which will effect performance
-                    bool castSuccess = ImpliedTyping::Cast(
-                        PtrAdd(temporaryValues, offsetDest), sizeof(temporaryValues)-offsetDest, typeDest,
-                        PtrAdd(AsPointer(source._values.cbegin()), offsetSrc), typeSrc);
-
-                    assert(castSuccess);  // type mis-match when attempting to build filtered hash value
-                    (void)castSuccess;
+                    FilterMask::Copy copy;
+                    copy._dstOffset = offsetDest; copy._srcOffset = offsetSrc;
+                    copy._size = typeDest.GetSize();
+                    copy._dstType = typeDest; copy._srcType = typeSrc;
+                    copy._cast = cast;
+                    result._copies.push_back(copy);
                 }
 
                 ++i; ++i2;
@@ -939,9 +938,57 @@ namespace Utility
 
         }
 
+        return std::move(result);
+    }
+
+    uint64      ParameterBox::CalculateFilteredHashValue(const ParameterBox& source, const FilterMask& mask) const
+    {
+            // when no parameters match, the filtered values are just our own values
+        if (mask._copies.empty())
+            return GetHash();
+
+        if (_values.size() > 1024) {
+            assert(0);
+            return 0;
+        }
+
+        uint8 temporaryValues[1024];
+        std::copy(_values.cbegin(), _values.cend(), temporaryValues);
+
+        const auto* sourceValues = AsPointer(source._values.cbegin());
+        for (auto c=mask._copies.cbegin(); c!=mask._copies.cend(); ++c) {
+            assert((c->_srcOffset + (c->_cast ? c->_srcType.GetSize() : c->_size)) <= source._values.size());
+            if (!c->_cast) {
+                XlCopyMemory(
+                    PtrAdd(temporaryValues, c->_dstOffset), 
+                    PtrAdd(sourceValues, c->_srcOffset),
+                    c->_size);
+            } else {
+                bool castSuccess = ImpliedTyping::Cast(
+                    PtrAdd(temporaryValues, c->_dstOffset), sizeof(temporaryValues)-c->_dstOffset, c->_dstType,
+                    PtrAdd(sourceValues, c->_srcOffset), c->_srcType);
+
+                assert(castSuccess);  // type mis-match when attempting to build filtered hash value
+                (void)castSuccess;
+            }
+        }
+
         return Hash64(temporaryValues, PtrAdd(temporaryValues, _values.size()));
     }
 
+    uint64      ParameterBox::CalculateFilteredHashValue(const ParameterBox& source) const
+    {
+        return CalculateFilteredHashValue(source, BuildFilterMask(source));
+    }
+
+    uint64      ParameterBox::CalculateLayoutHash() const
+    {
+            //  Two boxes with the same layout hash have the same parameters, with the
+            //  same types, at the same value offsets (values are always stored in 
+            //  parameter name order). So they can use the same FilterMask.
+        return Hash64(AsPointer(_types.cbegin()), AsPointer(_types.cend()), GetParameterNamesHash());
+    }
+
     class StringTableComparison
     {
     public:
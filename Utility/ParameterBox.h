@@ -156,6 +156,32 @@ namespace Utility
         uint64  CalculateFilteredHashValue(const ParameterBox& source) const;
         bool    AreParameterNamesEqual(const ParameterBox& other) const;
 
+            /// <summary>Precalculated matching between this box and a source box</summary>
+            /// CalculateFilteredHashValue needs to find the parameters that appear in both
+            /// this box and the source box. That only depends on the names and types in the
+            /// source (not the values). So a FilterMask can be calculated once, and then reused
+            /// for every source box with the same layout (see CalculateLayoutHash). Parameters
+            /// next to each other in both boxes (with the same types) are merged into a single
+            /// copy operation.
+            ///
+            /// The mask is only valid while this box isn't changed.
+        class FilterMask
+        {
+        public:
+            class Copy
+            {
+            public:
+                uint32      _dstOffset, _srcOffset, _size;
+                TypeDesc    _dstType, _srcType;
+                bool        _cast;
+            };
+            std::vector<Copy>   _copies;
+        };
+
+        FilterMask  BuildFilterMask(const ParameterBox& source) const;
+        uint64      CalculateFilteredHashValue(const ParameterBox& source, const FilterMask& mask) const;
+        uint64      CalculateLayoutHash() const;
+
         ////////////////////////////////////////////////////////////////////////////////////////
             //      M E R G I N G   &   I T E R A T O R                     //
         ////////////////////////////////////////////////////////////////////////////////////////
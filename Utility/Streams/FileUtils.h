@@ -41,7 +41,7 @@ namespace Utility
 
         struct ShareMode
         {
-            enum { Read = 1<<0, Write = 1<<1 };
+            enum { Read = 1<<0, Write = 1<<1, Delete = 1<<2 };     ///< Delete also allows other handles to rename the file
             typedef unsigned BitField;
         };
 
@@ -18,6 +18,7 @@ namespace Utility
         unsigned underlyingShareMode = 0;
         if (shareMode & BasicFile::ShareMode::Write)   { underlyingShareMode |= FILE_SHARE_WRITE; }
         if (shareMode & BasicFile::ShareMode::Read)    { underlyingShareMode |= FILE_SHARE_READ; }
+        if (shareMode & BasicFile::ShareMode::Delete)  { underlyingShareMode |= FILE_SHARE_DELETE; }
         return underlyingShareMode;
     }
 
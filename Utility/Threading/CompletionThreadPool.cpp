@@ -5,93 +5,326 @@
 // http://www.opensource.org/licenses/mit-license.php)
 
 #include "CompletionThreadPool.h"
+#include "LockFree.h"
 #include "../../ConsoleRig/Log.h"
 #include "../../Utility/SystemUtils.h"
 #include "../../Core/Exceptions.h"
+#include <algorithm>
 
 namespace Utility
 {
+        // Each worker thread records the pool it belongs to, and the index of
+        // it's own queue. This lets us push onto the local queue when a task
+        // is queued from within another task
+    static thread_local const CompletionThreadPool* s_currentPool = nullptr;
+    static thread_local unsigned s_currentQueueIndex = ~0u;
+
+    static void ExecuteTask(std::function<void()>& task)
+    {
+        TRY
+        {
+            task();
+        } CATCH(const std::exception& e) {
+            LogAlwaysError << "Suppressing exception in thread pool thread: " << e.what();
+        } CATCH(...) {
+            LogAlwaysError << "Suppressing unknown exception in thread pool thread.";
+        } CATCH_END
+    }
+
+    bool CompletionThreadPool::IsWorkerThread() const
+    {
+        return s_currentPool == this;
+    }
+
     void CompletionThreadPool::EnqueueInternal(PendingTask&& task)
     {
-        _pendingTasks.push_overflow(std::forward<PendingTask>(task));
+        unsigned queueIndex;
+        if (IsWorkerThread()) {
+            queueIndex = s_currentQueueIndex;
+        } else {
+            queueIndex = (_nextQueue++) % unsigned(_queues.size());
+        }
+
+        {
+            auto& queue = *_queues[queueIndex];
+            ScopedLock(queue._lock);
+            queue._tasks.push_back(std::move(task));
+        }
+        ++_pendingTaskCount;
+        WakeWorker();
+    }
+
+    void CompletionThreadPool::WakeWorker()
+    {
+        #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+                // set event should wake one thread -- and that thread should
+                // then take over and execute the task
+            XlSetEvent(_events[0]);
+        #else
+                // (lock & unlock to ensure a thread that has just checked
+                // _pendingTaskCount is actually waiting before we notify)
+            { std::unique_lock<std::mutex> lock(_wakeLock); }
+            _wakeCondition.notify_one();
+        #endif
+    }
+
+    bool CompletionThreadPool::TryPopTask(unsigned queueIndex, PendingTask& result)
+    {
+        auto queueCount = unsigned(_queues.size());
+
+            // First check our own queue (LIFO), then attempt to steal
+            // from the other queues (FIFO). When stealing, we start with
+            // the queue after ours, so different threads will tend to
+            // steal from different places.
+        if (queueIndex < queueCount) {
+            auto& queue = *_queues[queueIndex];
+            ScopedLock(queue._lock);
+            if (!queue._tasks.empty()) {
+                result = std::move(queue._tasks.back());
+                queue._tasks.pop_back();
+                --_pendingTaskCount;
+                return true;
+            }
+        }
+
+        auto start = (queueIndex < queueCount) ? (queueIndex+1) : (_nextQueue.load() % queueCount);
+        for (unsigned c=0; c<queueCount; ++c) {
+            auto victimIndex = (start + c) % queueCount;
+            if (victimIndex == queueIndex) continue;
+
+            auto& queue = *_queues[victimIndex];
+            ScopedLock(queue._lock);
+            if (!queue._tasks.empty()) {
+                result = std::move(queue._tasks.front());
+                queue._tasks.pop_front();
+                --_pendingTaskCount;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void CompletionThreadPool::WorkerFunction(unsigned queueIndex)
+    {
+        s_currentPool = this;
+        s_currentQueueIndex = queueIndex;
+
+        while (!_workerQuit) {
+            PendingTask task;
+            if (TryPopTask(queueIndex, task)) {
+                    // If there is still more work pending, pass the wake up
+                    // on to another thread. Otherwise a burst of tasks might
+                    // wake just a single thread.
+                if (_pendingTaskCount.load() != 0)
+                    WakeWorker();
+
+                    // if we got this far, we can execute the task....
+                ExecuteTask(task);
+
+                #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+                        // That that when using completion routines, we want to attempt to
+                        // distribute the tasks evenly between threads (so that the completion
+                        // routines will also be distributed evenly between threads.). To achieve
+                        // this, let's not attempt to search for another task immediately... Instead
+                        // when after we complete a task, let's encourage this thread to go back into
+                        // a stall (unless all of our threads are saturated)
+                    Threading::YieldTimeSlice();
+                #endif
+                continue;
+            }
 
-            // set event should wake one thread -- and that thread should
-            // then take over and execute the task
-        XlSetEvent(_events[0]);
+            #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+                    // Wait for the event with the "alertable" flag set true
+                    // note -- this is why we can't use std::condition_variable
+                    //      (because threads waiting on a condition variable won't
+                    //      be woken to execute completion routines)
+                XlWaitForMultipleSyncObjects(
+                    2, this->_events,
+                    false, XL_INFINITE, true);
+            #else
+                std::unique_lock<std::mutex> lock(_wakeLock);
+                _wakeCondition.wait(lock,
+                    [this]() { return this->_workerQuit.load() || this->_pendingTaskCount.load() != 0; });
+            #endif
+        }
+
+        s_currentPool = nullptr;
+        s_currentQueueIndex = ~0u;
     }
 
     CompletionThreadPool::CompletionThreadPool(unsigned threadCount)
+    : _nextQueue(0), _pendingTaskCount(0), _workerQuit(false)
     {
-            // once event is an "auto-reset" event, which should wake a single thread
-            // another event is a "manual-reset" event. This should 
-        _events[0] = XlCreateEvent(false);
-        _events[1] = XlCreateEvent(true);
-        _workerQuit = false;
+        #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+                // once event is an "auto-reset" event, which should wake a single thread
+                // another event is a "manual-reset" event. This should
+            _events[0] = XlCreateEvent(false);
+            _events[1] = XlCreateEvent(true);
+        #endif
+
+            // All of the queues must exist before any thread starts, because
+            // each thread will attempt to steal from all of the queues
+        threadCount = std::max(threadCount, 1u);
+        _queues.reserve(threadCount);
+        for (unsigned i = 0; i<threadCount; ++i)
+            _queues.push_back(std::make_unique<WorkerQueue>());
 
+        _workerThreads.reserve(threadCount);
         for (unsigned i = 0; i<threadCount; ++i)
             _workerThreads.emplace_back(
-                [this]
-                {
-                    while (!this->_workerQuit) {
-                        bool gotTask = false;
-                        std::function<void()> task;
-
-                        {
-                                // note that _pendingTasks is safe for multiple pushing threads,
-                                // but not safe for multiple popping threads. So we have to
-                                // lock to prevent more than one thread from attempt to pop
-                                // from it at the same time.
-                            ScopedLock(this->_pendingsTaskLock);
-
-                            std::function<void()>*t = nullptr;
-                            if (_pendingTasks.try_front(t)) {
-                                task = std::move(*t);
-                                _pendingTasks.pop();
-                                gotTask = true;
-                            }
-                        }
-
-                        if (gotTask) {
-                                // if we got this far, we can execute the task....
-                            TRY
-                            {
-                                task();
-                            } CATCH(const std::exception& e) {
-                                LogAlwaysError << "Suppressing exception in thread pool thread: " << e.what();
-                            } CATCH(...) {
-                                LogAlwaysError << "Suppressing unknown exception in thread pool thread.";
-                            } CATCH_END
-
-                                // That that when using completion routines, we want to attempt to
-                                // distribute the tasks evenly between threads (so that the completion
-                                // routines will also be distributed evenly between threads.). To achieve
-                                // this, let's not attempt to search for another task immediately... Instead
-                                // when after we complete a task, let's encourage this thread to go back into
-                                // a stall (unless all of our threads are saturated)
-                            Threading::YieldTimeSlice();
-                            continue;
-                        }
-
-                            // Wait for the event with the "alertable" flag set true
-                            // note -- this is why we can't use std::condition_variable
-                            //      (because threads waiting on a condition variable won't
-                            //      be woken to execute completion routines)
-                        XlWaitForMultipleSyncObjects(
-                            2, this->_events,
-                            false, XL_INFINITE, true);
-                    }
-                }
-            );
+                [this, i] { this->WorkerFunction(i); });
     }
 
     CompletionThreadPool::~CompletionThreadPool()
     {
         _workerQuit = true;
-        XlSetEvent(_events[1]);   // trigger a manual reset event should wake all threads (and keep them awake)
+        #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+            XlSetEvent(_events[1]);   // trigger a manual reset event should wake all threads (and keep them awake)
+        #else
+            { std::unique_lock<std::mutex> lock(_wakeLock); }
+            _wakeCondition.notify_all();
+        #endif
         for (auto&t : _workerThreads) t.join();
 
-        XlCloseSyncObject(_events[0]);
-        XlCloseSyncObject(_events[1]);
+        #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+            XlCloseSyncObject(_events[0]);
+            XlCloseSyncObject(_events[1]);
+        #endif
+    }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    void CompletionThreadPool::TaskGroup::RunInternal(PendingTask&& task)
+    {
+        ++_outstanding;
+        {
+            ScopedLock(_tasks->_lock);
+            _tasks->_tasks.push_back(std::move(task));
+        }
+        WakeWaiters();      // (a thread in Wait() can help with the new task)
+
+            // The pool task just executes the next task from the group's queue. Wait() 
+            // may have already executed it, in which case there's nothing to do (and the
+            // group may have been destroyed -- so we must not touch "group" unless we got a task)
+        auto* group = this;
+        auto tasks = _tasks;
+        _pool->EnqueueInternal(
+            [group, tasks]()
+            {
+                PendingTask t;
+                {
+                    ScopedLock(tasks->_lock);
+                    if (tasks->_tasks.empty()) return;
+                    t = std::move(tasks->_tasks.front());
+                    tasks->_tasks.pop_front();
+                }
+                ExecuteTask(t);
+                group->OnTaskComplete();
+            });
+    }
+
+    bool CompletionThreadPool::TaskGroup::TryExecuteOne()
+    {
+        PendingTask t;
+        {
+            ScopedLock(_tasks->_lock);
+            if (_tasks->_tasks.empty()) return false;
+            t = std::move(_tasks->_tasks.front());
+            _tasks->_tasks.pop_front();
+        }
+        ExecuteTask(t);
+        OnTaskComplete();
+        return true;
+    }
+
+    bool CompletionThreadPool::TaskGroup::HasQueuedTasks()
+    {
+        ScopedLock(_tasks->_lock);
+        return !_tasks->_tasks.empty();
+    }
+
+    void CompletionThreadPool::TaskGroup::WakeWaiters()
+    {
+            //  Only touch the mutex if there is actually someone waiting. The fence
+            //  pairs with the one in Wait(); either we see the waiter, or the waiter
+            //  sees the change we've just made.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waitingCount.load(std::memory_order_relaxed) != 0) {
+            { std::unique_lock<std::mutex> lock(_waitLock); }
+            _waitCondition.notify_all();
+        }
+    }
+
+    void CompletionThreadPool::TaskGroup::OnTaskComplete()
+    {
+            // Once _outstanding reaches zero, the group may be destroyed
+            // by another thread. So we must not touch any members after we've
+            // released _continuationLock (Wait() takes the lock after it sees
+            // zero, to synchronize with this)
+        auto* pool = _pool;
+        std::function<void()> continuation;
+        {
+            ScopedLock(_continuationLock);
+            if (--_outstanding != 0) return;
+            continuation = std::move(_continuation);
+            _continuation = nullptr;
+            WakeWaiters();
+        }
+        if (continuation)
+            pool->EnqueueInternal(std::move(continuation));
+    }
+
+    void CompletionThreadPool::TaskGroup::SetContinuation(std::function<void()>&& continuation)
+    {
+        {
+            ScopedLock(_continuationLock);
+            if (_outstanding.load() != 0) {
+                _continuation = std::move(continuation);
+                return;
+            }
+        }
+
+            // everything has already finished; queue immediately
+        _pool->EnqueueInternal(std::move(continuation));
+    }
+
+    bool CompletionThreadPool::TaskGroup::IsComplete() const
+    {
+        return _outstanding.load() == 0;
+    }
+
+    void CompletionThreadPool::TaskGroup::Wait()
+    {
+            // While we're waiting, help out by executing our own tasks. This is important 
+            // when waiting from within a pool thread -- otherwise we could deadlock with 
+            // all threads waiting on tasks that never start. Once our queue is empty, 
+            // the remaining tasks are already executing on other threads, and we sleep
+            // until they complete (or until more tasks are added to the group).
+        for (;;) {
+            while (TryExecuteOne()) {}
+            if (_outstanding.load() == 0) break;
+
+            std::unique_lock<std::mutex> lock(_waitLock);
+            ++_waitingCount;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (_outstanding.load() != 0 && !HasQueuedTasks())
+                _waitCondition.wait(lock);
+            --_waitingCount;
+        }
+
+        ScopedLock(_continuationLock);
+    }
+
+    CompletionThreadPool::TaskGroup::TaskGroup(CompletionThreadPool& pool)
+    : _pool(&pool), _outstanding(0)
+    , _tasks(std::make_shared<WorkerQueue>())
+    , _waitingCount(0)
+    {}
+
+    CompletionThreadPool::TaskGroup::~TaskGroup()
+    {
+        Wait();
     }
 }
 
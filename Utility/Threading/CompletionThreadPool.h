@@ -7,18 +7,48 @@
 #pragma once
 
 #include "Mutex.h"
-#include "LockFree.h"
+#include "ThreadingUtils.h"
+#include "../../Core/SelectConfiguration.h"
 #include <vector>
+#include <deque>
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
 
 namespace Utility
 {
+    /// <summary>Work stealing thread pool</summary>
+    /// Each worker thread owns a double ended queue of pending tasks. Tasks queued
+    /// from a worker thread are pushed onto the back of that worker's own queue, and
+    /// the worker pops from the back again (so recently queued, cache-warm tasks run first).
+    /// Tasks queued from outside of the pool are distributed round-robin between the
+    /// workers. When a worker runs out of tasks, it will steal from the front of the
+    /// other worker's queues.
+    ///
+    /// Each queue has its own small lock, so there is no single lock that all workers
+    /// must serialize on.
+    ///
+    /// On Windows, idle threads wait in an "alertable" state, so completion routines
+    /// (eg, from ReadFileEx) will be executed by the pool threads. On other platforms,
+    /// idle threads wait on a condition variable.
+    ///
+    /// Use TaskGroup to wait for a set of related tasks to complete (and to schedule
+    /// a continuation after them). TaskGroup::Wait() will execute the group's own pending
+    /// tasks on the calling thread while it waits.
     class CompletionThreadPool
     {
     public:
         template<class Fn, class... Args>
             void Enqueue(Fn&& fn, Args&&... args);
 
+        class TaskGroup;
+
+        bool IsWorkerThread() const;
+        unsigned GetWorkerThreadCount() const { return (unsigned)_workerThreads.size(); }
+
         CompletionThreadPool(unsigned threadCount);
         ~CompletionThreadPool();
 
@@ -27,16 +57,83 @@ namespace Utility
         CompletionThreadPool(CompletionThreadPool&&) = delete;
         CompletionThreadPool& operator=(CompletionThreadPool&&) = delete;
     private:
-        std::vector<std::thread> _workerThreads;
-        
-        Threading::Mutex _pendingsTaskLock;
         typedef std::function<void()> PendingTask;
-        LockFree::FixedSizeQueue<PendingTask, 256> _pendingTasks;
 
-        XlHandle _events[2];
-        volatile bool _workerQuit;
+        class WorkerQueue
+        {
+        public:
+            Threading::Mutex _lock;
+            std::deque<PendingTask> _tasks;
+        };
+
+        std::vector<std::thread> _workerThreads;
+        std::vector<std::unique_ptr<WorkerQueue>> _queues;
+        std::atomic<unsigned> _nextQueue;
+        std::atomic<unsigned> _pendingTaskCount;
+        std::atomic<bool> _workerQuit;
+
+        #if PLATFORMOS_ACTIVE == PLATFORMOS_WINDOWS
+            XlHandle _events[2];
+        #else
+            std::mutex _wakeLock;
+            std::condition_variable _wakeCondition;
+        #endif
 
         void EnqueueInternal(PendingTask&& task);
+        bool TryPopTask(unsigned queueIndex, PendingTask& result);
+        void WakeWorker();
+        void WorkerFunction(unsigned queueIndex);
+    };
+
+    /// <summary>Set of related tasks that can be waited on as a unit</summary>
+    /// Tasks added with Run() are held in the group's own queue, and a small task 
+    /// that executes the next one is queued in the pool immediately. Wait() will
+    /// block until all of them have completed, but will help by executing tasks
+    /// from the group's queue in the meantime (so it is safe to call Wait()
+    /// from within a pool thread). Once the group's queue is empty, Wait() sleeps
+    /// until the tasks running on other threads complete.
+    ///
+    /// Wait() never executes tasks that belong to other groups (or that were queued 
+    /// with Enqueue()). So a thread waiting on a few short tasks won't get stuck
+    /// executing some unrelated long task.
+    ///
+    /// SetContinuation() registers a function that will be queued in the pool
+    /// when the group next becomes empty (or immediately, if it's empty already).
+    ///
+    /// The destructor waits for all outstanding tasks.
+    class CompletionThreadPool::TaskGroup
+    {
+    public:
+        template<class Fn, class... Args>
+            void Run(Fn&& fn, Args&&... args);
+
+        void Wait();
+        bool IsComplete() const;
+        void SetContinuation(std::function<void()>&& continuation);
+
+        TaskGroup(CompletionThreadPool& pool);
+        ~TaskGroup();
+
+        TaskGroup(const TaskGroup&) = delete;
+        TaskGroup& operator=(const TaskGroup&) = delete;
+    private:
+        CompletionThreadPool* _pool;
+        std::atomic<unsigned> _outstanding;
+        Threading::Mutex _continuationLock;
+        std::function<void()> _continuation;
+
+            // (shared with the tasks queued in the pool, which can outlive the group)
+        std::shared_ptr<WorkerQueue> _tasks;
+
+        std::mutex _waitLock;
+        std::condition_variable _waitCondition;
+        std::atomic<unsigned> _waitingCount;
+
+        void RunInternal(PendingTask&& task);
+        bool TryExecuteOne();
+        bool HasQueuedTasks();
+        void WakeWaiters();
+        void OnTaskComplete();
     };
 
     template<class Fn, class... Args>
@@ -44,6 +141,12 @@ namespace Utility
         {
             EnqueueInternal(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
         }
+
+    template<class Fn, class... Args>
+        void CompletionThreadPool::TaskGroup::Run(Fn&& fn, Args&&... args)
+        {
+            RunInternal(std::bind(std::forward<Fn>(fn), std::forward<Args>(args)...));
+        }
 }
 
 using namespace Utility;
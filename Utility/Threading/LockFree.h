@@ -10,6 +10,11 @@
 #include "../PtrUtils.h"
 #include "Mutex.h"
 #include <queue>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <type_traits>
 #include <assert.h>
 
 namespace Utility
@@ -382,6 +387,293 @@ namespace LockFree
         {
             return _event;
         }
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+    template<typename Type, int Count>
+        class BoundedQueue
+    {
+    public:
+
+            //
+            //      Fixed size queue that is safe for multiple pushing
+            //      threads AND multiple popping threads.
+            //
+            //      Each slot has it's own sequence number, which tells us
+            //      if the slot is ready to be written (for pushers) or ready to 
+            //      be read (for poppers). Pushers & poppers only contend on 
+            //      the single atomic increment of _pushPos or _popPos. Unlike
+            //      FixedSizeQueue, a pusher that is preempted in the middle of
+            //      a push won't stall other pushing threads (it will only delay
+            //      the pop of that particular item).
+            //
+            //      There is no overflow path. When the queue is full, "try_push"
+            //      will fail, and "push_wait" will block until there is space.
+            //      Likewise, "pop_wait" blocks until there is something to pop.
+            //      The blocking methods spin briefly, and then sleep on a 
+            //      condition variable (so they won't burn a core while waiting).
+            //
+            //      Count must be a power of 2.
+            //
+
+        bool try_push(const Type&);
+        bool try_push(Type&&);
+        void push_wait(const Type&);
+        void push_wait(Type&&);
+
+        bool try_pop(Type&);
+        void pop_wait(Type&);
+        bool pop_wait(Type&, unsigned timeoutMilliseconds);
+
+        size_t size() const;
+
+        BoundedQueue();
+        ~BoundedQueue();
+
+    private:
+        class Slot
+        {
+        public:
+            std::atomic<size_t> _sequence;
+            typename std::aligned_storage<sizeof(Type), std::alignment_of<Type>::value>::type _storage;
+        };
+
+        static const unsigned CacheLineSize = 64;
+
+        Slot _slots[Count];
+        uint8 _padding0[CacheLineSize];
+        std::atomic<size_t> _pushPos;
+        uint8 _padding1[CacheLineSize];
+        std::atomic<size_t> _popPos;
+        uint8 _padding2[CacheLineSize];
+
+        std::atomic<unsigned> _waitingPushers;
+        std::atomic<unsigned> _waitingPoppers;
+        std::mutex _waitLock;
+        std::condition_variable _notEmpty;
+        std::condition_variable _notFull;
+
+        template<typename Ref> bool try_push_nowake(Ref&& newItem);
+        bool try_pop_nowake(Type& result);
+        void wake(std::condition_variable& cond, std::atomic<unsigned>& waitingCount);
+
+        BoundedQueue(const BoundedQueue<Type,Count>&);
+        const BoundedQueue<Type,Count>& operator=(const BoundedQueue<Type,Count>&);
+    };
+
+    template<typename Type, int Count>
+        BoundedQueue<Type,Count>::BoundedQueue()
+        {
+            static_assert((Count & (Count-1)) == 0, "BoundedQueue count must be a power of 2");
+            for (size_t c=0; c<Count; ++c)
+                _slots[c]._sequence.store(c, std::memory_order_relaxed);
+            _pushPos.store(0, std::memory_order_relaxed);
+            _popPos.store(0, std::memory_order_relaxed);
+            _waitingPushers.store(0, std::memory_order_relaxed);
+            _waitingPoppers.store(0, std::memory_order_relaxed);
+        }
+
+    template<typename Type, int Count>
+        BoundedQueue<Type,Count>::~BoundedQueue()
+        {
+                // destroy everything left in the queue
+            auto pushPos = _pushPos.load(std::memory_order_relaxed);
+            for (auto pos = _popPos.load(std::memory_order_relaxed); pos != pushPos; ++pos)
+                ((Type*)&_slots[pos & (Count-1)]._storage)->~Type();
+        }
+
+    #undef new 
+
+    template<typename Type, int Count>
+        template<typename Ref>
+            bool BoundedQueue<Type,Count>::try_push_nowake(Ref&& newItem)
+        {
+            auto pos = _pushPos.load(std::memory_order_relaxed);
+            for (;;) {
+                auto& slot = _slots[pos & (Count-1)];
+                auto seq = slot._sequence.load(std::memory_order_acquire);
+                auto diff = ptrdiff_t(seq) - ptrdiff_t(pos);
+                if (diff == 0) {
+                        // slot is free for writing, attempt to claim it
+                    if (_pushPos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+                        new(&slot._storage) Type(std::forward<Ref>(newItem));
+                        slot._sequence.store(pos+1, std::memory_order_release);
+                        return true;
+                    }
+                        // (on failure, compare_exchange_weak loads the new value of _pushPos into pos)
+                } else if (diff < 0) {
+                    return false;   // full (slot still contains an item from the previous lap)
+                } else {
+                    pos = _pushPos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::try_pop_nowake(Type& result)
+        {
+            auto pos = _popPos.load(std::memory_order_relaxed);
+            for (;;) {
+                auto& slot = _slots[pos & (Count-1)];
+                auto seq = slot._sequence.load(std::memory_order_acquire);
+                auto diff = ptrdiff_t(seq) - ptrdiff_t(pos+1);
+                if (diff == 0) {
+                    if (_popPos.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed)) {
+                        auto* item = (Type*)&slot._storage;
+                        result = std::move(*item);
+                        item->~Type();
+                            // mark this slot as writable for the push of the next lap
+                        slot._sequence.store(pos+Count, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    return false;   // empty (or the pusher for this slot hasn't finished yet)
+                } else {
+                    pos = _popPos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+    #if defined(DEBUG_NEW)
+        #define new DEBUG_NEW
+    #endif
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::try_push(const Type& newItem)
+        {
+            if (!try_push_nowake(newItem)) return false;
+            wake(_notEmpty, _waitingPoppers);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::try_push(Type&& newItem)
+        {
+            if (!try_push_nowake(std::move(newItem))) return false;
+            wake(_notEmpty, _waitingPoppers);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::try_pop(Type& result)
+        {
+            if (!try_pop_nowake(result)) return false;
+            wake(_notFull, _waitingPushers);
+            return true;
+        }
+
+    template<typename Type, int Count>
+        void BoundedQueue<Type,Count>::wake(std::condition_variable& cond, std::atomic<unsigned>& waitingCount)
+        {
+                //  Only touch the mutex if there is actually someone waiting.
+                //  The fence pairs with the increment of the waiting count in the
+                //  waiting functions; either we see the waiter, or the waiter 
+                //  sees the change we just made to the queue.
+                //  Every push or pop changes the state of just one slot, so
+                //  we only need to wake a single thread.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (waitingCount.load(std::memory_order_relaxed) != 0) {
+                { std::unique_lock<std::mutex> lock(_waitLock); }
+                cond.notify_one();
+            }
+        }
+
+    static const unsigned BoundedQueue_SpinCount = 64;
+
+    template<typename Type, int Count>
+        void BoundedQueue<Type,Count>::push_wait(const Type& newItem)
+        {
+            for (unsigned c=0; c<BoundedQueue_SpinCount; ++c) {
+                if (try_push(newItem)) return;
+                Threading::Pause();
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(_waitLock);
+                ++_waitingPushers;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (!try_push_nowake(newItem))
+                    _notFull.wait(lock);
+                --_waitingPushers;
+            }
+            wake(_notEmpty, _waitingPoppers);
+        }
+
+    template<typename Type, int Count>
+        void BoundedQueue<Type,Count>::push_wait(Type&& newItem)
+        {
+                // (try_push only moves from newItem when it succeeds)
+            for (unsigned c=0; c<BoundedQueue_SpinCount; ++c) {
+                if (try_push(std::move(newItem))) return;
+                Threading::Pause();
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(_waitLock);
+                ++_waitingPushers;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (!try_push_nowake(std::move(newItem)))
+                    _notFull.wait(lock);
+                --_waitingPushers;
+            }
+            wake(_notEmpty, _waitingPoppers);
+        }
+
+    template<typename Type, int Count>
+        void BoundedQueue<Type,Count>::pop_wait(Type& result)
+        {
+            for (unsigned c=0; c<BoundedQueue_SpinCount; ++c) {
+                if (try_pop(result)) return;
+                Threading::Pause();
+            }
+
+            {
+                std::unique_lock<std::mutex> lock(_waitLock);
+                ++_waitingPoppers;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                while (!try_pop_nowake(result))
+                    _notEmpty.wait(lock);
+                --_waitingPoppers;
+            }
+            wake(_notFull, _waitingPushers);
+        }
+
+    template<typename Type, int Count>
+        bool BoundedQueue<Type,Count>::pop_wait(Type& result, unsigned timeoutMilliseconds)
+        {
+            for (unsigned c=0; c<BoundedQueue_SpinCount; ++c) {
+                if (try_pop(result)) return true;
+                Threading::Pause();
+            }
+
+            auto timeout = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMilliseconds);
+            bool gotResult = false;
+            {
+                std::unique_lock<std::mutex> lock(_waitLock);
+                ++_waitingPoppers;
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                for (;;) {
+                    gotResult = try_pop_nowake(result);
+                    if (gotResult) break;
+                    if (_notEmpty.wait_until(lock, timeout) == std::cv_status::timeout) {
+                        gotResult = try_pop_nowake(result);
+                        break;
+                    }
+                }
+                --_waitingPoppers;
+            }
+            if (gotResult) wake(_notFull, _waitingPushers);
+            return gotResult;
+        }
+
+    template<typename Type, int Count>
+        size_t BoundedQueue<Type,Count>::size() const
+        {
+                // because of threading, this can only be an approximate result
+            auto popPos = _popPos.load(std::memory_order_relaxed);
+            auto pushPos = _pushPos.load(std::memory_order_relaxed);
+            return (pushPos > popPos) ? (pushPos - popPos) : 0;
+        }
 }
 
 }
@@ -19,6 +19,8 @@
     #if (PER_INSTANCE_AO==1)
         #define OUTPUT_PER_VERTEX_AO 1
     #endif
+#elif (GEO_INSTANCED_TRANSFORMS==1)
+    #define GEO_HAS_INSTANCE_ID 1
 #endif
 
 struct VSInput //////////////////////////////////////////////////////
@@ -130,6 +132,12 @@ struct VSInput //////////////////////////////////////////////////////
     #define OUTPUT_FOG_COLOR 1
 #endif
 
+#if (GEO_INSTANCED_TRANSFORMS==1) && (OUTPUT_LOCAL_TANGENT_FRAME==1)
+        // the per-instance transform is only available in the vertex shader;
+        // later stages need it to take the local tangent frame into world space
+    #define OUTPUT_LOCAL_TO_WORLD 1
+#endif
+
 struct VSOutput /////////////////////////////////////////////////////
 {
     float4 position : SV_Position;
@@ -193,6 +201,10 @@ struct VSOutput /////////////////////////////////////////////////////
         uint instanceId : SV_InstanceID;
     #endif
 
+    #if (OUTPUT_LOCAL_TO_WORLD==1)
+        nointerpolation float3x3 localToWorld : LOCALTOWORLD;
+    #endif
+
     VSOUTPUT_EXTRA
 }; //////////////////////////////////////////////////////////////////
 
@@ -243,6 +243,15 @@ float3 LocalToWorldUnitVector(float3 localSpaceVector)
     }
 #endif
 
+float3x3 GetLocalToWorldUniformScale(VSOutput geo)
+{
+    #if (OUTPUT_LOCAL_TO_WORLD==1)
+        return geo.localToWorld;
+    #else
+        return GetLocalToWorldUniformScale();
+    #endif
+}
+
 float3 GetNormal(VSOutput geo)
 {
     #if defined(RES_HAS_NormalsTexture_DXT)
@@ -272,9 +281,9 @@ float3 GetNormal(VSOutput geo)
                 //          There are many objects with uniform scale values, and they require a normalize here.
                 //          Ideally we'd have a LocalToWorld matrix with the scale removed,
                 //          or at least a "uniform scale" scalar to remove the scaling
-            return normalize(mul(GetLocalToWorldUniformScale(), localNormal));
+            return normalize(mul(GetLocalToWorldUniformScale(geo), localNormal));
 		#else
-			return normalize(mul(GetLocalToWorldUniformScale(), BuildLocalTangentFrameFromGeo(geo).normal));
+			return normalize(mul(GetLocalToWorldUniformScale(geo), BuildLocalTangentFrameFromGeo(geo).normal));
 		#endif
 
 	#elif (OUTPUT_NORMAL==1) && (RES_HAS_NormalsTexture==1) && (OUTPUT_TEXCOORD==1) && (OUTPUT_WORLD_VIEW_VECTOR==1)
@@ -19,11 +19,24 @@ cbuffer GlobalTransform : register(b0)
 
 cbuffer LocalTransform : register(b1)
 {
+#if GEO_INSTANCED_TRANSFORMS==1
+	row_major float3x4 UnusedLocalToWorld;
+#else
 	row_major float3x4 LocalToWorld;
+#endif
 	float3 LocalSpaceView;
 	uint2 MaterialGuid;
 }
 
+#if GEO_INSTANCED_TRANSFORMS==1
+		//	For instanced draws, the transform comes from a per-instance buffer.
+		//	It's written by InstanceWorldPosition() (see Vegetation/InstanceVS.h),
+		//	which must be called before anything else uses LocalToWorld.
+		//	This only works within the vertex shader -- later stages must use
+		//	the "localToWorld" interpolant (see GetLocalToWorldUniformScale(VSOutput))
+	static float3x4 LocalToWorld;
+#endif
+
 cbuffer GlobalState : register(b4)
 {
 	float Time;
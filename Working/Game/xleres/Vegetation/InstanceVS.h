@@ -6,7 +6,26 @@
 
 #include "../MainGeometry.h"
 
-#if GEO_HAS_INSTANCE_ID==1
+#if (GEO_HAS_INSTANCE_ID==1) && (SPAWNED_INSTANCE!=1) && (GEO_INSTANCED_TRANSFORMS==1)
+
+        //  Instanced draws from the model renderer. Each instance has a full
+        //  LocalToWorld transform, stored as 3 float4 rows
+    Buffer<float4> InstanceTransforms : register(t16);
+
+    float3 InstanceWorldPosition(VSInput input, out float3 objectCentreWorld)
+    {
+        uint base = input.instanceId * 3;
+        LocalToWorld = float3x4(
+            InstanceTransforms.Load(base+0),
+            InstanceTransforms.Load(base+1),
+            InstanceTransforms.Load(base+2));
+        objectCentreWorld = float3(LocalToWorld[0][3], LocalToWorld[1][3], LocalToWorld[2][3]);
+        return mul(LocalToWorld, float4(GetLocalPosition(input),1)).xyz;
+    }
+
+    float GetInstanceShadowing(VSInput input) { return 1.f; }
+
+#elif GEO_HAS_INSTANCE_ID==1
     struct InstanceDef
     {
         float4 posAndShadowing;